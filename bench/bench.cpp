@@ -0,0 +1,737 @@
+// bench/bench.cpp — guest workloads under every execution mode.
+// Six kernels from the ROADMAP's "Algorithms in guest" list, assembled here
+// into programs for the subset the core decodes (ADDI is the only
+// immediate ALU op and there are no logical ops, so shifts take a register
+// and x4 is two adds): crc32 (bitwise, through an xor subroutine), matmul
+// (shift-add multiply, there is no M extension), quicksort (recursive
+// Lomuto), mergesort (bottom-up), bfs (CSR graph) and dijkstra (dense
+// O(V^2)). Each exits with a checksum of its result, checked against the
+// same algorithm run on the host.
+//
+// Modes: interp (vector memory), fastmem, jit, timing (default caches and
+// branch predictor) and mmu (Sv32 identity megapage). Modes the host can't
+// run are skipped. Per kernel and mode: best host time of N runs, MIPS,
+// guest cycles and instret, guest RAM mapped and touched, and the host
+// peak RSS of that run (each run is a forked child).
+//
+//   seedos_bench [--quick] [--runs N] [--json FILE]
+//                [--compare BASELINE.json [--threshold PCT]]
+//
+// Without --compare the JSON goes to stdout (or FILE). With it, a table
+// against the baseline goes to stdout; a MIPS drop of more than PCT
+// (default 10) or a failed checksum is a regression and the exit status is
+// 1. Changed cycles or instret are reported but not failed: they follow
+// cost-model edits, not host speed.
+#include "bpred.hpp"
+#include "cache.hpp"
+#include "cpu.hpp"
+#include "jit.hpp"
+#include "mem.hpp"
+#include "mmu.hpp"
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+static constexpr uint32_t RAM = 4u << 20;             // one megapage, for the mmu mode
+static constexpr uint32_t DATA = 0x10000;
+static constexpr uint32_t STACK = RAM - 0x2000;      // the Sv32 root sits above it
+static constexpr uint32_t ROOT = RAM - 0x1000;
+
+enum Reg { zero = 0, ra = 1, sp = 2, t0 = 5, t1 = 6, t2 = 7, s0 = 8, s1 = 9,
+           a0 = 10, a1 = 11, a2 = 12, a7 = 17, s2 = 18, s3, s4, s5, s6, s7, s8, s9, s10, s11,
+           t3 = 28, t4, t5, t6 };
+
+// just enough of an assembler: the instructions the kernels use, with
+// labels resolved at the end
+struct Asm {
+    std::vector<uint32_t> code;
+    std::map<std::string, uint32_t> labels;
+    struct Fix { std::size_t at; std::string label; };
+    std::vector<Fix> fixes;
+
+    void L(const std::string& l){ labels[l] = 4 * (uint32_t)code.size(); }
+    void emit(uint32_t w){ code.push_back(w); }
+
+    void R(uint32_t f7, uint32_t f3, int rd, int rs1, int rs2){
+        emit((f7<<25)|((uint32_t)rs2<<20)|((uint32_t)rs1<<15)|(f3<<12)|((uint32_t)rd<<7)|0x33);
+    }
+    void I(uint32_t op, uint32_t f3, int rd, int rs1, int32_t imm){
+        emit((((uint32_t)imm&0xFFF)<<20)|((uint32_t)rs1<<15)|(f3<<12)|((uint32_t)rd<<7)|op);
+    }
+    void S(uint32_t f3, int rs1, int rs2, int32_t imm){
+        uint32_t u = (uint32_t)imm & 0xFFF;
+        emit(((u>>5)<<25)|((uint32_t)rs2<<20)|((uint32_t)rs1<<15)|(f3<<12)|((u&0x1F)<<7)|0x23);
+    }
+    void B(uint32_t f3, int rs1, int rs2, const std::string& l){
+        fixes.push_back({code.size(), l});
+        emit(((uint32_t)rs2<<20)|((uint32_t)rs1<<15)|(f3<<12)|0x63);
+    }
+
+    void add(int rd, int a, int b){ R(0, 0, rd, a, b); }
+    void sub(int rd, int a, int b){ R(0x20, 0, rd, a, b); }
+    void sll(int rd, int a, int b){ R(0, 1, rd, a, b); }
+    void slt(int rd, int a, int b){ R(0, 2, rd, a, b); }
+    void sltu(int rd, int a, int b){ R(0, 3, rd, a, b); }
+    void srl(int rd, int a, int b){ R(0, 5, rd, a, b); }
+    void addi(int rd, int a, int32_t imm){ I(0x13, 0, rd, a, imm); }
+    void mv(int rd, int a){ addi(rd, a, 0); }
+    void x4(int rd, int a){ add(rd, a, a); add(rd, rd, rd); }
+    void li(int rd, uint32_t v){
+        int32_t s = (int32_t)v;
+        if (s >= -2048 && s < 2048) { addi(rd, zero, s); return; }
+        emit((((v + 0x800) >> 12) << 12) | ((uint32_t)rd<<7) | 0x37);    // lui
+        if (v & 0xFFF) addi(rd, rd, (int32_t)(v << 20) >> 20);
+    }
+    void lw(int rd, int base, int32_t off){ I(0x03, 2, rd, base, off); }
+    void lbu(int rd, int base, int32_t off){ I(0x03, 4, rd, base, off); }
+    void sw(int rs, int base, int32_t off){ S(2, base, rs, off); }
+    void beq(int a, int b, const std::string& l){ B(0, a, b, l); }
+    void bne(int a, int b, const std::string& l){ B(1, a, b, l); }
+    void blt(int a, int b, const std::string& l){ B(4, a, b, l); }
+    void bge(int a, int b, const std::string& l){ B(5, a, b, l); }
+    void bgeu(int a, int b, const std::string& l){ B(7, a, b, l); }
+    void jal(int rd, const std::string& l){ fixes.push_back({code.size(), l}); emit(((uint32_t)rd<<7)|0x6F); }
+    void j(const std::string& l){ jal(zero, l); }
+    void call(const std::string& l){ jal(ra, l); }
+    void ret(){ I(0x67, 0, zero, ra, 0); }
+    void exit_a0(){ li(a7, 0); emit(0x00000073); }
+
+    std::vector<uint32_t> finish(){
+        for (const Fix& f : fixes) {
+            auto it = labels.find(f.label);
+            if (it == labels.end()) { std::fprintf(stderr, "bench: no label %s\n", f.label.c_str()); std::exit(2); }
+            uint32_t u = it->second - 4 * (uint32_t)f.at;
+            uint32_t& w = code[f.at];
+            if ((w & 0x7F) == 0x6F)
+                w |= (((u>>20)&1)<<31)|(((u>>1)&0x3FF)<<21)|(((u>>11)&1)<<20)|(((u>>12)&0xFF)<<12);
+            else
+                w |= (((u>>12)&1)<<31)|(((u>>5)&0x3F)<<25)|(((u>>1)&0xF)<<8)|(((u>>11)&1)<<7);
+        }
+        return code;
+    }
+};
+
+// a0 = h over a1 words at a0, h = h*31 + w; clobbers t0-t2
+static void emit_hash(Asm& a){
+    a.L("hash");
+    a.li(t0, 0);
+    a.L("hash_loop");
+    a.beq(a1, zero, "hash_done");
+    a.lw(t1, a0, 0);
+    a.li(t2, 5); a.sll(t2, t0, t2); a.sub(t0, t2, t0); a.add(t0, t0, t1);
+    a.addi(a0, a0, 4); a.addi(a1, a1, -1);
+    a.j("hash_loop");
+    a.L("hash_done");
+    a.mv(a0, t0);
+    a.ret();
+}
+
+// a0 = a0 * a1, shift and add; clobbers t0-t2
+static void emit_mul(Asm& a){
+    a.L("mul");
+    a.li(t0, 0); a.li(t2, 1);
+    a.L("mul_loop");
+    a.beq(a1, zero, "mul_done");
+    a.srl(t1, a1, t2); a.add(t1, t1, t1);
+    a.beq(t1, a1, "mul_skip");                                   // even
+    a.add(t0, t0, a0);
+    a.L("mul_skip");
+    a.add(a0, a0, a0); a.srl(a1, a1, t2);
+    a.j("mul_loop");
+    a.L("mul_done");
+    a.mv(a0, t0);
+    a.ret();
+}
+
+static uint32_t host_hash(const std::vector<uint32_t>& v){
+    uint32_t h = 0;
+    for (uint32_t w : v) h = h * 31 + w;
+    return h;
+}
+
+struct Rng {
+    uint32_t s;
+    uint32_t next(){ s ^= s << 13; s ^= s >> 17; s ^= s << 5; return s; }
+};
+
+struct Workload {
+    std::string name;
+    std::vector<uint32_t> code;
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> data;
+    uint32_t expect;
+    uint32_t footprint;        // bytes of data, for the size check
+};
+
+static std::vector<uint8_t> bytes_of(const std::vector<uint32_t>& v){
+    std::vector<uint8_t> b(4 * v.size());
+    std::memcpy(b.data(), v.data(), b.size());
+    return b;
+}
+
+static Workload crc32(uint32_t n){
+    Rng r{0x1234567};
+    std::vector<uint8_t> buf(n);
+    for (auto& b : buf) b = (uint8_t)r.next();
+    uint32_t crc = ~0u;
+    for (uint8_t b : buf) {
+        crc ^= b;
+        for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+
+    Asm a;
+    a.li(sp, STACK);
+    a.li(s0, DATA); a.li(s1, n); a.li(s2, ~0u); a.li(s3, 0xEDB88320u); a.li(s4, 1);
+    a.L("byte");
+    a.lbu(a1, s0, 0); a.mv(a0, s2); a.call("xor"); a.mv(s2, a0);
+    a.li(s5, 8);
+    a.L("bit");
+    a.srl(t0, s2, s4); a.add(t1, t0, t0); a.sub(t1, s2, t1);     // crc >> 1, low bit
+    a.mv(s2, t0);
+    a.beq(t1, zero, "bit_next");
+    a.mv(a0, s2); a.mv(a1, s3); a.call("xor"); a.mv(s2, a0);
+    a.L("bit_next");
+    a.addi(s5, s5, -1); a.bne(s5, zero, "bit");
+    a.addi(s0, s0, 1); a.addi(s1, s1, -1); a.bne(s1, zero, "byte");
+    a.li(t0, ~0u); a.sub(a0, t0, s2);
+    a.exit_a0();
+
+    // a0 ^= a1 a bit at a time from the top: the bits differ when exactly
+    // one of the two is negative; clobbers t0-t3
+    a.L("xor");
+    a.li(t0, 0); a.li(t3, 32);
+    a.L("xor_bit");
+    a.add(t0, t0, t0);
+    a.slt(t1, a0, zero); a.slt(t2, a1, zero); a.sub(t1, t1, t2); a.sltu(t1, zero, t1);
+    a.add(t0, t0, t1);
+    a.add(a0, a0, a0); a.add(a1, a1, a1);
+    a.addi(t3, t3, -1); a.bne(t3, zero, "xor_bit");
+    a.mv(a0, t0);
+    a.ret();
+    return {"crc32", a.finish(), {{DATA, buf}}, ~crc, n};
+}
+
+static Workload matmul(uint32_t n){
+    Rng r{0xC0FFEE};
+    std::vector<uint32_t> A(n * n), Bm(n * n), C(n * n, 0);
+    for (auto& x : A) x = r.next() & 0xFF;
+    for (auto& x : Bm) x = r.next() & 0xFF;
+    for (uint32_t i = 0; i < n; ++i)
+        for (uint32_t j = 0; j < n; ++j)
+            for (uint32_t k = 0; k < n; ++k) C[i*n + j] += A[i*n + k] * Bm[k*n + j];
+    const uint32_t pa = DATA, pb = pa + 4*n*n, pc = pb + 4*n*n;
+
+    Asm a;
+    a.li(sp, STACK);
+    a.li(s0, pa); a.li(s1, pb); a.li(s2, pc); a.li(s3, n); a.x4(s8, s3);
+    a.li(s4, 0);
+    a.L("row");
+    a.li(s5, 0);
+    a.L("col");
+    a.li(s6, 0); a.mv(s9, s0);                                   // s9 walks row i of A
+    a.x4(t0, s5); a.add(s10, s1, t0);                       // s10 walks column j of B
+    a.mv(s7, s3);
+    a.L("dot");
+    a.lw(a0, s9, 0); a.lw(a1, s10, 0); a.call("mul"); a.add(s6, s6, a0);
+    a.addi(s9, s9, 4); a.add(s10, s10, s8);
+    a.addi(s7, s7, -1); a.bne(s7, zero, "dot");
+    a.sw(s6, s2, 0); a.addi(s2, s2, 4);
+    a.addi(s5, s5, 1); a.bne(s5, s3, "col");
+    a.add(s0, s0, s8);
+    a.addi(s4, s4, 1); a.bne(s4, s3, "row");
+    a.li(a0, pc); a.li(a1, n * n); a.call("hash");
+    a.exit_a0();
+    emit_mul(a);
+    emit_hash(a);
+
+    std::vector<uint32_t> ab = A;
+    ab.insert(ab.end(), Bm.begin(), Bm.end());
+    return {"matmul", a.finish(), {{pa, bytes_of(ab)}}, host_hash(C), 12*n*n};
+}
+
+static std::vector<uint32_t> random_words(uint32_t n, uint32_t seed){
+    Rng r{seed};
+    std::vector<uint32_t> v(n);
+    for (auto& x : v) x = r.next();
+    return v;
+}
+
+static std::vector<uint32_t> sorted_signed(std::vector<uint32_t> v){
+    std::sort(v.begin(), v.end(), [](uint32_t x, uint32_t y){ return (int32_t)x < (int32_t)y; });
+    return v;
+}
+
+static Workload quicksort(uint32_t n){
+    std::vector<uint32_t> v = random_words(n, 0xBADC0DE);
+    Asm a;
+    a.li(sp, STACK);
+    a.li(a0, DATA); a.li(a1, DATA + 4*(n - 1)); a.call("qs");
+    a.li(a0, DATA); a.li(a1, n); a.call("hash");
+    a.exit_a0();
+
+    // qs(lo, hi): sort the words from lo to hi inclusive, pivot a[hi]
+    a.L("qs");
+    a.bgeu(a0, a1, "qs_ret");
+    a.addi(sp, sp, -16);
+    a.sw(ra, sp, 12); a.sw(s0, sp, 8); a.sw(s1, sp, 4); a.sw(s2, sp, 0);
+    a.mv(s0, a0); a.mv(s1, a1);
+    a.lw(t0, s1, 0); a.mv(t1, s0); a.mv(t2, s0);
+    a.L("part");
+    a.bgeu(t2, s1, "part_done");
+    a.lw(t3, t2, 0);
+    a.bge(t3, t0, "part_next");
+    a.lw(t4, t1, 0); a.sw(t3, t1, 0); a.sw(t4, t2, 0); a.addi(t1, t1, 4);
+    a.L("part_next");
+    a.addi(t2, t2, 4);
+    a.j("part");
+    a.L("part_done");
+    a.lw(t4, t1, 0); a.lw(t3, s1, 0); a.sw(t3, t1, 0); a.sw(t4, s1, 0);
+    a.mv(s2, t1);
+    a.mv(a0, s0); a.addi(a1, s2, -4); a.call("qs");
+    a.addi(a0, s2, 4); a.mv(a1, s1); a.call("qs");
+    a.lw(ra, sp, 12); a.lw(s0, sp, 8); a.lw(s1, sp, 4); a.lw(s2, sp, 0);
+    a.addi(sp, sp, 16);
+    a.L("qs_ret");
+    a.ret();
+    emit_hash(a);
+    return {"quicksort", a.finish(), {{DATA, bytes_of(v)}}, host_hash(sorted_signed(v)), 4*n};
+}
+
+static Workload mergesort(uint32_t n){
+    std::vector<uint32_t> v = random_words(n, 0x5EED);
+    Asm a;
+    a.li(sp, STACK);
+    a.li(s0, DATA); a.li(s1, DATA + 4*n); a.li(s2, n); a.li(s3, 1);   // src, dst, n, width
+    a.L("pass");
+    a.bge(s3, s2, "sorted");
+    a.li(s4, 0);
+    a.L("run");
+    a.add(t2, s4, s3);                                           // mid = min(i + w, n)
+    a.blt(t2, s2, "mid_ok");
+    a.mv(t2, s2);
+    a.L("mid_ok");
+    a.add(t3, t2, s3);                                           // hi = min(mid + w, n)
+    a.blt(t3, s2, "hi_ok");
+    a.mv(t3, s2);
+    a.L("hi_ok");
+    a.x4(t4, s4); a.add(s5, s0, t4); a.add(s9, s1, t4);     // left, out
+    a.x4(t4, t2); a.add(s6, s0, t4); a.mv(s7, s6);          // left end, right
+    a.x4(t4, t3); a.add(s8, s0, t4);                        // right end
+    a.L("merge");
+    a.bgeu(s5, s6, "right_rest");
+    a.bgeu(s7, s8, "left_rest");
+    a.lw(t0, s5, 0); a.lw(t1, s7, 0);
+    a.blt(t1, t0, "take_right");
+    a.sw(t0, s9, 0); a.addi(s5, s5, 4); a.addi(s9, s9, 4);
+    a.j("merge");
+    a.L("take_right");
+    a.sw(t1, s9, 0); a.addi(s7, s7, 4); a.addi(s9, s9, 4);
+    a.j("merge");
+    a.L("left_rest");
+    a.bgeu(s5, s6, "merged");
+    a.lw(t0, s5, 0); a.sw(t0, s9, 0); a.addi(s5, s5, 4); a.addi(s9, s9, 4);
+    a.j("left_rest");
+    a.L("right_rest");
+    a.bgeu(s7, s8, "merged");
+    a.lw(t1, s7, 0); a.sw(t1, s9, 0); a.addi(s7, s7, 4); a.addi(s9, s9, 4);
+    a.j("right_rest");
+    a.L("merged");
+    a.mv(s4, t3);
+    a.blt(s4, s2, "run");
+    a.mv(t0, s0); a.mv(s0, s1); a.mv(s1, t0);                    // swap buffers
+    a.add(s3, s3, s3);
+    a.j("pass");
+    a.L("sorted");
+    a.mv(a0, s0); a.mv(a1, s2); a.call("hash");
+    a.exit_a0();
+    emit_hash(a);
+    return {"mergesort", a.finish(), {{DATA, bytes_of(v)}}, host_hash(sorted_signed(v)), 8*n};
+}
+
+static Workload bfs(uint32_t nv){
+    const uint32_t deg = 4;
+    Rng r{0xB0F5};
+    std::vector<uint32_t> off(nv + 1), edges(nv * deg);
+    for (uint32_t u = 0; u <= nv; ++u) off[u] = u * deg;
+    for (uint32_t u = 0; u < nv; ++u)
+        for (uint32_t k = 0; k < deg; ++k)
+            edges[u*deg + k] = k == 0 ? (u + 1) % nv : r.next() % nv;   // a ring keeps it connected
+    std::vector<uint32_t> dist(nv, ~0u), q{0};
+    dist[0] = 0;
+    for (std::size_t h = 0; h < q.size(); ++h)
+        for (uint32_t e = off[q[h]]; e < off[q[h] + 1]; ++e)
+            if (dist[edges[e]] == ~0u) { dist[edges[e]] = dist[q[h]] + 1; q.push_back(edges[e]); }
+    const uint32_t p_off = DATA, p_edges = p_off + 4*(nv + 1), p_dist = p_edges + 4*nv*deg, p_q = p_dist + 4*nv;
+
+    Asm a;
+    a.li(sp, STACK);
+    a.li(s0, p_off); a.li(s1, p_edges); a.li(s2, p_dist); a.li(s3, p_q);
+    a.mv(t0, s2); a.li(t1, nv); a.li(t2, ~0u);
+    a.L("init");
+    a.sw(t2, t0, 0); a.addi(t0, t0, 4); a.addi(t1, t1, -1); a.bne(t1, zero, "init");
+    a.sw(zero, s2, 0); a.sw(zero, s3, 0); a.mv(s5, s3); a.addi(s6, s3, 4);   // head, tail
+    a.L("vertex");
+    a.bgeu(s5, s6, "done");
+    a.lw(t0, s5, 0); a.addi(s5, s5, 4);
+    a.x4(t1, t0); a.add(t2, s2, t1); a.lw(s7, t2, 0); a.addi(s7, s7, 1);
+    a.add(t2, s0, t1); a.lw(t3, t2, 0); a.lw(t4, t2, 4);
+    a.x4(t3, t3); a.add(t3, s1, t3); a.x4(t4, t4); a.add(t4, s1, t4);
+    a.L("edge");
+    a.bgeu(t3, t4, "vertex");
+    a.lw(t5, t3, 0); a.addi(t3, t3, 4);
+    a.x4(t6, t5); a.add(t6, s2, t6); a.lw(a2, t6, 0);
+    a.bge(a2, zero, "edge");                                     // seen
+    a.sw(s7, t6, 0); a.sw(t5, s6, 0); a.addi(s6, s6, 4);
+    a.j("edge");
+    a.L("done");
+    a.li(a0, p_dist); a.li(a1, nv); a.call("hash");
+    a.exit_a0();
+    emit_hash(a);
+
+    std::vector<uint32_t> graph = off;
+    graph.insert(graph.end(), edges.begin(), edges.end());
+    return {"bfs", a.finish(), {{p_off, bytes_of(graph)}}, host_hash(dist), p_q + 4*nv - DATA};
+}
+
+static Workload dijkstra(uint32_t nv){
+    const uint32_t INF = 0x7FFFFFFF;
+    Rng r{0xD15C0};
+    std::vector<uint32_t> w(nv * nv, 0);
+    for (uint32_t u = 0; u < nv; ++u)
+        for (uint32_t v = 0; v < nv; ++v)
+            if (u != v && (v == (u + 1) % nv || r.next() % 8 == 0)) w[u*nv + v] = 1 + r.next() % 100;
+    std::vector<uint32_t> dist(nv, INF);
+    std::vector<bool> done(nv, false);
+    dist[0] = 0;
+    for (uint32_t round = 0; round < nv; ++round) {
+        uint32_t u = nv, best = INF;
+        for (uint32_t v = 0; v < nv; ++v)
+            if (!done[v] && dist[v] < best) { best = dist[v]; u = v; }
+        if (u == nv) break;
+        done[u] = true;
+        for (uint32_t v = 0; v < nv; ++v)
+            if (w[u*nv + v] && best + w[u*nv + v] < dist[v]) dist[v] = best + w[u*nv + v];
+    }
+    const uint32_t p_w = DATA, p_dist = p_w + 4*nv*nv, p_done = p_dist + 4*nv;
+
+    Asm a;
+    a.li(sp, STACK);
+    a.li(s0, p_w); a.li(s1, p_dist); a.li(s2, p_done); a.li(s3, nv); a.x4(s7, s3);
+    a.li(t0, 0); a.li(t2, INF);
+    a.L("init");
+    a.x4(t1, t0); a.add(t3, s1, t1); a.sw(t2, t3, 0); a.add(t3, s2, t1); a.sw(zero, t3, 0);
+    a.addi(t0, t0, 1); a.blt(t0, s3, "init");
+    a.sw(zero, s1, 0);
+    a.mv(s4, s3);
+    a.L("round");
+    a.li(s5, -1); a.li(s6, INF); a.li(t0, 0);                    // u, best, v
+    a.L("scan");
+    a.bge(t0, s3, "scanned");
+    a.x4(t1, t0); a.add(t2, s2, t1); a.lw(t3, t2, 0); a.bne(t3, zero, "scan_next");
+    a.add(t2, s1, t1); a.lw(t3, t2, 0); a.bge(t3, s6, "scan_next");
+    a.mv(s6, t3); a.mv(s5, t0);
+    a.L("scan_next");
+    a.addi(t0, t0, 1);
+    a.j("scan");
+    a.L("scanned");
+    a.blt(s5, zero, "done");
+    a.x4(t1, s5); a.add(t2, s2, t1); a.li(t3, 1); a.sw(t3, t2, 0);
+    a.mv(a0, s5); a.mv(a1, s7); a.call("mul"); a.add(s8, s0, a0);   // row u
+    a.li(t0, 0);
+    a.L("relax");
+    a.bge(t0, s3, "relaxed");
+    a.x4(t1, t0); a.add(t2, s8, t1); a.lw(t3, t2, 0); a.beq(t3, zero, "relax_next");
+    a.add(t3, t3, s6);
+    a.add(t4, s1, t1); a.lw(t5, t4, 0); a.bge(t3, t5, "relax_next"); a.sw(t3, t4, 0);
+    a.L("relax_next");
+    a.addi(t0, t0, 1);
+    a.j("relax");
+    a.L("relaxed");
+    a.addi(s4, s4, -1); a.bne(s4, zero, "round");
+    a.L("done");
+    a.li(a0, p_dist); a.li(a1, nv); a.call("hash");
+    a.exit_a0();
+    emit_mul(a);
+    emit_hash(a);
+    return {"dijkstra", a.finish(), {{p_w, bytes_of(w)}}, host_hash(dist), p_done + 4*nv - DATA};
+}
+
+// ---------- modes ----------
+
+struct Result {
+    std::string kernel, mode;
+    bool ok{false};
+    uint32_t got{0};
+    uint64_t instret{0}, cycles{0};
+    double host_ms{0}, mips{0};
+    uint64_t touched_kb{0}, rss_kb{0};
+    uint64_t l1d_misses{0}, mispredicts{0};     // timing mode only
+};
+
+static const char* const MODES[] = {"interp", "fastmem", "jit", "timing", "mmu"};
+
+static bool mode_available(const std::string& m){
+    if (m == "fastmem") return Memory(RAM, MemBackend::Fastmem).backend() == MemBackend::Fastmem;
+    if (m == "jit") return Jit::available();
+    return true;
+}
+
+// pages holding anything but zeros: code, data and stack the guest reached
+static uint64_t touched_kb(const Memory& mem){
+    uint64_t pages = 0;
+    for (uint32_t p = 0; p < RAM; p += 4096) {
+        const uint8_t* b = mem.ram_span(p, 4096);
+        if (b && std::any_of(b, b + 4096, [](uint8_t x){ return x != 0; })) ++pages;
+    }
+    return pages * 4;
+}
+
+static Result run_once(const Workload& w, const std::string& mode){
+    Memory mem(RAM, mode == "fastmem" ? MemBackend::Fastmem : MemBackend::Vector);
+    for (std::size_t i = 0; i < w.code.size(); ++i) mem.store32(4 * (uint32_t)i, w.code[i]);
+    for (const auto& [addr, bytes] : w.data) mem.write_bytes(addr, bytes.data(), bytes.size());
+    CPU cpu;
+    std::unique_ptr<Jit> jit;
+    if (mode == "jit") { jit = std::make_unique<Jit>(mem); cpu.jit = jit.get(); }
+    CacheHierarchy caches;
+    BranchPredictor bpred;
+    if (mode == "timing") { cpu.caches = &caches; cpu.bpred = &bpred; }
+    Mmu mmu(mem);
+    if (mode == "mmu") {
+        mem.store32(ROOT, Mmu::V | Mmu::R | Mmu::W | Mmu::X | Mmu::A | Mmu::D);
+        cpu.satp = Mmu::SATP_SV32 | (ROOT >> 12);
+        cpu.mmu = &mmu;
+    }
+
+    Result res{w.name, mode};
+    auto t0 = std::chrono::steady_clock::now();
+    while (!cpu.halted) {
+        RunExit r = cpu.run(mem, UINT64_MAX);
+        if (r.reason == Exit::Trap || r.reason == Exit::Breakpoint) break;
+    }
+    res.host_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    res.got = cpu.exit_code;
+    res.ok = cpu.halted && cpu.exit_code == w.expect;
+    res.instret = cpu.instret;
+    res.cycles = cpu.cycles;
+    res.mips = res.host_ms > 0 ? cpu.instret / (res.host_ms * 1e3) : 0;
+    res.touched_kb = touched_kb(mem);
+    if (mode == "timing") {
+        res.l1d_misses = caches.level(1).stats().misses;
+        for (uint64_t m : bpred.stats().mispredicted) res.mispredicts += m;
+    }
+    return res;
+}
+
+// run_once in a forked child: ru_maxrss is a process-lifetime high-water
+// mark, so only a fresh process gives one run's peak (the parent's few MB
+// of workload data included)
+static Result run_child(const Workload& w, const std::string& mode){
+    struct Wire { bool ok; uint32_t got; uint64_t instret, cycles, touched_kb, l1d_misses, mispredicts; double host_ms; };
+    Result res{w.name, mode};
+    int fd[2];
+    if (pipe(fd) != 0) { std::perror("seedos_bench: pipe"); std::exit(2); }
+    std::fflush(stdout); std::fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) { std::perror("seedos_bench: fork"); std::exit(2); }
+    if (pid == 0) {
+        close(fd[0]);
+        Result r = run_once(w, mode);
+        Wire x{r.ok, r.got, r.instret, r.cycles, r.touched_kb, r.l1d_misses, r.mispredicts, r.host_ms};
+        _exit(write(fd[1], &x, sizeof x) == (ssize_t)sizeof x ? 0 : 1);
+    }
+    close(fd[1]);
+    Wire x{};
+    bool got = read(fd[0], &x, sizeof x) == (ssize_t)sizeof x;
+    close(fd[0]);
+    int status = 0;
+    rusage ru{};
+    wait4(pid, &status, 0, &ru);
+    if (!got) return res;                      // the child died: not ok
+    res.ok = x.ok; res.got = x.got; res.instret = x.instret; res.cycles = x.cycles;
+    res.touched_kb = x.touched_kb; res.l1d_misses = x.l1d_misses; res.mispredicts = x.mispredicts;
+    res.host_ms = x.host_ms;
+    res.mips = res.host_ms > 0 ? res.instret / (res.host_ms * 1e3) : 0;
+#if defined(__APPLE__)
+    res.rss_kb = (uint64_t)ru.ru_maxrss >> 10;     // bytes there, KiB on Linux
+#else
+    res.rss_kb = (uint64_t)ru.ru_maxrss;
+#endif
+    return res;
+}
+
+static Result run_best(const Workload& w, const std::string& mode, int runs){
+    Result best = run_child(w, mode);
+    for (int i = 1; i < runs && best.ok; ++i) {
+        Result r = run_child(w, mode);
+        if (r.instret != best.instret || r.cycles != best.cycles) r.ok = false;   // must be deterministic
+        if (!r.ok || r.host_ms < best.host_ms) best = r;
+    }
+    return best;
+}
+
+static void write_json(FILE* f, const std::vector<Result>& rs, bool quick, int runs){
+    std::fprintf(f, "{\"bench\":\"seedos\",\"quick\":%s,\"runs\":%d,\"guest_ram_kb\":%u,\"results\":[\n",
+                 quick ? "true" : "false", runs, RAM >> 10);
+    for (std::size_t i = 0; i < rs.size(); ++i) {
+        const Result& r = rs[i];
+        std::fprintf(f, "  {\"kernel\":\"%s\",\"mode\":\"%s\",\"ok\":%s,\"instret\":%llu,\"cycles\":%llu,"
+                        "\"host_ms\":%.3f,\"mips\":%.2f,\"guest_touched_kb\":%llu,\"host_rss_kb\":%llu",
+                     r.kernel.c_str(), r.mode.c_str(), r.ok ? "true" : "false",
+                     (unsigned long long)r.instret, (unsigned long long)r.cycles, r.host_ms, r.mips,
+                     (unsigned long long)r.touched_kb, (unsigned long long)r.rss_kb);
+        if (r.mode == "timing")
+            std::fprintf(f, ",\"l1d_misses\":%llu,\"mispredicts\":%llu",
+                         (unsigned long long)r.l1d_misses, (unsigned long long)r.mispredicts);
+        std::fprintf(f, "}%s\n", i + 1 < rs.size() ? "," : "");
+    }
+    std::fprintf(f, "]}\n");
+}
+
+// ---------- comparison ----------
+
+// only reads back what write_json writes: one result object per line
+static std::string str_field(const std::string& line, const char* key){
+    std::string k = std::string("\"") + key + "\":\"";
+    std::size_t p = line.find(k);
+    if (p == std::string::npos) return "";
+    p += k.size();
+    return line.substr(p, line.find('"', p) - p);
+}
+
+static double num_field(const std::string& line, const char* key){
+    std::string k = std::string("\"") + key + "\":";
+    std::size_t p = line.find(k);
+    return p == std::string::npos ? 0 : std::strtod(line.c_str() + p + k.size(), nullptr);
+}
+
+static bool load_baseline(const char* path, std::map<std::pair<std::string, std::string>, Result>& out,
+                          bool& quick){
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.find("\"bench\":") != std::string::npos) quick = line.find("\"quick\":true") != std::string::npos;
+        std::string kernel = str_field(line, "kernel"), mode = str_field(line, "mode");
+        if (kernel.empty() || mode.empty()) continue;
+        Result r{kernel, mode};
+        r.ok = line.find("\"ok\":true") != std::string::npos;
+        r.instret = (uint64_t)num_field(line, "instret");
+        r.cycles = (uint64_t)num_field(line, "cycles");
+        r.mips = num_field(line, "mips");
+        out[{kernel, mode}] = r;
+    }
+    return true;
+}
+
+// prints the table; the number of regressions
+static int compare(const std::vector<Result>& now, const std::map<std::pair<std::string, std::string>, Result>& base,
+                   double threshold){
+    int bad = 0;
+    std::printf("%-10s %-8s %10s %10s %8s  %s\n", "kernel", "mode", "base MIPS", "MIPS", "delta", "status");
+    for (const Result& r : now) {
+        auto it = base.find({r.kernel, r.mode});
+        if (it == base.end()) {
+            std::printf("%-10s %-8s %10s %10.1f %8s  %s\n", r.kernel.c_str(), r.mode.c_str(), "-", r.mips, "-",
+                        r.ok ? "new" : "FAIL");
+            bad += !r.ok;
+            continue;
+        }
+        const Result& b = it->second;
+        double delta = b.mips > 0 ? (r.mips - b.mips) * 100 / b.mips : 0;
+        std::string status = "ok";
+        if (!r.ok) status = "FAIL";
+        else if (delta < -threshold) status = "REGRESSION";
+        if (r.instret != b.instret || r.cycles != b.cycles) {
+            char buf[96];
+            std::snprintf(buf, sizeof buf, "%s (instret %+lld, cycles %+lld)", status.c_str(),
+                          (long long)(r.instret - b.instret), (long long)(r.cycles - b.cycles));
+            status = buf;
+        }
+        bad += !r.ok || delta < -threshold;
+        std::printf("%-10s %-8s %10.1f %10.1f %+7.1f%%  %s\n", r.kernel.c_str(), r.mode.c_str(),
+                    b.mips, r.mips, delta, status.c_str());
+    }
+    std::printf("%d regression%s (threshold %.1f%%)\n", bad, bad == 1 ? "" : "s", threshold);
+    return bad;
+}
+
+static void usage(){
+    std::fprintf(stderr, "usage: seedos_bench [--quick] [--runs N] [--json FILE] "
+                         "[--compare BASELINE.json [--threshold PCT]]\n");
+    std::exit(2);
+}
+
+int main(int argc, char** argv){
+    bool quick = false;
+    int runs = 3;
+    const char* json_path = nullptr;
+    const char* baseline = nullptr;
+    double threshold = 10;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool more = i + 1 < argc;
+        if (a == "--quick") quick = true;
+        else if (a == "--runs" && more) runs = std::max(1, std::atoi(argv[++i]));
+        else if (a == "--json" && more) json_path = argv[++i];
+        else if (a == "--compare" && more) baseline = argv[++i];
+        else if (a == "--threshold" && more) threshold = std::strtod(argv[++i], nullptr);
+        else usage();
+    }
+
+    // full size: 10-30M instructions each
+    const Workload kernels[] = {
+        crc32(quick ? 64 : 8192),
+        matmul(quick ? 8 : 56),
+        quicksort(quick ? 256 : 64u << 10),
+        mergesort(quick ? 256 : 64u << 10),
+        bfs(quick ? 256 : 64u << 10),
+        dijkstra(quick ? 32 : 512),
+    };
+
+    std::map<std::pair<std::string, std::string>, Result> base;
+    bool base_quick = quick;
+    if (baseline && !load_baseline(baseline, base, base_quick)) {
+        std::fprintf(stderr, "seedos_bench: cannot read %s\n", baseline);
+        return 2;
+    }
+    if (base_quick != quick)
+        std::fprintf(stderr, "seedos_bench: baseline was a %s run, this is a %s one\n",
+                     base_quick ? "--quick" : "full", quick ? "--quick" : "full");
+
+    std::vector<Result> results;
+    int failed = 0;
+    for (const Workload& w : kernels) {
+        if (DATA + w.footprint > STACK - 0x10000) { std::fprintf(stderr, "%s: too big\n", w.name.c_str()); return 2; }
+        for (const char* m : MODES) {
+            if (!mode_available(m)) continue;
+            Result r = run_best(w, m, runs);
+            if (!r.ok) {
+                std::fprintf(stderr, "seedos_bench: %s/%s: exit code %#x, expected %#x\n",
+                             w.name.c_str(), m, r.got, w.expect);
+                ++failed;
+            }
+            results.push_back(r);
+        }
+    }
+
+    if (json_path) {
+        FILE* f = std::fopen(json_path, "w");
+        if (!f) { std::fprintf(stderr, "seedos_bench: cannot write %s\n", json_path); return 2; }
+        write_json(f, results, quick, runs);
+        std::fclose(f);
+    }
+    if (baseline) return compare(results, base, threshold) ? 1 : 0;
+    if (!json_path) write_json(stdout, results, quick, runs);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+// bench/bulk.cpp — guest memcpy/memset/memcmp/strlen as RV32I loops (word
+// at a time, byte at a time for strlen) against the bulk-memory ECALLs
+// 13-16, over buffers from 64 B to 16 KiB. Each run repeats the call until
+// about 8 MiB have been processed. Reports host throughput, the speedup and
+// the guest cycles per byte each way (CostModel::Table, default
+// CPU::bulk_cost).
+//
+//   seedos_bulk
+#include "cpu.hpp"
+#include "mem.hpp"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+static uint32_t enc_I(uint32_t op,uint32_t rd,uint32_t rs1,int32_t imm){ return (((uint32_t)imm&0xFFF)<<20)|(rs1<<15)|(rd<<7)|op; }
+static uint32_t enc_LD(uint32_t f3,uint32_t rd,uint32_t rs1,int32_t imm){ return enc_I(0x03,rd,rs1,imm)|(f3<<12); }
+static uint32_t enc_SW(uint32_t rs1,uint32_t rs2,int32_t imm){
+    uint32_t u=(uint32_t)imm&0xFFF;
+    return ((u>>5)<<25)|(rs2<<20)|(rs1<<15)|(0b010<<12)|((u&0x1F)<<7)|0x23;
+}
+static uint32_t enc_LUI(uint32_t rd,uint32_t imm20){ return ((imm20&0xFFFFF)<<12)|(rd<<7)|0x37; }
+static uint32_t enc_BNE(uint32_t rs1,uint32_t rs2,int32_t off){
+    uint32_t u=(uint32_t)off;
+    return (((u>>12)&1)<<31)|(((u>>5)&0x3F)<<25)|(rs2<<20)|(rs1<<15)|(0b001<<12)|(((u>>1)&0xF)<<8)|(((u>>11)&1)<<7)|0x63;
+}
+static const uint32_t ECALL = 0x00000073;
+static const uint32_t SRC = 0x10000, DST = 0x20000;
+
+enum class Kind { Memcpy, Memset, Memcmp, Strlen };
+
+struct Prog {
+    std::vector<uint32_t> w;
+    int32_t here() const { return (int32_t)(w.size() * 4); }
+    void li(uint32_t rd, uint32_t v){                 // lui + addi, sign of the low half folded in
+        w.push_back(enc_LUI(rd, (v + 0x800) >> 12));
+        w.push_back(enc_I(0x13, rd, rd, (int32_t)(v << 20) >> 20));
+    }
+};
+
+// one program: iters calls, by loop or by ECALL, then exit
+static std::vector<uint32_t> build(Kind k, bool ecall, uint32_t n, uint32_t iters){
+    Prog p;
+    p.li(9, iters);
+    int32_t outer = p.here();
+    p.li(10, k == Kind::Strlen ? SRC : DST);
+    p.li(11, k == Kind::Memset ? 0x5A : SRC);
+    p.li(12, ecall ? n : (k == Kind::Memset ? DST : SRC) + n);
+    if (ecall) {
+        uint32_t id = k == Kind::Memcpy ? 13 : k == Kind::Memset ? 14 : k == Kind::Memcmp ? 15 : 16;
+        p.w.push_back(enc_I(0x13, 17, 0, (int32_t)id));
+        p.w.push_back(ECALL);
+    } else if (k == Kind::Memcpy) {
+        p.w.push_back(enc_LD(2, 5, 11, 0));
+        p.w.push_back(enc_SW(10, 5, 0));
+        p.w.push_back(enc_I(0x13, 11, 11, 4));
+        p.w.push_back(enc_I(0x13, 10, 10, 4));
+        p.w.push_back(enc_BNE(11, 12, -16));
+    } else if (k == Kind::Memset) {
+        p.li(13, 0x5A5A5A5A);
+        p.w.push_back(enc_SW(10, 13, 0));
+        p.w.push_back(enc_I(0x13, 10, 10, 4));
+        p.w.push_back(enc_BNE(10, 12, -8));
+    } else if (k == Kind::Memcmp) {
+        p.w.push_back(enc_LD(2, 5, 10, 0));
+        p.w.push_back(enc_LD(2, 6, 11, 0));
+        p.w.push_back(enc_BNE(5, 6, 16));             // differ: done
+        p.w.push_back(enc_I(0x13, 10, 10, 4));
+        p.w.push_back(enc_I(0x13, 11, 11, 4));
+        p.w.push_back(enc_BNE(11, 12, -20));
+    } else {
+        p.w.push_back(enc_LD(4, 5, 10, 0));           // lbu
+        p.w.push_back(enc_I(0x13, 10, 10, 1));
+        p.w.push_back(enc_BNE(5, 0, -8));
+    }
+    p.w.push_back(enc_I(0x13, 9, 9, -1));
+    p.w.push_back(enc_BNE(9, 0, outer - p.here()));
+    p.w.push_back(enc_I(0x13, 17, 0, 0));
+    p.w.push_back(ECALL);
+    return p.w;
+}
+
+struct Result { double secs; uint64_t cycles; };
+
+static Result run(Kind k, bool ecall, uint32_t n, uint32_t iters){
+    Memory mem(256*1024);
+    std::vector<uint8_t> buf(n);
+    for (uint32_t i = 0; i < n; ++i) buf[i] = (uint8_t)(1 + i % 251);
+    buf[n - 1] = 0;                                    // strlen stops on the last byte
+    mem.write_bytes(SRC, buf.data(), n);
+    mem.write_bytes(DST, buf.data(), n);               // memcmp: equal all the way
+    auto code = build(k, ecall, n, iters);
+    for (std::size_t i = 0; i < code.size(); ++i) mem.store32((uint32_t)(4*i), code[i]);
+
+    CPU cpu;
+    auto t0 = std::chrono::steady_clock::now();
+    while (!cpu.halted) cpu.run(mem, UINT64_MAX);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return {secs, cpu.cycles};
+}
+
+int main(){
+    const struct { Kind k; const char* name; } kinds[] = {
+        {Kind::Memcpy, "memcpy"}, {Kind::Memset, "memset"}, {Kind::Memcmp, "memcmp"}, {Kind::Strlen, "strlen"} };
+    std::printf("%-7s %6s %12s %12s %8s %14s %14s\n", "op", "bytes", "loop MB/s", "ecall MB/s", "speedup",
+                "loop cyc/B", "ecall cyc/B");
+    for (auto& kd : kinds) {
+        for (uint32_t n : {64u, 1024u, 16384u}) {
+            uint32_t iters = (8u << 20) / n;
+            Result a = run(kd.k, false, n, iters), b = run(kd.k, true, n, iters);
+            double mb = (double)n * iters / 1e6, bytes = (double)n * iters;
+            std::printf("%-7s %6u %12.1f %12.1f %7.1fx %14.2f %14.2f\n", kd.name, n, mb / a.secs, mb / b.secs,
+                        a.secs / b.secs, a.cycles / bytes, b.cycles / bytes);
+        }
+    }
+    return 0;
+}
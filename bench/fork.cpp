@@ -0,0 +1,116 @@
+// bench/fork.cpp — guests started from a Snapshot against guests built fresh.
+// The guest has a 256 KiB initialised data segment and init code that fills
+// a 64 KiB table before a short "work" phase. Three ways to get to the end
+// of the work phase:
+//   fresh  new Memory, load the image, run init, run work
+//   fork   Snapshot::fork() (taken after init), run work
+//   reset  Snapshot::reset() on one child, run work
+//
+//   seedos_fork [MiB of guest RAM]      (default 16)
+#include "cpu.hpp"
+#include "elf.hpp"
+#include "mem.hpp"
+#include "snapshot.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+static uint32_t enc_I(uint32_t op,uint32_t rd,uint32_t rs1,int32_t imm){ return (((uint32_t)imm&0xFFF)<<20)|(rs1<<15)|(rd<<7)|op; }
+static uint32_t enc_LW(uint32_t rd,uint32_t rs1,int32_t imm){ return enc_I(0x03,rd,rs1,imm)|(0b010<<12); }
+static uint32_t enc_SW(uint32_t rs1,uint32_t rs2,int32_t imm){
+    uint32_t u=(uint32_t)imm&0xFFF;
+    return ((u>>5)<<25)|(rs2<<20)|(rs1<<15)|(0b010<<12)|((u&0x1F)<<7)|0x23;
+}
+static uint32_t enc_LUI(uint32_t rd,uint32_t imm20){ return ((imm20&0xFFFFF)<<12)|(rd<<7)|0x37; }
+static uint32_t enc_BNE(uint32_t rs1,uint32_t rs2,int32_t off){
+    uint32_t u=(uint32_t)off;
+    return (((u>>12)&1)<<31)|(((u>>5)&0x3F)<<25)|(rs2<<20)|(rs1<<15)|(0b001<<12)|(((u>>1)&0xF)<<8)|(((u>>11)&1)<<7)|0x63;
+}
+
+static ElfImage make_image(){
+    const uint32_t code[] = {
+        enc_LUI(5, 0x10),            // 0x00 x5 = table (0x10000)
+        enc_I(0x13, 6, 0, 0),        // 0x04 x6 = 0
+        enc_LUI(7, 4),               // 0x08 x7 = 16384 words
+        enc_SW(5, 6, 0),             // 0x0C fill: [x5] = x6
+        enc_I(0x13, 5, 5, 4),        // 0x10
+        enc_I(0x13, 6, 6, 3),        // 0x14
+        enc_I(0x13, 7, 7, -1),       // 0x18
+        enc_BNE(7, 0, 0x0C - 0x1C),  // 0x1C
+        enc_I(0x13, 17, 0, 7),       // 0x20 yield: end of init
+        0x00000073,                  // 0x24
+        enc_LUI(5, 0x10),            // 0x28 work: read the table and the data, write one word
+        enc_LW(10, 5, 20),           // 0x2C
+        enc_LUI(8, 0x40),            // 0x30
+        enc_LW(11, 8, 0),            // 0x34
+        enc_SW(5, 11, 0),            // 0x38
+        enc_I(0x13, 17, 0, 0),       // 0x3C exit(a0)
+        0x00000073,                  // 0x40
+    };
+    // one blob standing in for the file: text at offset 0, data at 0x1000
+    std::vector<uint8_t> blob(0x1000 + (256u << 10));
+    for (std::size_t i = 0; i < sizeof code / sizeof code[0]; ++i)
+        for (int k = 0; k < 4; ++k) blob[4*i + k] = (uint8_t)(code[i] >> (8*k));
+    for (std::size_t i = 0x1000; i < blob.size(); ++i) blob[i] = (uint8_t)(i * 7);
+    ElfImage img;
+    img.segments = { {0, 0x1000, (uint32_t)sizeof code, 0},
+                     {0x40000, 256u << 10, 256u << 10, 0x1000} };
+    img.file = std::make_shared<const FileBytes>(std::move(blob));
+    return img;
+}
+
+static void finish(CPU& cpu, Memory& mem){
+    cpu.run(mem, 1'000'000);
+    if (!cpu.halted || cpu.exit_code != 15) { std::fprintf(stderr, "bad guest result %u\n", cpu.exit_code); std::exit(1); }
+}
+
+// operations per second, over ~0.3 s
+static double rate(const std::function<void()>& op){
+    using clk = std::chrono::steady_clock;
+    uint64_t n = 0; auto t0 = clk::now(); double secs = 0;
+    do { op(); ++n; secs = std::chrono::duration<double>(clk::now() - t0).count(); } while (secs < 0.3);
+    return n / secs;
+}
+
+int main(int argc, char** argv){
+    std::size_t mib = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+    std::size_t bytes = std::max<std::size_t>(mib, 1) << 20;
+    const ElfImage img = make_image();
+
+    std::printf("%-8s %-8s %12s %10s %12s\n", "backend", "start", "guests/s", "speedup", "dirty pages");
+    for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+        if (b == MemBackend::Fastmem && !fastmem::available()) continue;
+        const char* bn = b == MemBackend::Fastmem ? "fastmem" : "vector";
+
+        double fresh = rate([&]{
+            Memory mem(bytes, b); CPU cpu;
+            cpu.pc = img.load_into(mem);
+            cpu.run(mem, 1'000'000);                 // init, up to the yield
+            finish(cpu, mem);
+        });
+
+        Memory parent(bytes, b); CPU pcpu;
+        pcpu.pc = img.load_into(parent);
+        pcpu.run(parent, 1'000'000);
+        Snapshot snap(pcpu, parent);
+
+        std::size_t dirty = 0;
+        double fork = rate([&]{
+            Snapshot::Child c = snap.fork();
+            finish(c.cpu, *c.mem);
+            dirty = c.mem->dirty_pages();
+        });
+
+        Snapshot::Child c = snap.fork();
+        double reset = rate([&]{
+            snap.reset(c.cpu, *c.mem);
+            finish(c.cpu, *c.mem);
+        });
+
+        std::printf("%-8s %-8s %12.0f %10s %12s\n", bn, "fresh", fresh, "1.0x", "-");
+        std::printf("%-8s %-8s %12.0f %9.1fx %12zu\n", bn, "fork", fork, fork / fresh, dirty);
+        std::printf("%-8s %-8s %12.0f %9.1fx %12zu\n", bn, "reset", reset, reset / fresh, dirty);
+    }
+    return 0;
+}
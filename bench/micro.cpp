@@ -0,0 +1,102 @@
+// bench/micro.cpp — what each optional interpreter feature costs per instruction.
+// Runs the same guest loop through every single-feature loop variant and
+// reports host ns per guest instruction against the minimal variant.
+//
+//   seedos_micro [insns]      (default 20M per run, best of 3)
+#include "cache.hpp"
+#include "cpu.hpp"
+#include "mem.hpp"
+#include "mmu.hpp"
+#include "trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_set>
+
+static uint32_t enc_I(uint32_t op,uint32_t rd,uint32_t rs1,int32_t imm){ return (((uint32_t)imm&0xFFF)<<20)|(rs1<<15)|(rd<<7)|op; }
+static uint32_t enc_R(uint32_t rd,uint32_t rs1,uint32_t rs2){ return (rs2<<20)|(rs1<<15)|(rd<<7)|0x33; }
+static uint32_t enc_LW(uint32_t rd,uint32_t rs1,int32_t imm){ return enc_I(0x03,rd,rs1,imm)|(0b010<<12); }
+static uint32_t enc_SW(uint32_t rs1,uint32_t rs2,int32_t imm){
+    uint32_t u=(uint32_t)imm&0xFFF;
+    return ((u>>5)<<25)|(rs2<<20)|(rs1<<15)|(0b010<<12)|((u&0x1F)<<7)|0x23;
+}
+static uint32_t enc_JAL(uint32_t rd,int32_t off){
+    uint32_t u=(uint32_t)off;
+    return (((u>>20)&1)<<31)|(((u>>1)&0x3FF)<<21)|(((u>>11)&1)<<20)|(((u>>12)&0xFF)<<12)|(rd<<7)|0x6F;
+}
+
+// endless loop: load, add, store, bump, jump (ALU, memory and jump costs)
+static void load_loop(Memory& ram){
+    const uint32_t prog[] = {
+        enc_I(0x13, 5, 0, 0),        // 0x00 x5 = 0
+        enc_I(0x13, 8, 0, 0x400),    // 0x04 x8 = data
+        enc_LW(6, 8, 0),             // 0x08 loop: x6 = [x8]
+        enc_R(6, 6, 5),              // 0x0C x6 += x5
+        enc_SW(8, 6, 0),             // 0x10 [x8] = x6
+        enc_I(0x13, 5, 5, 1),        // 0x14 x5++
+        enc_JAL(0, 0x08 - 0x18),     // 0x18 j loop
+    };
+    for (uint32_t i = 0; i < sizeof prog / sizeof prog[0]; ++i) ram.store32(4*i, prog[i]);
+}
+
+struct Config { const char* name; unsigned feats; };
+
+static double ns_per_insn(unsigned feats, uint64_t insns){
+    double best = 1e30;
+    for (int rep = 0; rep < 3; ++rep) {
+        Memory ram(64*1024, (feats & FeatFastmem) ? MemBackend::Fastmem : MemBackend::Vector);
+        load_loop(ram);
+        CPU cpu;
+        std::unordered_set<uint32_t> bps{0xFFF0};   // never hit, still checked
+        if (feats & FeatBreakpoints) cpu.breakpoints = &bps;
+        global_trace().enable(feats & FeatTrace);
+        if (feats & FeatPreempt) cpu.quantum = 0xFFFFFFFFu;
+        ram.set_timer(feats & FeatTimer);
+        cpu.cost_model = (feats & FeatCost) ? CostModel::Table : CostModel::Flat;
+        CacheHierarchy caches;
+        if (feats & FeatTiming) cpu.caches = &caches;
+        Mmu mmu(ram);
+        if (feats & FeatMmu) {                      // identity: one 4 MiB megapage over RAM
+            ram.store32(0x8000, Mmu::V | Mmu::R | Mmu::W | Mmu::X | Mmu::A | Mmu::D);
+            cpu.satp = Mmu::SATP_SV32 | (0x8000 >> 12);
+            cpu.mmu = &mmu;
+        }
+        if ((cpu.features(ram) & FeatAll) != feats) { std::fprintf(stderr, "variant mismatch\n"); std::exit(1); }
+
+        auto t0 = std::chrono::steady_clock::now();
+        RunExit r = cpu.run(ram, insns);
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (r.reason != Exit::Budget) { std::fprintf(stderr, "unexpected exit %s\n", exit_name(r.reason)); std::exit(1); }
+        if (secs * 1e9 / insns < best) best = secs * 1e9 / insns;
+    }
+    global_trace().enable(false);
+    return best;
+}
+
+int main(int argc, char** argv){
+    uint64_t insns = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20'000'000;
+    global_trace().set_capacity(1u << 16);
+
+    const Config configs[] = {
+        {"minimal",      0},
+        {"+breakpoints", FeatBreakpoints},
+        {"+trace",       FeatTrace},
+        {"+preempt",     FeatPreempt},
+        {"+timer",       FeatTimer},
+        {"+cost",        FeatCost},
+        {"+fastmem",     FeatFastmem},
+        {"+timing",      FeatTiming},
+        {"+mmu",         FeatMmu},
+        {"default",      FeatTimer | FeatCost | FeatFastmem},
+        {"all",          FeatAll},
+    };
+    std::printf("%-14s %10s %10s %8s\n", "variant", "ns/insn", "delta", "MIPS");
+    double base = 0;
+    for (const Config& c : configs) {
+        if ((c.feats & FeatFastmem) && !fastmem::available()) continue;
+        double ns = ns_per_insn(c.feats, insns);
+        if (c.feats == 0) base = ns;
+        std::printf("%-14s %10.3f %+10.3f %8.1f\n", c.name, ns, ns - base, 1e3 / ns);
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+// bench/sched.cpp — context switches per second through Scheduler with
+// 10, 100 and 1000 guest tasks over four priority levels. Every task runs
+// the same code with its own registers:
+//   yield    count, ECALL 7, repeat: a switch every 3 instructions
+//   preempt  count forever: a switch at every quantum expiry
+//   lock     take lock, count, yield, unlock: waiters park until the unlock
+//   futex    the same around an AMOSWAP mutex, futex wait/wake on contention
+// The two contended loads also run with SchedConfig::park off ("-spin"):
+// a blocked task then yields and retries every slice. work/s counts
+// critical sections (x5 increments) across all tasks.
+//
+//   seedos_sched [seconds per run]      (default 0.3)
+#include "cpu.hpp"
+#include "mem.hpp"
+#include "sched.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+static uint32_t enc_I(uint32_t op,uint32_t rd,uint32_t rs1,int32_t imm){ return (((uint32_t)imm&0xFFF)<<20)|(rs1<<15)|(rd<<7)|op; }
+static uint32_t enc_JAL(uint32_t rd,int32_t off){
+    uint32_t u=(uint32_t)off;
+    return (((u>>20)&1)<<31)|(((u>>1)&0x3FF)<<21)|(((u>>11)&1)<<20)|(((u>>12)&0xFF)<<12)|(rd<<7)|0x6F;
+}
+static uint32_t enc_B(uint32_t f3,uint32_t rs1,uint32_t rs2,int32_t off){
+    uint32_t u=(uint32_t)off;
+    return (((u>>12)&1)<<31)|(((u>>5)&0x3F)<<25)|(rs2<<20)|(rs1<<15)|(f3<<12)|(((u>>1)&0xF)<<8)|(((u>>11)&1)<<7)|0x63;
+}
+static uint32_t enc_SW(uint32_t rs1,uint32_t rs2,int32_t imm){
+    uint32_t u=(uint32_t)imm;
+    return (((u>>5)&0x7F)<<25)|(rs2<<20)|(rs1<<15)|(2u<<12)|((u&0x1F)<<7)|0x23;
+}
+static uint32_t enc_AMOSWAP(uint32_t rd,uint32_t rs1,uint32_t rs2){ return (1u<<27)|(rs2<<20)|(rs1<<15)|(2u<<12)|(rd<<7)|0x2F; }
+static const uint32_t ECALL = 0x00000073;
+
+static void load(Memory& mem){
+    const uint32_t yield[] = {
+        enc_I(0x13, 5, 5, 1),        // 0x000 x5++
+        enc_I(0x13, 17, 0, 7),       // 0x004 yield
+        ECALL,                       // 0x008
+        enc_JAL(0, -12),             // 0x00C
+    };
+    const uint32_t spin[] = {
+        enc_I(0x13, 5, 5, 1),        // 0x100 x5++
+        enc_JAL(0, -4),              // 0x104
+    };
+    const uint32_t lock[] = {
+        enc_I(0x13, 10, 0, 0x400),   // 0x200 a0 = lock address
+        enc_I(0x13, 17, 0, 9),       // 0x204 lock(a0)
+        ECALL,                       // 0x208
+        enc_I(0x13, 5, 5, 1),        // 0x20C x5++ under the lock
+        enc_I(0x13, 17, 0, 7),       // 0x210 yield while holding it
+        ECALL,                       // 0x214
+        enc_I(0x13, 17, 0, 10),      // 0x218 unlock(a0)
+        ECALL,                       // 0x21C
+        enc_JAL(0, -0x20),           // 0x220
+    };
+    const uint32_t futex[] = {
+        enc_I(0x13, 10, 0, 0x500),   // 0x300 a0 = mutex word
+        enc_I(0x13, 6, 0, 1),        // 0x304
+        enc_AMOSWAP(7, 10, 6),       // 0x308 x7 = swap(*a0, 1)
+        enc_B(0, 7, 0, 20),          // 0x30C was free: got it
+        enc_I(0x13, 11, 0, 1),       // 0x310 futex_wait(a0, 1)
+        enc_I(0x13, 17, 0, 11),      // 0x314
+        ECALL,                       // 0x318
+        enc_JAL(0, -28),             // 0x31C try again (a0 was overwritten)
+        enc_I(0x13, 5, 5, 1),        // 0x320 x5++ under the mutex
+        enc_I(0x13, 17, 0, 7),       // 0x324 yield while holding it
+        ECALL,                       // 0x328
+        enc_SW(10, 0, 0),            // 0x32C release
+        enc_I(0x13, 11, 0, 1),       // 0x330 futex_wake(a0, 1)
+        enc_I(0x13, 17, 0, 12),      // 0x334
+        ECALL,                       // 0x338
+        enc_JAL(0, -0x3C),           // 0x33C
+    };
+    auto put = [&](uint32_t at, const uint32_t* w, std::size_t n){ for (std::size_t i = 0; i < n; ++i) mem.store32(at + 4*(uint32_t)i, w[i]); };
+    put(0x000, yield, sizeof yield / 4);
+    put(0x100, spin, sizeof spin / 4);
+    put(0x200, lock, sizeof lock / 4);
+    put(0x300, futex, sizeof futex / 4);
+}
+
+int main(int argc, char** argv){
+    double secs = argc > 1 ? std::strtod(argv[1], nullptr) : 0.3;
+    if (!(secs > 0)) secs = 0.3;
+    struct Load { const char* name; uint32_t pc; bool park; };
+    const Load loads[] = { {"yield", 0x000, true}, {"preempt", 0x100, true},
+                           {"lock", 0x200, true}, {"lock-spin", 0x200, false},
+                           {"futex", 0x300, true}, {"futex-spin", 0x300, false} };
+
+    std::printf("%-10s %6s %14s %12s %12s %10s %10s\n", "load", "tasks", "switches/s", "guest MIPS", "work/s", "blocks", "promoted");
+    for (const Load& l : loads) {
+        for (int n : {10, 100, 1000}) {
+            Memory mem(64*1024);
+            load(mem);
+            SchedConfig cfg; cfg.park = l.park;
+            Scheduler s(mem, cfg);
+            for (int i = 0; i < n; ++i) s.spawn(l.pc, (uint32_t)(i % 4));
+
+            using clk = std::chrono::steady_clock;
+            auto t0 = clk::now(); double el = 0;
+            do { s.run(100'000); el = std::chrono::duration<double>(clk::now() - t0).count(); } while (el < secs);
+            const auto& st = s.stats();
+            uint64_t work = 0;
+            for (int i = 0; i < n; ++i) work += s.task(i).cpu.x[5];
+            std::printf("%-10s %6d %14.0f %12.1f %12.0f %10llu %10llu\n", l.name, n, st.switches / el,
+                        st.insns / el / 1e6, work / el, (unsigned long long)st.blocks, (unsigned long long)st.promotions);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "batch.hpp"
+#include "elf.hpp"
+#include "jit.hpp"
+#include "mem.hpp"
+#include "workpool.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <sstream>
+
+std::vector<BatchJob> read_manifest(const std::string& path){
+    std::ifstream f(path);
+    if (!f) throw std::runtime_error("cannot open manifest " + path);
+    std::vector<BatchJob> jobs;
+    std::string line;
+    for (int ln = 1; std::getline(f, line); ++ln) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream is(line);
+        BatchJob j;
+        if (!(is >> j.elf)) continue;
+        auto bad = [&](const std::string& t){
+            return std::runtime_error(path + ":" + std::to_string(ln) + ": bad token '" + t + "'");
+        };
+        for (std::string t; is >> t; ) {
+            std::string key, val = t;
+            auto eq = t.find('=');
+            if (eq != std::string::npos) { key = t.substr(0, eq); val = t.substr(eq + 1); }
+            char* end = nullptr;
+            unsigned long long v = std::strtoull(val.c_str(), &end, 0);
+            if (val.empty() || *end) throw bad(t);
+            if (key == "mem")       j.mem_bytes = (std::size_t)v;
+            else if (key == "max")  j.max_insns = v;
+            else if (key.empty() && j.args.size() < 8) j.args.push_back((uint32_t)v);
+            else throw bad(t);
+        }
+        jobs.push_back(std::move(j));
+    }
+    return jobs;
+}
+
+static void run_one(const BatchJob& job, const ElfImage& img, bool use_jit, BatchResult& r){
+    auto t0 = std::chrono::steady_clock::now();
+    Memory mem(job.mem_bytes);
+    CPU cpu;
+    cpu.pc = img.load_into(mem);
+    for (std::size_t i = 0; i < job.args.size(); ++i) cpu.x[10 + i] = job.args[i];
+    std::unique_ptr<Jit> jit;
+    if (use_jit && Jit::available()) { jit = std::make_unique<Jit>(mem); cpu.jit = jit.get(); }
+    RunExit ex{Exit::Budget, 0};
+    while (ex.insns < job.max_insns) {                 // ride through yields, nobody schedules
+        RunExit e = cpu.run(mem, job.max_insns - ex.insns);
+        ex.insns += e.insns; ex.reason = e.reason;
+        if (e.reason != Exit::Yield) break;
+    }
+    r.ok = true;
+    r.reason = ex.reason; r.exit_code = cpu.exit_code; r.pc = cpu.pc;
+    r.instret = cpu.instret; r.cycles = cpu.cycles;
+    r.host_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+BatchReport run_batch(const std::vector<BatchJob>& jobs, unsigned threads, bool jit){
+    auto t0 = std::chrono::steady_clock::now();
+    BatchReport rep;
+    rep.results.resize(jobs.size());
+
+    // parse each distinct ELF once, up front; the workers only read them
+    struct Loaded { std::unique_ptr<const ElfImage> img; std::string error; };
+    std::map<std::string, Loaded> images;
+    std::vector<const ElfImage*> img(jobs.size(), nullptr);
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        auto it = images.find(jobs[i].elf);
+        if (it == images.end()) {
+            Loaded l;
+            try {
+                l.img = std::make_unique<const ElfImage>(ElfImage::parse(jobs[i].elf));
+                if (l.img->segments.empty()) l.error = "no loadable segments";
+            } catch (const std::exception& e) { l.error = e.what(); }
+            it = images.emplace(jobs[i].elf, std::move(l)).first;
+        }
+        img[i] = it->second.img.get();
+        rep.results[i].error = it->second.error;
+    }
+    rep.images = images.size();
+
+    WorkPool pool(threads);
+    pool.for_each(jobs.size(), [&](std::size_t i){
+        BatchResult& r = rep.results[i];
+        if (!r.error.empty()) return;
+        try { run_one(jobs[i], *img[i], jit, r); }
+        catch (const std::exception& e) { r.ok = false; r.error = e.what(); }
+    });
+    rep.threads = pool.threads();
+    rep.steals = pool.steals();
+    rep.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    return rep;
+}
+
+static void json_str(FILE* f, const std::string& s){
+    std::fputc('"', f);
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') std::fprintf(f, "\\%c", c);
+        else if (c < 0x20)         std::fprintf(f, "\\u%04x", c);
+        else                       std::fputc(c, f);
+    }
+    std::fputc('"', f);
+}
+
+void write_batch_json(FILE* f, const std::vector<BatchJob>& jobs, const BatchReport& r){
+    std::fprintf(f, "{\"threads\":%u,\"jobs\":%zu,\"images\":%zu,\"steals\":%llu,\"wall_ms\":%.3f,\"results\":[\n",
+                 r.threads, jobs.size(), r.images, (unsigned long long)r.steals, r.wall_ms);
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        const BatchResult& x = r.results[i];
+        std::fprintf(f, "  {\"elf\":");
+        json_str(f, jobs[i].elf);
+        std::fprintf(f, ",\"args\":[");
+        for (std::size_t k = 0; k < jobs[i].args.size(); ++k) std::fprintf(f, "%s%u", k ? "," : "", jobs[i].args[k]);
+        if (x.ok)
+            std::fprintf(f, "],\"exit\":\"%s\",\"exit_code\":%u,\"pc\":%u,\"instret\":%llu,\"cycles\":%llu,\"host_ms\":%.3f}",
+                         exit_name(x.reason), x.exit_code, x.pc,
+                         (unsigned long long)x.instret, (unsigned long long)x.cycles, x.host_ms);
+        else {
+            std::fprintf(f, "],\"exit\":\"error\",\"error\":");
+            json_str(f, x.error);
+            std::fputc('}', f);
+        }
+        std::fprintf(f, "%s\n", i + 1 < jobs.size() ? "," : "");
+    }
+    std::fprintf(f, "]}\n");
+}
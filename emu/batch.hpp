@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "cpu.hpp"
+
+// Batch mode: many short guest programs, each in its own CPU + Memory, run
+// on a WorkPool. Every distinct ELF is parsed once and shared read-only by
+// all the instances that use it.
+//
+// Manifest: one job per line, '#' starts a comment.
+//   <elf path> [mem=<bytes>] [max=<insns>] [a0 a1 ... a7]
+// Integers may be decimal or 0x-hex; they go into a0.. in order.
+struct BatchJob {
+    std::string elf;
+    std::vector<uint32_t> args;            // a0, a1, ...
+    std::size_t mem_bytes = 64*1024;
+    uint64_t max_insns = 10'000'000;
+};
+
+struct BatchResult {
+    bool ok = false;                       // false: error holds why it never ran
+    std::string error;
+    Exit reason = Exit::Budget;
+    uint32_t exit_code = 0, pc = 0;
+    uint64_t instret = 0, cycles = 0;
+    double host_ms = 0;
+};
+
+struct BatchReport {
+    std::vector<BatchResult> results;      // same order as the jobs
+    unsigned threads = 0;
+    std::size_t images = 0;                // distinct ELF files parsed
+    uint64_t steals = 0;
+    double wall_ms = 0;
+};
+
+// throws std::runtime_error naming the file and line on a malformed manifest
+std::vector<BatchJob> read_manifest(const std::string& path);
+
+// threads = 0: one per host core; jit: give every instance a translator
+BatchReport run_batch(const std::vector<BatchJob>& jobs, unsigned threads = 0, bool jit = false);
+
+void write_batch_json(FILE* f, const std::vector<BatchJob>& jobs, const BatchReport& r);
@@ -0,0 +1,122 @@
+#include "bpred.hpp"
+#include "symbols.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+BranchPredictor::BranchPredictor(const BranchSpec& s)
+: cfg(s),
+  mask((1u << s.table_bits) - 1),
+  hist_mask(s.history_bits >= 32 ? ~0u : (1u << s.history_bits) - 1),
+  counters(1u << s.table_bits, 1),
+  targets(1u << s.table_bits, 0),
+  ras(s.ras_depth, 0) {}
+
+uint32_t BranchPredictor::record(uint32_t pc, Kind k, bool taken, bool wrong){
+    Site& s = by_pc.try_emplace(pc, Site{k}).first->second;
+    ++s.executed; s.taken += taken; s.mispredicted += wrong;
+    ++st.executed[k]; st.mispredicted[k] += wrong;
+    return wrong ? cfg.penalty : 0;
+}
+
+uint32_t BranchPredictor::branch(uint32_t pc, int32_t off, bool taken){
+    bool guess;
+    if (cfg.kind == Predictor::Btfn) {
+        guess = off < 0;
+    } else {
+        uint32_t i = (pc >> 2) ^ (cfg.kind == Predictor::Gshare ? ghr : 0);
+        uint8_t& c = counters[i & mask];
+        guess = c >= 2;
+        if (taken) { if (c < 3) ++c; } else if (c > 0) --c;
+        ghr = ((ghr << 1) | taken) & hist_mask;
+    }
+    return record(pc, Cond, taken, guess != taken);
+}
+
+void BranchPredictor::push(uint32_t ret){
+    if (ras.empty()) return;
+    ras[ras_top] = ret;
+    ras_top = (ras_top + 1) % ras.size();
+    ras_used = std::min<uint32_t>(ras_used + 1, (uint32_t)ras.size());
+}
+
+uint32_t BranchPredictor::pop(){
+    if (!ras_used) return 0;
+    ras_top = (ras_top + (uint32_t)ras.size() - 1) % ras.size();
+    --ras_used;
+    return ras[ras_top];
+}
+
+// RAS hints from the ISA manual: x1 and x5 are link registers; a JALR
+// through a link register that doesn't write it is a return.
+uint32_t BranchPredictor::jump(uint32_t pc, uint32_t target, uint8_t rd, uint8_t rs1, bool jalr){
+    auto link = [](uint8_t r){ return r == 1 || r == 5; };
+    uint32_t penalty = 0;
+    if (jalr && link(rs1) && !(link(rd) && rs1 == rd)) {
+        penalty = record(pc, Return, true, pop() != target);
+    } else if (jalr) {
+        uint32_t& t = targets[(pc >> 2) & mask];
+        penalty = record(pc, Indirect, true, t != target);
+        t = target;
+    }
+    if (link(rd)) push(pc + 4);
+    return penalty;
+}
+
+std::vector<std::pair<uint32_t, BranchPredictor::Site>> BranchPredictor::worst(std::size_t n) const {
+    std::vector<std::pair<uint32_t, Site>> v(by_pc.begin(), by_pc.end());
+    std::sort(v.begin(), v.end(), [](const auto& a, const auto& b){
+        return a.second.mispredicted != b.second.mispredicted ? a.second.mispredicted > b.second.mispredicted
+                                                              : a.first < b.first;
+    });
+    if (v.size() > n) v.resize(n);
+    return v;
+}
+
+void BranchPredictor::write_csv(std::FILE* f, const SymbolTable* syms) const {
+    std::fprintf(f, "pc,symbol,kind,executed,taken,mispredicted\n");
+    for (auto& [pc, s] : worst(by_pc.size()))
+        std::fprintf(f, "0x%08x,%s,%s,%llu,%llu,%llu\n", pc, syms ? syms->describe(pc).c_str() : "",
+                     kind_name(s.kind), (unsigned long long)s.executed,
+                     (unsigned long long)s.taken, (unsigned long long)s.mispredicted);
+}
+
+static uint32_t number(const std::string& v, const std::string& what){
+    char* end = nullptr;
+    unsigned long n = std::strtoul(v.c_str(), &end, 0);
+    if (v.empty() || *end) throw std::invalid_argument("bad " + what + " '" + v + "'");
+    return (uint32_t)n;
+}
+
+BranchSpec BranchSpec::parse(const std::string& text){
+    BranchSpec s;
+    std::istringstream in(text);
+    std::string item;
+    bool first = true;
+    while (std::getline(in, item, ',')) {
+        auto eq = item.find('=');
+        if (first) {
+            first = false;
+            std::istringstream f(item);
+            std::string name, bits, hist;
+            std::getline(f, name, ':'); std::getline(f, bits, ':'); std::getline(f, hist, ':');
+            if (name == "btfn")         s.kind = Predictor::Btfn;
+            else if (name == "bimodal") s.kind = Predictor::Bimodal;
+            else if (name == "gshare")  s.kind = Predictor::Gshare;
+            else throw std::invalid_argument("unknown predictor '" + name + "'");
+            if (!bits.empty()) s.table_bits = s.history_bits = number(bits, "table bits");
+            if (!hist.empty()) s.history_bits = number(hist, "history bits");
+            if (s.table_bits < 1 || s.table_bits > 24 || s.history_bits > 32)
+                throw std::invalid_argument("table bits must be 1..24, history at most 32");
+        } else if (eq != std::string::npos && item.substr(0, eq) == "ras") {
+            s.ras_depth = number(item.substr(eq + 1), "ras depth");
+        } else if (eq != std::string::npos && item.substr(0, eq) == "penalty") {
+            s.penalty = number(item.substr(eq + 1), "penalty");
+        } else {
+            throw std::invalid_argument("expected ras=N or penalty=N, got '" + item + "'");
+        }
+    }
+    if (first) throw std::invalid_argument("empty predictor spec");
+    return s;
+}
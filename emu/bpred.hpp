@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class SymbolTable;
+
+// Branch prediction for timing: CPU::bpred sees every conditional branch and
+// JALR (and JAL, for the return-address stack). A wrong guess adds the
+// penalty to the instruction's cost. The predicted-taken target is assumed
+// known (a perfect BTB), so JAL never mispredicts.
+
+enum class Predictor : uint8_t {
+    Btfn,        // static: backward taken, forward not taken
+    Bimodal,     // 2-bit counters indexed by pc
+    Gshare       // 2-bit counters indexed by pc ^ global history
+};
+
+struct BranchSpec {
+    Predictor kind{Predictor::Gshare};
+    uint32_t table_bits{12};     // 2^n counters (and JALR target slots)
+    uint32_t history_bits{12};   // gshare global history length
+    uint32_t ras_depth{16};      // return-address stack entries (0 = none)
+    uint32_t penalty{3};         // cycles per mispredict
+
+    // "btfn", "bimodal[:BITS]", "gshare[:BITS[:HISTORY]]", then optional
+    // ",ras=N" and ",penalty=N". Throws std::invalid_argument.
+    static BranchSpec parse(const std::string& text);
+};
+
+class BranchPredictor {
+public:
+    enum Kind : uint8_t { Cond, Return, Indirect };
+    struct Site { Kind kind; uint64_t executed{0}, taken{0}, mispredicted{0}; };
+    struct Stats { uint64_t executed[3]{}, mispredicted[3]{}; };   // by Kind
+
+    explicit BranchPredictor(const BranchSpec& s = BranchSpec{});
+
+    // penalty cycles for a conditional branch at pc with offset off
+    uint32_t branch(uint32_t pc, int32_t off, bool taken);
+    // penalty cycles for JAL (jalr=false, never wrong) or JALR to target
+    uint32_t jump(uint32_t pc, uint32_t target, uint8_t rd, uint8_t rs1, bool jalr);
+
+    const BranchSpec& spec() const { return cfg; }
+    const Stats& stats() const { return st; }
+    const std::unordered_map<uint32_t, Site>& sites() const { return by_pc; }
+    // the n sites with the most mispredicts, most first
+    std::vector<std::pair<uint32_t, Site>> worst(std::size_t n) const;
+    // every site as CSV: pc,symbol,kind,executed,taken,mispredicted
+    void write_csv(std::FILE* f, const SymbolTable* syms = nullptr) const;
+
+    static const char* kind_name(Kind k){ return k == Cond ? "cond" : k == Return ? "return" : "indirect"; }
+    static const char* predictor_name(Predictor p){
+        return p == Predictor::Btfn ? "btfn" : p == Predictor::Bimodal ? "bimodal" : "gshare";
+    }
+
+private:
+    uint32_t record(uint32_t pc, Kind k, bool taken, bool wrong);
+    void push(uint32_t ret);
+    uint32_t pop();                    // 0 when empty: a guaranteed miss
+
+    BranchSpec cfg;
+    uint32_t mask, hist_mask;
+    std::vector<uint8_t> counters;     // 2-bit, start weakly not taken
+    std::vector<uint32_t> targets;     // last target of non-return JALRs
+    uint32_t ghr{0};
+    std::vector<uint32_t> ras;         // circular; overflow drops the oldest
+    uint32_t ras_top{0}, ras_used{0};
+    Stats st;
+    std::unordered_map<uint32_t, Site> by_pc;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <array>
+
+// ---- memory-mapped device ----
+// Offsets are relative to the address the device was attached at. A handler
+// returns false to decline the access: on a page that is also RAM it then
+// goes to RAM, anywhere else it is an access fault.
+class Device {
+public:
+    virtual ~Device() = default;
+    virtual bool read8  (uint32_t, uint8_t&)  { return false; }
+    virtual bool read16 (uint32_t, uint16_t&) { return false; }
+    virtual bool read32 (uint32_t, uint32_t&) { return false; }
+    virtual bool write8 (uint32_t, uint8_t)   { return false; }
+    virtual bool write16(uint32_t, uint16_t)  { return false; }
+    virtual bool write32(uint32_t, uint32_t)  { return false; }
+};
+
+// ---- device bus ----
+// Page-granular guest address -> device map. Two-level table (1024 directory
+// slots x 1024 pages), leaves allocated on attach, so a lookup is two loads
+// whatever the number of devices, and an address with no leaf is one.
+class Bus {
+public:
+    static constexpr uint32_t PAGE_SHIFT = 12;
+    static constexpr uint32_t PAGE       = 1u << PAGE_SHIFT;
+
+    struct Entry { Device* dev = nullptr; uint32_t base = 0; };   // base: where dev was attached
+
+    // map [base, base+len) to dev (page granular, not owned); later attaches win
+    void attach(uint32_t base, uint32_t len, Device* dev){
+        for (uint64_t a = base & ~(uint64_t)(PAGE-1); a < (uint64_t)base + len; a += PAGE) {
+            auto& leaf = dir[a >> 22];
+            if (!leaf) leaf = std::make_unique<Leaf>();
+            (*leaf)[(a >> PAGE_SHIFT) & 1023] = Entry{dev, base};
+        }
+    }
+
+    const Entry* find(uint32_t addr) const {
+        const Leaf* leaf = dir[addr >> 22].get();
+        if (!leaf) return nullptr;
+        const Entry& e = (*leaf)[(addr >> PAGE_SHIFT) & 1023];
+        return e.dev ? &e : nullptr;
+    }
+
+    // does [addr, addr+len) touch a device page? (len <= PAGE)
+    bool claims(uint32_t addr, uint32_t len) const {
+        return find(addr) || (((addr & (PAGE-1)) + len > PAGE) && find(addr + len - 1));
+    }
+
+private:
+    using Leaf = std::array<Entry, 1024>;
+    std::unique_ptr<Leaf> dir[1024];
+};
@@ -0,0 +1,137 @@
+#include "cache.hpp"
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+static bool pow2(uint32_t v){ return v && !(v & (v - 1)); }
+
+Cache::Cache(const CacheConfig& c) : cfg(c) {
+    if (c.size == 0) return;                               // absent level
+    if (!pow2(c.size) || !pow2(c.ways) || !pow2(c.line) || c.line < 4 || c.size < c.ways * c.line)
+        throw std::invalid_argument("cache geometry must be powers of two with at least one set");
+    while ((1u << shift) < c.line) ++shift;
+    uint32_t sets = c.size / (c.ways * c.line);
+    set_mask = sets - 1;
+    tags.assign((std::size_t)sets * c.ways, NONE);
+    stamp.assign(tags.size(), 0);
+    dirty.assign(tags.size(), 0);
+}
+
+bool Cache::lookup(uint32_t ln, bool write){
+    if (!present()) return false;
+    const bool wb = cfg.write == WritePolicy::WriteBack;
+    uint32_t base = (ln & set_mask) * cfg.ways;
+    for (uint32_t w = 0; w < cfg.ways; ++w) {
+        uint32_t s = base + w;
+        if (tags[s] != ln) continue;
+        ++st.hits;
+        if (cfg.repl == Replace::Lru) stamp[s] = ++clock;
+        if (write && wb) dirty[s] = 1;
+        mru = ln; mru_slot = s;
+        return true;
+    }
+    ++st.misses;
+    if (write && !wb) return false;                        // no write-allocate
+
+    // victim: an empty way, else by policy
+    uint32_t v = base;
+    bool empty = false;
+    for (uint32_t w = 0; w < cfg.ways; ++w)
+        if (tags[base + w] == NONE) { v = base + w; empty = true; break; }
+    if (!empty) {
+        if (cfg.repl == Replace::Random) {
+            rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+            v = base + (rng & (cfg.ways - 1));
+        } else {
+            for (uint32_t w = 1; w < cfg.ways; ++w)
+                if (stamp[base + w] < stamp[v]) v = base + w;
+        }
+        ++st.evictions;
+        if (dirty[v]) { ++st.writebacks; wb_pending = true; wb_addr = tags[v] << shift; }
+    }
+    tags[v] = ln; dirty[v] = write && wb; stamp[v] = ++clock;
+    mru = ln; mru_slot = v;
+    return false;
+}
+
+CacheHierarchy::CacheHierarchy(const CacheSpec& s)
+: l1i(s.l1i), l1d(s.l1d), l2(s.l2),
+  l1i_lat(s.l1i.latency), l1d_lat(s.l1d.latency), mem_lat(s.mem_latency),
+  l1d_wt(s.l1d.write == WritePolicy::WriteThrough) {}
+
+uint32_t CacheHierarchy::fill(uint32_t addr){
+    if (!l2.present()) return mem_lat;
+    bool hit = l2.access(addr, false);
+    uint32_t wb; l2.take_writeback(wb);                    // memory takes it for free
+    return l2.config().latency + (hit ? 0 : mem_lat);
+}
+
+void CacheHierarchy::post(uint32_t addr){
+    if (!l2.present()) return;
+    l2.access(addr, true);
+    uint32_t wb; l2.take_writeback(wb);
+}
+
+uint32_t CacheHierarchy::fetch_slow(uint32_t addr){
+    return l1i.access(addr, false) ? l1i_lat : l1i_lat + fill(addr);
+}
+
+uint32_t CacheHierarchy::data_slow(uint32_t addr, bool write){
+    bool hit = l1d.access(addr, write);
+    uint32_t wb;
+    if (l1d.take_writeback(wb)) post(wb);
+    if (write && l1d_wt) { post(addr); return l1d_lat; }   // hit or not, the write goes down
+    return hit ? l1d_lat : l1d_lat + fill(addr);
+}
+
+// SIZE:WAYS:LINE[:policy...][:LATENCY], e.g. "32k:8:64:lru:wb:0"
+static CacheConfig parse_level(const std::string& name, const std::string& v, CacheConfig c){
+    if (v == "off") { c.size = 0; return c; }
+    std::istringstream in(v);
+    std::string f;
+    int field = 0;
+    while (std::getline(in, f, ':')) {
+        if (f.empty()) throw std::invalid_argument("empty field in " + name);
+        if (f == "lru")         { c.repl = Replace::Lru;    continue; }
+        if (f == "fifo")        { c.repl = Replace::Fifo;   continue; }
+        if (f == "random")      { c.repl = Replace::Random; continue; }
+        if (f == "wb")          { c.write = WritePolicy::WriteBack;    continue; }
+        if (f == "wt")          { c.write = WritePolicy::WriteThrough; continue; }
+        char* end = nullptr;
+        unsigned long n = std::strtoul(f.c_str(), &end, 0);
+        if (*end == 'k' || *end == 'K') { n <<= 10; ++end; }
+        else if (*end == 'm' || *end == 'M') { n <<= 20; ++end; }
+        if (end == f.c_str() || *end) throw std::invalid_argument("bad field '" + f + "' in " + name);
+        switch (field++) {
+            case 0: c.size = (uint32_t)n; break;
+            case 1: c.ways = (uint32_t)n; break;
+            case 2: c.line = (uint32_t)n; break;
+            case 3: c.latency = (uint32_t)n; break;
+            default: throw std::invalid_argument("too many fields in " + name);
+        }
+    }
+    Cache check(c);                                        // geometry errors surface here
+    return c;
+}
+
+CacheSpec CacheSpec::parse(const std::string& text){
+    CacheSpec s;
+    if (text == "default") return s;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        auto eq = item.find('=');
+        if (eq == std::string::npos) throw std::invalid_argument("expected level=value, got '" + item + "'");
+        std::string k = item.substr(0, eq), v = item.substr(eq + 1);
+        if (k == "l1i")      s.l1i = parse_level(k, v, s.l1i);
+        else if (k == "l1d") s.l1d = parse_level(k, v, s.l1d);
+        else if (k == "l2")  s.l2  = parse_level(k, v, s.l2);
+        else if (k == "mem") {
+            char* end = nullptr;
+            s.mem_latency = (uint32_t)std::strtoul(v.c_str(), &end, 0);
+            if (v.empty() || *end) throw std::invalid_argument("bad mem latency '" + v + "'");
+        }
+        else throw std::invalid_argument("unknown cache level '" + k + "'");
+    }
+    return s;
+}
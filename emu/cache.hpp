@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Timing model of a cache hierarchy: tags only, no data (guest memory stays
+// the one copy of every byte). Set CPU::caches to hook one into instruction
+// fetch and every load/store/AMO; the cycles it returns are added to the
+// instruction's cost, so they show up in cycles and in timer ticks.
+
+enum class Replace : uint8_t { Lru, Fifo, Random };
+enum class WritePolicy : uint8_t {
+    WriteBack,      // dirty victims go to the next level; write misses allocate
+    WriteThrough    // every write goes on to the next level; write misses don't allocate
+};
+
+struct CacheConfig {
+    uint32_t size{0};            // bytes; 0 = no such level
+    uint32_t ways{1};            // 1 = direct-mapped
+    uint32_t line{64};           // bytes
+    Replace repl{Replace::Lru};
+    WritePolicy write{WritePolicy::WriteBack};
+    uint32_t latency{0};         // cycles charged for every access that reaches this level
+};
+
+struct CacheStats { uint64_t hits{0}, misses{0}, evictions{0}, writebacks{0}; };
+
+// One set-associative level. size/ways/line must be powers of two with at
+// least one set (std::invalid_argument otherwise).
+class Cache {
+public:
+    explicit Cache(const CacheConfig& c);
+
+    bool present() const { return !tags.empty(); }
+    const CacheConfig& config() const { return cfg; }
+    const CacheStats& stats() const { return st; }
+
+    // true on a hit. A miss fills the line (except a write-through write
+    // miss); a dirty victim is left for take_writeback().
+    bool access(uint32_t addr, bool write){
+        return mru_hit(addr, write) || lookup(addr >> shift, write);
+    }
+    // the common case, small enough to inline into the interpreter: the
+    // line the last access used, which has nothing to reorder (write-through
+    // writes always take the long way)
+    bool mru_hit(uint32_t addr, bool write){
+        if ((addr >> shift) != mru) return false;
+        if (write) {
+            if (cfg.write != WritePolicy::WriteBack) return false;
+            dirty[mru_slot] = 1;
+        }
+        ++st.hits;
+        return true;
+    }
+    bool take_writeback(uint32_t& addr){
+        if (!wb_pending) return false;
+        wb_pending = false; addr = wb_addr; return true;
+    }
+
+private:
+    static constexpr uint32_t NONE = ~0u;   // empty way (line numbers are < 2^30)
+    bool lookup(uint32_t ln, bool write);
+
+    CacheConfig cfg;
+    uint32_t shift{0}, set_mask{0};
+    std::vector<uint32_t> tags;      // line number per way, sets*ways
+    std::vector<uint64_t> stamp;     // LRU: last use, FIFO: fill time
+    std::vector<uint8_t>  dirty;
+    uint64_t clock{0};
+    uint32_t rng{0x9E3779B9u};       // Random replacement
+    uint32_t mru{NONE}, mru_slot{0};
+    bool wb_pending{false}; uint32_t wb_addr{0};
+    CacheStats st;
+};
+
+// what CacheHierarchy models; the defaults are a small in-order core's
+struct CacheSpec {
+    CacheConfig l1i{16u << 10, 4, 64, Replace::Lru, WritePolicy::WriteBack, 0};
+    CacheConfig l1d{16u << 10, 4, 64, Replace::Lru, WritePolicy::WriteBack, 0};
+    CacheConfig l2 {256u << 10, 8, 64, Replace::Lru, WritePolicy::WriteBack, 10};
+    uint32_t mem_latency{100};
+
+    // "default", or comma-separated overrides of the defaults:
+    //   l1i=SIZE:WAYS:LINE[:lru|fifo|random][:wb|wt][:LATENCY]  (l1d, l2 alike)
+    //   l2=off   mem=LATENCY
+    // SIZE takes a k/m suffix. Throws std::invalid_argument.
+    static CacheSpec parse(const std::string& text);
+};
+
+// Split L1I/L1D over an optional unified L2, then memory. Writes that leave
+// L1 (write-through traffic, dirty victims) are posted: they update the
+// lower levels' state and counters but cost no cycles.
+class CacheHierarchy {
+public:
+    explicit CacheHierarchy(const CacheSpec& s = CacheSpec{});
+
+    // extra cycles for one instruction fetch / data access
+    uint32_t fetch(uint32_t addr){
+        return l1i.mru_hit(addr, false) ? l1i_lat : fetch_slow(addr);
+    }
+    uint32_t data(uint32_t addr, bool write){
+        return l1d.mru_hit(addr, write) ? l1d_lat : data_slow(addr, write);
+    }
+
+    const Cache& level(unsigned i) const { return i == 0 ? l1i : i == 1 ? l1d : l2; }
+    static const char* level_name(unsigned i){ return i == 0 ? "L1I" : i == 1 ? "L1D" : "L2"; }
+    static constexpr unsigned LEVELS = 3;
+    uint32_t mem_latency() const { return mem_lat; }
+
+private:
+    uint32_t fetch_slow(uint32_t addr);
+    uint32_t data_slow(uint32_t addr, bool write);
+    uint32_t fill(uint32_t addr);      // read a line from below L1
+    void post(uint32_t addr);          // write a line below L1
+
+    Cache l1i, l1d, l2;
+    uint32_t l1i_lat, l1d_lat, mem_lat;
+    bool l1d_wt;
+};
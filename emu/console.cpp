@@ -0,0 +1,36 @@
+#include "console.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+void Console::out(const char* p, std::size_t n){
+    ++st.writes;
+    while (n) {
+        ssize_t w = ::write(fd, p, n);
+        if (w < 0) { if (errno == EINTR) continue; return; }   // nowhere to report it
+        p += w; n -= (std::size_t)w;
+    }
+}
+
+void Console::drain(){
+    if (!len) return;
+    std::cout.flush();
+    out(buf.data(), len);
+    len = 0;
+}
+
+void Console::write(const void* p, std::size_t n){
+    if (!n) return;
+    std::lock_guard<std::mutex> lk(mu);
+    if (muted) return;
+    const char* s = static_cast<const char*>(p);
+    st.bytes += n;
+    if (len + n > buf.size()) {
+        drain();
+        if (n >= buf.size()) { std::cout.flush(); out(s, n); return; }
+    }
+    std::memcpy(buf.data() + len, s, n);
+    len += n;
+    if (len == buf.size() || (policy == Policy::Line && std::memchr(s, '\n', n))) drain();
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Guest console output (print/putchar/write ECALLs and the UART). Bytes
+// collect in a per-guest buffer and reach the host in one write(2) when a
+// newline arrives (Line policy), the buffer fills, the guest exits, or the
+// owner calls flush(). std::cout is flushed first each time, so host and
+// guest text keep their program order at every flush.
+class Console {
+public:
+    enum class Policy : uint8_t {
+        Line,        // flush at each newline: interactive, still one write per line
+        Full         // flush only when full, on exit or on demand: throughput
+    };
+    static constexpr std::size_t CAP = 64 * 1024;
+
+    explicit Console(int fd = 1, std::size_t cap = CAP) : buf(cap), fd(fd) {}
+    ~Console(){ flush(); }
+    Console(const Console&) = delete;
+    Console& operator=(const Console&) = delete;
+
+    void put(uint8_t c){
+        std::lock_guard<std::mutex> lk(mu);     // harts on other threads share the UART
+        if (muted) return;
+        buf[len++] = (char)c;
+        ++st.bytes;
+        if (len == buf.size() || (c == '\n' && policy == Policy::Line)) drain();
+    }
+    // one guest span; spans bigger than the buffer go straight out
+    void write(const void* p, std::size_t n);
+    void flush(){ std::lock_guard<std::mutex> lk(mu); drain(); }
+
+    void set_fd(int f){ flush(); fd = f; }
+    void set_policy(Policy p){ policy = p; }
+    // drop guest output (a debugger replaying what was already printed)
+    void set_muted(bool m){ flush(); muted = m; }
+    bool is_muted() const { return muted; }
+    Policy get_policy() const { return policy; }
+    static Policy& default_policy(){ static Policy p = Policy::Line; return p; }
+
+    struct Stats { uint64_t bytes{0}, writes{0}; };   // guest bytes, host write(2) calls
+    const Stats& stats() const { return st; }
+
+private:
+    void drain();                                   // mu held
+    void out(const char* p, std::size_t n);
+
+    std::mutex mu;
+    std::vector<char> buf;
+    std::size_t len{0};
+    int fd;
+    Policy policy{default_policy()};
+    bool muted{false};
+    Stats st;
+};
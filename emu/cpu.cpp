@@ -1,128 +1,504 @@
 #include "cpu.hpp"
 #include "mem.hpp"
 #include <cstdint>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <vector>
 #include "trace.hpp"
+#include "jit.hpp"
+#include <stdexcept>
+#include <type_traits>
+#include <csetjmp>
+#include <atomic>
+#include <mutex>
+#include "fastmem.hpp"
+#include "bpred.hpp"
+#include "cache.hpp"
+#include "mmu.hpp"
+#include "profile.hpp"
+#include "debug.hpp"
 
 
-static inline uint32_t get_bits(uint32_t v,int pos,int len){ return (v>>pos)&((1u<<len)-1u); }
-static inline int32_t  sign_extend(uint32_t v,int bits){ uint32_t m=1u<<(bits-1); return (int32_t)((v^m)-m); }
+// a guest pointer argument: virtual while the hart translates
+static uint8_t guest_load8(CPU& c, Memory& mem, uint32_t va){
+    return c.mmu && (c.satp & Mmu::SATP_SV32) ? c.mmu->load<uint8_t>(va) : mem.load8(va);
+}
+static uint32_t guest_load32(CPU& c, Memory& mem, uint32_t va){
+    return c.mmu && (c.satp & Mmu::SATP_SV32) ? c.mmu->load<uint32_t>(va) : mem.load32(va);
+}
+static void guest_store8(CPU& c, Memory& mem, uint32_t va, uint8_t v){
+    if (c.mmu && (c.satp & Mmu::SATP_SV32)) c.mmu->store<uint8_t>(va, v); else mem.store8(va, v);
+}
 
-bool CPU::step(Memory& mem){
-    if (halted) return false;
+// Bulk-memory ECALLs: check the guest range once, then host memmove/memset/
+// memcmp/memchr straight on RAM. A translating hart, or a range touching a
+// device page, takes the byte path instead: same result, no speedup. A bad
+// range faults like the equivalent loads/stores (pc stays on the ECALL).
+// Each returns the bytes it processed, for CPU::bulk_cost.
+static uint32_t bulk_copy(CPU& c, Memory& mem, uint32_t dst, uint32_t src, uint32_t n){
+    const bool virt = c.mmu && (c.satp & Mmu::SATP_SV32);
+    if (const uint8_t* s = virt ? nullptr : mem.ram_span(src, n)) {
+        if (dst < src + n && src < dst + n) {                 // overlap: memmove semantics
+            std::vector<uint8_t> tmp(s, s + n);
+            mem.write_bytes(dst, tmp.data(), n);
+        } else {
+            mem.write_bytes(dst, s, n);
+        }
+    } else if (dst > src && dst < src + n) {
+        for (uint32_t i = n; i--; ) guest_store8(c, mem, dst + i, guest_load8(c, mem, src + i));
+    } else {
+        for (uint32_t i = 0; i < n; ++i) guest_store8(c, mem, dst + i, guest_load8(c, mem, src + i));
+    }
+    return n;
+}
+static uint32_t bulk_set(CPU& c, Memory& mem, uint32_t dst, uint8_t v, uint32_t n){
+    if (c.mmu && (c.satp & Mmu::SATP_SV32)) for (uint32_t i = 0; i < n; ++i) guest_store8(c, mem, dst + i, v);
+    else mem.fill(dst, v, n);
+    return n;
+}
+static uint32_t bulk_cmp(CPU& c, Memory& mem, uint32_t a, uint32_t b, uint32_t n, int& r){
+    const bool virt = c.mmu && (c.satp & Mmu::SATP_SV32);
+    const uint8_t* pa = virt ? nullptr : mem.ram_span(a, n);
+    const uint8_t* pb = virt ? nullptr : mem.ram_span(b, n);
+    if (pa && pb) { r = std::memcmp(pa, pb, n); return n; }
+    for (uint32_t i = 0; i < n; ++i) {
+        uint8_t x = guest_load8(c, mem, a + i), y = guest_load8(c, mem, b + i);
+        if (x != y) { r = x < y ? -1 : 1; return i + 1; }
+    }
+    r = 0;
+    return n;
+}
+static uint32_t bulk_strlen(CPU& c, Memory& mem, uint32_t s, uint32_t& len){
+    uint32_t p = s;
+    if (!(c.mmu && (c.satp & Mmu::SATP_SV32))) {
+        for (;;) {                                            // page by page through RAM
+            uint32_t chunk = Bus::PAGE - (p & (Bus::PAGE - 1));
+            if ((uint64_t)p + chunk > mem.size()) chunk = p < mem.size() ? (uint32_t)mem.size() - p : 0;
+            const uint8_t* sp = chunk ? mem.ram_span(p, chunk) : nullptr;
+            if (!sp) break;                                   // device page or the end: bytes from here
+            if (const void* z = std::memchr(sp, 0, chunk)) {
+                len = p - s + (uint32_t)((const uint8_t*)z - sp);
+                return len + 1;
+            }
+            p += chunk;
+        }
+    }
+    while (guest_load8(c, mem, p)) ++p;
+    len = p - s;
+    return len + 1;
+}
+
+// ECALL: a7 = id, a0/a1 = args, result in a0. false: run it again when
+// the task resumes (pc stays on the ECALL)
+static bool do_ecall(CPU& c, Memory& mem){
+    uint32_t id=c.x[17], a0=c.x[10], a1=c.x[11], a2=c.x[12];
+    auto charge = [&](uint32_t bytes){
+        uint32_t bpc = std::max(c.bulk_cost.bytes_per_cycle, 1u);
+        c.ecall_cycles = c.bulk_cost.setup + (uint32_t)(((uint64_t)bytes + bpc - 1) / bpc);
+    };
+    std::lock_guard<std::mutex> lk(mem.syscall_mutex());   // harts may run on other threads
+    switch(id){
+        case 0: c.exit_code=a0; c.halted=true; mem.console().flush(); break;   // exit(a0)
+        case 1: { char b[12]; int k=std::snprintf(b,sizeof b,"%u\n",a0); mem.console().write(b,(std::size_t)k); break; } // print_u32
+        case 2: mem.console().put((uint8_t)a0); break;          // putchar
+        case 3: c.x[10]=mem.sbrk((int32_t)a0); break;           // sbrk
+        case 4: {                                               // write_str(ptr, len)
+            const uint8_t* p = c.mmu && (c.satp & Mmu::SATP_SV32) ? nullptr : mem.ram_span(a0,a1);
+            if(p) mem.console().write(p,a1);                    // one span, no per-byte loads
+            else for(uint32_t i=0;i<a1;i++) mem.console().put(guest_load8(c,mem,a0+i));
+            break;
+        }
+        case 5: c.x[10]=mem.malloc32(a0); break;                // malloc
+        case 6: mem.free32(a0); break;                          // free
+        case 7: c.yielded=true; break;                          // yield
+        case 8: c.x[10]=mem.input(mem.time()); break;          // get_time
+        case 9:                                                 // lock(addr)
+            if(!mem.try_lock(a0)) {                             // block: yield, retry on resume
+                c.yielded=true;
+                if(mem.parking()) { c.waiting=CPU::Wait::Lock; c.wait_addr=a0; }
+                return false;
+            }
+            break;
+        case 10: mem.unlock(a0); break;                         // unlock(addr)
+        case 11:                                                // futex_wait(addr, expected)
+            if(guest_load32(c,mem,a0)!=a1) { c.x[10]=1; break; } // changed already: don't sleep
+            c.x[10]=0; c.yielded=true;                          // resumes past the ECALL when woken
+            if(mem.parking()) { c.waiting=CPU::Wait::Futex; c.wait_addr=a0; mem.futex_park(a0); }
+            break;
+        case 12: c.x[10]=mem.futex_wake(a0,a1); break;          // futex_wake(addr, n) -> woken
+        case 13: charge(bulk_copy(c,mem,a0,a1,a2)); break;      // memcpy(dst, src, n) -> dst (overlap ok)
+        case 14: charge(bulk_set(c,mem,a0,(uint8_t)a1,a2)); break; // memset(dst, byte, n) -> dst
+        case 15: { int r=0; charge(bulk_cmp(c,mem,a0,a1,a2,r)); c.x[10]=(uint32_t)(r>0)-(uint32_t)(r<0); break; } // memcmp -> -1/0/1
+        case 16: { uint32_t n=0; charge(bulk_strlen(c,mem,a0,n)); c.x[10]=n; break; } // strlen(s)
+        default: std::cerr<<"[ecall] unsupported "<<id<<"\n"; c.halted=true; c.exit_code=(uint32_t)-1; break;
+    }
+    return true;
+}
+
+// RV32A read-modify-write on a guest word; returns the old value
+static uint32_t amo(Op op, uint32_t* w, uint32_t v){
+    constexpr int SC = __ATOMIC_SEQ_CST;
+    switch(op){
+        case Op::AmoSwap: return __atomic_exchange_n(w, v, SC);
+        case Op::AmoAdd:  return __atomic_fetch_add(w, v, SC);
+        case Op::AmoXor:  return __atomic_fetch_xor(w, v, SC);
+        case Op::AmoAnd:  return __atomic_fetch_and(w, v, SC);
+        case Op::AmoOr:   return __atomic_fetch_or(w, v, SC);
+        default: break;
+    }
+    uint32_t old = __atomic_load_n(w, SC), nv;
+    do {
+        switch(op){
+            case Op::AmoMin:  nv = (int32_t)old < (int32_t)v ? old : v; break;
+            case Op::AmoMax:  nv = (int32_t)old > (int32_t)v ? old : v; break;
+            case Op::AmoMinu: nv = old < v ? old : v; break;
+            default:          nv = old > v ? old : v; break;   // AmoMaxu
+        }
+    } while (!__atomic_compare_exchange_n(w, &old, nv, true, SC, SC));
+    return old;
+}
+
+const char* exit_name(Exit e){
+    switch(e){
+        case Exit::Halt:       return "halt";
+        case Exit::Yield:      return "yield";
+        case Exit::Quantum:    return "quantum";
+        case Exit::Breakpoint: return "breakpoint";
+        case Exit::Trap:       return "trap";
+        case Exit::Budget:     return "budget";
+        case Exit::Watchpoint: return "watchpoint";
+    }
+    return "?";
+}
+
+// Threaded dispatch: every handler ends in its own fetch + indirect jump
+// (NEXT), so the host predictor sees one jump site per guest opcode.
+// Compilers without labels-as-values get a switch of gotos instead.
+#if defined(__GNUC__) || defined(__clang__)
+#define SEEDOS_THREADED 1
+#else
+#define SEEDOS_THREADED 0
+#endif
+
+struct NoGuard { explicit NoGuard(const uint8_t*){} };
+
+template<unsigned F>
+RunExit CPU::run_loop(Memory& mem, uint64_t max_insns){
+    constexpr bool Bps = F & FeatBreakpoints;
+    RunExit ex{Exit::Budget, 0};
+    if (halted) { ex.reason = Exit::Halt; return ex; }
     yielded = false;
+    if (max_insns == 0) return ex;
+
+    DecodeCache* dc;                          // set past the sigsetjmp below
+    uint32_t& ticks = mem.tick_sink();        // FeatTimer is only set while the timer runs
+    Decoded d; const Decoded* dp = nullptr;   // dp: the cache slot d was copied from
+    uint32_t ipc = pc, stall = 0;             // FeatTiming: pc of d, model cycles so far
+    std::conditional_t<(F & FeatFastmem) != 0, fastmem::Guard, NoGuard> guard(mem.host_base());
+    const uint64_t instret0 = instret;
+    if constexpr (F & FeatMmu) mmu->bind(satp);
 
-    uint32_t inst   = mem.load32(pc);
-    uint32_t opcode = get_bits(inst,0,7);
-    uint32_t rd     = get_bits(inst,7,5);
-    uint32_t funct3 = get_bits(inst,12,3);
-    uint32_t rs1    = get_bits(inst,15,5);
-
-    uint32_t cost = 1;
-
-    if(opcode==0x13){ // ADDI
-        if(funct3!=0b000) return false;
-        int32_t imm = sign_extend(get_bits(inst,20,12),12);
-        if(rd!=0) x[rd] = (uint32_t)((int32_t)x[rs1] + imm);
-        pc += 4;
-
-    } else if(opcode==0x33){ // R-type subset
-        uint32_t rs2=get_bits(inst,20,5), f7=get_bits(inst,25,7);
-        if(funct3==0b000 && f7==0)               { if(rd!=0) x[rd]=x[rs1]+x[rs2];             pc+=4; }
-        else if(funct3==0b000 && f7==0b0100000)  { if(rd!=0) x[rd]=x[rs1]-x[rs2];             pc+=4; }
-        else if(funct3==0b001 && f7==0)          { if(rd!=0) x[rd]=x[rs1]<<(x[rs2]&31u);      pc+=4; }
-        else if(funct3==0b101 && f7==0)          { if(rd!=0) x[rd]=x[rs1]>>(x[rs2]&31u);      pc+=4; }
-        else if(funct3==0b101 && f7==0b0100000)  { if(rd!=0) x[rd]=(uint32_t)((int32_t)x[rs1]>>(int)(x[rs2]&31u)); pc+=4; }
-        else if(funct3==0b010 && f7==0)          { if(rd!=0) x[rd]=((int32_t)x[rs1]<(int32_t)x[rs2])?1u:0u; pc+=4; }
-        else if(funct3==0b011 && f7==0)          { if(rd!=0) x[rd]=(x[rs1]<x[rs2])?1u:0u;     pc+=4; }
-        else return false;
-
-    } else if(opcode==0x37){ // LUI
-        if(rd!=0) x[rd]=get_bits(inst,12,20)<<12; pc+=4;
-
-    } else if(opcode==0x63){ // branches
-        uint32_t rs2=get_bits(inst,20,5), i12=get_bits(inst,31,1), i10_5=get_bits(inst,25,6), i4_1=get_bits(inst,8,4), i11=get_bits(inst,7,1);
-        int32_t off=sign_extend((i12<<12)|(i11<<11)|(i10_5<<5)|(i4_1<<1),13);
-        if     (funct3==0b000) pc=(x[rs1]==x[rs2])?pc+off:pc+4;
-        else if(funct3==0b001) pc=(x[rs1]!=x[rs2])?pc+off:pc+4;
-        else if(funct3==0b100) pc=((int32_t)x[rs1]<(int32_t)x[rs2])?pc+off:pc+4;
-        else if(funct3==0b101) pc=((int32_t)x[rs1]>=(int32_t)x[rs2])?pc+off:pc+4;
-        else if(funct3==0b110) pc=(x[rs1]<x[rs2])?pc+off:pc+4;
-        else if(funct3==0b111) pc=(x[rs1]>=x[rs2])?pc+off:pc+4;
-        else return false;
-
-    } else if(opcode==0x03){ // LW
-        if(funct3!=0b010) return false;
-        int32_t imm=sign_extend(get_bits(inst,20,12),12);
-        if(rd!=0) x[rd]=mem.load32(x[rs1]+(uint32_t)imm);
-        pc+=4; cost+=2;
-
-    } else if(opcode==0x23){ // SW
-        uint32_t i11_5=get_bits(inst,25,7), i4_0=get_bits(inst,7,5), rs2=get_bits(inst,20,5);
-        int32_t imm=sign_extend((i11_5<<5)|i4_0,12);
-        if(funct3!=0b010) return false;
-        mem.store32(x[rs1]+(uint32_t)imm, x[rs2]);
-        pc+=4; cost+=2;
-
-    } else if(opcode==0x6F){ // JAL
-        uint32_t i20=get_bits(inst,31,1), i10_1=get_bits(inst,21,10), i11=get_bits(inst,20,1), i19_12=get_bits(inst,12,8);
-        int32_t off=sign_extend((i20<<20)|(i19_12<<12)|(i11<<11)|(i10_1<<1),21);
-        uint32_t ret=pc+4; pc=pc+off; if(rd!=0) x[rd]=ret; cost+=1;
-
-    } else if(opcode==0x67){ // JALR
-        if(funct3!=0b000) return false;
-        int32_t imm=sign_extend(get_bits(inst,20,12),12);
-        uint32_t ret=pc+4; uint32_t tgt=(x[rs1]+(uint32_t)imm)&~1u;
-        pc=tgt; if(rd!=0) x[rd]=ret; cost+=1;
-
-    } else if(opcode==0x73){ // SYSTEM
-        uint32_t imm12=get_bits(inst,20,12);
-        if(funct3==0 && imm12==0){ // ECALL
-            uint32_t id=x[17], a0=x[10], a1=x[11];
-            switch(id){
-                case 0: exit_code=a0; halted=true; break;               // exit(a0)
-                case 1: std::cout<<a0<<"\n"; break;                     // print_u32
-                case 2: std::cout<<(char)(a0&0xFF)<<std::flush; break;  // putchar
-                case 3: x[10]=mem.sbrk((int32_t)a0); break;             // sbrk
-                case 4: for(uint32_t i=0;i<a1;i++) std::cout<<(char)mem.load8(a0+i); std::cout.flush(); break; // write_str
-                case 5: x[10]=mem.malloc32(a0); break;                  // malloc
-                case 6: mem.free32(a0); break;                          // free
-                case 7: yielded=true; break;                            // yield
-                case 8: x[10]=mem.time(); break;                        // get_time
-                case 9: {                                               // lock(addr)
-                    if(!mem.try_lock(a0)) { yielded=true; }             // block by yielding
-                    break;
-                }
-                case 10: mem.unlock(a0); break;                         // unlock(addr)
-                default: std::cerr<<"[ecall] unsupported "<<id<<"\n"; halted=true; exit_code=(uint32_t)-1; break;
+    // per-instruction bookkeeping, same order as the old step(); true = leave
+    // the loop. Only ECALL/EBREAK (sys) can halt or yield outside preemption.
+    auto retire = [&](uint32_t cost, bool sys) -> bool {
+        if constexpr (!(F & FeatCost)) cost = 1;
+        if constexpr (F & FeatTiming) {
+            // the fetch is charged here, not in FETCH(): an instruction that
+            // faults and is redone goes through the model only once
+            if (caches) cost += caches->fetch(ipc);
+            cost += stall;
+            stall = 0;
+            if (profiler) profiler->retire(ipc, cost + 1);
+        }
+        x[0]=0;
+        instret += 1;
+        if constexpr (F & FeatTimer) ticks += cost;
+        bool timed = false;
+        if constexpr (F & FeatPreempt) {
+            timed = quantum != 0;
+            if (quantum && ++slice_count >= quantum){
+                yielded = true; slice_count = 0;
             }
-            pc+=4;
-        } else if(funct3==0 && imm12==1){ halted=true; pc+=4; }
-        else return false;
+        }
+        if constexpr (F & FeatTrace) {
+            // record one retired instruction (pc already holds the *next* pc)
+            cycles += cost;
+            global_trace().push(tid, pc, major_opcode(d.op), (uint32_t)cycles, instret);
+            cycles++;
+        } else {
+            cycles += cost + 1;     // + 1: we retired one instruction
+        }
+        if constexpr (F & FeatPreempt)
+            if (quantum > 0) --quantum; // count down the time slice (the "timer")
+        ++ex.insns;
+        if (sys && halted)        { ex.reason = Exit::Halt;    return true; }
+        if ((F & FeatPreempt) && timed && quantum==0) { ex.reason = Exit::Quantum; return true; }
+        if (((F & FeatPreempt) || sys) && yielded)    { ex.reason = Exit::Yield;   return true; }
+        return ex.insns >= max_insns;
+    };
 
-    } else return false;
+#if SEEDOS_THREADED
+    static void* const labels[(unsigned)Op::Count] = {
+        &&op_illegal, &&op_illegal,
+        &&op_addi, &&op_add, &&op_sub, &&op_sll, &&op_srl, &&op_sra, &&op_slt, &&op_sltu,
+        &&op_lui, &&op_auipc,
+        &&op_beq, &&op_bne, &&op_blt, &&op_bge, &&op_bltu, &&op_bgeu,
+        &&op_lb, &&op_lh, &&op_lw, &&op_lbu, &&op_lhu,
+        &&op_sb, &&op_sh, &&op_sw,
+        &&op_jal, &&op_jalr,
+        &&op_ecall, &&op_ebreak,
+        &&op_fence, &&op_fence_i, &&op_sfence_vma,
+        &&op_csr, &&op_csr, &&op_csr, &&op_csr, &&op_csr, &&op_csr,
+        &&op_lr, &&op_sc,
+        &&op_amo, &&op_amo, &&op_amo, &&op_amo, &&op_amo, &&op_amo, &&op_amo, &&op_amo, &&op_amo,
+        &&fu_lui_addi, &&fu_auipc_addi, &&fu_auipc_jalr, &&fu_addi_branch, &&fu_add_lw, &&fu_lui_lw,
+    };
+#define DISPATCH() goto *labels[(unsigned)d.op]
+#else
+#define DISPATCH() do { switch(d.op){ \
+        case Op::Addi: goto op_addi; case Op::Add:  goto op_add;  case Op::Sub:  goto op_sub;  \
+        case Op::Sll:  goto op_sll;  case Op::Srl:  goto op_srl;  case Op::Sra:  goto op_sra;  \
+        case Op::Slt:  goto op_slt;  case Op::Sltu: goto op_sltu; case Op::Lui:  goto op_lui;  case Op::Auipc: goto op_auipc; \
+        case Op::Beq:  goto op_beq;  case Op::Bne:  goto op_bne;  case Op::Blt:  goto op_blt;  \
+        case Op::Bge:  goto op_bge;  case Op::Bltu: goto op_bltu; case Op::Bgeu: goto op_bgeu; \
+        case Op::Lb:   goto op_lb;   case Op::Lh:   goto op_lh;   case Op::Lw:   goto op_lw;   \
+        case Op::Lbu:  goto op_lbu;  case Op::Lhu:  goto op_lhu;  case Op::Sb:   goto op_sb;   \
+        case Op::Sh:   goto op_sh;   case Op::Sw:   goto op_sw;   case Op::Jal:  goto op_jal;  \
+        case Op::Jalr: goto op_jalr; case Op::Ecall: goto op_ecall; case Op::Ebreak: goto op_ebreak; \
+        case Op::Fence: goto op_fence; case Op::FenceI: goto op_fence_i; case Op::SfenceVma: goto op_sfence_vma; \
+        case Op::CsrRw: case Op::CsrRs: case Op::CsrRc: \
+        case Op::CsrRwi: case Op::CsrRsi: case Op::CsrRci: goto op_csr; \
+        case Op::LrW:  goto op_lr;   case Op::ScW:  goto op_sc;   \
+        case Op::AmoSwap: case Op::AmoAdd: case Op::AmoXor: case Op::AmoAnd: case Op::AmoOr: \
+        case Op::AmoMin: case Op::AmoMax: case Op::AmoMinu: case Op::AmoMaxu: goto op_amo; \
+        case Op::FuseLuiAddi: goto fu_lui_addi; case Op::FuseAuipcAddi: goto fu_auipc_addi; \
+        case Op::FuseAuipcJalr: goto fu_auipc_jalr; case Op::FuseAddiBranch: goto fu_addi_branch; \
+        case Op::FuseAddLw: goto fu_add_lw; case Op::FuseLuiLw: goto fu_lui_lw; \
+        default: goto op_illegal; } } while(0)
+#endif
 
-    x[0]=0;
-    instret += 1;
-    cycles  += cost;
-    mem.tick(cost);
+#define FETCH() do { \
+        if (Bps && breakpoints->count(pc)) { ex.reason = Exit::Breakpoint; goto out; } \
+        if (F & FeatTiming) ipc = pc; \
+        dp = &dc->fetch(mem, (F & FeatMmu) ? mmu->fetch(pc) : pc); \
+        d = *dp;                          /* copy: a store may invalidate the slot */ \
+        if (Bps) d.op = base_op(d.op);    /* a breakpoint may sit between a pair */ \
+        DISPATCH(); } while(0)
+// fused pair: first half is done, retire it, then run the next slot's
+// handler directly (no fetch, no cache lookup)
+#define SECOND(cost) do { if (retire(cost, false)) goto out; d = dp[1]; \
+        if (F & FeatTiming) ipc = pc; } while(0)
+#define NEXT(cost) do { if (retire(cost, false)) goto out; FETCH(); } while(0)
+#define SYS_NEXT(cost) do { if (retire(cost, true)) goto out; FETCH(); } while(0)
+#define LOAD(N, a)     ((F & FeatMmu) ? mmu->load<uint##N##_t>(a) \
+                        : (F & FeatFastmem) ? mem.fast_load<uint##N##_t>(a) : mem.load##N(a))
+#define STORE(N, a, v) ((F & FeatMmu) ? mmu->store<uint##N##_t>(a, (uint##N##_t)(v)) \
+                        : (F & FeatFastmem) ? mem.fast_store<uint##N##_t>(a, (uint##N##_t)(v)) : mem.store##N(a, (uint##N##_t)(v)))
+// physical address of an atomic access
+#define PHYS(a, acc)   ((F & FeatMmu) ? mmu->translate(a, Mmu::acc) : (a))
+// data side of the cache model, after the access so a faulting one isn't counted
+#define DATA(a, w) do { if constexpr ((F & FeatTiming) != 0) if (caches) stall += caches->data(a, w); } while(0)
+// branch predictor and profiler, before pc moves: a conditional branch / JAL or JALR to target
+#define BRANCH(cond) do { bool t_ = (cond); \
+        if constexpr ((F & FeatTiming) != 0) if (bpred) stall += bpred->branch(pc, d.imm, t_); \
+        pc = t_ ? pc+d.imm : pc+4; } while(0)
+#define JUMP(target, jalr) do { if constexpr ((F & FeatTiming) != 0) { \
+        if (bpred) stall += bpred->jump(pc, target, d.rd, d.rs1, jalr); \
+        if (profiler) profiler->jump(pc, d.rd, d.rs1, jalr, target); } } while(0)
+#define EA   (RS1+(uint32_t)d.imm)
+#define RD   d.rd
+#define RS1  x[d.rs1]
+#define RS2  x[d.rs2]
 
-    if (quantum && ++slice_count >= quantum){
-        yielded = true; slice_count = 0;
+    try {
+        if constexpr (F & FeatFastmem) {
+            // a faulting LW/SW lands here with nothing written (the barrier in
+            // fast_load32/fast_store32 keeps CPU state in memory up to the
+            // access). Redo it through the checked accessors: they trap, or
+            // serve the timer page; then carry on at full speed. Locals
+            // written since sigsetjmp are indeterminate here: set them again.
+            // The redo runs disarmed, so a fault in it can't land back here.
+            if (sigsetjmp(guard.env, 0)) {
+                ex = RunExit{Exit::Budget, instret - instret0};
+                stall = 0; ipc = pc; dp = nullptr;
+                guard.disarm();
+                RunExit r = run_loop<F & ~(FeatFastmem | FeatBreakpoints)>(mem, 1);
+                guard.rearm();
+                ex.insns += r.insns;
+                if (r.reason != Exit::Budget) { ex.reason = r.reason; goto out; }
+                if (ex.insns >= max_insns) goto out;
+            }
+        }
+        dc = &mem.icache();     // not live across sigsetjmp, so a longjmp can't clobber it
+        FETCH();
+
+    op_addi: if(RD) x[RD]=RS1+(uint32_t)d.imm;                    pc+=4; NEXT(1);
+    op_add:  if(RD) x[RD]=RS1+RS2;                                pc+=4; NEXT(1);
+    op_sub:  if(RD) x[RD]=RS1-RS2;                                pc+=4; NEXT(1);
+    op_sll:  if(RD) x[RD]=RS1<<(RS2&31u);                         pc+=4; NEXT(1);
+    op_srl:  if(RD) x[RD]=RS1>>(RS2&31u);                         pc+=4; NEXT(1);
+    op_sra:  if(RD) x[RD]=(uint32_t)((int32_t)RS1>>(int)(RS2&31u)); pc+=4; NEXT(1);
+    op_slt:  if(RD) x[RD]=((int32_t)RS1<(int32_t)RS2)?1u:0u;      pc+=4; NEXT(1);
+    op_sltu: if(RD) x[RD]=(RS1<RS2)?1u:0u;                        pc+=4; NEXT(1);
+
+    op_lui:  if(RD) x[RD]=(uint32_t)d.imm;                        pc+=4; NEXT(1);
+    op_auipc: if(RD) x[RD]=pc+(uint32_t)d.imm;                    pc+=4; NEXT(1);
+
+    op_beq:  BRANCH(RS1==RS2);                                    NEXT(1);
+    op_bne:  BRANCH(RS1!=RS2);                                    NEXT(1);
+    op_blt:  BRANCH((int32_t)RS1<(int32_t)RS2);                   NEXT(1);
+    op_bge:  BRANCH((int32_t)RS1>=(int32_t)RS2);                  NEXT(1);
+    op_bltu: BRANCH(RS1<RS2);                                     NEXT(1);
+    op_bgeu: BRANCH(RS1>=RS2);                                    NEXT(1);
+
+    op_lb:  { uint32_t a=EA; if(RD) x[RD]=(uint32_t)(int8_t)LOAD(8, a);   DATA(a, false); } pc+=4; NEXT(3);
+    op_lh:  { uint32_t a=EA; if(RD) x[RD]=(uint32_t)(int16_t)LOAD(16, a); DATA(a, false); } pc+=4; NEXT(3);
+    op_lw:  { uint32_t a=EA; if(RD) x[RD]=LOAD(32, a);                    DATA(a, false); } pc+=4; NEXT(3);
+    op_lbu: { uint32_t a=EA; if(RD) x[RD]=LOAD(8, a);                     DATA(a, false); } pc+=4; NEXT(3);
+    op_lhu: { uint32_t a=EA; if(RD) x[RD]=LOAD(16, a);                    DATA(a, false); } pc+=4; NEXT(3);
+    op_sb:  { uint32_t a=EA; STORE(8, a, RS2);                            DATA(a, true);  } pc+=4; NEXT(3);
+    op_sh:  { uint32_t a=EA; STORE(16, a, RS2);                           DATA(a, true);  } pc+=4; NEXT(3);
+    op_sw:  { uint32_t a=EA; STORE(32, a, RS2);                           DATA(a, true);  } pc+=4; NEXT(3);
+
+    op_jal:  { uint32_t ret=pc+4; JUMP(pc+d.imm, false); pc=pc+d.imm; if(RD) x[RD]=ret; } NEXT(2);
+    op_jalr: { uint32_t ret=pc+4, t=(RS1+(uint32_t)d.imm)&~1u; JUMP(t, true); pc=t; if(RD) x[RD]=ret; } NEXT(2);
+
+    // FENCE: guest plain accesses are host plain accesses, so order them
+    // with a full host fence. FENCE.I: pick up other harts' code writes.
+    op_fence:   std::atomic_thread_fence(std::memory_order_seq_cst); pc+=4; NEXT(1);
+    op_fence_i: std::atomic_thread_fence(std::memory_order_seq_cst); dc->clear(); pc+=4; NEXT(1);
+
+    // LR/SC: the reservation remembers the loaded value and SC is a
+    // compare-and-swap against it (a concurrent store of the same value
+    // goes unnoticed, as in most emulators)
+    op_lr: { uint32_t a=RS1, p=PHYS(a, Read); uint32_t v=__atomic_load_n(mem.atomic_word(p, false), __ATOMIC_SEQ_CST);
+             resv=true; resv_addr=p; resv_val=v; if(RD) x[RD]=v; DATA(a, false); } pc+=4; NEXT(3);
+    op_sc: { uint32_t a=RS1, p=PHYS(a, Write); uint32_t* w=mem.atomic_word(p); uint32_t expect=resv_val;
+             bool ok = resv && resv_addr==p
+                    && __atomic_compare_exchange_n(w, &expect, RS2, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+             mem.atomic_done(); resv=false; if(ok) dc->invalidate(p, 4); if(RD) x[RD]=ok?0u:1u; DATA(a, true); } pc+=4; NEXT(3);
+    op_amo: { uint32_t a=RS1, p=PHYS(a, Write); uint32_t old=amo(d.op, mem.atomic_word(p), RS2); mem.atomic_done();
+              dc->invalidate(p, 4); if(RD) x[RD]=old; DATA(a, true); }        pc+=4; NEXT(3);
+
+    // SFENCE.VMA: rs1 = x0 drops every TLB entry, else the one for rs1's page
+    // (ASIDs are not tracked, so rs2 doesn't matter)
+    op_sfence_vma: if (mmu) { if (d.rs1) mmu->flush_page(RS1); else mmu->flush(); } pc+=4; NEXT(1);
+
+    // Zicsr: read, then write unless CSRRS/CSRRC[I] have nothing to set or
+    // clear. A satp write that turns translation on or off retires and
+    // leaves; run_variant() carries on in the other loop.
+    op_csr: { const bool imm = d.op >= Op::CsrRwi, rw = d.op == Op::CsrRw || d.op == Op::CsrRwi;
+              const uint32_t n = (uint32_t)d.imm, src = imm ? d.rs1 : RS1;
+              uint32_t old;
+              if (!read_csr(n, mem, old)) goto op_illegal;
+              if (rw || d.rs1) {
+                  uint32_t v = rw ? src : (d.op == Op::CsrRs || d.op == Op::CsrRsi) ? old | src : old & ~src;
+                  if (!write_csr(n, v)) goto op_illegal;
+              }
+              if(RD) x[RD]=old; }
+              pc+=4;
+              if (mmu && ((satp & Mmu::SATP_SV32) != 0) != ((F & FeatMmu) != 0)) {
+                  if (!retire(1, false)) remap = true;
+                  goto out;
+              }
+              if constexpr (F & FeatMmu) mmu->bind(satp);
+              NEXT(1);
+
+    op_ecall:  ecall_cycles=0; if (do_ecall(*this, mem)) pc+=4;   SYS_NEXT(1 + ecall_cycles);
+    op_ebreak: if (debugger && debugger->planted((F & FeatMmu) ? mmu->fetch(pc) : pc)) {
+                   ex.reason = Exit::Breakpoint; goto out;       // not retired, like Bps
+               }
+               halted=true;          pc+=4;                       SYS_NEXT(1);
+
+    // fused pairs: per-instruction retire (trace, timer, quantum) is kept,
+    // so state and counters match unfused execution step for step
+    fu_lui_addi:    dc->count_fused(d.op); if(RD) x[RD]=(uint32_t)d.imm;     pc+=4; SECOND(1); goto op_addi;
+    fu_auipc_addi:  dc->count_fused(d.op); if(RD) x[RD]=pc+(uint32_t)d.imm;  pc+=4; SECOND(1); goto op_addi;
+    fu_auipc_jalr:  dc->count_fused(d.op); if(RD) x[RD]=pc+(uint32_t)d.imm;  pc+=4; SECOND(1); goto op_jalr;
+    fu_addi_branch: dc->count_fused(d.op); if(RD) x[RD]=RS1+(uint32_t)d.imm; pc+=4; SECOND(1); DISPATCH();
+    fu_add_lw:      dc->count_fused(d.op); if(RD) x[RD]=RS1+RS2;             pc+=4; SECOND(1); goto op_lw;
+    fu_lui_lw:      dc->count_fused(d.op); if(RD) x[RD]=(uint32_t)d.imm;     pc+=4; SECOND(1); goto op_lw;
+
+    op_illegal: ex.reason = Exit::Trap;
+    out:;
+    } catch (const std::out_of_range&) {
+        ex.reason = Exit::Trap;   // fetch/load/store fault: nothing was written
+    } catch (const Memory::WatchHit&) {
+        ex.reason = Exit::Watchpoint;   // checked before the store, same as a fault
     }
-    
-    
-    // record one retired instruction
-    global_trace().push(tid, pc /* NOTE: pc now holds *next* pc; we want the executed one */,
-                        opcode, (uint32_t)cycles, instret);
-    
-    
-    
-    
-    cycles++;                  // we retired one instruction
-    if (quantum > 0) --quantum; // count down the time slice (the "timer")
-    return true;
+    return ex;
 
-   
+#undef DISPATCH
+#undef FETCH
+#undef NEXT
+#undef SYS_NEXT
+#undef SECOND
+#undef LOAD
+#undef STORE
+#undef DATA
+#undef BRANCH
+#undef JUMP
+#undef PHYS
+#undef EA
+#undef RD
+#undef RS1
+#undef RS2
+}
+
+unsigned CPU::features(const Memory& mem) const {
+    unsigned f = 0;
+    if (breakpoints)                      f |= FeatBreakpoints;
+    if (global_trace().is_enabled())      f |= FeatTrace;
+    if (quantum)                          f |= FeatPreempt;
+    if (mem.timer_enabled())              f |= FeatTimer;
+    if (cost_model == CostModel::Table)   f |= FeatCost;
+    if (mem.backend() == MemBackend::Fastmem) f |= FeatFastmem;
+    if (caches || bpred || profiler)      f |= FeatTiming;
+    if (mmu && (satp & Mmu::SATP_SV32))   f |= FeatMmu;
+    return f;
+}
+
+// The loop a feature set runs in: translated accesses never use the
+// fastmem reservation, so Mmu sets share the loop without FeatFastmem.
+static constexpr unsigned loop_for(unsigned f){
+    return (f & FeatMmu) ? f & ~FeatFastmem : f;
+}
+
+// one instantiation per distinct loop, indexed by the feature bits
+RunExit CPU::run_variant(Memory& mem, uint64_t max_insns, unsigned f){
+    using Loop = RunExit (CPU::*)(Memory&, uint64_t);
+#define L2(f)  &CPU::run_loop<loop_for(f)>, &CPU::run_loop<loop_for(f+1)>
+#define L8(f)  L2(f), L2(f+2), L2(f+4), L2(f+6)
+#define L64(f) L8(f), L8(f+8), L8(f+16), L8(f+24), L8(f+32), L8(f+40), L8(f+48), L8(f+56)
+    static const Loop loops[FeatAll + 1] = { L64(0), L64(64), L64(128), L64(192) };
+#undef L2
+#undef L8
+#undef L64
+    RunExit ex = (this->*loops[f & FeatAll])(mem, max_insns);
+    while (remap) {          // satp switched translation: same features, other loop
+        remap = false;
+        f = (f & ~FeatMmu) | (features(mem) & FeatMmu);
+        RunExit more = (this->*loops[f & FeatAll])(mem, max_insns - ex.insns);
+        ex.reason = more.reason; ex.insns += more.insns;
+    }
+    return ex;
+}
+
+bool CPU::step(Memory& mem){
+    return run_variant(mem, 1, features(mem) & ~FeatBreakpoints).insns == 1;
+}
+
+RunExit CPU::run(Memory& mem, uint64_t max_insns){
+    unsigned f = features(mem);
+    // the JIT bakes in the table cost model and never traces, runs timing
+    // models or translates addresses
+    if (jit && !breakpoints && !debugger && !(f & (FeatTrace | FeatTiming | FeatMmu)) && (f & FeatCost))
+        return jit->run(*this, mem, max_insns);
+    return run_variant(mem, max_insns, f);
+}
 
+RunExit CPU::interpret(Memory& mem, uint64_t max_insns){
+    return run_variant(mem, max_insns, features(mem) & ~FeatBreakpoints);
 }
@@ -1,20 +1,106 @@
 #pragma once
 #include <cstdint>
+#include <unordered_set>
 class Memory;
+class Jit;
+class CacheHierarchy;
+class Mmu;
+class BranchPredictor;
+class Profiler;
+class Debugger;
+
+// why CPU::run handed control back
+enum class Exit : uint8_t {
+    Halt,        // exit ECALL / EBREAK, or already halted
+    Yield,       // yield/lock ECALL or slice_count hit the quantum
+    Quantum,     // quantum counted down to 0 (preemption timer)
+    Breakpoint,  // pc is in *breakpoints (nothing executed at that pc)
+    Trap,        // illegal instruction or memory fault (pc left on it)
+    Budget,      // max_insns retired
+    Watchpoint   // a store into a watched range (pc left on it, nothing written)
+};
+const char* exit_name(Exit e);
+
+struct RunExit { Exit reason; uint64_t insns; };
+
+// cycles charged per instruction (plus 1 for retiring it, plus cache
+// latencies and mispredict penalties when CPU::caches / CPU::bpred are set)
+enum class CostModel : uint8_t {
+    Table,       // LW/SW 3, JAL/JALR 2, everything else 1
+    Flat         // 1 for everything: cycles == 2*instret, for pure throughput runs
+};
+
+// optional work in the interpreter loop; each combination is its own
+// compiled loop, so a feature that is off costs nothing per instruction
+enum Feature : unsigned {
+    FeatBreakpoints = 1,   // breakpoints set: check pc before every fetch
+    FeatTrace       = 2,   // global_trace() enabled: record every retire
+    FeatPreempt     = 4,   // quantum != 0: slice/yield/quantum countdown
+    FeatTimer       = 8,   // Memory timer running: tick() per instruction
+    FeatCost        = 16,  // CostModel::Table; off = Flat
+    FeatFastmem     = 32,  // MemBackend::Fastmem: LW/SW are single host accesses
+    FeatTiming      = 64,  // caches, bpred or profiler set: fetches, data accesses and jumps feed them
+    FeatMmu         = 128, // mmu set and satp.MODE = Sv32: fetch and data addresses are virtual
+    FeatAll         = 255
+};
 
 struct CPU {
     // architectural state
     uint32_t x[32]{}; uint32_t pc{0};
+    uint32_t satp{0};  // Sv32: MODE (bit 31) | root page-table PPN; translated when mmu is set
+    // machine-mode CSRs (csr.hpp), plain storage for now
+    uint32_t mstatus{0}, mie{0}, mtvec{0}, mscratch{0}, mepc{0}, mcause{0}, mtval{0};
 
     // runtime flags/counters
     bool halted{false}; uint32_t exit_code{0};
     uint64_t cycles{0}, instret{0};
     uint32_t quantum{0}, slice_count{0}; bool yielded{false};
+    bool resv{false}; uint32_t resv_addr{0}, resv_val{0};   // LR/SC reservation
+    bool remap{false};   // a CSR write turned translation on/off: run() switches loops
+    CostModel cost_model{CostModel::Table};
+    // bulk-memory ECALLs (13-16) charge setup + bytes / bytes_per_cycle
+    // (rounded up) on top of the ECALL itself under CostModel::Table
+    struct BulkCost { uint32_t setup{8}, bytes_per_cycle{8}; } bulk_cost;
+    uint32_t ecall_cycles{0};   // that charge, for the ECALL being retired
 
     // scheduling metadata (not architectural)
     uint32_t tid{0};   // thread id (for prints/ownership if you want later)
     uint32_t prio{1};  // smaller number = higher priority
+    // set by a lock ECALL that found wait_addr taken, or a futex wait on it,
+    // while a scheduler parks tasks (sched.hpp)
+    enum class Wait : uint8_t { None, Lock, Futex };
+    Wait waiting{Wait::None}; uint32_t wait_addr{0};
+
+    // debugger hook: run() stops before executing any of these pcs
+    const std::unordered_set<uint32_t>* breakpoints{nullptr};
+    // patched-EBREAK breakpoints and watchpoints (debug.hpp): cost nothing
+    // until hit; an EBREAK it planted exits with Breakpoint instead of halting
+    Debugger* debugger{nullptr};
+
+    // optional translator (jit.hpp); used by run() when tracing, breakpoints, the debugger and timing models are off
+    Jit* jit{nullptr};
+
+    // optional timing models (cache.hpp, bpred.hpp); never translated
+    CacheHierarchy* caches{nullptr};
+    BranchPredictor* bpred{nullptr};
+    // optional sampling profiler (profile.hpp); shares the timing loop
+    Profiler* profiler{nullptr};
+
+    // Sv32 translation + TLB (mmu.hpp), used while satp.MODE is set; never translated
+    Mmu* mmu{nullptr};
+
+    bool step(Memory& mem);                           // exactly one instruction
+    RunExit run(Memory& mem, uint64_t max_insns);     // tight loop until an exit
+    RunExit interpret(Memory& mem, uint64_t max_insns); // run(), never translated
+
+    // Feature bits this CPU needs right now; run() enters that loop
+    unsigned features(const Memory& mem) const;
+
+    // Zicsr access by CSR number (csr.cpp); false = illegal instruction
+    bool read_csr(uint32_t n, const Memory& mem, uint32_t& v) const;
+    bool write_csr(uint32_t n, uint32_t v);
 
-    bool step(Memory& mem);
-    
+private:
+    RunExit run_variant(Memory& mem, uint64_t max_insns, unsigned features);
+    template<unsigned F> RunExit run_loop(Memory& mem, uint64_t max_insns);
 };
@@ -0,0 +1,75 @@
+#include "csr.hpp"
+#include "cpu.hpp"
+#include "mem.hpp"
+#include "mmu.hpp"
+
+const char* csr::name(uint32_t n){
+    switch (n) {
+        case SATP: return "satp";
+        case MSTATUS: return "mstatus";     case MISA: return "misa";
+        case MIE: return "mie";             case MTVEC: return "mtvec";
+        case MSCRATCH: return "mscratch";   case MEPC: return "mepc";
+        case MCAUSE: return "mcause";       case MTVAL: return "mtval";
+        case MIP: return "mip";
+        case MCYCLE: return "mcycle";       case MINSTRET: return "minstret";
+        case MCYCLEH: return "mcycleh";     case MINSTRETH: return "minstreth";
+        case CYCLE: return "cycle";         case TIME: return "time";
+        case INSTRET: return "instret";     case CYCLEH: return "cycleh";
+        case TIMEH: return "timeh";         case INSTRETH: return "instreth";
+        case MVENDORID: return "mvendorid"; case MARCHID: return "marchid";
+        case MIMPID: return "mimpid";       case MHARTID: return "mhartid";
+        default: return nullptr;
+    }
+}
+
+// cycles/instret count every instruction retired before this one; time is
+// the 32-bit MMIO timer, so timeh is always 0
+bool CPU::read_csr(uint32_t n, const Memory& mem, uint32_t& v) const {
+    using namespace csr;
+    switch (n) {
+        case SATP:      v = satp; break;
+        case MSTATUS:   v = mstatus | MSTATUS_MPP; break;
+        case MISA:      v = MISA_VALUE; break;
+        case MIE:       v = mie; break;
+        case MTVEC:     v = mtvec; break;
+        case MSCRATCH:  v = mscratch; break;
+        case MEPC:      v = mepc; break;
+        case MCAUSE:    v = mcause; break;
+        case MTVAL:     v = mtval; break;
+        case MIP:       v = 0; break;                  // no interrupt sources
+        case MCYCLE:  case CYCLE:    v = (uint32_t)cycles; break;
+        case MCYCLEH: case CYCLEH:   v = (uint32_t)(cycles >> 32); break;
+        case MINSTRET:  case INSTRET:  v = (uint32_t)instret; break;
+        case MINSTRETH: case INSTRETH: v = (uint32_t)(instret >> 32); break;
+        case TIME:      v = mem.time(); break;
+        case TIMEH:     v = 0; break;
+        case MVENDORID: case MARCHID: case MIMPID: v = 0; break;
+        case MHARTID:   v = tid; break;
+        default: return false;
+    }
+    return true;
+}
+
+bool CPU::write_csr(uint32_t n, uint32_t v){
+    using namespace csr;
+    auto lo = [v](uint64_t& c){ c = (c & ~0xFFFFFFFFull) | v; };
+    auto hi = [v](uint64_t& c){ c = (c & 0xFFFFFFFFull) | (uint64_t)v << 32; };
+    switch (n) {
+        case SATP:      satp = v & (Mmu::SATP_SV32 | 0x3FFFFF); break;   // no ASIDs
+        case MSTATUS:   mstatus = v & MSTATUS_MASK; break;
+        case MISA:      break;                         // WARL: fixed
+        case MIE:       mie = v & MIE_MASK; break;
+        case MTVEC:     mtvec = v & ~2u; break;        // direct or vectored
+        case MSCRATCH:  mscratch = v; break;
+        case MEPC:      mepc = v & ~3u; break;
+        case MCAUSE:    mcause = v; break;
+        case MTVAL:     mtval = v; break;
+        case MIP:       break;
+        case MCYCLE:    lo(cycles); break;
+        case MCYCLEH:   hi(cycles); break;
+        case MINSTRET:  lo(instret); break;
+        case MINSTRETH: hi(instret); break;
+        default: return false;                         // unknown or read-only
+    }
+    return true;
+}
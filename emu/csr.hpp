@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+
+// Zicsr: the CSRs CPU::read_csr / write_csr know. The user counters are
+// views of CPU::cycles, Memory::time() and CPU::instret, so a guest can
+// time itself with one rdcycle instead of an ECALL. The machine-mode ones
+// are plain storage (WARL masks applied): nothing traps through them yet.
+// Any other number is an illegal instruction, as is a write to a read-only
+// CSR (number bits 11:10 = 3).
+namespace csr {
+enum : uint32_t {
+    SATP      = 0x180,          // CPU::satp (mmu.hpp)
+    MSTATUS   = 0x300, MISA = 0x301, MIE = 0x304, MTVEC = 0x305,
+    MSCRATCH  = 0x340, MEPC = 0x341, MCAUSE = 0x342, MTVAL = 0x343, MIP = 0x344,
+    MCYCLE    = 0xB00, MINSTRET = 0xB02, MCYCLEH = 0xB80, MINSTRETH = 0xB82,
+    CYCLE     = 0xC00, TIME = 0xC01, INSTRET = 0xC02,
+    CYCLEH    = 0xC80, TIMEH = 0xC81, INSTRETH = 0xC82,
+    MVENDORID = 0xF11, MARCHID = 0xF12, MIMPID = 0xF13, MHARTID = 0xF14,
+};
+
+constexpr uint32_t MISA_VALUE   = (1u << 30) | (1u << ('A' - 'A')) | (1u << ('I' - 'A'));   // RV32IA
+constexpr uint32_t MSTATUS_MASK = (1u << 3) | (1u << 7);    // MIE, MPIE; MPP reads as M
+constexpr uint32_t MSTATUS_MPP  = 3u << 11;
+constexpr uint32_t MIE_MASK     = (1u << 3) | (1u << 7) | (1u << 11);   // MSIE, MTIE, MEIE
+
+inline bool read_only(uint32_t n){ return (n >> 10) == 3; }
+const char* name(uint32_t n);   // "cycle", ...; nullptr if not implemented
+}
@@ -0,0 +1,198 @@
+#include "debug.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include "mmu.hpp"
+
+Debugger::Debugger(CPU& c, Memory& m) : cpu(c), mem(m) {
+    cpu.debugger = this;
+}
+
+Debugger::~Debugger(){
+    rec.reset();
+    for (auto& [a, w] : saved)
+        if (mem.load32(a) == EBREAK) poke(a, w);    // else the guest rewrote it since
+    std::vector<Memory::Watch> ws = mem.watchpoints();
+    for (const auto& w : ws) mem.unwatch(w.addr);
+    if (cpu.mmu) cpu.mmu->flush();
+    cpu.debugger = nullptr;
+}
+
+bool Debugger::set_breakpoint(uint32_t addr){
+    if ((addr & 3u) || (uint64_t)addr + 4 > mem.size() || mem.is_device(addr) || saved.count(addr)) return false;
+    saved.emplace(addr, mem.load32(addr));
+    ever[addr] = saved[addr];
+    poke(addr, EBREAK);
+    return true;
+}
+
+bool Debugger::clear_breakpoint(uint32_t addr){
+    auto it = saved.find(addr);
+    if (it == saved.end()) return false;
+    if (mem.load32(addr) == EBREAK) poke(addr, it->second);
+    saved.erase(it);
+    return true;
+}
+
+std::vector<uint32_t> Debugger::breakpoints() const {
+    std::vector<uint32_t> v;
+    for (auto& [a, w] : saved) v.push_back(a);
+    std::sort(v.begin(), v.end());
+    return v;
+}
+
+bool Debugger::watch(uint32_t addr, uint32_t len){
+    const auto& ws = mem.watchpoints();
+    if (std::any_of(ws.begin(), ws.end(), [&](const Memory::Watch& w){ return w.addr == addr; })) return false;
+    try { mem.watch(addr, len); } catch (const std::out_of_range&) { return false; }
+    if (cpu.mmu) cpu.mmu->flush();                  // writable TLB entries skip the check
+    return true;
+}
+
+bool Debugger::unwatch(uint32_t addr){ return mem.unwatch(addr); }
+
+uint32_t Debugger::read32(uint32_t addr) const {
+    auto it = saved.find(addr);
+    return it != saved.end() ? it->second : mem.load32(addr);
+}
+
+uint32_t Debugger::phys(uint32_t pc) const {
+    if (!cpu.mmu || !(cpu.satp & Mmu::SATP_SV32)) return pc;
+    try { return cpu.mmu->fetch(pc); } catch (const std::out_of_range&) { return pc; }
+}
+
+void Debugger::poke(uint32_t addr, uint32_t w){
+    mem.arm_watches(false);
+    mem.store32(addr, w);
+    mem.arm_watches(true);
+}
+
+uint32_t Debugger::peek(const Memory::Watch& r) const {
+    uint32_t v = 0;
+    for (uint32_t i = 0; i < std::min<uint32_t>(r.len, 4); ++i) v |= (uint32_t)mem.load8(r.addr + i) << (8*i);
+    return v;
+}
+
+RunExit Debugger::exec(uint64_t n){
+    if (!rec) return cpu.run(mem, n);
+    rec->set_live(true);
+    RunExit r = cpu.run(mem, std::min(n, rec->room()));
+    rec->set_live(false);
+    rec->sync();
+    return r;
+}
+
+RunExit Debugger::one(){
+    auto it = saved.find(phys(cpu.pc));
+    if (it == saved.end()) return exec(1);
+    uint32_t a = it->first;
+    poke(a, it->second);
+    RunExit r = exec(1);
+    if (saved.count(a)) poke(a, EBREAK);
+    return r;
+}
+
+Debugger::Stop Debugger::finish(RunExit r, uint64_t insns){
+    Stop st{r.reason, insns};
+    mem.console().flush();                          // the guest's partial line before the host reports the stop
+    if (r.reason != Exit::Watchpoint) return st;
+    st.store = mem.watch_hit();
+    for (const auto& w : mem.watchpoints())
+        if (st.store.addr < (uint64_t)w.addr + w.len && w.addr < (uint64_t)st.store.addr + st.store.len) {
+            st.range = w;
+            break;
+        }
+    st.old_value = peek(st.range);
+    mem.arm_watches(false);                         // let the store through, once
+    RunExit s = one();
+    mem.arm_watches(true);
+    if (cpu.mmu) cpu.mmu->flush();
+    st.insns += s.insns;
+    st.new_value = peek(st.range);
+    return st;
+}
+
+Debugger::Stop Debugger::cont(uint64_t budget){
+    if (!budget || cpu.halted) return Stop{cpu.halted ? Exit::Halt : Exit::Budget, 0};
+    RunExit r = one();
+    uint64_t n = r.insns;
+    while ((r.reason == Exit::Budget || r.reason == Exit::Yield) && n < budget && !cpu.halted) {
+        r = exec(budget - n);
+        n += r.insns;
+    }
+    if (r.reason == Exit::Yield) r.reason = Exit::Budget;
+    if (cpu.halted && r.reason == Exit::Budget) r.reason = Exit::Halt;
+    return finish(r, n);
+}
+
+Debugger::Stop Debugger::step(uint64_t n){
+    RunExit r{cpu.halted ? Exit::Halt : Exit::Budget, 0};
+    uint64_t done = 0;
+    while (done < n && !cpu.halted) {
+        r = one();
+        done += r.insns;
+        if (r.reason != Exit::Budget && r.reason != Exit::Yield) break;
+        r.reason = Exit::Budget;
+    }
+    if (cpu.halted && r.reason == Exit::Budget) r.reason = Exit::Halt;
+    return finish(r, done);
+}
+
+void Debugger::record(uint64_t interval){
+    rec.reset();
+    rec = std::make_unique<Recorder>(cpu, mem, interval);
+}
+
+void Debugger::resync(){
+    for (auto& [a, orig] : ever) {
+        uint32_t w = mem.load32(a);
+        auto it = saved.find(a);
+        if (it != saved.end() && w != EBREAK) { it->second = w; poke(a, EBREAK); }
+        else if (it == saved.end() && w == EBREAK && orig != EBREAK) poke(a, orig);
+    }
+}
+
+uint64_t Debugger::seek(uint64_t t){
+    rec->rewind(t);
+    resync();
+    uint64_t replayed = 0;
+    while (cpu.instret < t && !cpu.halted) {
+        Stop s = cont(t - cpu.instret);
+        replayed += s.insns;
+        if (!s.insns) break;                        // trap: it didn't go this way before either
+    }
+    return replayed;
+}
+
+Debugger::Stop Debugger::reverse_step(uint64_t n){
+    if (!rec) return Stop{Exit::Budget, 0};
+    uint64_t t = cpu.instret - std::min(n, cpu.instret);
+    return Stop{Exit::Budget, seek(std::max(t, rec->start()))};
+}
+
+Debugger::Stop Debugger::reverse_cont(){
+    if (!rec) return Stop{Exit::Budget, 0};
+    uint64_t end = cpu.instret, replayed = 0;
+    while (end > rec->start()) {
+        // replay [from, end) and keep the last stop in it
+        uint64_t from = rec->checkpoint_before(end);
+        replayed += seek(from);
+        Stop last{Exit::Budget, 0};
+        uint64_t at = 0;
+        if (planted(phys(cpu.pc))) { last.reason = Exit::Breakpoint; at = cpu.instret; }
+        while (cpu.instret < end && !cpu.halted) {
+            Stop s = cont(end - cpu.instret);
+            replayed += s.insns;
+            if ((s.reason == Exit::Breakpoint || s.reason == Exit::Watchpoint) && cpu.instret < end) {
+                last = s; at = cpu.instret;
+            } else if (s.reason != Exit::Budget || !s.insns) break;
+        }
+        if (last.reason != Exit::Budget) {
+            replayed += seek(at);
+            last.insns = replayed;
+            return last;
+        }
+        end = from;
+    }
+    replayed += seek(rec->start());
+    return Stop{Exit::Budget, replayed};
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "cpu.hpp"
+#include "mem.hpp"
+#include "replay.hpp"
+
+// Software breakpoints and write watchpoints for one CPU + Memory.
+//
+// A breakpoint is an EBREAK written over the instruction; the original word
+// is kept here and put back for the one instruction that steps over it, so
+// cont() runs the ordinary loop at full speed (no per-instruction pc
+// check) until the guest fetches the EBREAK. read32() hides the patches
+// from the disassembler and memory dumps.
+//
+// Watchpoints use Memory's page-granular tracking: only stores to a page
+// holding a watched range pay for the check. A hit stops after the store
+// completes, pc on the next instruction, with the range's old and new
+// values.
+//
+// With record() on, reverse_step() and reverse_cont() go back in time by
+// rewinding to a checkpoint and replaying forward (replay.hpp).
+//
+// Addresses are physical (the same as pc unless Sv32 is on). Attaching
+// turns the JIT off for this CPU; destroying the Debugger restores every
+// patched word and drops its watchpoints.
+class Debugger {
+public:
+    static constexpr uint32_t EBREAK = 0x00100073;
+
+    Debugger(CPU& cpu, Memory& mem);
+    ~Debugger();
+    Debugger(const Debugger&) = delete;
+    Debugger& operator=(const Debugger&) = delete;
+
+    // false: misaligned, not RAM, or already in that state
+    bool set_breakpoint(uint32_t addr);
+    bool clear_breakpoint(uint32_t addr);
+    bool planted(uint32_t addr) const { return !saved.empty() && saved.count(addr); }
+    std::vector<uint32_t> breakpoints() const;      // sorted
+
+    // watch [addr, addr+len); one range per start address
+    bool watch(uint32_t addr, uint32_t len = 4);
+    bool unwatch(uint32_t addr);
+
+    // the guest's view, with planted EBREAKs replaced by the original words
+    uint32_t read32(uint32_t addr) const;
+
+    struct Stop {
+        Exit reason;               // Breakpoint, Watchpoint, Halt, Trap, Quantum or Budget
+        uint64_t insns;            // retired
+        Memory::Watch store{0, 0}; // Watchpoint: the store that hit
+        Memory::Watch range{0, 0}; // and the watched range it hit
+        uint32_t old_value{0}, new_value{0};   // first (up to) 4 bytes of the range, before and after
+    };
+    // run until a breakpoint, a watchpoint, halt, trap or budget, riding
+    // through yields; a breakpoint at pc is stepped over first
+    Stop cont(uint64_t budget = UINT64_MAX);
+    // n instructions, or fewer if something stops them
+    Stop step(uint64_t n = 1);
+
+    // ---- reverse execution ----
+    // record from here on (see Recorder); off drops the history
+    void record(uint64_t interval = Recorder::INTERVAL);
+    void stop_recording(){ rec.reset(); }
+    const Recorder* recorder() const { return rec.get(); }
+    // back n instructions (not before the start of the recording); Budget,
+    // insns = instructions replayed to get there
+    Stop reverse_step(uint64_t n = 1);
+    // back to the last breakpoint or watchpoint stop before now, or to the
+    // start of the recording (Budget) if there is none
+    Stop reverse_cont();
+
+private:
+    uint32_t phys(uint32_t pc) const;
+    void poke(uint32_t addr, uint32_t w);           // watchpoints don't see the debugger's writes
+    uint32_t peek(const Memory::Watch& r) const;
+    RunExit exec(uint64_t n);                       // cpu.run, in pieces the recorder can follow
+    RunExit one();                                  // one instruction, stepping over a planted EBREAK
+    Stop finish(RunExit r, uint64_t insns);
+    uint64_t seek(uint64_t t);                      // rewind and replay to instret t; instructions replayed
+    void resync();                                  // patches as they should be, after a rewind
+
+    CPU& cpu;
+    Memory& mem;
+    std::unordered_map<uint32_t, uint32_t> saved;   // planted address -> original word
+    std::unordered_map<uint32_t, uint32_t> ever;    // every address planted so far -> original word
+    std::unique_ptr<Recorder> rec;
+};
@@ -0,0 +1,212 @@
+#include "decode.hpp"
+#include "mem.hpp"
+
+static inline uint32_t get_bits(uint32_t v,int pos,int len){ return (v>>pos)&((1u<<len)-1u); }
+static inline int32_t  sign_extend(uint32_t v,int bits){ uint32_t m=1u<<(bits-1); return (int32_t)((v^m)-m); }
+
+Decoded decode(uint32_t inst){
+    uint32_t opcode = get_bits(inst,0,7);
+    uint32_t funct3 = get_bits(inst,12,3);
+    Decoded d;
+    d.rd  = (uint8_t)get_bits(inst,7,5);
+    d.rs1 = (uint8_t)get_bits(inst,15,5);
+    d.rs2 = (uint8_t)get_bits(inst,20,5);
+    d.op  = Op::Illegal;
+
+    if(opcode==0x13){ // ADDI
+        if(funct3==0b000){ d.op=Op::Addi; d.imm=sign_extend(get_bits(inst,20,12),12); }
+
+    } else if(opcode==0x33){ // R-type subset
+        uint32_t f7=get_bits(inst,25,7);
+        if     (funct3==0b000 && f7==0)          d.op=Op::Add;
+        else if(funct3==0b000 && f7==0b0100000)  d.op=Op::Sub;
+        else if(funct3==0b001 && f7==0)          d.op=Op::Sll;
+        else if(funct3==0b101 && f7==0)          d.op=Op::Srl;
+        else if(funct3==0b101 && f7==0b0100000)  d.op=Op::Sra;
+        else if(funct3==0b010 && f7==0)          d.op=Op::Slt;
+        else if(funct3==0b011 && f7==0)          d.op=Op::Sltu;
+
+    } else if(opcode==0x37){ // LUI
+        d.op=Op::Lui; d.imm=(int32_t)(get_bits(inst,12,20)<<12);
+
+    } else if(opcode==0x17){ // AUIPC
+        d.op=Op::Auipc; d.imm=(int32_t)(get_bits(inst,12,20)<<12);
+
+    } else if(opcode==0x63){ // branches
+        uint32_t i12=get_bits(inst,31,1), i10_5=get_bits(inst,25,6), i4_1=get_bits(inst,8,4), i11=get_bits(inst,7,1);
+        d.imm=sign_extend((i12<<12)|(i11<<11)|(i10_5<<5)|(i4_1<<1),13);
+        switch(funct3){
+            case 0b000: d.op=Op::Beq;  break;
+            case 0b001: d.op=Op::Bne;  break;
+            case 0b100: d.op=Op::Blt;  break;
+            case 0b101: d.op=Op::Bge;  break;
+            case 0b110: d.op=Op::Bltu; break;
+            case 0b111: d.op=Op::Bgeu; break;
+            default: break;
+        }
+
+    } else if(opcode==0x03){ // loads
+        static const Op ops[8]={Op::Lb,Op::Lh,Op::Lw,Op::Illegal,Op::Lbu,Op::Lhu,Op::Illegal,Op::Illegal};
+        d.op=ops[funct3]; d.imm=sign_extend(get_bits(inst,20,12),12);
+
+    } else if(opcode==0x23){ // stores
+        uint32_t i11_5=get_bits(inst,25,7), i4_0=get_bits(inst,7,5);
+        static const Op ops[8]={Op::Sb,Op::Sh,Op::Sw,Op::Illegal,Op::Illegal,Op::Illegal,Op::Illegal,Op::Illegal};
+        d.op=ops[funct3]; d.imm=sign_extend((i11_5<<5)|i4_0,12);
+
+    } else if(opcode==0x6F){ // JAL
+        uint32_t i20=get_bits(inst,31,1), i10_1=get_bits(inst,21,10), i11=get_bits(inst,20,1), i19_12=get_bits(inst,12,8);
+        d.op=Op::Jal; d.imm=sign_extend((i20<<20)|(i19_12<<12)|(i11<<11)|(i10_1<<1),21);
+
+    } else if(opcode==0x67){ // JALR
+        if(funct3==0b000){ d.op=Op::Jalr; d.imm=sign_extend(get_bits(inst,20,12),12); }
+
+    } else if(opcode==0x0F){ // MISC-MEM
+        if     (funct3==0b000) d.op=Op::Fence;
+        else if(funct3==0b001) d.op=Op::FenceI;
+
+    } else if(opcode==0x2F){ // AMO (aq/rl ignored: every AMO is sequentially consistent)
+        uint32_t f5=get_bits(inst,27,5);
+        if(funct3==0b010) switch(f5){
+            case 0b00010: if(d.rs2==0) d.op=Op::LrW; break;
+            case 0b00011: d.op=Op::ScW;     break;
+            case 0b00001: d.op=Op::AmoSwap; break;
+            case 0b00000: d.op=Op::AmoAdd;  break;
+            case 0b00100: d.op=Op::AmoXor;  break;
+            case 0b01100: d.op=Op::AmoAnd;  break;
+            case 0b01000: d.op=Op::AmoOr;   break;
+            case 0b10000: d.op=Op::AmoMin;  break;
+            case 0b10100: d.op=Op::AmoMax;  break;
+            case 0b11000: d.op=Op::AmoMinu; break;
+            case 0b11100: d.op=Op::AmoMaxu; break;
+            default: break;
+        }
+
+    } else if(opcode==0x73){ // SYSTEM
+        uint32_t imm12=get_bits(inst,20,12);
+        if     (funct3==0 && imm12==0) d.op=Op::Ecall;
+        else if(funct3==0 && imm12==1) d.op=Op::Ebreak;
+        else if(funct3==0 && d.rd==0 && get_bits(inst,25,7)==0b0001001) d.op=Op::SfenceVma;
+        else if(funct3!=0 && funct3!=0b100){
+            static const Op csr_ops[8] = { Op::Illegal, Op::CsrRw, Op::CsrRs, Op::CsrRc,
+                                           Op::Illegal, Op::CsrRwi, Op::CsrRsi, Op::CsrRci };
+            d.op=csr_ops[funct3]; d.imm=(int32_t)imm12;
+        }
+    }
+    return d;
+}
+
+uint32_t major_opcode(Op op){
+    switch(base_op(op)){
+        case Op::Addi: return 0x13;
+        case Op::Add: case Op::Sub: case Op::Sll: case Op::Srl:
+        case Op::Sra: case Op::Slt: case Op::Sltu: return 0x33;
+        case Op::Lui: return 0x37;
+        case Op::Auipc: return 0x17;
+        case Op::Beq: case Op::Bne: case Op::Blt: case Op::Bge:
+        case Op::Bltu: case Op::Bgeu: return 0x63;
+        case Op::Lb: case Op::Lh: case Op::Lw: case Op::Lbu: case Op::Lhu: return 0x03;
+        case Op::Sb: case Op::Sh: case Op::Sw: return 0x23;
+        case Op::Jal: return 0x6F;
+        case Op::Jalr: return 0x67;
+        case Op::Ecall: case Op::Ebreak: case Op::SfenceVma:
+        case Op::CsrRw: case Op::CsrRs: case Op::CsrRc:
+        case Op::CsrRwi: case Op::CsrRsi: case Op::CsrRci: return 0x73;
+        case Op::Fence: case Op::FenceI: return 0x0F;
+        case Op::LrW: case Op::ScW: return 0x2F;
+        default: return is_amo(op) ? 0x2F : 0;
+    }
+}
+
+Op base_op(Op op){
+    switch(op){
+        case Op::FuseLuiAddi:    case Op::FuseLuiLw:      return Op::Lui;
+        case Op::FuseAuipcAddi:  case Op::FuseAuipcJalr:  return Op::Auipc;
+        case Op::FuseAddiBranch: return Op::Addi;
+        case Op::FuseAddLw:      return Op::Add;
+        default:                 return op;
+    }
+}
+
+const char* fuse_name(Op op){
+    switch(op){
+        case Op::FuseLuiAddi:    return "lui+addi";
+        case Op::FuseAuipcAddi:  return "auipc+addi";
+        case Op::FuseAuipcJalr:  return "auipc+jalr";
+        case Op::FuseAddiBranch: return "addi+branch";
+        case Op::FuseAddLw:      return "add+lw";
+        case Op::FuseLuiLw:      return "lui+lw";
+        default:                 return "-";
+    }
+}
+
+static bool is_branch(Op op){ return op >= Op::Beq && op <= Op::Bgeu; }
+
+// the pair is only worth fusing when the second consumes the first's rd
+static Op fused_kind(const Decoded& a, const Decoded& b){
+    if (a.rd == 0) return Op::Undecoded;
+    switch(a.op){
+        case Op::Lui:
+            if (b.op==Op::Addi && b.rd==a.rd && b.rs1==a.rd) return Op::FuseLuiAddi;
+            if (b.op==Op::Lw && b.rs1==a.rd)                 return Op::FuseLuiLw;
+            break;
+        case Op::Auipc:
+            if (b.op==Op::Addi && b.rd==a.rd && b.rs1==a.rd) return Op::FuseAuipcAddi;
+            if (b.op==Op::Jalr && b.rs1==a.rd)               return Op::FuseAuipcJalr;
+            break;
+        case Op::Addi:
+            if (is_branch(b.op) && (b.rs1==a.rd || b.rs2==a.rd)) return Op::FuseAddiBranch;
+            break;
+        case Op::Add:
+            if (b.op==Op::Lw && b.rs1==a.rd) return Op::FuseAddLw;
+            break;
+        default: break;
+    }
+    return Op::Undecoded;
+}
+
+void DecodeCache::fuse(Decoded* slot, uint32_t i){
+    if (i + 1 >= SLOTS) return;                 // pairs never straddle a page
+    Decoded& a = slot[i]; const Decoded& b = slot[i+1];
+    if (a.op == Op::Undecoded || b.op == Op::Undecoded || is_fused(a.op)) return;
+    Op k = fused_kind(a, b);
+    if (k == Op::Undecoded) return;
+    a.op = k;
+    ++st.fused_pairs[(unsigned)k - FIRST_FUSED];
+}
+
+const Decoded& DecodeCache::fill(const Memory& mem, uint32_t pc){
+    ++st.misses;
+    uint32_t inst = mem.load32(pc);          // may throw out_of_range, like a plain fetch
+    uint32_t pg = pc >> PAGE_SHIFT;
+    // misaligned pcs and MMIO words are decoded fresh every time
+    if ((pc & 3u) != 0 || pg >= pages.size() || mem.is_device(pc)) {
+        scratch = decode(inst);
+        return scratch;
+    }
+    if (!pages[pg]) pages[pg] = std::make_unique<Page>();
+    Decoded* slot = pages[pg]->slot;
+    uint32_t i = (pc >> 2) & (SLOTS-1);
+    slot[i] = decode(inst);
+    if (fusion) {
+        // decode the successor eagerly so the pair can be recognised now
+        uint32_t nx = pc + 4;
+        if (i + 1 < SLOTS && slot[i+1].op == Op::Undecoded && (std::size_t)nx + 3 < mem.size()
+            && !mem.is_device(nx))
+            slot[i+1] = decode(mem.load32(nx));
+        fuse(slot, i);
+        if (i > 0) fuse(slot, i - 1);           // a refilled word may complete its predecessor's pair
+    }
+    return slot[i];
+}
+
+void DecodeCache::drop(uint32_t addr, uint32_t len){
+    for (uint32_t w = addr & ~3u; w < addr + len; w += 4) {
+        uint32_t pg = w >> PAGE_SHIFT;
+        if (!has_page(pg)) continue;
+        Decoded* slot = pages[pg]->slot;
+        uint32_t i = (w >> 2) & (SLOTS-1);
+        if (slot[i].op != Op::Undecoded) { slot[i] = Decoded{}; ++st.invalidations; ++gen; }
+        if (i > 0 && is_fused(slot[i-1].op)) slot[i-1].op = base_op(slot[i-1].op);
+    }
+}
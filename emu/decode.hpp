@@ -0,0 +1,135 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+class Memory;
+
+// ---- predecoded instruction ----
+// One guest word decoded once: `op` picks the handler, the operands are
+// already extracted, so the hot loop never touches get_bits/sign_extend.
+enum class Op : uint8_t {
+    Undecoded = 0,                 // empty cache slot (zero-initialised pages)
+    Illegal,
+    Addi, Add, Sub, Sll, Srl, Sra, Slt, Sltu,
+    Lui, Auipc,
+    Beq, Bne, Blt, Bge, Bltu, Bgeu,
+    Lb, Lh, Lw, Lbu, Lhu,
+    Sb, Sh, Sw,
+    Jal, Jalr,
+    Ecall, Ebreak,
+    Fence, FenceI,
+    SfenceVma,                     // Sv32 TLB flush (mmu.hpp)
+    CsrRw, CsrRs, CsrRc,           // Zicsr (csr.hpp): imm = CSR number
+    CsrRwi, CsrRsi, CsrRci,        //   rs1 holds the 5-bit immediate
+    LrW, ScW,                      // RV32A
+    AmoSwap, AmoAdd, AmoXor, AmoAnd, AmoOr, AmoMin, AmoMax, AmoMinu, AmoMaxu,
+    // Macro-op fusion: set on the first slot of a recognised pair. The
+    // record still holds the first instruction; the second is the next
+    // slot of the same page, which the handler runs without a fetch.
+    FuseLuiAddi,                   // lui rd,hi ; addi rd,rd,lo      (li)
+    FuseAuipcAddi,                 // auipc rd,hi ; addi rd,rd,lo    (la)
+    FuseAuipcJalr,                 // auipc t,hi ; jalr rd,lo(t)     (call/tail)
+    FuseAddiBranch,                // addi r,r,k ; b<cc> r,s,off     (loop tail)
+    FuseAddLw,                     // add t,a,b ; lw rd,k(t)         (indexed load)
+    FuseLuiLw,                     // lui t,hi ; lw rd,lo(t)         (absolute load)
+    Count
+};
+constexpr unsigned FIRST_FUSED = (unsigned)Op::FuseLuiAddi;
+constexpr unsigned FUSE_KINDS  = (unsigned)Op::Count - FIRST_FUSED;
+
+struct Decoded {
+    Op op{Op::Undecoded};
+    uint8_t rd{0}, rs1{0}, rs2{0};
+    int32_t imm{0};                // I/S/B/J immediate, or the LUI/AUIPC value (<<12 applied)
+};
+
+Decoded  decode(uint32_t inst);
+uint32_t major_opcode(Op op);      // the 7-bit opcode field, for the trace
+Op       base_op(Op op);           // a fused op's first instruction; identity otherwise
+const char* fuse_name(Op op);
+inline bool is_fused(Op op){ return (unsigned)op >= FIRST_FUSED && op != Op::Count; }
+inline bool is_amo(Op op){ return op >= Op::AmoSwap && op <= Op::AmoMaxu; }
+inline bool is_csr(Op op){ return op >= Op::CsrRw && op <= Op::CsrRci; }
+
+// ---- decode cache ----
+// Guest words decoded once and kept per 4 KiB guest page. Memory calls
+// invalidate() on every store, so self-modifying code and debugger patches
+// are picked up on the next fetch.
+class DecodeCache {
+public:
+    static constexpr uint32_t PAGE_SHIFT = 12;
+    static constexpr uint32_t SLOTS      = 1u << (PAGE_SHIFT - 2);
+
+    struct Stats {
+        uint64_t hits = 0, misses = 0, invalidations = 0;
+        uint64_t fused_pairs[FUSE_KINDS]{};   // pairs formed, per pattern
+        uint64_t fused_runs[FUSE_KINDS]{};    // pairs executed, per pattern
+    };
+
+    explicit DecodeCache(std::size_t mem_bytes)
+    : pages((mem_bytes >> PAGE_SHIFT) + 1) {}
+
+    // decoded record for pc; decodes through mem.load32 on a miss
+    const Decoded& fetch(const Memory& mem, uint32_t pc){
+        uint32_t pg = pc >> PAGE_SHIFT;
+        if ((pc & 3u) == 0 && pg < pages.size() && pages[pg]) {
+            const Decoded& d = pages[pg]->slot[(pc >> 2) & (SLOTS-1)];
+            if (d.op != Op::Undecoded) { ++st.hits; return d; }
+        }
+        return fill(mem, pc);
+    }
+
+    // drop every slot overlapping [addr, addr+len) and unfuse the slot
+    // before each; len <= 4, so at most two pages
+    void invalidate(uint32_t addr, uint32_t len){
+        uint32_t first = addr >> PAGE_SHIFT, last = (addr + len - 1) >> PAGE_SHIFT;
+        if (has_page(first) || (last != first && has_page(last))) drop(addr, len);
+    }
+
+    // any length: whole pages are dropped outright
+    void invalidate_range(uint32_t addr, std::size_t len){
+        uint64_t end = (uint64_t)addr + len;
+        for (uint64_t a = addr; a < end; ) {
+            uint32_t pg = (uint32_t)(a >> PAGE_SHIFT);
+            uint64_t pend = std::min<uint64_t>(end, (uint64_t)(pg + 1) << PAGE_SHIFT);
+            if (has_page(pg)) {
+                if (a == (uint64_t)pg << PAGE_SHIFT && pend - a == (1u << PAGE_SHIFT)) invalidate_page(pg);
+                else drop((uint32_t)a, (uint32_t)(pend - a));
+            }
+            a = pend;
+        }
+    }
+    void clear(){ for (auto& p : pages) p.reset(); ++gen; }
+    // drop one whole page (its contents were replaced wholesale); pairs
+    // never fuse across pages, so nothing outside it goes stale
+    void invalidate_page(uint32_t pg){
+        if (has_page(pg)) { pages[pg].reset(); ++gen; }
+    }
+    const Stats& stats() const { return st; }
+    void count_fused(Op op){ ++st.fused_runs[(unsigned)op - FIRST_FUSED]; }
+
+    // pair fusion on fill (on by default); changing it drops everything decoded
+    void set_fusion(bool on){ if (on != fusion) { fusion = on; clear(); } }
+    bool fusion_enabled() const { return fusion; }
+
+    // bumped whenever a decoded word goes stale; consumers that derive
+    // code from decoded words (the JIT) compare it to know when to flush
+    uint64_t generation() const { return gen; }
+
+private:
+    struct Page { Decoded slot[SLOTS]{}; };
+
+    bool has_page(uint32_t pg) const { return pg < pages.size() && pages[pg]; }
+    const Decoded& fill(const Memory& mem, uint32_t pc);
+    void fuse(Decoded* slot, uint32_t i);  // try pairing slot[i] with slot[i+1]
+    void drop(uint32_t addr, uint32_t len);
+
+    std::vector<std::unique_ptr<Page>> pages;
+    Decoded scratch;               // result for pcs we refuse to cache
+    Stats st;
+    uint64_t gen = 0;
+    bool fusion = true;
+};
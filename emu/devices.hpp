@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include "bus.hpp"
+#include "console.hpp"
+
+// ---- timer (0x3000) ----
+// +0 TIME (read), +4 add ticks, +8 reset (word writes). Every other byte of
+// the page is plain RAM, as before the bus existed.
+class TimerDevice : public Device {
+public:
+    static constexpr uint32_t BASE = 0x3000;
+
+    bool read32(uint32_t off, uint32_t& v) override {
+        if (off != 0) return false;
+        v = now.load(std::memory_order_relaxed); return true;
+    }
+    bool write32(uint32_t off, uint32_t v) override {
+        if (off == 4) { now.fetch_add(v, std::memory_order_relaxed); return true; }
+        if (off == 8) { now.store(0, std::memory_order_relaxed);     return true; }
+        return false;
+    }
+
+    std::atomic<uint32_t> now{0};   // harts on other threads add their ticks
+};
+
+// ---- UART (0x4000_0000) ----
+// Transmit-only 16550 subset: a store to THR (+0) sends its low byte to the
+// guest's Console; LSR (+5) always reads "transmitter empty".
+class UartDevice : public Device {
+public:
+    explicit UartDevice(Console& con) : con(con) {}
+    static constexpr uint32_t BASE = 0x40000000;
+
+    bool write8 (uint32_t off, uint8_t v)  override { return off == 0 && tx(v); }
+    bool write16(uint32_t off, uint16_t v) override { return off == 0 && tx((uint8_t)v); }
+    bool write32(uint32_t off, uint32_t v) override { return off == 0 && tx((uint8_t)v); }
+    bool read8(uint32_t off, uint8_t& v) override {
+        if (off == 0) { v = 0;    return true; }   // RBR: nothing received
+        if (off == 5) { v = 0x60; return true; }   // LSR: THRE | TEMT
+        return false;
+    }
+
+private:
+    bool tx(uint8_t c){ con.put(c); return true; }
+    Console& con;
+};
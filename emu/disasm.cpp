@@ -1,4 +1,6 @@
 #include "disasm.hpp"
+#include "symbols.hpp"
+#include "csr.hpp"
 #include <sstream>
 #include <iomanip>
 #include <cstdint>
@@ -31,6 +33,10 @@ std::string disasm(uint32_t inst){
         uint32_t rd=get_bits(inst,7,5), imm20=get_bits(inst,12,20);
         ss<<"lui x"<<rd<<", 0x"<<std::hex<<imm20<<std::dec;
 
+    } else if(op==0x17){ // AUIPC
+        uint32_t rd=get_bits(inst,7,5), imm20=get_bits(inst,12,20);
+        ss<<"auipc x"<<rd<<", 0x"<<std::hex<<imm20<<std::dec;
+
     } else if(op==0x63){ // branches
         uint32_t rs1=get_bits(inst,15,5), rs2=get_bits(inst,20,5), f3=get_bits(inst,12,3);
         uint32_t i12=get_bits(inst,31,1), i10_5=get_bits(inst,25,6), i4_1=get_bits(inst,8,4), i11=get_bits(inst,7,1);
@@ -44,15 +50,16 @@ std::string disasm(uint32_t inst){
         else if(f3==0b111) ss<<"bgeu x"<<rs1<<", x"<<rs2<<", "<<d.str();
         else ss<<"branch(?)";
 
-    } else if(op==0x03){ // LW
+    } else if(op==0x03){ // loads
         uint32_t rd=get_bits(inst,7,5), f3=get_bits(inst,12,3), rs1=get_bits(inst,15,5);
-        if(f3==0b010){ int32_t imm=sign_extend(get_bits(inst,20,12),12); ss<<"lw x"<<rd<<", "<<imm<<"(x"<<rs1<<")"; }
+        static const char* const names[8]={"lb","lh","lw",nullptr,"lbu","lhu",nullptr,nullptr};
+        if(names[f3]){ int32_t imm=sign_extend(get_bits(inst,20,12),12); ss<<names[f3]<<" x"<<rd<<", "<<imm<<"(x"<<rs1<<")"; }
         else ss<<"load(?)";
 
-    } else if(op==0x23){ // SW
+    } else if(op==0x23){ // stores
         uint32_t f3=get_bits(inst,12,3), rs1=get_bits(inst,15,5), rs2=get_bits(inst,20,5), i11_5=get_bits(inst,25,7), i4_0=get_bits(inst,7,5);
         int32_t imm=sign_extend((i11_5<<5)|i4_0,12);
-        if(f3==0b010) ss<<"sw x"<<rs2<<", "<<imm<<"(x"<<rs1<<")";
+        if(f3<=0b010) ss<<(f3==0?"sb":f3==1?"sh":"sw")<<" x"<<rs2<<", "<<imm<<"(x"<<rs1<<")";
         else ss<<"store(?)";
 
     } else if(op==0x6F){ // JAL
@@ -67,13 +74,51 @@ std::string disasm(uint32_t inst){
         if(f3!=0b000) ss<<"jalr(?)";
         else { int32_t imm=sign_extend(get_bits(inst,20,12),12); ss<<"jalr x"<<rd<<", x"<<rs1<<", "<<imm; }
 
+    } else if(op==0x0F){ // MISC-MEM
+        uint32_t f3=get_bits(inst,12,3);
+        if(f3==0) ss<<"fence"; else if(f3==1) ss<<"fence.i"; else ss<<"misc-mem(?)";
+
+    } else if(op==0x2F){ // AMO
+        uint32_t rd=get_bits(inst,7,5), f3=get_bits(inst,12,3), rs1=get_bits(inst,15,5), rs2=get_bits(inst,20,5), f5=get_bits(inst,27,5);
+        const char* name=nullptr;
+        switch(f5){
+            case 0b00010: name="lr.w"; break;      case 0b00011: name="sc.w"; break;
+            case 0b00001: name="amoswap.w"; break; case 0b00000: name="amoadd.w"; break;
+            case 0b00100: name="amoxor.w"; break;  case 0b01100: name="amoand.w"; break;
+            case 0b01000: name="amoor.w"; break;   case 0b10000: name="amomin.w"; break;
+            case 0b10100: name="amomax.w"; break;  case 0b11000: name="amominu.w"; break;
+            case 0b11100: name="amomaxu.w"; break; default: break;
+        }
+        if(!name || f3!=0b010) ss<<"amo(?)";
+        else if(f5==0b00010) ss<<name<<" x"<<rd<<", (x"<<rs1<<")";
+        else ss<<name<<" x"<<rd<<", x"<<rs2<<", (x"<<rs1<<")";
+
     } else if(op==0x73){ // SYSTEM
         uint32_t imm12=get_bits(inst,20,12), f3=get_bits(inst,12,3);
+        uint32_t rd=get_bits(inst,7,5), rs1=get_bits(inst,15,5), rs2=get_bits(inst,20,5);
         if(f3==0 && imm12==0) ss<<"ecall";
         else if(f3==0 && imm12==1) ss<<"ebreak";
+        else if(f3==0 && rd==0 && get_bits(inst,25,7)==0b0001001) ss<<"sfence.vma x"<<rs1<<", x"<<rs2;
+        else if(f3!=0 && f3!=0b100){
+            static const char* const names[8] = { "", "csrrw", "csrrs", "csrrc", "", "csrrwi", "csrrsi", "csrrci" };
+            ss<<names[f3]<<" x"<<rd<<", ";
+            if(const char* n=csr::name(imm12)) ss<<n; else ss<<"0x"<<std::hex<<imm12<<std::dec;
+            if(f3 & 0b100) ss<<", "<<rs1; else ss<<", x"<<rs1;
+        }
         else ss<<"system(?)";
 
     } else ss<<"unknown(0x"<<std::hex<<inst<<std::dec<<")";
 
     return ss.str();
 }
+
+std::string disasm(uint32_t inst, uint32_t pc, const SymbolTable& syms){
+    std::string s = disasm(inst);
+    uint32_t op=get_bits(inst,0,7);
+    int32_t off;
+    if(op==0x63)      off=sign_extend((get_bits(inst,31,1)<<12)|(get_bits(inst,7,1)<<11)|(get_bits(inst,25,6)<<5)|(get_bits(inst,8,4)<<1),13);
+    else if(op==0x6F) off=sign_extend((get_bits(inst,31,1)<<20)|(get_bits(inst,12,8)<<12)|(get_bits(inst,20,1)<<11)|(get_bits(inst,21,10)<<1),21);
+    else return s;
+    std::string t = syms.describe(pc + (uint32_t)off);
+    return t.empty() ? s : s + " <" + t + ">";
+}
@@ -3,3 +3,7 @@
 #include <string>
 
 std::string disasm(uint32_t inst);
+
+class SymbolTable;
+// same, with " <sym+off>" after a branch/JAL target that has a symbol
+std::string disasm(uint32_t inst, uint32_t pc, const SymbolTable& syms);
@@ -2,6 +2,13 @@
 #include <fstream>
 #include <cstring>
 #include <iostream>
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SEEDOS_MMAP_FILES 1
+#endif
 
 // Minimal ELF32 structures (only fields we use)
 struct Elf32_Ehdr {
@@ -38,6 +45,9 @@ struct Elf32_Phdr {
 #ifndef PT_LOAD
 #define PT_LOAD 1
 #endif
+#ifndef SHT_SYMTAB
+#define SHT_SYMTAB 2
+#endif
 
 std::vector<uint8_t> read_file(const std::string& path){
     std::ifstream f(path, std::ios::binary);
@@ -57,11 +67,72 @@ static uint32_t u32le(const void* p){
     const uint8_t* b=(const uint8_t*)p; return (uint32_t)(b[0] | (b[1]<<8) | (b[2]<<16) | (b[3]<<24));
 }
 
-uint32_t load_elf32_into_memory(const std::string& path, Memory& mem){
-    auto file = read_file(path);
-    if(file.size() < sizeof(Elf32_Ehdr)) throw std::runtime_error("ELF too small");
+FileBytes::FileBytes(std::vector<uint8_t> bytes) : owned(std::move(bytes)) {
+    p = owned.data(); n = owned.size();
+}
+
+std::shared_ptr<const FileBytes> FileBytes::open(const std::string& path){
+    std::shared_ptr<FileBytes> f(new FileBytes());
+#if SEEDOS_MMAP_FILES
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("open failed: "+path);
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* m = ::mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            f->p = (const uint8_t*)m; f->n = (std::size_t)st.st_size; f->fd_ = fd; f->mapped = true;
+            return f;
+        }
+    }
+    ::close(fd);
+#endif
+    f->owned = read_file(path);
+    f->p = f->owned.data(); f->n = f->owned.size();
+    return f;
+}
+
+FileBytes::~FileBytes(){
+#if SEEDOS_MMAP_FILES
+    if (mapped) ::munmap(const_cast<uint8_t*>(p), n);
+    if (fd_ >= 0) ::close(fd_);
+#endif
+}
+
+// .symtab + its .strtab; anything malformed just leaves symbols out
+static void read_symbols(const uint8_t* f, std::size_t size, SymbolTable& out){
+    const Elf32_Ehdr* eh = (const Elf32_Ehdr*)f;
+    uint32_t shoff = u32le(&eh->e_shoff);
+    uint16_t shentsize = u16le(&eh->e_shentsize), shnum = u16le(&eh->e_shnum);
+    if (!shoff || shentsize < 40 || (uint64_t)shoff + (uint64_t)shnum * shentsize > size) return;
+    auto sh = [&](uint32_t i){ return f + shoff + (std::size_t)i * shentsize; };
+    for (uint16_t i = 0; i < shnum; ++i) {
+        if (u32le(sh(i) + 4) != SHT_SYMTAB) continue;
+        uint32_t off = u32le(sh(i) + 16), len = u32le(sh(i) + 20), link = u32le(sh(i) + 24);
+        if (link >= shnum || (uint64_t)off + len > size) return;
+        uint32_t stroff = u32le(sh(link) + 16), strlen_ = u32le(sh(link) + 20);
+        if ((uint64_t)stroff + strlen_ > size) return;
+        const char* strtab = (const char*)f + stroff;
+        for (uint32_t k = 16; k + 16 <= len; k += 16) {      // entry 0 is the null symbol
+            const uint8_t* e = f + off + k;
+            uint32_t name = u32le(e), value = u32le(e + 4), sz = u32le(e + 8);
+            uint8_t type = e[12] & 0xF; uint16_t shndx = u16le(e + 14);
+            if (shndx == 0 || type > 2 || name == 0 || name >= strlen_) continue;   // undefined, section/file syms
+            std::size_t nl = strnlen(strtab + name, strlen_ - name);
+            if (nl == 0 || strtab[name] == '$') continue;                          // mapping symbols
+            out.add({value, sz, std::string(strtab + name, nl), type == 2});
+        }
+        break;
+    }
+    out.finish();
+}
+
+ElfImage ElfImage::parse(const std::string& path){
+    auto fb = FileBytes::open(path);
+    const uint8_t* file = fb->data();
+    std::size_t file_size = fb->size();
+    if(file_size < sizeof(Elf32_Ehdr)) throw std::runtime_error("ELF too small");
 
-    const Elf32_Ehdr* eh = (const Elf32_Ehdr*)file.data();
+    const Elf32_Ehdr* eh = (const Elf32_Ehdr*)file;
 
     // Validate ELF ident
     const unsigned char* id = eh->e_ident;
@@ -77,16 +148,18 @@ uint32_t load_elf32_into_memory(const std::string& path, Memory& mem){
     uint16_t e_phentsize = u16le(&eh->e_phentsize);
     uint16_t e_phnum     = u16le(&eh->e_phnum);
 
-    if(e_phoff + (uint32_t)e_phnum * e_phentsize > file.size())
+    if((uint64_t)e_phoff + (uint64_t)e_phnum * e_phentsize > file_size)
         throw std::runtime_error("program headers out of range");
 
     if(e_machine != EM_RISCV){
         std::cerr << "[elf] warning: e_machine="<< e_machine <<" (expect " << EM_RISCV << ")\n";
     }
 
-    // Map PT_LOAD segments
+    ElfImage img;
+    img.entry = e_entry;
+    img.file = fb;
     for(uint16_t i=0;i<e_phnum;i++){
-        const uint8_t* ph_ptr = file.data() + e_phoff + i*e_phentsize;
+        const uint8_t* ph_ptr = file + e_phoff + i*e_phentsize;
         uint32_t p_type   = u32le(ph_ptr+0);
         uint32_t p_offset = u32le(ph_ptr+4);
         uint32_t p_vaddr  = u32le(ph_ptr+8);
@@ -94,18 +167,29 @@ uint32_t load_elf32_into_memory(const std::string& path, Memory& mem){
         uint32_t p_memsz  = u32le(ph_ptr+20);
 
         if(p_type != PT_LOAD) continue;
-        if(p_offset + p_filesz > file.size())
+        if((uint64_t)p_offset + p_filesz > file_size)
             throw std::runtime_error("segment exceeds file size");
+        img.segments.push_back(Segment{p_vaddr, std::max(p_memsz, p_filesz), p_filesz, p_offset});
+    }
+    read_symbols(file, file_size, img.symbols);
+    return img;
+}
 
-        // Copy file bytes
-        for(uint32_t k=0;k<p_filesz;k++){
-            mem.store8(p_vaddr + k, file[p_offset + k]);
-        }
-        // Zero BSS
-        for(uint32_t k=p_filesz; k<p_memsz; k++){
-            mem.store8(p_vaddr + k, 0);
+uint32_t ElfImage::load_into(Memory& mem) const {
+    constexpr uint32_t PAGE = fastmem::PAGE;
+    for(const Segment& s : segments){
+        uint32_t mapped = 0;
+        // file pages straight into guest RAM when both sides are page aligned
+        if(file->fd() >= 0 && s.vaddr % PAGE == 0 && s.offset % PAGE == 0){
+            uint32_t whole = s.filesz & ~(PAGE - 1);
+            if(whole && mem.map_file(s.vaddr, whole, file->fd(), s.offset)) mapped = whole;
         }
+        mem.write_bytes(s.vaddr + mapped, bytes(s) + mapped, s.filesz - mapped);
+        mem.fill(s.vaddr + s.filesz, 0, s.memsz - s.filesz);     // BSS
     }
+    return entry;
+}
 
-    return e_entry;
+uint32_t load_elf32_into_memory(const std::string& path, Memory& mem){
+    return ElfImage::parse(path).load_into(mem);
 }
@@ -2,8 +2,51 @@
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <memory>
 #include <stdexcept>
 #include "mem.hpp"
+#include "symbols.hpp"
+
+// A whole file, read-only: mmap'ed where the host has it (nothing is read
+// until touched), else read into memory.
+class FileBytes {
+public:
+    static std::shared_ptr<const FileBytes> open(const std::string& path);   // throws runtime_error
+    explicit FileBytes(std::vector<uint8_t> bytes);                          // in memory, fd() = -1
+    ~FileBytes();
+    FileBytes(const FileBytes&) = delete;
+    FileBytes& operator=(const FileBytes&) = delete;
+
+    const uint8_t* data() const { return p; }
+    std::size_t size() const { return n; }
+    int fd() const { return fd_; }          // open while mapped, for direct segment mappings
+
+private:
+    FileBytes() = default;
+    std::vector<uint8_t> owned;
+    const uint8_t* p = nullptr; std::size_t n = 0;
+    int fd_ = -1; bool mapped = false;
+};
+
+// A parsed executable, independent of any Memory: map and validate the
+// file once, then load it into as many guest instances as needed.
+struct ElfImage {
+    struct Segment {
+        uint32_t vaddr, memsz, filesz;      // [vaddr, vaddr+filesz) from the file, the rest zero
+        uint32_t offset;                    // of the first byte in the file
+    };
+    uint32_t entry = 0;
+    std::vector<Segment> segments;          // PT_LOAD only
+    SymbolTable symbols;                    // .symtab, if the file has one
+    std::shared_ptr<const FileBytes> file;  // segment bytes live here
+
+    const uint8_t* bytes(const Segment& s) const { return file->data() + s.offset; }
+
+    static ElfImage parse(const std::string& path);
+    // Bulk copies, or under fastmem a private file mapping for the
+    // page-aligned part of a segment; returns entry
+    uint32_t load_into(Memory& mem) const;
+};
 
 // Returns entry point address after loading PT_LOAD segments into Memory.
 uint32_t load_elf32_into_memory(const std::string& path, Memory& mem);
@@ -0,0 +1,130 @@
+#include "fastmem.hpp"
+#include <mutex>
+
+#if SEEDOS_FASTMEM
+#include <csignal>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace fastmem {
+
+static thread_local Guard* armed = nullptr;
+static struct sigaction old_segv, old_bus;
+
+static void on_fault(int sig, siginfo_t* si, void* uc){
+    Guard* g = armed;
+    const uint8_t* a = (const uint8_t*)si->si_addr;
+    if (g && g->base && a >= g->base && a < g->base + SPACE + GUARD) {
+        siglongjmp(g->env, 1);
+    }
+    // not ours: hand it to whoever was installed before us
+    const struct sigaction& old = sig == SIGBUS ? old_bus : old_segv;
+    if (old.sa_flags & SA_SIGINFO) { old.sa_sigaction(sig, si, uc); return; }
+    if (old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN) { old.sa_handler(sig); return; }
+    signal(sig, SIG_DFL);                     // re-raised on return from the handler
+}
+
+static void install(){
+    static std::once_flag once;
+    std::call_once(once, []{
+        struct sigaction sa{};
+        sa.sa_sigaction = on_fault;
+        sa.sa_flags = SA_SIGINFO | SA_NODEFER;   // siglongjmp skips the mask restore
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGSEGV, &sa, &old_segv);
+        sigaction(SIGBUS,  &sa, &old_bus);
+    });
+}
+
+bool available(){
+    static const bool ok = []{
+        uint8_t* p = reserve(0);
+        if (p) release(p);
+        return p != nullptr;
+    }();
+    return ok;
+}
+
+uint8_t* reserve(std::size_t ram_bytes){
+    void* p = ::mmap(nullptr, SPACE + GUARD, PROT_NONE, MAP_PRIVATE|MAP_ANON|MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+    std::size_t commit = (ram_bytes + PAGE - 1) & ~(std::size_t)(PAGE - 1);
+    if (commit && ::mprotect(p, commit, PROT_READ|PROT_WRITE) != 0) {
+        ::munmap(p, SPACE + GUARD);
+        return nullptr;
+    }
+    install();
+    return (uint8_t*)p;
+}
+
+void release(uint8_t* base){ if (base) ::munmap(base, SPACE + GUARD); }
+
+void protect(uint8_t* base, uint32_t addr, uint32_t len){
+    uint64_t lo = addr & ~(uint64_t)(PAGE - 1), hi = ((uint64_t)addr + len + PAGE - 1) & ~(uint64_t)(PAGE - 1);
+    ::mprotect(base + lo, hi - lo, PROT_NONE);
+}
+
+int make_image(const uint8_t* data, std::size_t len){
+#if defined(__linux__)
+    int fd = ::memfd_create("seedos-image", MFD_CLOEXEC);
+#else
+    char path[] = "/tmp/seedos-image-XXXXXX";
+    int fd = ::mkstemp(path);
+    if (fd >= 0) ::unlink(path);
+#endif
+    if (fd < 0) return -1;
+    if (::ftruncate(fd, (off_t)len) != 0) { ::close(fd); return -1; }
+    for (std::size_t done = 0; done < len; ) {
+        ssize_t k = ::pwrite(fd, data + done, len - done, (off_t)done);
+        if (k <= 0) { ::close(fd); return -1; }
+        done += (std::size_t)k;
+    }
+    return fd;
+}
+
+void close_image(int fd){ if (fd >= 0) ::close(fd); }
+
+bool map_image(uint8_t* base, std::size_t len, int fd){
+    return ::mmap(base, len, PROT_READ, MAP_PRIVATE|MAP_FIXED, fd, 0) != MAP_FAILED;
+}
+
+void set_writable(uint8_t* base, uint32_t addr, uint32_t len, bool w){
+    ::mprotect(base + addr, len, w ? PROT_READ|PROT_WRITE : PROT_READ);
+}
+
+void discard(uint8_t* base, uint32_t addr, uint32_t len, int fd){
+    ::mmap(base + addr, len, PROT_READ, MAP_PRIVATE|MAP_FIXED, fd, (off_t)addr);
+}
+
+bool map_file(uint8_t* base, uint32_t addr, uint32_t len, int fd, uint64_t off){
+    return ::mmap(base + addr, len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, (off_t)off) != MAP_FAILED;
+}
+
+Guard::Guard(const uint8_t* b) : base(b), prev(armed) { armed = this; }
+Guard::~Guard(){ armed = prev; }
+void Guard::disarm(){ armed = prev; }
+void Guard::rearm(){ armed = this; }
+
+} // namespace fastmem
+
+#else // !SEEDOS_FASTMEM: Memory always uses its vector backend
+
+namespace fastmem {
+bool available(){ return false; }
+uint8_t* reserve(std::size_t){ return nullptr; }
+void release(uint8_t*){}
+void protect(uint8_t*, uint32_t, uint32_t){}
+int  make_image(const uint8_t*, std::size_t){ return -1; }
+void close_image(int){}
+bool map_image(uint8_t*, std::size_t, int){ return false; }
+void set_writable(uint8_t*, uint32_t, uint32_t, bool){}
+void discard(uint8_t*, uint32_t, uint32_t, int){}
+bool map_file(uint8_t*, uint32_t, uint32_t, int, uint64_t){ return false; }
+Guard::Guard(const uint8_t* b) : base(b), prev(nullptr) {}
+Guard::~Guard(){}
+void Guard::disarm(){}
+void Guard::rearm(){}
+} // namespace fastmem
+
+#endif
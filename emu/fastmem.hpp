@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <csetjmp>
+
+// Fastmem: the whole 32-bit guest space reserved in host address space, so a
+// guest access is one host load/store at base+addr. Only the RAM range is
+// readable/writable; everything else (beyond RAM, device pages, the guard
+// past 4 GiB) is PROT_NONE. A fault there, raised inside a Guard, jumps back
+// to the Guard's sigsetjmp and the interpreter redoes that instruction
+// through the checked accessors, which trap or talk to the device.
+namespace fastmem {
+
+constexpr uint64_t SPACE = 1ull << 32;      // guest addresses
+constexpr uint64_t GUARD = 1ull << 16;      // past the top: a word at 0xFFFFFFFF still faults
+constexpr uint32_t PAGE  = 4096;
+
+bool available();                           // built in and the host allows the reservation
+
+// reserve SPACE+GUARD, commit [0, ram_bytes); nullptr if the host refuses
+uint8_t* reserve(std::size_t ram_bytes);
+void     release(uint8_t* base);
+void     protect(uint8_t* base, uint32_t addr, uint32_t len);  // PROT_NONE, page granular
+
+// ---- copy-on-write images (snapshot.hpp) ----
+// An image is an anonymous file holding a RAM snapshot. Mapping it over a
+// reservation's RAM shares the pages with every other mapping; the first
+// write to a page gives that mapping a private copy, and discard() maps
+// the image back over it (read-only) so the page reads the image again.
+// A fresh MAP_FIXED mapping, not madvise: MADV_DONTNEED only drops private
+// copies on Linux and is advisory elsewhere (Darwin keeps them).
+int  make_image(const uint8_t* data, std::size_t len);      // fd, or -1
+void close_image(int fd);
+bool map_image(uint8_t* base, std::size_t len, int fd);     // [0, len) read-only, private
+void set_writable(uint8_t* base, uint32_t addr, uint32_t len, bool w);   // PROT_READ(|PROT_WRITE)
+void discard(uint8_t* base, uint32_t addr, uint32_t len, int fd);   // drop private copies
+
+// [addr, addr+len) becomes a private, writable mapping of fd at off (all
+// page aligned); the loader uses it to place ELF segments without copying
+bool map_file(uint8_t* base, uint32_t addr, uint32_t len, int fd, uint64_t off);
+
+// Armed for the current thread while alive. Use as
+//   fastmem::Guard g(base);  if (sigsetjmp(g.env, 0)) { /* faulted */ }
+// The frame that called sigsetjmp must outlive every access made under it.
+struct Guard {
+    sigjmp_buf env;
+    explicit Guard(const uint8_t* base);
+    ~Guard();
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+    // faults go to the enclosing Guard (if any) until rearm(); for work
+    // done from inside the sigsetjmp handler, which must not jump back to it
+    void disarm();
+    void rearm();
+
+    const uint8_t* base;
+    Guard* prev;
+};
+
+} // namespace fastmem
+
+// keeps guest-visible state in memory (not registers) at a fastmem access,
+// so nothing is lost when a fault siglongjmps out of it
+#if defined(__GNUC__) || defined(__clang__)
+#define FASTMEM_BARRIER() asm volatile("" ::: "memory")
+#else
+#define FASTMEM_BARRIER() ((void)0)
+#endif
@@ -0,0 +1,87 @@
+#include "heap.hpp"
+
+void GuestHeap::link(uint32_t start, Chunk& c){
+    unsigned k = class_of(c.size);
+    c.free = true; c.prev = NIL; c.next = heads[k];
+    if (heads[k] != NIL) chunks[heads[k]].prev = start;
+    heads[k] = start;
+    nonempty |= 1ull << k;
+    free_end[start + c.size] = start;
+    st.free_bytes += c.size; ++st.free_chunks;
+}
+
+void GuestHeap::unlink(uint32_t start, Chunk& c){
+    unsigned k = class_of(c.size);
+    if (c.prev != NIL) chunks[c.prev].next = c.next; else heads[k] = c.next;
+    if (c.next != NIL) chunks[c.next].prev = c.prev;
+    if (heads[k] == NIL) nonempty &= ~(1ull << k);
+    c.free = false;
+    free_end.erase(start + c.size);
+    st.free_bytes -= c.size; --st.free_chunks;
+}
+
+uint32_t GuestHeap::take(uint32_t need){
+    unsigned k = class_of(need);
+    uint32_t found = NIL;
+    if (k < EXACT) {
+        found = heads[k];
+    } else {
+        unsigned tries = 8;                       // bounded first fit in the own class
+        for (uint32_t p = heads[k]; p != NIL && tries--; p = chunks[p].next)
+            if (chunks[p].size >= need) { found = p; break; }
+    }
+    if (found == NIL) {
+        uint64_t m = nonempty & ~((2ull << k) - 1);   // every chunk there is bigger
+        if (!m) return NIL;
+        found = heads[__builtin_ctzll(m)];
+    }
+    Chunk& c = chunks[found];
+    unlink(found, c);
+    if (c.size - need >= ALIGN) {                 // split; the tail goes back
+        uint32_t rest = c.size - need;
+        c.size = need;
+        Chunk& t = chunks[found + need];
+        t = Chunk{rest};
+        link(found + need, t);
+    }
+    return found;
+}
+
+void GuestHeap::release(uint32_t start, uint32_t size){
+    auto nx = chunks.find(start + size);
+    if (nx != chunks.end() && nx->second.free) {  // header tag of the next chunk
+        unlink(nx->first, nx->second);
+        size += nx->second.size;
+        chunks.erase(nx);
+    }
+    auto pv = free_end.find(start);               // footer tag of the previous one
+    if (pv != free_end.end()) {
+        uint32_t ps = pv->second;
+        Chunk& p = chunks[ps];
+        unlink(ps, p);
+        chunks.erase(start);
+        start = ps;
+        size += p.size;
+    }
+    Chunk& c = chunks[start];
+    c = Chunk{size};
+    link(start, c);
+}
+
+void GuestHeap::free(uint32_t ptr){
+    auto it = chunks.find(ptr);
+    if (ptr == NIL || it == chunks.end() || it->second.free) { ++st.bad_frees; return; }
+    ++st.frees;
+    st.live_bytes -= it->second.req; --st.live_blocks;
+    release(ptr, it->second.size);
+}
+
+HeapStats GuestHeap::stats() const {
+    HeapStats s = st;
+    if (nonempty) {                               // the biggest chunk is in the top class
+        unsigned k = 63 - (unsigned)__builtin_clzll(nonempty);
+        for (uint32_t p = heads[k]; p != NIL; p = chunks.at(p).next)
+            s.largest_free = std::max<uint64_t>(s.largest_free, chunks.at(p).size);
+    }
+    return s;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+// Guest heap behind Memory::malloc32/free32 (ECALL 5/6). Chunk metadata
+// lives on the host, so a guest that scribbles over its heap can't corrupt
+// the allocator. Each chunk has a header tag (start -> size) and a free one
+// also a footer tag (end -> start), so free() finds both neighbours with two
+// hash lookups and coalesces in O(1).
+//
+// Free chunks sit in segregated lists: exact 8-byte classes up to 256 bytes,
+// then one class per power of two. malloc takes the head of an exact class,
+// first-fits a few entries of its own power-of-two class, then takes the
+// head of the next non-empty class (found in a bitmap), where every chunk
+// fits. Remainders are split off and refiled.
+struct HeapStats {
+    static constexpr unsigned HIST = 14;       // request sizes: <=8, <=16, ... <=32K, larger
+    uint64_t mallocs{0}, frees{0}, failed{0}, bad_frees{0};
+    uint64_t live_bytes{0}, live_blocks{0};     // as requested by the guest
+    uint64_t peak_live{0};
+    uint64_t free_bytes{0}, free_chunks{0};
+    uint64_t largest_free{0};                   // filled by GuestHeap::stats()
+    uint32_t heap_bytes{0};                     // taken from sbrk so far
+    uint32_t peak_brk{0};
+    uint64_t hist[HIST]{};
+
+    // external fragmentation: share of free bytes outside the largest chunk
+    double fragmentation() const { return free_bytes ? 1.0 - (double)largest_free / free_bytes : 0.0; }
+    static unsigned bucket(uint32_t n){
+        unsigned b = 0;
+        while (b + 1 < HIST && n > (8u << b)) ++b;
+        return b;
+    }
+};
+
+class GuestHeap {
+public:
+    static constexpr uint32_t ALIGN = 8, GROW = 4096;
+
+    GuestHeap(){ std::fill(heads, heads + CLASSES, NIL); }
+
+    // grow(bytes, at): extend the break by bytes, at = old break; false =
+    // out of memory. Returns 0 for nbytes == 0 or when growing fails.
+    template<class Grow> uint32_t malloc(uint32_t nbytes, Grow&& grow){
+        if (nbytes == 0) return 0;
+        ++st.mallocs;
+        uint32_t need = std::max(ALIGN, (nbytes + (ALIGN - 1)) & ~(ALIGN - 1));
+        if (need < nbytes) { ++st.failed; return 0; }           // wrapped
+        uint32_t p = take(need);
+        if (!p) {
+            uint32_t more = std::max(need, GROW), at = 0;
+            if (!grow(more, at)) { ++st.failed; return 0; }
+            st.heap_bytes += more;
+            note_brk(at + more);
+            release(at, more);                                   // merges with a free top chunk
+            p = take(need);
+        }
+        Chunk& c = chunks[p];
+        c.req = nbytes;
+        ++st.hist[HeapStats::bucket(nbytes)];
+        st.live_bytes += nbytes; ++st.live_blocks;
+        st.peak_live = std::max(st.peak_live, st.live_bytes);
+        return p;
+    }
+    // unknown pointers and double frees are counted and ignored
+    void free(uint32_t ptr);
+
+    void note_brk(uint32_t brk){ st.peak_brk = std::max(st.peak_brk, brk); }
+    HeapStats stats() const;
+
+private:
+    static constexpr unsigned EXACT = 32, CLASSES = 56;     // 8..256, then 2^8.. 2^31
+    static constexpr uint32_t NIL = 0;                      // the heap never starts at 0
+    struct Chunk {
+        uint32_t size{0}, req{0};
+        bool free{false};
+        uint32_t prev{NIL}, next{NIL};                       // free-list links
+    };
+
+    static unsigned class_of(uint32_t size){
+        if (size <= EXACT * ALIGN) return size / ALIGN - 1;
+        return EXACT + (31 - (unsigned)__builtin_clz(size)) - 8;
+    }
+    uint32_t take(uint32_t need);                // a chunk of exactly need bytes, or 0
+    void release(uint32_t start, uint32_t size); // coalesce and file
+    void link(uint32_t start, Chunk& c);
+    void unlink(uint32_t start, Chunk& c);
+
+    std::unordered_map<uint32_t, Chunk> chunks;      // header tags, by start
+    std::unordered_map<uint32_t, uint32_t> free_end; // footer tags: end -> start, free chunks only
+    uint32_t heads[CLASSES];
+    uint64_t nonempty{0};
+    HeapStats st;
+};
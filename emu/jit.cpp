@@ -0,0 +1,389 @@
+#include "jit.hpp"
+#include "mem.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+
+#if SEEDOS_JIT
+#include <sys/mman.h>
+
+namespace {
+
+constexpr uint32_t MAX_BLOCK = 64;      // guest instructions per block
+constexpr uint32_t HOT_SLOTS = 4096;    // direct-mapped pc -> block front cache
+constexpr std::size_t MAX_BLOCK_BYTES = MAX_BLOCK * 160; // generous bound on one block's code
+
+constexpr int32_t OFF_PC      = (int32_t)offsetof(CPU, pc);
+constexpr int32_t OFF_CYCLES  = (int32_t)offsetof(CPU, cycles);
+constexpr int32_t OFF_INSTRET = (int32_t)offsetof(CPU, instret);
+constexpr int32_t OFF_BUDGET  = (int32_t)offsetof(Jit::Ctx, budget);
+constexpr int32_t OFF_TICKS   = (int32_t)offsetof(Jit::Ctx, ticks);
+constexpr int32_t OFF_STATUS  = (int32_t)offsetof(Jit::Ctx, status);
+inline int32_t X(uint32_t r){ return (int32_t)(offsetof(CPU, x) + 4*r); }
+
+enum Reg : uint8_t { EAX=0, ECX=1, EDX=2, ESI=6 };
+enum Cc  : uint8_t { CC_B=0x2, CC_AE=0x3, CC_E=0x4, CC_NE=0x5, CC_L=0xC, CC_GE=0xD };
+
+// x86-64 emitter, only the encodings the translator needs.
+// rbx = CPU*, rbp = Jit::Ctx* for the whole time we're in the code cache.
+struct Emit {
+    uint8_t* p; uint8_t* end; bool ok = true;
+
+    void b(uint8_t v){ if (p < end) *p++ = v; else ok = false; }
+    void d32(uint32_t v){ for (int i=0;i<4;i++) b((uint8_t)(v >> (8*i))); }
+    void q64(uint64_t v){ for (int i=0;i<8;i++) b((uint8_t)(v >> (8*i))); }
+
+    // 32-bit guest register traffic through [rbx+disp32]
+    void load(Reg r, int32_t off)           { b(0x8B); b((uint8_t)(0x83 | r<<3)); d32((uint32_t)off); }
+    void store(int32_t off, Reg r)          { b(0x89); b((uint8_t)(0x83 | r<<3)); d32((uint32_t)off); }
+    void store_imm(int32_t off, uint32_t v) { b(0xC7); b(0x83); d32((uint32_t)off); d32(v); }
+    void alu_mem(uint8_t opc, int32_t off)  { b(opc); b(0x83); d32((uint32_t)off); }   // eax op= [rbx+off]
+    void add_eax(int32_t imm)               { b(0x05); d32((uint32_t)imm); }
+    void and_eax(uint32_t imm)              { b(0x25); d32(imm); }
+    void shift_eax_cl(uint8_t ext)          { b(0xD3); b((uint8_t)(0xC0 | ext<<3)); }
+    void setcc_eax(Cc cc)                   { b(0x0F); b((uint8_t)(0x90 | cc)); b(0xC0); b(0x0F); b(0xB6); b(0xC0); }
+
+    // 64-bit counters: [rbx+off] (CPU) and [rbp+off] (Ctx), op /ext imm32
+    void q_cpu(uint8_t ext, int32_t off, uint32_t imm){ b(0x48); b(0x81); b((uint8_t)(0x83 | ext<<3)); d32((uint32_t)off); d32(imm); }
+    void q_ctx(uint8_t ext, int32_t off, uint32_t imm){ b(0x48); b(0x81); b((uint8_t)(0x85 | ext<<3)); d32((uint32_t)off); d32(imm); }
+    void cmp_status(uint8_t imm8){ b(0x83); b(0xBD); d32((uint32_t)OFF_STATUS); b(imm8); }
+
+    void mov_eax(uint32_t v){ b(0xB8); d32(v); }
+    void xor_eax()          { b(0x31); b(0xC0); }
+    void call(const void* fn){
+        b(0x48); b(0x89); b(0xEF);                    // mov rdi, rbp
+        b(0x48); b(0xB8); q64((uint64_t)(uintptr_t)fn); // mov rax, fn
+        b(0xFF); b(0xD0);                             // call rax
+    }
+    uint8_t* jcc(Cc cc){ b(0x0F); b((uint8_t)(0x80 | cc)); uint8_t* s = p; d32(0); return s; }
+    uint8_t* jmp()     { b(0xE9); uint8_t* s = p; d32(0); return s; }
+};
+
+void patch(uint8_t* site, const uint8_t* target){
+    int32_t rel = (int32_t)(target - (site + 4));
+    for (int i=0;i<4;i++) site[i] = (uint8_t)((uint32_t)rel >> (8*i));
+}
+
+// helpers called from translated code; they never let an exception cross it
+template<Op K> uint32_t jit_load(Jit::Ctx* c, uint32_t addr){
+    if (c->ticks) { c->mem->tick((uint32_t)c->ticks); c->ticks = 0; }
+    try {
+        switch (K) {
+            case Op::Lb:  return (uint32_t)(int8_t)c->mem->load8(addr);
+            case Op::Lh:  return (uint32_t)(int16_t)c->mem->load16(addr);
+            case Op::Lbu: return c->mem->load8(addr);
+            case Op::Lhu: return c->mem->load16(addr);
+            default:      return c->mem->load32(addr);
+        }
+    }
+    catch (const std::out_of_range&) { c->status = 1; return 0; }
+}
+template<Op K> void jit_store(Jit::Ctx* c, uint32_t addr, uint32_t v){
+    if (c->ticks) { c->mem->tick((uint32_t)c->ticks); c->ticks = 0; }
+    try {
+        switch (K) {
+            case Op::Sb: c->mem->store8(addr, (uint8_t)v);   break;
+            case Op::Sh: c->mem->store16(addr, (uint16_t)v); break;
+            default:     c->mem->store32(addr, v);           break;
+        }
+    }
+    catch (const std::out_of_range&) { c->status = 1; return; }
+    catch (const Memory::WatchHit&) { c->status = 3; return; }
+    if (c->mem->icache().generation() != c->gen) c->status = 2;
+}
+
+const void* load_helper(Op op){
+    switch (op) {
+        case Op::Lb:  return (const void*)&jit_load<Op::Lb>;
+        case Op::Lh:  return (const void*)&jit_load<Op::Lh>;
+        case Op::Lbu: return (const void*)&jit_load<Op::Lbu>;
+        case Op::Lhu: return (const void*)&jit_load<Op::Lhu>;
+        default:      return (const void*)&jit_load<Op::Lw>;
+    }
+}
+const void* store_helper(Op op){
+    switch (op) {
+        case Op::Sb: return (const void*)&jit_store<Op::Sb>;
+        case Op::Sh: return (const void*)&jit_store<Op::Sh>;
+        default:     return (const void*)&jit_store<Op::Sw>;
+    }
+}
+
+bool translatable(Op op){
+    return op >= Op::Addi && op <= Op::Jalr;   // RV32I minus SYSTEM; no fences or atomics
+}
+
+bool ends_block(Op op){
+    switch(op){
+        case Op::Beq: case Op::Bne: case Op::Blt: case Op::Bge: case Op::Bltu: case Op::Bgeu:
+        case Op::Jal: case Op::Jalr: return true;
+        default: return false;
+    }
+}
+
+// instructions until (and including) the next yield/quantum event of CPU::run
+uint64_t until_event(const CPU& c){
+    uint64_t q = c.quantum, s = c.slice_count;
+    uint64_t k_yield = s >= q ? 1 : (q - s + 2) / 2;
+    return std::min(k_yield, q);
+}
+
+} // namespace
+
+bool Jit::available(){ return true; }
+
+Jit::Jit(Memory& m, std::size_t cache_bytes) : mem(m), hot(HOT_SLOTS, Hot{~0u, nullptr}) {
+    void* p = ::mmap(nullptr, cache_bytes, PROT_READ|PROT_WRITE|PROT_EXEC, MAP_PRIVATE|MAP_ANON, -1, 0);
+    if (p == MAP_FAILED) throw std::runtime_error("jit: cannot map code cache");
+    cache = (uint8_t*)p; cap = cache_bytes;
+
+    Emit e{cache, cache + cap};
+    e.b(0x53); e.b(0x55); e.b(0x41); e.b(0x54);   // push rbx; push rbp; push r12 (keeps rsp 16-aligned)
+    e.b(0x48); e.b(0x89); e.b(0xFB);              // mov rbx, rdi   (CPU*)
+    e.b(0x48); e.b(0x89); e.b(0xF5);              // mov rbp, rsi   (Ctx*)
+    e.b(0xFF); e.b(0xE2);                         // jmp rdx        (block)
+    exit_stub = e.p;
+    e.b(0x41); e.b(0x5C); e.b(0x5D); e.b(0x5B);   // pop r12; pop rbp; pop rbx
+    e.b(0xC3);                                    // ret (eax = 0 ok / 1 fault)
+    used = (std::size_t)(e.p - cache);
+    enter = reinterpret_cast<uint32_t(*)(CPU*, Ctx*, uint8_t*)>(cache);
+    ctx.mem = &mem;
+    gen = mem.icache().generation();
+}
+
+Jit::~Jit(){ if (cache) ::munmap(cache, cap); }
+
+void Jit::flush(){
+    blocks.clear(); by_pc.clear(); unresolved.clear();
+    std::fill(hot.begin(), hot.end(), Hot{~0u, nullptr});
+    used = (std::size_t)(exit_stub + 5 - cache);  // keep the trampoline
+    full = false;
+    gen = mem.icache().generation();
+    ++st.flushes;
+}
+
+Jit::Block* Jit::find(uint32_t pc){
+    if (pc & 3u) return nullptr;
+    Hot& h = hot[(pc >> 2) & (HOT_SLOTS-1)];
+    if (h.pc == pc) return h.b;
+    Block* b;
+    auto it = by_pc.find(pc);
+    if (it != by_pc.end()) b = it->second;
+    else {
+        b = compile(pc);
+        if (!b && full) { flush(); b = compile(pc); }
+        if (!b) by_pc[pc] = nullptr;
+    }
+    h = Hot{pc, b};
+    return b;
+}
+
+Jit::Block* Jit::compile(uint32_t start){
+    // collect the guest block through the decode cache, so a later store to
+    // any of these words bumps its generation and we flush
+    Decoded ins[MAX_BLOCK]; uint32_t n = 0;
+    DecodeCache& dc = mem.icache();
+    for (uint32_t a = start; n < MAX_BLOCK; a += 4) {
+        if (mem.is_device(a)) break;             // device pages are never translated
+        Decoded d;
+        try { d = dc.fetch(mem, a); } catch (const std::out_of_range&) { break; }
+        d.op = base_op(d.op);                      // translated code needs no pair fusion
+        if (!translatable(d.op)) break;           // the interpreter runs these
+        ins[n++] = d;
+        if (ends_block(d.op)) break;
+    }
+    if (n == 0) return nullptr;
+    if (cap - used < MAX_BLOCK_BYTES) { full = true; return nullptr; }
+
+    Emit e{cache + used, cache + cap};
+    uint8_t* entry = e.p;
+
+    // budget gate: chained blocks skip the dispatcher, so each one checks
+    e.q_ctx(7, OFF_BUDGET, n);                     // cmp qword [rbp+budget], n
+    uint8_t* no_budget = e.jcc(CC_B);
+    e.q_ctx(5, OFF_BUDGET, n);                     // sub qword [rbp+budget], n
+
+    uint32_t pend_n = 0, pend_cost = 0;           // retired but not yet added to the counters
+    auto commit = [&]{
+        if (!pend_n) return;
+        e.q_cpu(0, OFF_INSTRET, pend_n);
+        e.q_cpu(0, OFF_CYCLES,  pend_cost + pend_n);  // cost, plus step's extra cycles++
+        e.q_ctx(0, OFF_TICKS,   pend_cost);
+        pend_n = pend_cost = 0;
+    };
+    struct Chain { uint8_t* site; uint32_t target; };
+    struct Slow  { uint8_t* site; uint32_t i; bool store; };
+    std::vector<Chain> chains; std::vector<Slow> slows;
+    auto exit_to = [&](uint32_t target){
+        e.store_imm(OFF_PC, target); e.xor_eax();
+        uint8_t* s = e.jmp(); chains.push_back({s, target});
+    };
+
+    bool open_end = true;
+    for (uint32_t i = 0; i < n; ++i) {
+        const Decoded& d = ins[i];
+        const uint32_t pc = start + 4*i;
+        switch (d.op) {
+        case Op::Addi:
+            if (d.rd) { e.load(EAX, X(d.rs1)); e.add_eax(d.imm); e.store(X(d.rd), EAX); }
+            ++pend_n; pend_cost += 1; break;
+        case Op::Add: case Op::Sub:
+            if (d.rd) { e.load(EAX, X(d.rs1)); e.alu_mem(d.op==Op::Add ? 0x03 : 0x2B, X(d.rs2)); e.store(X(d.rd), EAX); }
+            ++pend_n; pend_cost += 1; break;
+        case Op::Sll: case Op::Srl: case Op::Sra:
+            if (d.rd) {
+                e.load(EAX, X(d.rs1)); e.load(ECX, X(d.rs2));
+                e.shift_eax_cl(d.op==Op::Sll ? 4 : d.op==Op::Srl ? 5 : 7);   // x86 masks cl to 5 bits too
+                e.store(X(d.rd), EAX);
+            }
+            ++pend_n; pend_cost += 1; break;
+        case Op::Slt: case Op::Sltu:
+            if (d.rd) { e.load(EAX, X(d.rs1)); e.alu_mem(0x3B, X(d.rs2)); e.setcc_eax(d.op==Op::Slt ? CC_L : CC_B); e.store(X(d.rd), EAX); }
+            ++pend_n; pend_cost += 1; break;
+        case Op::Lui:
+            if (d.rd) e.store_imm(X(d.rd), (uint32_t)d.imm);
+            ++pend_n; pend_cost += 1; break;
+        case Op::Auipc:
+            if (d.rd) e.store_imm(X(d.rd), pc + (uint32_t)d.imm);
+            ++pend_n; pend_cost += 1; break;
+
+        case Op::Lb: case Op::Lh: case Op::Lw: case Op::Lbu: case Op::Lhu:
+            if (d.rd) {            // step() skips the access entirely for rd == x0
+                commit();          // the timer must see every earlier instruction
+                e.load(EAX, X(d.rs1)); e.add_eax(d.imm);
+                e.b(0x89); e.b(0xC6);                          // mov esi, eax
+                e.call(load_helper(d.op));
+                e.cmp_status(0); slows.push_back({e.jcc(CC_NE), i, false});
+                e.store(X(d.rd), EAX);
+            }
+            ++pend_n; pend_cost += 3; break;
+        case Op::Sb: case Op::Sh: case Op::Sw:
+            commit();
+            e.load(EAX, X(d.rs1)); e.add_eax(d.imm);
+            e.b(0x89); e.b(0xC6);                              // mov esi, eax
+            e.load(EDX, X(d.rs2));
+            e.call(store_helper(d.op));
+            e.cmp_status(0); slows.push_back({e.jcc(CC_NE), i, true});
+            ++pend_n; pend_cost += 3; break;
+
+        case Op::Beq: case Op::Bne: case Op::Blt: case Op::Bge: case Op::Bltu: case Op::Bgeu: {
+            ++pend_n; pend_cost += 1; commit();
+            static const Cc cc_of[] = { CC_E, CC_NE, CC_L, CC_GE, CC_B, CC_AE };
+            e.load(EAX, X(d.rs1)); e.alu_mem(0x3B, X(d.rs2));
+            uint8_t* taken = e.jcc(cc_of[(int)d.op - (int)Op::Beq]);
+            exit_to(pc + 4);
+            patch(taken, e.p);
+            exit_to(pc + (uint32_t)d.imm);
+            open_end = false; break;
+        }
+        case Op::Jal:
+            ++pend_n; pend_cost += 2; commit();
+            if (d.rd) e.store_imm(X(d.rd), pc + 4);
+            exit_to(pc + (uint32_t)d.imm);
+            open_end = false; break;
+        case Op::Jalr:
+            ++pend_n; pend_cost += 2; commit();
+            e.load(EAX, X(d.rs1)); e.add_eax(d.imm); e.and_eax(~1u);  // read rs1 before rd is written
+            if (d.rd) e.store_imm(X(d.rd), pc + 4);
+            e.store(OFF_PC, EAX); e.xor_eax();
+            patch(e.jmp(), exit_stub);                                 // dynamic target: back to the dispatcher
+            open_end = false; break;
+        default: break;   // not collected above
+        }
+    }
+    if (open_end) { commit(); exit_to(start + 4*n); }
+
+    // out-of-line paths
+    patch(no_budget, e.p);
+    e.store_imm(OFF_PC, start); e.xor_eax(); patch(e.jmp(), exit_stub);
+    for (const Slow& s : slows) {
+        patch(s.site, e.p);
+        const uint32_t pc = start + 4*s.i;
+        uint8_t* to_smc = nullptr;
+        if (s.store) { e.cmp_status(2); to_smc = e.jcc(CC_E); }
+        // fault or watch hit: pc stays on the access, refund what we didn't run
+        e.store_imm(OFF_PC, pc); e.q_ctx(0, OFF_BUDGET, n - s.i);
+        e.mov_eax(1); patch(e.jmp(), exit_stub);
+        if (s.store) {
+            // the store hit decoded code: retire it, then leave so the dispatcher flushes
+            patch(to_smc, e.p);
+            e.q_cpu(0, OFF_INSTRET, 1); e.q_cpu(0, OFF_CYCLES, 4); e.q_ctx(0, OFF_TICKS, 3);
+            e.store_imm(OFF_PC, pc + 4); e.q_ctx(0, OFF_BUDGET, n - s.i - 1);
+            e.xor_eax(); patch(e.jmp(), exit_stub);
+        }
+    }
+    if (!e.ok) throw std::logic_error("jit: MAX_BLOCK_BYTES too small");
+    used = (std::size_t)(e.p - cache);
+
+    blocks.push_back(std::make_unique<Block>(Block{start, n, entry}));
+    Block* blk = blocks.back().get();
+    by_pc[start] = blk;
+    ++st.blocks;
+
+    // link: earlier blocks waiting on us, then our own static exits
+    auto waiting = unresolved.find(start);
+    if (waiting != unresolved.end()) {
+        for (uint8_t* site : waiting->second) { patch(site, entry); ++st.chains; }
+        unresolved.erase(waiting);
+    }
+    for (const Chain& c : chains) {
+        patch(c.site, exit_stub);
+        auto it = by_pc.find(c.target);
+        if (it != by_pc.end() && it->second) { patch(c.site, it->second->code); ++st.chains; }
+        else unresolved[c.target].push_back(c.site);
+    }
+    return blk;
+}
+
+RunExit Jit::run(CPU& cpu, Memory& m, uint64_t max_insns){
+    if (&m != &mem) return cpu.interpret(m, max_insns);
+    RunExit ex{Exit::Budget, 0};
+    if (cpu.halted) { ex.reason = Exit::Halt; return ex; }
+    cpu.yielded = false;
+
+    while (ex.insns < max_insns) {
+        if (mem.icache().generation() != gen) flush();
+        // never let translated code reach a quantum/yield event: the
+        // interpreter retires that instruction and sets the flags itself
+        uint64_t room = max_insns - ex.insns;
+        if (cpu.quantum) room = std::min<uint64_t>(room, until_event(cpu) - 1);
+
+        Block* b = room ? find(cpu.pc) : nullptr;
+        if (b && b->n <= room) {
+            ctx.budget = room; ctx.ticks = 0; ctx.status = 0; ctx.gen = gen;
+            ++st.entries;
+            uint32_t rc = enter(&cpu, &ctx, b->code);
+            uint64_t done = room - ctx.budget;
+            if (ctx.ticks) mem.tick((uint32_t)ctx.ticks);
+            if (cpu.quantum) { cpu.slice_count += (uint32_t)done; cpu.quantum -= (uint32_t)done; }
+            ex.insns += done; st.jit_insns += done;
+            if (rc == 1) { ex.reason = ctx.status == 3 ? Exit::Watchpoint : Exit::Trap; return ex; }
+            if (done) continue;
+        }
+        RunExit r = cpu.interpret(mem, 1);
+        ex.insns += r.insns; st.interp_insns += r.insns;
+        if (r.reason != Exit::Budget) { ex.reason = r.reason; return ex; }
+        if (cpu.features(mem) & FeatMmu) {         // a CSR write enabled Sv32
+            r = cpu.interpret(mem, max_insns - ex.insns);
+            ex.insns += r.insns; st.interp_insns += r.insns; ex.reason = r.reason;
+            return ex;
+        }
+    }
+    return ex;
+}
+
+#else // !SEEDOS_JIT: keep the interface, always interpret
+
+bool Jit::available(){ return false; }
+Jit::Jit(Memory& m, std::size_t) : mem(m) {}
+Jit::~Jit() = default;
+void Jit::flush(){}
+Jit::Block* Jit::find(uint32_t){ return nullptr; }
+Jit::Block* Jit::compile(uint32_t){ return nullptr; }
+RunExit Jit::run(CPU& cpu, Memory& m, uint64_t max_insns){
+    RunExit r = cpu.interpret(m, max_insns);
+    st.interp_insns += r.insns;
+    return r;
+}
+
+#endif
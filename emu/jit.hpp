@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "cpu.hpp"
+
+class Memory;
+
+// Basic-block JIT: guest blocks (ending at a branch/JAL/JALR, or just before
+// a SYSTEM instruction) are translated to x86-64 into an executable code
+// cache and chained directly to each other. Guest registers stay in CPU::x,
+// so the interpreter can take over at any block boundary; it runs SYSTEM
+// instructions, anything the JIT refuses, and the instruction on which a
+// quantum/yield event falls, so accounting matches CPU::step exactly.
+//
+// Attach with `cpu.jit = &jit;` — CPU::run then goes through Jit::run
+// whenever tracing and breakpoints are off. One Jit serves every CPU that
+// shares its Memory.
+class Jit {
+public:
+    struct Stats {
+        uint64_t blocks = 0;        // blocks compiled
+        uint64_t entries = 0;       // dispatcher -> code cache transitions
+        uint64_t chains = 0;        // direct block-to-block jumps patched in
+        uint64_t flushes = 0;       // whole-cache flushes (guest code written / cache full)
+        uint64_t jit_insns = 0;     // instructions retired in translated code
+        uint64_t interp_insns = 0;  // instructions handed back to the interpreter
+    };
+
+    explicit Jit(Memory& mem, std::size_t cache_bytes = 16u << 20);
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    static bool available();        // false where the backend isn't built (non x86-64)
+
+    RunExit run(CPU& cpu, Memory& m, uint64_t max_insns);   // m must be the Memory we were built for
+    void flush();
+    const Stats& stats() const { return st; }
+
+    // shared with the generated code and its helpers
+    struct Ctx {
+        uint64_t budget;            // instructions the translated code may still retire
+        uint64_t ticks;             // timer ticks not yet handed to Memory::tick
+        uint32_t status;            // 0 ok, 1 memory fault, 2 guest code was written, 3 watch hit
+        uint32_t pad;
+        Memory*  mem;
+        uint64_t gen;               // decode-cache generation the code was built from
+    };
+
+private:
+    struct Block { uint32_t pc, n; uint8_t* code; };
+
+    Block* find(uint32_t pc);
+    Block* compile(uint32_t pc);
+
+    Memory& mem;
+    uint8_t* cache = nullptr; std::size_t cap = 0, used = 0; bool full = false;
+    uint8_t* exit_stub = nullptr;                       // common epilogue
+    uint32_t (*enter)(CPU*, Ctx*, uint8_t*) = nullptr;  // prologue trampoline
+    Ctx ctx{};
+    uint64_t gen = 0;
+
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::unordered_map<uint32_t, Block*> by_pc;         // nullptr = interpret this pc
+    std::unordered_map<uint32_t, std::vector<uint8_t*>> unresolved; // target pc -> rel32 sites
+    struct Hot { uint32_t pc; Block* b; };
+    std::vector<Hot> hot;                               // direct-mapped front of by_pc
+    Stats st;
+};
@@ -9,6 +9,11 @@
 #include <cctype>
 #include <cstdint>
 #include <vector>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
 #include <sys/stat.h>
 
 #include "cpu.hpp"
@@ -18,6 +23,15 @@
 #include "elf.hpp"
 #include "sync.hpp"
 #include "syscall.hpp"
+#include "jit.hpp"
+#include "smp.hpp"
+#include "batch.hpp"
+#include "cache.hpp"
+#include "bpred.hpp"
+#include "profile.hpp"
+#include "sched.hpp"
+#include "mmu.hpp"
+#include "debug.hpp"
 
 // -------------------------------
 // Small utilities used everywhere
@@ -39,21 +53,48 @@ static void dump_regs(const CPU& c){
               << " x6="  << c.x[6] << " x7=" << c.x[7] << "\n";
 }
 
-static void dump_words(const Memory& ram, uint32_t addr, int n){
+// with a Debugger, planted breakpoints show as the words they replaced
+static uint32_t word_at(const Memory& ram, const Debugger* dbg, uint32_t a){
+    return dbg ? dbg->read32(a) : ram.load32(a);
+}
+
+static void dump_words(const Memory& ram, uint32_t addr, int n, const Debugger* dbg = nullptr){
     for(int i=0;i<n;i++){
         uint32_t a = addr + 4*i;
-        uint32_t w = ram.load32(a);
+        uint32_t w = word_at(ram, dbg, a);
         std::cout << "  " << hex32(a) << ": " << hex32(w)
                   << "  " << disasm(w) << "\n";
     }
 }
 
-static void disasm_ahead(const Memory& ram, uint32_t pc, int k){
+static void disasm_ahead(const Memory& ram, uint32_t pc, int k, const SymbolTable* syms = nullptr,
+                         const Debugger* dbg = nullptr){
     for(int i=0;i<k;i++){
         uint32_t a = pc + 4*i;
-        uint32_t w = ram.load32(a);
-        std::cout << "  " << hex32(a) << ": " << disasm(w) << "\n";
+        uint32_t w = word_at(ram, dbg, a);
+        const SymbolTable::Symbol* s = syms ? syms->lookup(a) : nullptr;
+        if (s && s->addr == a) std::cout << s->name << ":\n";
+        std::cout << "  " << hex32(a) << ": " << (syms ? disasm(w, a, *syms) : disasm(w)) << "\n";
+    }
+}
+
+// Run up to `budget` instructions, riding through yields (the callers here
+// don't schedule on them). Stops on halt, quantum, breakpoint or trap.
+static RunExit run_through_yields(CPU& cpu, Memory& ram, uint64_t budget){
+    RunExit total{Exit::Budget, 0};
+    while (total.insns < budget) {
+        RunExit r = cpu.run(ram, budget - total.insns);
+        total.insns += r.insns; total.reason = r.reason;
+        if (r.reason != Exit::Yield) break;
     }
+    return total;
+}
+
+static void report_trap(const CPU& cpu, const Memory& ram, const SymbolTable* syms = nullptr){
+    std::cout << "[trap] pc=" << hex32(cpu.pc);
+    if (syms && syms->lookup(cpu.pc)) std::cout << " <" << syms->describe(cpu.pc) << ">";
+    try { std::cout << "  " << disasm(ram.load32(cpu.pc)); } catch (const std::out_of_range&) {}
+    std::cout << "\n";
 }
 
 // ---------- encoders ----------
@@ -69,6 +110,21 @@ static inline uint32_t enc_LUI(uint8_t rd, uint32_t imm20){
     return ((imm20 & 0xFFFFF)<<12)|(rd<<7)|0x37;
 }
 static inline uint32_t enc_ECALL(){ return 0x00000073u; }
+static inline uint32_t enc_B(uint8_t rs1, uint8_t rs2, uint8_t f3, int32_t off){
+    uint32_t u = (uint32_t)off;
+    return (((u>>12)&1)<<31)|(((u>>5)&0x3F)<<25)|(rs2<<20)|(rs1<<15)|(f3<<12)
+         |(((u>>1)&0xF)<<8)|(((u>>11)&1)<<7)|0x63;
+}
+static inline uint32_t enc_LW(uint8_t rd, uint8_t rs1, int32_t imm12){
+    return ((uint32_t)(imm12 & 0xFFF)<<20)|(rs1<<15)|(0b010<<12)|(rd<<7)|0x03;
+}
+static inline uint32_t enc_SW(uint8_t rs1, uint8_t rs2, int32_t imm12){
+    uint32_t u = (uint32_t)(imm12 & 0xFFF);
+    return ((u>>5)<<25)|(rs2<<20)|(rs1<<15)|(0b010<<12)|((u&0x1F)<<7)|0x23;
+}
+static inline uint32_t enc_AMO(uint8_t f5, uint8_t rd, uint8_t rs1, uint8_t rs2){
+    return ((uint32_t)f5<<27)|(rs2<<20)|(rs1<<15)|(0b010<<12)|(rd<<7)|0x2F;
+}
 
 // ---------- tiny program images for two "processes" ----------
 static void load_task_program(Memory& ram, uint32_t base, int which){
@@ -91,37 +147,173 @@ static void load_task_program(Memory& ram, uint32_t base, int which){
     put32(ram, a+0x1C, enc_ECALL());                           // exit
 }
 
+// ---------- SMP workload: x7 rounds of amoadd + an LR/SC-locked plain increment ----------
+// 0x2000 atomic counter, 0x2004 locked counter, 0x2008 spinlock
+static constexpr uint32_t SMP_CODE = 0x1000, SMP_DATA = 0x2000;
+static void load_smp_program(Memory& ram){
+    uint32_t a = SMP_CODE;
+    auto emit = [&](uint32_t w){ put32(ram, a, w); a += 4; };
+    emit(enc_LUI(5, SMP_DATA>>12));                 // 0x00 x5 = data
+    emit(enc_I(6, 0, 1, 0));                        // 0x04 x6 = 1
+    emit(enc_I(8, 5, 8, 0));                        // 0x08 x8 = &lock
+    emit(enc_AMO(0x00, 0, 5, 6));                   // 0x0C loop: amoadd.w x0,x6,(x5)
+    emit(enc_AMO(0x02, 9, 8, 0));                   // 0x10 acq:  lr.w x9,(x8)
+    emit(enc_B(9, 0, 0b001, -4));                   // 0x14       bnez x9,acq
+    emit(enc_AMO(0x03, 9, 8, 6));                   // 0x18       sc.w x9,x6,(x8)
+    emit(enc_B(9, 0, 0b001, -12));                  // 0x1C       bnez x9,acq
+    emit(enc_LW(10, 5, 4));                         // 0x20 lw   x10,4(x5)
+    emit(enc_I(10, 10, 1, 0));                      // 0x24 addi x10,x10,1
+    emit(enc_SW(5, 10, 4));                         // 0x28 sw   x10,4(x5)
+    emit(enc_AMO(0x01, 0, 8, 0));                   // 0x2C release: amoswap.w x0,x0,(x8)
+    emit(enc_I(7, 7, -1, 0));                       // 0x30 x7--
+    emit(enc_B(7, 0, 0b001, 0x0C - 0x34));          // 0x34 bnez x7,loop
+    emit(enc_I(10, 0, 0, 0));                       // 0x38 a0 = 0
+    emit(enc_I(17, 0, 0, 0));                       // 0x3C a7 = exit
+    emit(enc_ECALL());                              // 0x40
+}
+
+// ---------- Sv32 workload: the same code and virtual addresses in two address spaces ----------
+// Physical: page tables from 0x10000, code frames at 0x20000/0x21000, 16 data
+// frames per task from 0x30000/0x40000. Virtual: code at 0, data at VM_DATA.
+// Each round reads and bumps one word per data page; exit code = the sum read.
+static constexpr uint32_t VM_DATA = 0x10000, VM_PAGES = 16, VM_ROUNDS = 8;
+static void load_vm_program(Memory& ram, uint32_t pa){
+    uint32_t a = pa;
+    auto emit = [&](uint32_t w){ put32(ram, a, w); a += 4; };
+    emit(enc_I(7, 0, 0, 0));                        // 0x00 x7 = 0 (sum)
+    emit(enc_I(9, 0, VM_ROUNDS, 0));                // 0x04 x9 = rounds
+    emit(enc_LUI(12, 1));                           // 0x08 x12 = page size
+    emit(enc_LUI(8, VM_DATA >> 12));                // 0x0C round: x8 = data
+    emit(enc_I(10, 0, VM_PAGES, 0));                // 0x10 x10 = pages
+    emit(enc_LW(11, 8, 0));                         // 0x14 page: lw x11,0(x8)
+    emit(enc_R(7, 7, 11, 0, 0));                    // 0x18 x7 += x11
+    emit(enc_I(11, 11, 1, 0));                      // 0x1C x11++
+    emit(enc_SW(8, 11, 0));                         // 0x20 sw x11,0(x8)
+    emit(enc_R(8, 8, 12, 0, 0));                    // 0x24 next page
+    emit(enc_I(10, 10, -1, 0));                     // 0x28 x10--
+    emit(enc_B(10, 0, 0b001, 0x14 - 0x2C));         // 0x2C bnez x10,page
+    emit(enc_I(9, 9, -1, 0));                       // 0x30 x9--
+    emit(enc_B(9, 0, 0b001, 0x0C - 0x34));          // 0x34 bnez x9,round
+    emit(enc_I(10, 7, 0, 0));                       // 0x38 a0 = sum
+    emit(enc_I(17, 0, 0, 0));                       // 0x3C a7 = exit
+    emit(enc_ECALL());                              // 0x40
+}
+
+// one 4 KiB mapping below 4 MiB: root -> the single level-0 table l0 -> pa
+static void vm_map(Memory& ram, uint32_t root, uint32_t l0, uint32_t va, uint32_t pa, uint32_t flags){
+    put32(ram, root + 4*(va >> 22), ((l0 >> 12) << 10) | Mmu::V);
+    put32(ram, l0 + 4*((va >> 12) & 0x3FF), ((pa >> 12) << 10) | flags | Mmu::V);
+}
+
+// both tasks round-robin on one TLB of `entries`; every switch changes satp
+// and so flushes it
+static void run_vm(unsigned entries){
+    Memory ram(1u << 20);
+    ram.set_timer(false);
+    Mmu mmu(ram, entries);
+    CPU task[2];
+    for (uint32_t t = 0; t < 2; ++t) {
+        uint32_t root = 0x10000 + 0x2000*t, l0 = root + 0x1000, code = 0x20000 + 0x1000*t;
+        load_vm_program(ram, code);
+        vm_map(ram, root, l0, 0, code, Mmu::R | Mmu::X);
+        for (uint32_t i = 0; i < VM_PAGES; ++i) {
+            uint32_t frame = 0x30000 + 0x10000*t + 0x1000*i;
+            put32(ram, frame, (t + 1) * (i + 1));
+            vm_map(ram, root, l0, VM_DATA + 0x1000*i, frame, Mmu::R | Mmu::W);
+        }
+        task[t].satp = Mmu::SATP_SV32 | (root >> 12);
+        task[t].mmu = &mmu; task[t].tid = t;
+    }
+    while (!(task[0].halted && task[1].halted)) {
+        for (CPU& c : task) {
+            if (c.halted) continue;
+            c.quantum = 1000;
+            if (c.run(ram, UINT64_MAX).reason == Exit::Trap) {
+                std::cout << "[vm] task " << c.tid << " page fault at va " << hex32(mmu.last_fault().vaddr)
+                          << " pc=" << hex32(c.pc) << "\n";
+                c.halted = true;
+            }
+        }
+    }
+    const Mmu::Stats& s = mmu.stats();
+    uint64_t hits = s.hits[Mmu::Read] + s.hits[Mmu::Write] + s.hits[Mmu::Exec];
+    uint64_t misses = s.misses[Mmu::Read] + s.misses[Mmu::Write] + s.misses[Mmu::Exec];
+    std::cout << "[vm] tlb=" << std::setw(2) << entries
+              << " exit A=" << task[0].exit_code << " B=" << task[1].exit_code
+              << " hits=" << hits << " misses=" << misses
+              << " (fetch " << s.misses[Mmu::Exec] << ", load " << s.misses[Mmu::Read]
+              << ", store " << s.misses[Mmu::Write] << ") walks=" << s.walks
+              << " flushes=" << s.flushes << " hit_rate=" << std::fixed << std::setprecision(2)
+              << (hits + misses ? 100.0 * hits / (hits + misses) : 0.0) << "%" << std::defaultfloat << "\n";
+}
+
+// run `total` rounds split across `n` harts; prints counters, returns wall seconds
+static double run_smp(unsigned n, uint32_t total){
+    Memory ram(64*1024);
+    ram.set_timer(false);
+    load_smp_program(ram);
+    std::vector<CPU> cpus(n);
+    Smp smp(ram);
+    for (unsigned i = 0; i < n; ++i) {
+        cpus[i].pc = SMP_CODE; cpus[i].tid = i;
+        cpus[i].x[7] = total / n + (i < total % n);
+        smp.add(cpus[i]);
+    }
+    Smp::Result r = smp.run();
+    uint64_t insns = 0; bool ok = true;
+    for (auto& h : r.harts) { insns += h.insns; ok = ok && h.reason == Exit::Halt; }
+    std::cout << "[smp] harts=" << n << " atomic=" << ram.load32(SMP_DATA)
+              << " locked=" << ram.load32(SMP_DATA + 4) << " expected=" << total
+              << (ok ? "" : " (a hart did not halt)")
+              << " insns=" << insns << " (spinning included) "
+              << (uint64_t)(r.seconds*1e3) << " ms\n";
+    return r.seconds;
+}
+
 // -------------------------- debugger helpers --------------------------
 static void run_with_breakpoints(CPU& cpu, Memory& ram,
                                  std::initializer_list<uint32_t> bp_list,
                                  int max_steps = 200)
 {
-    std::unordered_set<uint32_t> bps(bp_list);
-    for (int i = 0; i < max_steps && !cpu.halted; ++i) {
-        if (bps.count(cpu.pc)) {
-            uint32_t inst = ram.load32(cpu.pc);
-            std::cout << "[brk] pc=0x" << std::hex << cpu.pc << std::dec
-                      << "  " << disasm(inst) << "\n";
-            dump_regs(cpu);
-            for (int s = 0; s < 3 && !cpu.halted; ++s) {
-                cpu.step(ram);
-                uint32_t ninst = ram.load32(cpu.pc);
-                std::cout << "  -> next pc=0x" << std::hex << cpu.pc << std::dec
-                          << "  " << disasm(ninst) << "\n";
-            }
-        } else {
-            cpu.step(ram);
+    Debugger dbg(cpu, ram);
+    for (uint32_t a : bp_list) dbg.set_breakpoint(a);
+    for (int i = 0; i < max_steps && !cpu.halted; ) {
+        Debugger::Stop r = dbg.cont((uint64_t)(max_steps - i));
+        i += (int)r.insns;
+        if (r.reason == Exit::Trap) { report_trap(cpu, ram); break; }
+        if (r.reason != Exit::Breakpoint) continue;
+        uint32_t inst = dbg.read32(cpu.pc);
+        std::cout << "[brk] pc=0x" << std::hex << cpu.pc << std::dec
+                  << "  " << disasm(inst) << "\n";
+        dump_regs(cpu);
+        for (int s = 0; s < 3 && !cpu.halted; ++s) {
+            i += (int)dbg.step().insns;
+            uint32_t ninst = dbg.read32(cpu.pc);
+            std::cout << "  -> next pc=0x" << std::hex << cpu.pc << std::dec
+                      << "  " << disasm(ninst) << "\n";
         }
     }
 }
 
-static void run_repl(CPU& cpu, Memory& ram, std::unordered_set<uint32_t>& bps){
+static void report_watch(const Debugger::Stop& r){
+    std::cout << "[watch] " << hex32(r.range.addr) << " " << hex32(r.old_value) << " -> "
+              << hex32(r.new_value) << " (store " << hex32(r.store.addr) << "+" << r.store.len << ")\n";
+}
+
+// Breakpoints are EBREAKs patched into guest memory (debug.hpp): `c` runs
+// the plain interpreter loop until one is fetched. The session is recorded
+// (replay.hpp), so `rs`/`rc` go back from a checkpoint instead of a rerun.
+static void run_repl(CPU& cpu, Memory& ram, const std::unordered_set<uint32_t>& bps,
+                     const SymbolTable* syms = nullptr){
     auto help = []{
         std::cout <<
         "commands:\n"
-        "  c                 continue until breakpoint/exit\n"
+        "  c                 continue until breakpoint/watchpoint/exit\n"
         "  s [n]             single-step n (default 1)\n"
-        "  b <hex>           toggle breakpoint (e.g. b 0xC)\n"
+        "  rs [n]            reverse-step n (default 1)\n"
+        "  rc                reverse-continue to the previous breakpoint/watchpoint\n"
+        "  b <hex|symbol>    toggle breakpoint (e.g. b 0xC, b main)\n"
+        "  w <addr> [len]    toggle write watchpoint (default 4 bytes)\n"
         "  r                 show registers\n"
         "  m <addr> <n>      dump n words from addr (hex)\n"
         "  d [k]             disasm k ahead (default 4)\n"
@@ -129,32 +321,63 @@ static void run_repl(CPU& cpu, Memory& ram, std::unordered_set<uint32_t>& bps){
         "  h                 help\n";
     };
     help();
+    Debugger dbg(cpu, ram);
+    for (uint32_t a : bps) dbg.set_breakpoint(a);
+    dbg.record();
+    auto where = [&](const std::string& s, uint32_t& a){
+        const SymbolTable::Symbol* sym = syms ? syms->find(s) : nullptr;
+        if(!sym && !std::isdigit((unsigned char)(s.empty() ? 'x' : s[0]))){ std::cout<<"no symbol "<<s<<"\n"; return false; }
+        a = sym ? sym->addr : std::stoul(s,nullptr,0);
+        return true;
+    };
     std::string line;
     while(true){
-        std::cout << "(dbg) pc=" << hex32(cpu.pc) << " > " << std::flush;
+        ram.console().flush();                  // a partial guest line goes ahead of the prompt
+        std::cout << "(dbg) pc=" << hex32(cpu.pc);
+        if (syms && syms->lookup(cpu.pc)) std::cout << " <" << syms->describe(cpu.pc) << ">";
+        std::cout << " > " << std::flush;
         if(!std::getline(std::cin, line)) break;
         std::istringstream iss(line);
         std::string cmd; iss >> cmd;
         if(cmd=="c"){
-            while(!cpu.halted){
-                if(bps.count(cpu.pc)) { std::cout << "[hit] " << hex32(cpu.pc) << "\n"; break; }
-                cpu.step(ram);
-            }
+            Debugger::Stop r = dbg.cont();
+            if(r.reason==Exit::Breakpoint) std::cout << "[hit] " << hex32(cpu.pc) << "\n";
+            else if(r.reason==Exit::Watchpoint) report_watch(r);
+            else if(r.reason==Exit::Trap) report_trap(cpu, ram, syms);
         }else if(cmd=="s"){
             int n=1; (void)(iss>>n);
-            while(n-- > 0 && !cpu.halted) cpu.step(ram);
-            uint32_t w = ram.load32(cpu.pc);
-            std::cout << "next: " << hex32(cpu.pc) << "  " << disasm(w) << "\n";
+            Debugger::Stop r = dbg.step(n > 0 ? (uint64_t)n : 0);
+            if(r.reason==Exit::Watchpoint) report_watch(r);
+            else if(r.reason==Exit::Trap) report_trap(cpu, ram, syms);
+            uint32_t w = dbg.read32(cpu.pc);
+            std::cout << "next: " << hex32(cpu.pc) << "  " << (syms ? disasm(w, cpu.pc, *syms) : disasm(w)) << "\n";
+        }else if(cmd=="rs" || cmd=="rc"){
+            int n=1; (void)(iss>>n);
+            Debugger::Stop r = cmd=="rs" ? dbg.reverse_step(n > 0 ? (uint64_t)n : 0) : dbg.reverse_cont();
+            if(r.reason==Exit::Breakpoint) std::cout << "[hit] " << hex32(cpu.pc) << "\n";
+            else if(r.reason==Exit::Watchpoint) report_watch(r);
+            else if(cpu.instret==dbg.recorder()->start()) std::cout << "[start]\n";
+            uint32_t w = dbg.read32(cpu.pc);
+            std::cout << "back: " << hex32(cpu.pc) << "  " << (syms ? disasm(w, cpu.pc, *syms) : disasm(w))
+                      << "  instret=" << cpu.instret << "\n";
         }else if(cmd=="b"){
-            std::string hx; iss>>hx; uint32_t a = std::stoul(hx,nullptr,0);
-            if(bps.erase(a)) std::cout<<"- bp "<<hex32(a)<<"\n";
-            else { bps.insert(a); std::cout<<"+ bp "<<hex32(a)<<"\n"; }
+            std::string hx; iss>>hx;
+            uint32_t a; if(!where(hx, a)) continue;
+            if(dbg.clear_breakpoint(a)) std::cout<<"- bp "<<hex32(a)<<"\n";
+            else if(dbg.set_breakpoint(a)) std::cout<<"+ bp "<<hex32(a)<<"\n";
+            else std::cout<<"cannot break at "<<hex32(a)<<"\n";
+        }else if(cmd=="w"){
+            std::string hx; uint32_t len=4; iss>>hx>>len;
+            uint32_t a; if(!where(hx, a)) continue;
+            if(dbg.unwatch(a)) std::cout<<"- watch "<<hex32(a)<<"\n";
+            else if(dbg.watch(a, len)) std::cout<<"+ watch "<<hex32(a)<<" len="<<len<<"\n";
+            else std::cout<<"cannot watch "<<hex32(a)<<"\n";
         }else if(cmd=="r"){
             dump_regs(cpu);
         }else if(cmd=="m"){
-            std::string hx; int n=1; iss>>hx>>n; dump_words(ram, std::stoul(hx,nullptr,0), n);
+            std::string hx; int n=1; iss>>hx>>n; dump_words(ram, std::stoul(hx,nullptr,0), n, &dbg);
         }else if(cmd=="d"){
-            int k=4; (void)(iss>>k); disasm_ahead(ram, cpu.pc, k);
+            int k=4; (void)(iss>>k); disasm_ahead(ram, cpu.pc, k, syms, &dbg);
         }else if(cmd=="q"){
             break;
         }else if(cmd=="h" || cmd=="?"){
@@ -171,13 +394,78 @@ static void run_repl(CPU& cpu, Memory& ram, std::unordered_set<uint32_t>& bps){
 // -------------------------- schedulers --------------------------
 struct Task { const char* name; CPU cpu; bool done=false; uint64_t steps=0; };
 
-static void run_round_robin_demo(){
+static void print_jit_stats(const Jit& j){
+    const auto& s = j.stats();
+    std::cout << "[jit] blocks=" << s.blocks << " entries=" << s.entries
+              << " chains=" << s.chains << " flushes=" << s.flushes
+              << " jit_insns=" << s.jit_insns << " interp_insns=" << s.interp_insns << "\n";
+}
+
+static void print_cache_stats(const CacheHierarchy& ch){
+    for (unsigned i = 0; i < CacheHierarchy::LEVELS; ++i) {
+        const Cache& c = ch.level(i);
+        if (!c.present()) continue;
+        const auto& s = c.stats();
+        uint64_t n = s.hits + s.misses;
+        std::cout << "[cache] " << CacheHierarchy::level_name(i) << " " << (c.config().size >> 10) << "K "
+                  << c.config().ways << "-way " << c.config().line << "B"
+                  << " hits=" << s.hits << " misses=" << s.misses
+                  << " evictions=" << s.evictions << " writebacks=" << s.writebacks
+                  << " miss_rate=" << std::fixed << std::setprecision(2)
+                  << (n ? 100.0 * s.misses / n : 0.0) << "%" << std::defaultfloat << "\n";
+    }
+}
+
+static void print_heap_stats(const HeapStats& h){
+    std::cout << "[heap] mallocs=" << h.mallocs << " frees=" << h.frees << " failed=" << h.failed
+              << " bad_frees=" << h.bad_frees << " live=" << h.live_bytes << "B/" << h.live_blocks
+              << " peak_live=" << h.peak_live << "B peak_brk=0x" << std::hex << h.peak_brk << std::dec << "\n";
+    std::cout << "[heap] free=" << h.free_bytes << "B/" << h.free_chunks << " largest=" << h.largest_free
+              << "B fragmentation=" << std::fixed << std::setprecision(2) << 100.0 * h.fragmentation()
+              << "%" << std::defaultfloat << "\n[heap] sizes:";
+    for (unsigned b = 0; b < HeapStats::HIST; ++b) {
+        if (!h.hist[b]) continue;
+        if (b + 1 < HeapStats::HIST) std::cout << " <=" << (8u << b);
+        else std::cout << " >" << (8u << (b - 1));
+        std::cout << "=" << h.hist[b];
+    }
+    std::cout << "\n";
+}
+
+static void print_bpred_stats(const BranchPredictor& bp, const SymbolTable& syms){
+    const auto& sp = bp.spec();
+    const auto& s = bp.stats();
+    std::cout << "[bpred] " << BranchPredictor::predictor_name(sp.kind);
+    if (sp.kind != Predictor::Btfn) std::cout << " 2^" << sp.table_bits;
+    if (sp.kind == Predictor::Gshare) std::cout << " hist=" << sp.history_bits;
+    std::cout << " ras=" << sp.ras_depth << " penalty=" << sp.penalty << "\n";
+    for (unsigned k = 0; k < 3; ++k) {
+        if (!s.executed[k]) continue;
+        std::cout << "[bpred] " << BranchPredictor::kind_name((BranchPredictor::Kind)k)
+                  << " executed=" << s.executed[k] << " mispredicted=" << s.mispredicted[k]
+                  << " rate=" << std::fixed << std::setprecision(2)
+                  << 100.0 * s.mispredicted[k] / s.executed[k] << "%" << std::defaultfloat << "\n";
+    }
+    for (auto& [pc, site] : bp.worst(5)) {
+        if (!site.mispredicted) break;
+        std::string where = syms.describe(pc);
+        std::cout << "[bpred]   0x" << std::hex << std::setw(8) << std::setfill('0') << pc
+                  << std::dec << std::setfill(' ');
+        if (!where.empty()) std::cout << " <" << where << ">";
+        std::cout << " " << BranchPredictor::kind_name(site.kind)
+                  << " mispredicted=" << site.mispredicted << "/" << site.executed << "\n";
+    }
+}
+
+static void run_round_robin_demo(bool use_jit){
     std::cout << "\n[sched] round-robin demo\n";
     Memory ram(64*1024);
     Task A{"A"}, B{"B"};
     const uint32_t A_BASE=0x0000, B_BASE=0x1000;
     load_task_program(ram, A_BASE, 1); A.cpu.pc = A_BASE;
     load_task_program(ram, B_BASE, 2); B.cpu.pc = B_BASE;
+    std::unique_ptr<Jit> jit;
+    if (use_jit) { jit = std::make_unique<Jit>(ram); A.cpu.jit = B.cpu.jit = jit.get(); }
 
     std::array<Task*,2> q = { &A, &B };
     const int QUANTUM = 20;
@@ -188,11 +476,10 @@ static void run_round_robin_demo(){
         Task* t = q[cur];
         if(!t->done){
             int slice = 0;
-            while(slice < QUANTUM && !t->done){
-                if(t->cpu.halted){ t->done = true; break; }
-                t->cpu.step(ram);
-                ++t->steps; ++slice; ++total;
-            }
+            RunExit r = run_through_yields(t->cpu, ram, QUANTUM);
+            slice = (int)r.insns; t->steps += r.insns; total += r.insns;
+            if(r.reason==Exit::Trap){ report_trap(t->cpu, ram); t->done = true; }
+            if(t->cpu.halted) t->done = true;
             std::cout << "[sched] ran task " << t->name
                       << " for " << slice << " steps  pc=0x"
                       << std::hex << t->cpu.pc << std::dec << "\n";
@@ -203,15 +490,18 @@ static void run_round_robin_demo(){
     }
     std::cout << "[sched] finished: total=" << total
               << "  A.steps=" << A.steps << "  B.steps=" << B.steps << "\n";
+    if (jit) print_jit_stats(*jit);
 }
 
-static void run_round_robin_preemptive_demo(){
+static void run_round_robin_preemptive_demo(bool use_jit){
     std::cout << "[sched] preemptive RR demo\n";
     Task A{"A"}, B{"B"};
     const uint32_t A_BASE=0x0000, B_BASE=0x1000;
     Memory ram(64*1024);
     load_task_program(ram, A_BASE, 1); A.cpu.pc = A_BASE;
     load_task_program(ram, B_BASE, 2); B.cpu.pc = B_BASE;
+    std::unique_ptr<Jit> jit;
+    if (use_jit) { jit = std::make_unique<Jit>(ram); A.cpu.jit = B.cpu.jit = jit.get(); }
 
     Task* q[2] = { &A, &B };
     const int SLICE = 20; const int MAX_TOTAL = 2000;
@@ -220,7 +510,9 @@ static void run_round_robin_preemptive_demo(){
         Task& t = *q[cur];
         t.cpu.quantum = SLICE;          // “timer”
         int ran = 0;
-        while(t.cpu.quantum > 0 && !t.cpu.halted){ t.cpu.step(ram); ran++; total++; }
+        RunExit r = run_through_yields(t.cpu, ram, UINT64_MAX);
+        ran += (int)r.insns; total += (int)r.insns;
+        if(r.reason==Exit::Trap){ report_trap(t.cpu, ram); t.cpu.halted = true; }
         std::cout << "[sched] preempted task " << t.name
                   << " after " << ran << " steps  pc=0x"
                   << std::hex << t.cpu.pc << std::dec << "\n";
@@ -229,12 +521,74 @@ static void run_round_robin_preemptive_demo(){
     std::cout << "[sched] DONE total=" << total
               << "  A.steps=" << A.cpu.cycles
               << "  B.steps=" << B.cpu.cycles << "\n";
+    if (jit) print_jit_stats(*jit);
+}
+
+// N tasks over four priorities, each adding 1 to a shared counter 20 times
+// under the kernel lock (ECALL 9/10); preempted holders make the rest park
+static constexpr uint32_t SCHED_LOCK = 0x400, SCHED_COUNTER = 0x404;
+static void run_sched_demo(unsigned n){
+    std::cout << "[sched] " << n << " tasks, O(1) multi-level queue\n";
+    Memory ram(64*1024);
+    uint32_t a = 0;
+    auto emit = [&](uint32_t w){ put32(ram, a, w); a += 4; };
+    emit(enc_I(6, 0, 20, 0));                       // 0x00 x6 = rounds
+    emit(enc_I(10, 0, SCHED_LOCK, 0));              // 0x04 loop: lock(a0)
+    emit(enc_I(17, 0, 9, 0));                       // 0x08
+    emit(enc_ECALL());                              // 0x0C
+    emit(enc_LW(7, 0, SCHED_COUNTER));              // 0x10 counter++ (lw, addi, sw)
+    emit(enc_I(7, 7, 1, 0));                        // 0x14
+    emit(enc_SW(0, 7, SCHED_COUNTER));              // 0x18
+    emit(enc_I(17, 0, 10, 0));                      // 0x1C unlock(a0)
+    emit(enc_ECALL());                              // 0x20
+    emit(enc_I(6, 6, -1, 0));                       // 0x24
+    emit(enc_B(6, 0, 0b001, 0x04 - 0x28));          // 0x28 bne x6, x0, loop
+    emit(enc_I(10, 0, 0, 0));                       // 0x2C exit(0)
+    emit(enc_I(17, 0, 0, 0));                       // 0x30
+    emit(enc_ECALL());                              // 0x34
+
+    SchedConfig cfg; cfg.levels = 4; cfg.base_quantum = 2;   // short slices: holders get preempted
+    Scheduler s(ram, cfg);
+    for (unsigned i = 0; i < n; ++i) s.spawn(0, i % 4);
+    auto t0 = std::chrono::steady_clock::now();
+    auto st = s.run();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "[sched] counter=" << ram.load32(SCHED_COUNTER) << " expected=" << 20 * n
+              << " switches=" << st.switches << " blocks=" << st.blocks << " wakeups=" << st.wakeups
+              << " promotions=" << st.promotions << (st.deadlock ? " DEADLOCK" : "")
+              << " insns=" << st.insns << " (" << (uint64_t)(secs > 0 ? st.switches / secs : 0) << " switches/s)\n";
+    for (unsigned p = 0; p < cfg.levels; ++p) {
+        uint64_t tasks = 0, run = 0, wait = 0, blocked = 0, sw = 0;
+        for (int i = 0; i < s.size(); ++i) {
+            const auto& t = s.task(i);
+            if (t.cpu.prio != p) continue;
+            ++tasks; run += t.run_insns; wait += t.wait_insns; blocked += t.blocked_insns; sw += t.switches;
+        }
+        if (!tasks) continue;
+        std::cout << "[sched] prio " << p << ": tasks=" << tasks << " quantum=" << s.quantum(p)
+                  << " avg run=" << run / tasks << " wait=" << wait / tasks
+                  << " blocked=" << blocked / tasks << " switches=" << sw / tasks << "\n";
+    }
 }
 
 // -------------------------- CLI options --------------------------
 struct Options {
     std::string elf = "program.elf";
     bool heap = false, race=false, sys=false, user=false, dbg=false, rr=false, rrp=false, all=true;
+    bool jit = false;   // modifier: run ELF/scheduler guests through the JIT
+    bool no_timer = false, flat_cost = false;   // modifiers for the ELF run
+    bool vector_mem = false;                    // modifier: checked std::vector RAM everywhere
+    bool elf_dbg = false;                       // debug the ELF in the REPL instead of running it
+    bool quiet = false;                         // no [sys] line per handle_ecall()
+    std::string trace;                          // ELF run: stream a binary trace here
+    std::string cache;                          // ELF run: cache model spec ("" = none)
+    std::string bpred, bpred_report;            // ELF run: predictor spec, per-branch CSV path
+    std::string profile, profile_out;           // ELF run: sampling period, folded-stacks path
+    unsigned smp = 0;                           // --smp N: RV32A workload on N harts
+    unsigned sched = 0;                         // --sched N: N tasks through Scheduler
+    bool vm = false;                            // --vm: Sv32 address spaces + TLB sizing
+    std::string batch, report;                  // --batch manifest, JSON report path ("" = stdout)
+    unsigned threads = 0;                       // batch workers (0 = host cores)
 };
 
 static void print_help(){
@@ -248,6 +602,28 @@ static void print_help(){
     "  --dbg            run interactive debugger demo\n"
     "  --rr             run cooperative round-robin\n"
     "  --rrp            run preemptive round-robin\n"
+    "  --jit            translate ELF/scheduler guests to host code (x86-64)\n"
+    "  --no-timer       ELF run: stop the MMIO timer (TIME reads stay 0)\n"
+    "  --flat-cost      ELF run: every instruction costs 1 cycle\n"
+    "  --vector-mem     keep guest RAM in a checked vector instead of fastmem\n"
+    "  --elf-dbg        open the ELF in the debugger REPL (symbols from .symtab)\n"
+    "  --console <mode> guest output: line (flush per newline, default) or full (flush when\n"
+    "                   the 64K buffer fills or the guest exits)\n"
+    "  --quiet          drop the [sys] diagnostics printed per syscall\n"
+    "  --trace <path>   ELF run: stream every instruction to a binary trace\n"
+    "  --cache <spec>   ELF run: model L1I/L1D/L2 (\"default\" or e.g. l1d=32k:8:64:wt,l2=off,mem=80)\n"
+    "  --bpred <spec>   ELF run: model branch prediction (btfn, bimodal[:BITS], gshare[:BITS[:HIST]],\n"
+    "                   then optional ,ras=N ,penalty=N)\n"
+    "  --bpred-report <path>  ELF run with --bpred: write per-branch stats as CSV\n"
+    "  --profile <spec> ELF run: sample pc + call stack every N insns (N, insns:N or cycles:N)\n"
+    "  --profile-out <path>  ELF run with --profile: write folded stacks (flamegraph.pl input)\n"
+    "  --trace2json <in> <out>  convert a binary trace to NDJSON and exit\n"
+    "  --smp <n>        run an RV32A workload on 1 and on n host-thread harts\n"
+    "  --sched <n>      run n prioritised tasks contending for a lock through the O(1) scheduler\n"
+    "  --vm             run two tasks in separate Sv32 address spaces; TLB stats per TLB size\n"
+    "  --batch <file>   run every job in a manifest on a thread pool, print a JSON report, exit\n"
+    "  --report <path>  batch: write the JSON report here instead of stdout\n"
+    "  --threads <n>    batch: worker threads (default: host cores)\n"
     "  --all            run everything (default if no flags)\n"
     "  --help           show this help\n";
 }
@@ -267,6 +643,36 @@ static Options parse_cli(int argc, char** argv){
         else if(a=="--dbg"){ need(o.dbg); }
         else if(a=="--rr"){ need(o.rr); }
         else if(a=="--rrp"){ need(o.rrp); }
+        else if(a=="--jit"){ o.jit = true; }
+        else if(a=="--no-timer"){ o.no_timer = true; }
+        else if(a=="--flat-cost"){ o.flat_cost = true; }
+        else if(a=="--vector-mem"){ o.vector_mem = true; }
+        else if(a=="--elf-dbg"){ o.elf_dbg = true; }
+        else if(a=="--quiet"){ o.quiet = true; }
+        else if(a=="--console" && i+1<argc){
+            std::string m = argv[++i];
+            if (m == "line") Console::default_policy() = Console::Policy::Line;
+            else if (m == "full") Console::default_policy() = Console::Policy::Full;
+            else { std::cerr << "--console: line or full\n"; std::exit(1); }
+        }
+        else if(a=="--trace" && i+1<argc){ o.trace = argv[++i]; }
+        else if(a=="--cache" && i+1<argc){ o.cache = argv[++i]; }
+        else if(a=="--bpred" && i+1<argc){ o.bpred = argv[++i]; }
+        else if(a=="--bpred-report" && i+1<argc){ o.bpred_report = argv[++i]; }
+        else if(a=="--profile" && i+1<argc){ o.profile = argv[++i]; }
+        else if(a=="--profile-out" && i+1<argc){ o.profile_out = argv[++i]; }
+        else if(a=="--batch" && i+1<argc){ o.batch = argv[++i]; }
+        else if(a=="--report" && i+1<argc){ o.report = argv[++i]; }
+        else if(a=="--threads" && i+1<argc){ o.threads = (unsigned)std::max(0, std::atoi(argv[++i])); }
+        else if(a=="--vm"){ o.all=false; o.vm = true; }
+        else if(a=="--smp" && i+1<argc){ o.all=false; o.smp = (unsigned)std::max(1, std::atoi(argv[++i])); }
+        else if(a=="--sched" && i+1<argc){ o.all=false; o.sched = (unsigned)std::max(1, std::atoi(argv[++i])); }
+        else if(a=="--trace2json" && i+2<argc){
+            long long n = trace_to_ndjson(argv[i+1], argv[i+2]);
+            if (n < 0) { std::cerr << "cannot convert " << argv[i+1] << "\n"; std::exit(1); }
+            std::cout << "[trace] " << n << " records -> " << argv[i+2] << "\n";
+            std::exit(0);
+        }
         else { std::cerr << "unknown arg: " << a << "\n"; print_help(); std::exit(1); }
     }
     return o;
@@ -275,6 +681,28 @@ static Options parse_cli(int argc, char** argv){
 // =========================== main ===========================
 int main(int argc, char** argv){
     Options opt = parse_cli(argc, argv);
+    if (opt.vector_mem) Memory::set_default_backend(MemBackend::Vector);
+    if (opt.quiet) set_syscall_log(false);
+
+    // batch mode replaces everything else
+    if (!opt.batch.empty()) {
+        std::vector<BatchJob> jobs;
+        try { jobs = read_manifest(opt.batch); }
+        catch (const std::exception& e) { std::cerr << "[batch] " << e.what() << "\n"; return 1; }
+        BatchReport rep = run_batch(jobs, opt.threads, opt.jit);
+        FILE* f = opt.report.empty() ? stdout : std::fopen(opt.report.c_str(), "wb");
+        if (!f) { std::cerr << "[batch] cannot write " << opt.report << "\n"; return 1; }
+        write_batch_json(f, jobs, rep);
+        if (f != stdout) {
+            std::fclose(f);
+            std::size_t failed = 0;
+            for (auto& r : rep.results) failed += !r.ok || r.reason != Exit::Halt;
+            std::cout << "[batch] " << jobs.size() << " jobs (" << rep.images << " images) on "
+                      << rep.threads << " threads in " << (uint64_t)rep.wall_ms << " ms, "
+                      << failed << " did not halt -> " << opt.report << "\n";
+        }
+        return 0;
+    }
 
     // reusable RAM/CPU for ELF & heap demo
     Memory ram(64*1024);
@@ -282,14 +710,96 @@ int main(int argc, char** argv){
 
     // 1) ELF (always attempted first; if it fails, we fall through)
     if (file_exists(opt.elf.c_str())) {
-        uint32_t entry = load_elf32_into_memory(opt.elf.c_str(), ram);
-        CPU elf_cpu; elf_cpu.pc = entry; elf_cpu.quantum = 200; elf_cpu.tid = 0;
+        ElfImage img = ElfImage::parse(opt.elf);
+        uint32_t entry = img.load_into(ram);
+        // nobody schedules here: no quantum, so run() takes the loop without preemption
+        CPU elf_cpu; elf_cpu.pc = entry; elf_cpu.tid = 0;
+        if (opt.flat_cost) elf_cpu.cost_model = CostModel::Flat;
+        if (opt.no_timer)  ram.set_timer(false);
+        std::unique_ptr<Jit> jit;
+        if (opt.jit) { jit = std::make_unique<Jit>(ram); elf_cpu.jit = jit.get(); }
+        std::unique_ptr<CacheHierarchy> caches;
+        if (!opt.cache.empty()) {
+            try { caches = std::make_unique<CacheHierarchy>(CacheSpec::parse(opt.cache)); }
+            catch (const std::exception& e) { std::cerr << "[cache] " << e.what() << "\n"; return 1; }
+            elf_cpu.caches = caches.get();
+        }
+        std::unique_ptr<BranchPredictor> bpred;
+        if (!opt.bpred.empty()) {
+            try { bpred = std::make_unique<BranchPredictor>(BranchSpec::parse(opt.bpred)); }
+            catch (const std::exception& e) { std::cerr << "[bpred] " << e.what() << "\n"; return 1; }
+            elf_cpu.bpred = bpred.get();
+        }
+        std::unique_ptr<Profiler> prof;
+        if (!opt.profile.empty()) {
+            try { prof = std::make_unique<Profiler>(ProfileSpec::parse(opt.profile)); }
+            catch (const std::exception& e) { std::cerr << "[prof] " << e.what() << "\n"; return 1; }
+            elf_cpu.profiler = prof.get();
+        }
         std::cout << "[elf] loaded '" << opt.elf << "' entry=0x"
                   << std::hex << entry << std::dec << "\n";
-        for (int steps=0; steps<10'000'000 && !elf_cpu.halted; ++steps) elf_cpu.step(ram);
+        if (!img.symbols.empty()) std::cout << "[elf] " << img.symbols.size() << " symbols\n";
+        if (opt.elf_dbg) {
+            std::unordered_set<uint32_t> bps;
+            run_repl(elf_cpu, ram, bps, &img.symbols);
+            return 0;
+        }
+        if (!opt.trace.empty()) {
+            if (global_trace().open_stream(opt.trace)) global_trace().enable(true);
+            else std::cerr << "[trace] cannot open " << opt.trace << "\n";
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        RunExit r = run_through_yields(elf_cpu, ram, 10'000'000);
+        ram.console().flush();
+        if (global_trace().is_streaming()) {
+            global_trace().enable(false);
+            std::cout << "[trace] " << global_trace().close_stream() << " records -> " << opt.trace << "\n";
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (r.reason == Exit::Trap) report_trap(elf_cpu, ram, &img.symbols);
         std::cout << "[elf] finished exit_code=" << elf_cpu.exit_code
                   << " instret=" << elf_cpu.instret
-                  << " cycles="  << elf_cpu.cycles << "\n\n";
+                  << " cycles="  << elf_cpu.cycles << "\n";
+        const auto& ic = ram.icache().stats();
+        std::cout << "[icache] hits=" << ic.hits << " misses=" << ic.misses
+                  << " invalidations=" << ic.invalidations << "\n";
+        std::cout << "[fuse] pattern=formed/executed:";
+        for (unsigned k = 0; k < FUSE_KINDS; ++k)
+            std::cout << " " << fuse_name((Op)(FIRST_FUSED + k)) << "="
+                      << ic.fused_pairs[k] << "/" << ic.fused_runs[k];
+        std::cout << "\n";
+        if (jit) print_jit_stats(*jit);
+        if (ram.heap_stats().mallocs) print_heap_stats(ram.heap_stats());
+        if (caches) print_cache_stats(*caches);
+        if (bpred) {
+            print_bpred_stats(*bpred, img.symbols);
+            if (!opt.bpred_report.empty()) {
+                if (std::FILE* f = std::fopen(opt.bpred_report.c_str(), "w")) {
+                    bpred->write_csv(f, &img.symbols);
+                    std::fclose(f);
+                    std::cout << "[bpred] " << bpred->sites().size() << " sites -> " << opt.bpred_report << "\n";
+                } else {
+                    std::cerr << "[bpred] cannot open " << opt.bpred_report << "\n";
+                }
+            }
+        }
+        if (prof) {
+            std::cout << "[prof] " << prof->samples() << " samples, one per " << prof->spec().period
+                      << (prof->spec().unit == ProfileSpec::Cycles ? " cycles" : " insns") << "\n" << std::flush;
+            prof->write_top(stdout, 10, &img.symbols);
+            std::fflush(stdout);
+            if (!opt.profile_out.empty()) {
+                if (std::FILE* f = std::fopen(opt.profile_out.c_str(), "w")) {
+                    prof->write_folded(f, &img.symbols);
+                    std::fclose(f);
+                    std::cout << "[prof] folded stacks -> " << opt.profile_out << "\n";
+                } else {
+                    std::cerr << "[prof] cannot open " << opt.profile_out << "\n";
+                }
+            }
+        }
+        std::cout << "[elf] host " << (uint64_t)(secs*1e3) << " ms, "
+                  << (secs > 0 ? r.insns / secs / 1e6 : 0.0) << " MIPS\n\n";
     } else {
         std::cout << "[elf] '" << opt.elf << "' not found; running selected demos.\n";
     }
@@ -353,7 +863,7 @@ int main(int argc, char** argv){
         um.store32(0x14, enc_I(10, 0, 0, 0));
         um.store32(0x18, enc_I(17, 0, 0, 0));
         um.store32(0x1C, encSYSTEM(0));
-        for (int i=0;i<50 && !u.halted;i++) u.step(um);
+        run_through_yields(u, um, 50);
     }
 
     // 6) Debugger & schedulers
@@ -372,8 +882,28 @@ int main(int argc, char** argv){
         run_repl(c, m, bps);
     }
 
-    if (ALL || opt.rr)  run_round_robin_demo();
-    if (ALL || opt.rrp) run_round_robin_preemptive_demo();
+    if (ALL || opt.rr)  run_round_robin_demo(opt.jit);
+    if (ALL || opt.rrp) run_round_robin_preemptive_demo(opt.jit);
+
+    // 7) SMP: not part of --all (timings depend on the host's cores)
+    if (opt.smp){
+        constexpr uint32_t ROUNDS = 200'000;
+        double one = run_smp(1, ROUNDS);
+        if (opt.smp > 1) {
+            double many = run_smp(opt.smp, ROUNDS);
+            std::cout << "[smp] speedup x" << (many > 0 ? one / many : 0.0)
+                      << " with " << opt.smp << " harts on "
+                      << std::thread::hardware_concurrency() << " host cores\n";
+        }
+    }
+
+    if (opt.sched) run_sched_demo(opt.sched);
+
+    // 8) Sv32: not part of --all either
+    if (opt.vm){
+        std::cout << "[vm] two tasks, same virtual addresses, separate page tables\n";
+        for (unsigned entries : {4u, 16u, 64u}) run_vm(entries);
+    }
 
     return 0;
 }
@@ -4,114 +4,538 @@
 #include <unordered_map>
 #include <stdexcept>
 #include <algorithm>
+#include <cstring>
+#include <mutex>
+#include "decode.hpp"
+#include "fastmem.hpp"
+#include "bus.hpp"
+#include "devices.hpp"
+#include "heap.hpp"
+
+class Snapshot;
+
+// where guest RAM lives (see fastmem.hpp); both give identical results
+enum class MemBackend : uint8_t {
+    Vector,      // std::vector + explicit checks: portable, the reference
+    Fastmem      // 4 GiB host reservation, faults instead of checks
+};
+
+// Record/replay hooks (replay.hpp)
+class ReplayLog {
+public:
+    virtual ~ReplayLog() = default;
+    virtual uint32_t input(uint32_t v) = 0;      // a nondeterministic value the guest reads
+    virtual void first_write(uint32_t pg) = 0;   // pg is about to change
+};
 
 class Memory {
 public:
-    explicit Memory(std::size_t n)
-    : bytes(n, 0),
+    explicit Memory(std::size_t n, MemBackend b = default_backend())
+    : n(n),
       text_end(0x1000),
       heap_brk(0x2000),
       heap_base(heap_brk),
-      mmio_time(0) {}
-
-    // ---- loads/stores (little-endian) with simple MMIO timer ----
-    uint32_t load32(uint32_t addr) const {
-        if (addr == 0x3000) return mmio_time;        // TIME
-        if (addr + 3 >= bytes.size()) throw std::out_of_range("load32 OOB");
-        return (uint32_t)bytes[addr]
-             | ((uint32_t)bytes[addr+1] << 8)
-             | ((uint32_t)bytes[addr+2] << 16)
-             | ((uint32_t)bytes[addr+3] << 24);
-    }
-    void store32(uint32_t addr, uint32_t v) {
-        if (addr == 0x3004) { mmio_time += v; return; } // add ticks
-        if (addr == 0x3008) { mmio_time  = 0; return; } // reset
-        if (addr + 3 >= bytes.size()) throw std::out_of_range("store32 OOB");
-        bytes[addr]   = (uint8_t)(v & 0xFF);
-        bytes[addr+1] = (uint8_t)((v >> 8) & 0xFF);
-        bytes[addr+2] = (uint8_t)((v >> 16) & 0xFF);
-        bytes[addr+3] = (uint8_t)((v >> 24) & 0xFF);
-    }
-    void store8(uint32_t addr, uint8_t v){
-        if (addr >= bytes.size()) throw std::out_of_range("store8 OOB");
-        bytes[addr] = v;
-    }
-    uint8_t load8(uint32_t addr) const{
-        if (addr >= bytes.size()) throw std::out_of_range("load8 OOB");
-        return bytes[addr];
+      dcache(n) {
+        // fastmem needs whole pages, or accesses just past RAM would not fault
+        if (b == MemBackend::Fastmem && n % fastmem::PAGE == 0 && (fm = fastmem::reserve(n))) {
+            ram = fm;
+        } else {
+            bytes.assign(n, 0);
+            ram = bytes.data();
+        }
+        page_ptr.resize(n / Bus::PAGE);
+        for (std::size_t pg = 0; pg < page_ptr.size(); ++pg) page_ptr[pg] = ram + pg * Bus::PAGE;
+        attach(TimerDevice::BASE, Bus::PAGE, &timer);
+        attach(UartDevice::BASE,  Bus::PAGE, &uart);
+    }
+    ~Memory(){ fastmem::release(fm); }
+    Memory(const Memory&) = delete;
+    Memory& operator=(const Memory&) = delete;
+
+    MemBackend backend() const { return fm ? MemBackend::Fastmem : MemBackend::Vector; }
+    static MemBackend default_backend(){ return default_ref(); }
+    static void set_default_backend(MemBackend b){ default_ref() = b; }
+
+    // ---- devices ----
+    // Map [base, base+len) to dev (not owned). RAM under a device page stays
+    // RAM for every access the device declines.
+    void attach(uint32_t base, uint32_t len, Device* dev){
+        bus.attach(base, len, dev);
+        for (uint64_t a = base & ~(uint64_t)(Bus::PAGE-1); a < (uint64_t)base + len && a < n; a += Bus::PAGE)
+            if ((a >> Bus::PAGE_SHIFT) < page_ptr.size()) page_ptr[a >> Bus::PAGE_SHIFT] = nullptr;
+        if (!fm) return;
+        // fastmem: device pages must fault, so their RAM bytes move aside
+        for (uint64_t a = base & ~(uint64_t)(Bus::PAGE-1); a < (uint64_t)base + len && a < n; a += Bus::PAGE) {
+            auto& side = shadow[(uint32_t)a >> Bus::PAGE_SHIFT];
+            if (!side.empty()) continue;
+            side.assign(fm + a, fm + a + Bus::PAGE);
+            fastmem::protect(fm, (uint32_t)a, Bus::PAGE);
+        }
     }
+    bool is_device(uint32_t addr) const { return bus.find(addr) != nullptr; }
+
+    // ---- loads/stores (little-endian); device pages take the slow path ----
+    uint32_t load32(uint32_t addr) const { return load<4>(addr); }
+    uint16_t load16(uint32_t addr) const { return (uint16_t)load<2>(addr); }
+    uint8_t  load8 (uint32_t addr) const { return (uint8_t)load<1>(addr); }
+    void store32(uint32_t addr, uint32_t v){ store<4>(addr, v); }
+    void store16(uint32_t addr, uint16_t v){ store<2>(addr, v); }
+    void store8 (uint32_t addr, uint8_t v) { store<1>(addr, v); }
+
+    // ---- bulk (loader, memset/memcpy-style callers) ----
+    // Same effect as a loop of store8, but page by page: one bounds check,
+    // memcpy/memset on RAM pages, byte stores only on device pages.
+    void write_bytes(uint32_t addr, const uint8_t* src, std::size_t len){ bulk(addr, len, src, 0); }
+    void fill(uint32_t addr, uint8_t v, std::size_t len){ bulk(addr, len, nullptr, v); }
+
+    // Fastmem only: map [addr, addr+len) privately from fd at off instead of
+    // copying. Everything page aligned, inside RAM, no device page, not a
+    // snapshot child; false means copy instead.
+    bool map_file(uint32_t addr, std::size_t len, int fd, uint64_t off){
+        if (!fm || cow || rec || !len || ((addr | off | len) & (fastmem::PAGE - 1)) || (uint64_t)addr + len > n) return false;
+        for (uint64_t a = addr; a < (uint64_t)addr + len; a += Bus::PAGE) if (bus.find((uint32_t)a)) return false;
+        if (!fastmem::map_file(fm, addr, (uint32_t)len, fd, off)) return false;
+        icache().invalidate_range(addr, len);
+        return true;
+    }
+
+    // ---- fastmem: one host access, no checks ----
+    // Only inside a fastmem::Guard on host_base(): anything the checked
+    // accessors would trap on or route to a device faults instead.
+    uint8_t* host_base() const { return fm; }
+    template<typename T> T fast_load(uint32_t addr) const {
+        FASTMEM_BARRIER();
+        T v; std::memcpy(&v, fm + addr, sizeof v);
+        return v;
+    }
+    template<typename T> void fast_store(uint32_t addr, T v){
+        FASTMEM_BARRIER();
+        std::memcpy(fm + addr, &v, sizeof v);
+        icache().invalidate(addr, sizeof v);
+    }
+
+    // ---- Sv32 TLB entries (mmu.hpp) ----
+    // Host pointer to the RAM page holding pa, for direct access; nullptr
+    // where the checked accessors have to run: device pages, past RAM, and
+    // writes to a snapshot child or while recording (they mark pages dirty)
+    // or to a watched page.
+    uint8_t* direct_page(uint32_t pa, bool write) const {
+        pa &= ~(Bus::PAGE - 1);
+        if ((std::size_t)pa + Bus::PAGE > n || bus.find(pa)) return nullptr;
+        if (write && (cow || rec || watched_page(pa >> Bus::PAGE_SHIFT))) return nullptr;
+        return ram + pa;
+    }
+
+    // ---- predecoded instructions (kept coherent by the stores above) ----
+    // The calling hart's view: its own cache while a Hart binding for this
+    // Memory is alive on the thread, the shared one otherwise.
+    DecodeCache& icache() const {
+        Hart* h = tl_hart;
+        return h && h->mem == this ? h->icache : const_cast<DecodeCache&>(dcache);
+    }
+
+    // ---- SMP ----
+    // A host thread running a hart binds one of these for the run: the hart
+    // gets a private decode cache (its own stores keep it coherent, other
+    // harts' stores show up after FENCE.I, as in RISC-V) and a private tick
+    // count that reaches the shared timer at sync_ticks() and before any
+    // device access, instead of contending on it every instruction.
+    struct Hart {
+        explicit Hart(Memory& m) : mem(&m), icache(m.size()), prev(tl_hart) { tl_hart = this; }
+        ~Hart(){ mem->sync_ticks(); tl_hart = prev; }
+        Hart(const Hart&) = delete;
+        Hart& operator=(const Hart&) = delete;
+
+        Memory* mem;
+        DecodeCache icache;
+        uint32_t ticks = 0;
+        Hart* prev;
+    };
+    void sync_ticks() const {
+        uint32_t& t = tick_sink();
+        if (t) { timer.now.fetch_add(t, std::memory_order_relaxed); t = 0; }
+    }
+    // where this thread's ticks collect until the next sync; the
+    // interpreter looks it up once per run instead of once per instruction
+    uint32_t& tick_sink() const {
+        Hart* h = tl_hart;
+        return h && h->mem == this ? h->ticks : pending_ticks;
+    }
+
+    // RV32A: the aligned RAM word at addr, for host atomics in place (guest
+    // RAM is little-endian like the hosts we build on). Misaligned, past RAM
+    // or on a device page: out_of_range, i.e. a guest trap. A write to a
+    // watched page calls atomic_done() once it is through.
+    uint32_t* atomic_word(uint32_t addr, bool write = true) const {
+        if ((addr & 3u) || (std::size_t)addr + 4 > n || bus.claims(addr, 4)) throw std::out_of_range("amo address");
+        if (write && watching) {
+            check_watch(addr, 4);
+            if (fm && watched_page(addr >> Bus::PAGE_SHIFT)) {
+                open_page = (addr >> Bus::PAGE_SHIFT) + 1;
+                fastmem::set_writable(fm, addr & ~(fastmem::PAGE - 1), fastmem::PAGE, true);
+            }
+        }
+        if (cow || rec) touch(addr, 4);
+        return reinterpret_cast<uint32_t*>(ram + addr);
+    }
+    void atomic_done() const { if (open_page) { reprotect(open_page - 1); open_page = 0; } }
+
+    // ECALLs touching the heap, locks or the console take this, so harts on
+    // different threads can make them concurrently
+    std::mutex& syscall_mutex() const { return sys; }
+
+    // guest output: ECALLs and the UART write here (console.hpp)
+    Console& console(){ return con; }
+
+    // host bytes of [addr, addr+len) when all of it is plain RAM (no device
+    // page), else nullptr; lets write ECALLs hand a guest buffer over whole
+    const uint8_t* ram_span(uint32_t addr, uint32_t len) const {
+        if ((uint64_t)addr + len > n) return nullptr;
+        for (uint64_t p = addr & ~(uint64_t)(Bus::PAGE-1); p < (uint64_t)addr + len; p += Bus::PAGE)
+            if (bus.claims((uint32_t)p, 1)) return nullptr;
+        return ram + addr;
+    }
+
+    // ---- copy-on-write children (snapshot.hpp) ----
+    // A Memory forked from a Snapshot records every page written since the
+    // fork (or the last Snapshot::reset), so a reset only restores those.
+    bool is_cow() const { return cow; }
+    std::size_t dirty_pages() const { return dirty_list.size(); }
 
     // ---- “clock” flows with executed work ----
-    void tick(uint32_t cycles){ mmio_time += cycles; }
-    uint32_t time() const { return mmio_time; }
+    void tick(uint32_t cycles){
+        if (timer_on) tick_sink() += cycles;
+    }
+    uint32_t time() const { sync_ticks(); return timer.now.load(std::memory_order_relaxed); }
+    // headless runs that never read TIME can stop the clock; the
+    // interpreter then skips tick() altogether
+    void set_timer(bool on){ timer_on = on; }
+    bool timer_enabled() const { return timer_on; }
 
-    // ---- sbrk & tiny first-fit allocator ----
+    // ---- sbrk & segregated-fit allocator (heap.hpp) ----
     uint32_t sbrk(int32_t delta){
         uint32_t old = heap_brk;
         int64_t target = (int64_t)heap_brk + (int64_t)delta;
         target = std::max<int64_t>(target, (int64_t)text_end);
-        target = std::min<int64_t>(target, (int64_t)bytes.size());
+        target = std::min<int64_t>(target, (int64_t)n);
         heap_brk = (uint32_t)target;
+        heap.note_brk(heap_brk);
         return old;
     }
     uint32_t brk()   const { return heap_brk; }
     uint32_t hbase() const { return heap_base; }
-    std::size_t size() const { return bytes.size(); }
+    std::size_t size() const { return n; }
 
+    // 0 when nbytes is 0 or RAM is exhausted (the break is then left alone)
     uint32_t malloc32(uint32_t nbytes){
-        if (nbytes == 0) return 0;
-        const uint32_t ALIGN = 8;
-        auto align_up = [&](uint32_t v){ return (v + (ALIGN-1)) & ~(ALIGN-1); };
-        uint32_t need = align_up(nbytes);
-        for (size_t i=0;i<blocks.size();++i){
-            auto& b = blocks[i];
-            if (b.free && b.size >= need){
-                uint32_t start=b.start, remain=b.size-need;
-                b.free=false; b.size=need;
-                if (remain >= ALIGN){
-                    blocks.insert(blocks.begin()+i+1, Block{start+need,remain,true});
-                }
-                return start;
+        return heap.malloc(nbytes, [this](uint32_t more, uint32_t& at){
+            if ((uint64_t)heap_brk + more > n) return false;
+            at = sbrk((int32_t)more);
+            return true;
+        });
+    }
+    void free32(uint32_t ptr){ heap.free(ptr); }
+    HeapStats heap_stats() const { return heap.stats(); }
+
+    // ---- write watchpoints (debug.hpp) ----
+    // Only pages holding a watched range are tracked: stores there take the
+    // checked path (under fastmem the pages are read-only, so fast stores
+    // fault into it) and one overlapping a range throws WatchHit before
+    // writing anything. Stores to other pages cost what they always did.
+    struct Watch { uint32_t addr, len; };
+    struct WatchHit {};
+    void watch(uint32_t addr, uint32_t len){
+        if (!len || (uint64_t)addr + len > n) throw std::out_of_range("watch range");
+        watches.push_back({addr, len});
+        if (watch_pages.empty()) watch_pages.assign((n + Bus::PAGE - 1) >> Bus::PAGE_SHIFT, 0);
+        for (uint32_t pg = addr >> Bus::PAGE_SHIFT; pg <= (addr + len - 1) >> Bus::PAGE_SHIFT; ++pg)
+            if (!watch_pages[pg]++) reprotect(pg);
+        watching = true;
+    }
+    bool unwatch(uint32_t addr){
+        auto it = std::find_if(watches.begin(), watches.end(), [&](const Watch& w){ return w.addr == addr; });
+        if (it == watches.end()) return false;
+        for (uint32_t pg = it->addr >> Bus::PAGE_SHIFT; pg <= (it->addr + it->len - 1) >> Bus::PAGE_SHIFT; ++pg)
+            if (!--watch_pages[pg]) reprotect(pg);
+        watches.erase(it);
+        watching = !watches.empty();
+        return true;
+    }
+    const std::vector<Watch>& watchpoints() const { return watches; }
+    // off while a debugger steps over a store it stopped on
+    void arm_watches(bool on){ armed = on; }
+    // the store that threw WatchHit last
+    Watch watch_hit() const { return hit; }
+
+    // ---- record/replay (replay.hpp) ----
+    // Device reads and the time ECALL go through input(): logged while
+    // recording, served from the log while replaying. While a log is
+    // attached, first_write(pg) runs before the first write to each page
+    // since the last reset_writes(), with the old contents still in place.
+    void attach_replay(ReplayLog* r){
+        rec = r;
+        written.assign(r ? (n + Bus::PAGE - 1) >> Bus::PAGE_SHIFT : 0, 0);
+        written_list.clear();
+        if (fm) for (uint32_t pg = 0; pg < (n + Bus::PAGE - 1) >> Bus::PAGE_SHIFT; ++pg) reprotect(pg);
+    }
+    void reset_writes(){
+        for (uint32_t pg : written_list) { written[pg] = 0; reprotect(pg); }
+        written_list.clear();
+    }
+    uint32_t input(uint32_t v) const { return rec ? rec->input(v) : v; }
+
+    // ---- kernel mutex (very small) ----
+    // returns true if we took the lock; false if already locked. Only held
+    // locks have an entry.
+    bool try_lock(uint32_t addr){ return locks.emplace(addr, true).second; }
+    void unlock(uint32_t addr){ locks.erase(addr); if (waits) waits->unlocked.push_back(addr); }
+
+    // ---- futex wait queues ----
+    // The queues themselves belong to the scheduler that parks guest tasks
+    // (sched.hpp); it attaches a WaitLog so ECALLs can count waiters and
+    // report unlocks and wakes. With none attached nothing parks: a contended
+    // lock ECALL retries after a yield, a futex wait is a yield.
+    struct WaitLog {
+        std::vector<uint32_t> unlocked;                      // lock addresses, in order
+        std::vector<std::pair<uint32_t,uint32_t>> woken;     // futex address, tasks to wake
+        std::unordered_map<uint32_t,uint32_t> parked;        // futex address -> waiters
+    };
+    void attach_waits(WaitLog* w){ waits = w; }
+    bool parking() const { return waits != nullptr; }
+    void futex_park(uint32_t addr){ if (waits) ++waits->parked[addr]; }
+    // up to n waiters on addr; returns how many
+    uint32_t futex_wake(uint32_t addr, uint32_t n){
+        if (!waits || !n) return 0;
+        auto it = waits->parked.find(addr);
+        if (it == waits->parked.end()) return 0;
+        uint32_t k = std::min(n, it->second);
+        if (!(it->second -= k)) waits->parked.erase(it);
+        waits->woken.push_back({addr, k});
+        return k;
+    }
+
+private:
+    static MemBackend& default_ref(){
+        static MemBackend b = fastmem::available() ? MemBackend::Fastmem : MemBackend::Vector;
+        return b;
+    }
+
+    // plain RAM inside one page: one page_ptr load and the offset. Device
+    // pages, page-crossing and out-of-range accesses take the *_slow path.
+    template<unsigned S> uint32_t load(uint32_t addr) const {
+        uint32_t pg = addr >> Bus::PAGE_SHIFT, off = addr & (Bus::PAGE-1);
+        if (pg < page_ptr.size() && off <= Bus::PAGE - S)
+            if (const uint8_t* p = page_ptr[pg]) {
+                uint32_t v = 0;
+                for (unsigned i = 0; i < S; ++i) v |= (uint32_t)p[off+i] << (8*i);
+                return v;
             }
-        }
-        uint32_t grow = std::max<uint32_t>(need, 4096);
-        uint32_t old  = sbrk(grow);
-        blocks.push_back(Block{old,grow,true});
-        return malloc32(need);
-    }
-    void free32(uint32_t ptr){
-        if (ptr < heap_base || ptr >= heap_brk) return;
-        for (size_t i=0;i<blocks.size();++i){
-            auto& b=blocks[i];
-            if (b.start==ptr){
-                b.free=true;
-                if (i+1<blocks.size() && blocks[i+1].free){
-                    b.size += blocks[i+1].size;
-                    blocks.erase(blocks.begin()+i+1);
-                }
-                if (i>0 && blocks[i-1].free){
-                    blocks[i-1].size += b.size;
-                    blocks.erase(blocks.begin()+i);
-                }
+        return load_slow<S>(addr);
+    }
+    template<unsigned S> void store(uint32_t addr, uint32_t v){
+        uint32_t pg = addr >> Bus::PAGE_SHIFT, off = addr & (Bus::PAGE-1);
+        if (pg < page_ptr.size() && off <= Bus::PAGE - S)
+            if (uint8_t* p = page_ptr[pg]) {
+                WatchWindow ww(*this, addr, S);
+                if (cow || rec) touch(addr, S);
+                for (unsigned i = 0; i < S; ++i) p[off+i] = (uint8_t)(v >> (8*i));
+                icache().invalidate(addr, S);
                 return;
             }
+        store_slow<S>(addr, v);
+    }
+    template<unsigned S> uint32_t load_slow(uint32_t addr) const {
+        if (bus.claims(addr, S)) return dev_load(addr, S);
+        if ((std::size_t)addr + S > n) throw std::out_of_range("load OOB");
+        uint32_t v = 0;
+        for (unsigned i = 0; i < S; ++i) v |= (uint32_t)ram[addr+i] << (8*i);
+        return v;
+    }
+    template<unsigned S> void store_slow(uint32_t addr, uint32_t v){
+        if (bus.claims(addr, S)) { dev_store(addr, S, v); return; }
+        if ((std::size_t)addr + S > n) throw std::out_of_range("store OOB");
+        WatchWindow ww(*this, addr, S);
+        if (cow || rec) touch(addr, S);
+        for (unsigned i = 0; i < S; ++i) ram[addr+i] = (uint8_t)(v >> (8*i));
+        icache().invalidate(addr, S);
+    }
+
+    void bulk(uint32_t addr, std::size_t len, const uint8_t* src, uint8_t v){
+        if ((uint64_t)addr + len > n) throw std::out_of_range("bulk store OOB");
+        WatchWindow ww(*this, addr, len);
+        while (len) {
+            uint32_t chunk = (uint32_t)std::min<std::size_t>(len, Bus::PAGE - (addr & (Bus::PAGE - 1)));
+            if (bus.find(addr)) {
+                for (uint32_t i = 0; i < chunk; ++i) dev_store(addr + i, 1, src ? src[i] : v);
+            } else {
+                if (cow || rec) touch(addr, chunk);
+                if (src) std::memcpy(ram + addr, src, chunk); else std::memset(ram + addr, v, chunk);
+                icache().invalidate_range(addr, chunk);
+            }
+            addr += chunk; len -= chunk;
+            if (src) src += chunk;
         }
     }
 
-    // ---- kernel mutex (very small) ----
-    // returns true if we took the lock; false if already locked
-    bool try_lock(uint32_t addr){
-        return !locks[addr] ? (locks[addr]=true, true) : false;
+    // an access touching a device page: the device first (if the access is
+    // inside its page), else byte by byte from RAM
+    uint32_t dev_load(uint32_t addr, unsigned size) const {
+        sync_ticks();
+        const Bus::Entry* e = bus.find(addr);
+        if (e && ((addr ^ (addr + size - 1)) >> Bus::PAGE_SHIFT) == 0) {
+            uint32_t off = addr - e->base;
+            uint8_t b; uint16_t h; uint32_t w;
+            if (size == 1 && e->dev->read8(off, b))  return input(b);
+            if (size == 2 && e->dev->read16(off, h)) return input(h);
+            if (size == 4 && e->dev->read32(off, w)) return input(w);
+        }
+        uint32_t v = 0;
+        for (unsigned i = 0; i < size; ++i) v |= (uint32_t)*ram_byte((uint64_t)addr + i) << (8*i);
+        return v;
+    }
+    void dev_store(uint32_t addr, unsigned size, uint32_t v){
+        sync_ticks();
+        const Bus::Entry* e = bus.find(addr);
+        if (e && ((addr ^ (addr + size - 1)) >> Bus::PAGE_SHIFT) == 0) {
+            uint32_t off = addr - e->base;
+            if (size == 1 && e->dev->write8(off, (uint8_t)v))   return;
+            if (size == 2 && e->dev->write16(off, (uint16_t)v)) return;
+            if (size == 4 && e->dev->write32(off, v))           return;
+        }
+        for (unsigned i = 0; i < size; ++i) ram_byte((uint64_t)addr + i);   // fault before writing anything
+        WatchWindow ww(*this, addr, size);
+        if (cow || rec) touch(addr, size);
+        for (unsigned i = 0; i < size; ++i) *ram_byte((uint64_t)addr + i) = (uint8_t)(v >> (8*i));
+        icache().invalidate(addr, size);
+    }
+    // copy-on-write and recording: note each page before its first write;
+    // under fastmem a clean page is read-only, so a fast store to it faults
+    // and comes here through the checked path
+    void touch(uint32_t addr, unsigned len) const {
+        for (uint32_t pg = addr / fastmem::PAGE; pg <= (addr + len - 1) / fastmem::PAGE; ++pg) {
+            if (cow && !dirty[pg]) make_dirty(pg);
+            if (rec && !written[pg]) note_write(pg);
+        }
+    }
+    void make_dirty(uint32_t pg) const {
+        dirty[pg] = 1;
+        dirty_list.push_back(pg);
+        if (fm && fast_writable(pg)) fastmem::set_writable(fm, pg * fastmem::PAGE, fastmem::PAGE, true);
+    }
+    void note_write(uint32_t pg) const {
+        rec->first_write(pg);                  // old contents, before anything changes
+        written[pg] = 1;
+        written_list.push_back(pg);
+        if (fm && fast_writable(pg)) fastmem::set_writable(fm, pg * fastmem::PAGE, fastmem::PAGE, true);
     }
-    void unlock(uint32_t addr){ locks[addr]=false; }
 
-private:
-    struct Block{ uint32_t start, size; bool free; };
+    // a store overlapping a watched range while armed: note it and throw
+    // before writing
+    void check_watch(uint32_t addr, std::size_t len) const {
+        if (!armed) return;
+        uint32_t first = addr >> Bus::PAGE_SHIFT, last = (uint32_t)((addr + len - 1) >> Bus::PAGE_SHIFT);
+        bool any = false;
+        for (uint32_t pg = first; pg <= last && !any; ++pg) any = watched_page(pg);
+        if (!any) return;
+        for (const Watch& w : watches)
+            if (addr < (uint64_t)w.addr + w.len && w.addr < (uint64_t)addr + len) {
+                hit = Watch{addr, (uint32_t)std::min<std::size_t>(len, UINT32_MAX)};
+                throw WatchHit{};
+            }
+    }
+    bool watched_page(uint32_t pg) const { return pg < watch_pages.size() && watch_pages[pg]; }
+    // A checked store while watches are set: check_watch, then under
+    // fastmem open the watched pages it covers (they are read-only to fast
+    // stores, and the checked path writes through the same mapping) until
+    // the write is done.
+    struct WatchWindow {
+        const Memory* m{nullptr}; uint32_t first{0}, last{0};
+        WatchWindow(const Memory& mem, uint32_t addr, std::size_t len){
+            if (!mem.watching || !len) return;
+            mem.check_watch(addr, len);
+            if (!mem.fm) return;
+            m = &mem; first = addr >> Bus::PAGE_SHIFT; last = (uint32_t)((addr + len - 1) >> Bus::PAGE_SHIFT);
+            for (uint32_t pg = first; pg <= last; ++pg)
+                if (mem.watched_page(pg) && !mem.shadow.count(pg))
+                    fastmem::set_writable(mem.fm, pg * fastmem::PAGE, fastmem::PAGE, true);
+        }
+        ~WatchWindow(){ if (m) for (uint32_t pg = first; pg <= last; ++pg) if (m->watched_page(pg)) m->reprotect(pg); }
+        WatchWindow(const WatchWindow&) = delete;
+        WatchWindow& operator=(const WatchWindow&) = delete;
+    };
+    // what a fast store to pg should see under fastmem: writable RAM, or a
+    // fault into the checked path (clean COW page, page not yet written
+    // since the last checkpoint, watched page)
+    bool fast_writable(uint32_t pg) const {
+        return !watched_page(pg) && !(cow && !dirty[pg]) && !(rec && !written[pg]);
+    }
+    void reprotect(uint32_t pg) const {
+        if (!fm || shadow.count(pg)) return;
+        fastmem::set_writable(fm, pg * fastmem::PAGE, fastmem::PAGE, fast_writable(pg));
+    }
 
-    std::vector<uint8_t> bytes;
+    // whole pages for replay.hpp, bypassing devices, watches and tracking
+    std::size_t page_len(uint32_t pg) const {
+        return std::min<std::size_t>(Bus::PAGE, n - ((std::size_t)pg << Bus::PAGE_SHIFT));
+    }
+    void read_page(uint32_t pg, std::vector<uint8_t>& out) const {
+        const uint8_t* p = ram_byte((uint64_t)pg << Bus::PAGE_SHIFT);
+        out.assign(p, p + page_len(pg));
+    }
+    void write_page(uint32_t pg, const std::vector<uint8_t>& in){
+        if (cow && !dirty[pg]) make_dirty(pg);
+        uint8_t* p = ram_byte((uint64_t)pg << Bus::PAGE_SHIFT);
+        bool open = fm && !shadow.count(pg);
+        if (open) fastmem::set_writable(fm, pg * fastmem::PAGE, fastmem::PAGE, true);
+        std::memcpy(p, in.data(), std::min(in.size(), page_len(pg)));
+        if (open) reprotect(pg);
+        icache().invalidate_page(pg);
+    }
+
+    uint8_t* ram_byte(uint64_t a) const {
+        if (a >= n) throw std::out_of_range("device page access OOB");
+        if (fm) {
+            auto it = shadow.find((uint32_t)a >> Bus::PAGE_SHIFT);
+            if (it != shadow.end()) return const_cast<uint8_t*>(&it->second[a & (Bus::PAGE-1)]);
+        }
+        return ram + a;
+    }
+
+    std::size_t n;
+    std::vector<uint8_t> bytes;     // Vector backend
+    uint8_t* fm = nullptr;          // Fastmem backend: the reservation
+    uint8_t* ram = nullptr;         // whichever holds RAM
+    std::vector<uint8_t*> page_ptr; // host address of each whole RAM page; nullptr on device pages
+    std::unordered_map<uint32_t, std::vector<uint8_t>> shadow;  // fastmem: RAM of device pages, by page
     uint32_t text_end, heap_brk, heap_base;
 
-    uint32_t mmio_time;
+    bool timer_on = true;
+    Bus bus;
+    mutable TimerDevice timer;
+    mutable uint32_t pending_ticks = 0;   // tick_sink() when no Hart is bound
+    Console con;                    // before uart, which writes to it
+    UartDevice uart{con};
+    mutable std::mutex sys;
+    static inline thread_local Hart* tl_hart = nullptr;
     std::unordered_map<uint32_t,bool> locks;
-    std::vector<Block> blocks; // sorted by start
+    WaitLog* waits{nullptr};
+    DecodeCache dcache;
+    GuestHeap heap;
+
+    std::vector<Watch> watches;
+    std::vector<uint16_t> watch_pages;         // ranges per page, once anything was watched
+    bool watching = false;                     // any ranges set
+    bool armed = true;                         // stores into them throw WatchHit
+    mutable Watch hit{0, 0};
+    mutable uint32_t open_page = 0;            // 1 + page atomic_word opened, or 0
+
+    bool cow = false;                          // forked from a Snapshot
+    mutable std::vector<uint8_t> dirty;        // per page, while cow
+    mutable std::vector<uint32_t> dirty_list;  // the pages set in `dirty`
+
+    ReplayLog* rec{nullptr};
+    mutable std::vector<uint8_t> written;        // per page, since the last reset_writes()
+    mutable std::vector<uint32_t> written_list;  // the pages set in `written`
+    friend class Snapshot;
+    friend class Recorder;
 };
@@ -0,0 +1,100 @@
+#include "mmu.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+const Mmu::Entry Mmu::EMPTY{{NO_TAG, NO_TAG, NO_TAG}, NO_TAG, 0, 0, 0};
+
+Mmu::Mmu(Memory& mem, unsigned entries)
+: mem(mem), tlb(entries && !(entries & (entries - 1)) ? entries : 64, EMPTY), mask((uint32_t)tlb.size() - 1) {}
+
+void Mmu::flush(){
+    std::fill(tlb.begin(), tlb.end(), EMPTY);
+    ++st.flushes;
+}
+
+void Mmu::flush_page(uint32_t va){
+    Entry& e = slot(va);
+    if (e.vpage == (va & ~(PAGE - 1))) e = EMPTY;
+    ++st.flushes;
+}
+
+void Mmu::page_fault(uint32_t va, Access a){
+    fault = Fault{va, a};
+    ++st.faults;
+    throw std::out_of_range("page fault");
+}
+
+// The Sv32 walk: two levels of 1024 PTEs, a leaf at level 1 maps a 4 MiB
+// megapage. A and D are set in the PTE itself (as hardware updating them).
+uint32_t Mmu::walk(uint32_t va, Access a, uint32_t& perm){
+    ++st.walks;
+    uint64_t table = (uint64_t)(cur & 0x3FFFFF) << PAGE_SHIFT;
+    for (int level = 1; level >= 0; --level) {
+        uint32_t vpn = level ? va >> 22 : (va >> 12) & 0x3FF;
+        uint64_t pte_pa = table + 4u * vpn;
+        if (pte_pa + 4 > mem.size()) page_fault(va, a);
+        uint32_t pte = mem.load32((uint32_t)pte_pa);
+        if (!(pte & V) || ((pte & W) && !(pte & R))) page_fault(va, a);
+        uint64_t ppn = pte >> 10;
+        if (!(pte & (R | X))) {                              // pointer to the next level
+            table = ppn << PAGE_SHIFT;
+            continue;
+        }
+        const uint32_t need = a == Read ? R : a == Write ? W : X;
+        if (!(pte & need)) page_fault(va, a);
+        if (level && (ppn & 0x3FF)) page_fault(va, a);       // misaligned megapage
+        uint32_t upd = pte | A | (a == Write ? (uint32_t)D : 0u);
+        if (upd != pte) mem.store32((uint32_t)pte_pa, pte = upd);
+        perm = pte & (R | X);
+        if ((pte & W) && (pte & D)) perm |= W;
+        uint64_t pa = level ? (ppn << PAGE_SHIFT) | (va & 0x3FF000) : ppn << PAGE_SHIFT;
+        if (pa >> 32 || (pa >= mem.size() && !mem.is_device((uint32_t)pa)))
+            page_fault(va, a);                               // an access fault, really
+        return (uint32_t)pa;
+    }
+    page_fault(va, a);                                       // level 0 entry was a pointer
+}
+
+uint32_t Mmu::translate(uint32_t va, Access a){
+    Entry& e = slot(va);
+    const uint32_t vp = va & ~(PAGE - 1);
+    const uint32_t need = a == Read ? R : a == Write ? W : X;
+    if (e.vpage == vp && (e.perm & need)) { ++st.hits[a]; return va + e.delta; }
+    ++st.misses[a];
+    uint32_t perm = 0;
+    uint32_t pp = walk(va, a, perm);
+    uint8_t* rd = mem.direct_page(pp, false);
+    uint8_t* wr = mem.direct_page(pp, true);
+    e.vpage = vp;
+    e.delta = pp - vp;
+    e.perm = perm;
+    e.addend = (uintptr_t)rd - vp;
+    e.tag[Read]  = (perm & R) && rd ? vp : NO_TAG;
+    e.tag[Write] = (perm & W) && wr ? vp : NO_TAG;
+    e.tag[Exec]  = (perm & X) ? vp : NO_TAG;
+    return pp | (va & (PAGE - 1));
+}
+
+// misaligned, device pages, or the first access after a miss
+uint32_t Mmu::load_slow(uint32_t va, unsigned n){
+    if (((va & (PAGE - 1)) + n) > PAGE) {                    // straddles two pages
+        uint32_t v = 0;
+        for (unsigned i = 0; i < n; ++i) v |= (uint32_t)mem.load8(translate(va + i, Read)) << (8*i);
+        return v;
+    }
+    uint32_t pa = translate(va, Read);
+    return n == 1 ? mem.load8(pa) : n == 2 ? mem.load16(pa) : mem.load32(pa);
+}
+
+void Mmu::store_slow(uint32_t va, unsigned n, uint32_t v){
+    if (((va & (PAGE - 1)) + n) > PAGE) {
+        uint32_t pa[4];
+        for (unsigned i = 0; i < n; ++i) pa[i] = translate(va + i, Write);   // fault before writing
+        for (unsigned i = 0; i < n; ++i) mem.store8(pa[i], (uint8_t)(v >> (8*i)));
+        return;
+    }
+    uint32_t pa = translate(va, Write);
+    if (n == 1) mem.store8(pa, (uint8_t)v);
+    else if (n == 2) mem.store16(pa, (uint16_t)v);
+    else mem.store32(pa, v);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "mem.hpp"
+
+// Sv32 address translation for one hart. CPU::satp picks the page table;
+// run() takes the FeatMmu loop while satp.MODE is set and CPU::mmu points
+// here. Every access first tries a direct-mapped software TLB whose entries
+// carry a host pointer for their page, so a hit is one compare and one add.
+// A miss walks the two-level table in guest physical memory (setting A, and
+// D on a write), refills the entry and goes through the checked accessors.
+//
+// There are no privilege levels, so U is ignored. A write entry needs D, so
+// the first store to a clean page walks again to set it. Memory::attach()
+// after entries were filled needs a flush().
+class Mmu {
+public:
+    enum Access : unsigned { Read, Write, Exec };
+    static constexpr uint32_t PAGE_SHIFT = 12, PAGE = 1u << PAGE_SHIFT;
+    static constexpr uint32_t SATP_SV32 = 1u << 31;    // satp.MODE; PPN of the root in 21:0
+    enum Pte : uint32_t { V = 1, R = 2, W = 4, X = 8, U = 16, G = 32, A = 64, D = 128 };
+
+    struct Stats {
+        uint64_t hits[3]{}, misses[3]{};      // by Access
+        uint64_t walks{0}, faults{0}, flushes{0};
+    };
+    struct Fault { uint32_t vaddr{0}; Access access{Read}; };
+
+    explicit Mmu(Memory& mem, unsigned entries = 64);   // entries: a power of two
+
+    // the satp entries are filled under; a different one flushes (no ASIDs)
+    void bind(uint32_t satp){ if (satp != cur) { cur = satp; flush(); } }
+    void flush();                         // SFENCE.VMA x0
+    void flush_page(uint32_t va);         // SFENCE.VMA rs1
+
+    // virtual accesses; a page fault throws std::out_of_range (a guest trap)
+    template<typename T> T load(uint32_t va){
+        const Entry& e = slot(va);
+        if (e.tag[Read] == tag_of(va, sizeof(T))) {
+            ++st.hits[Read];
+            T v; std::memcpy(&v, (const void*)(e.addend + va), sizeof v);
+            return v;
+        }
+        return (T)load_slow(va, sizeof(T));
+    }
+    template<typename T> void store(uint32_t va, T v){
+        const Entry& e = slot(va);
+        if (e.tag[Write] == tag_of(va, sizeof(T))) {
+            ++st.hits[Write];
+            std::memcpy((void*)(e.addend + va), &v, sizeof v);
+            mem.icache().invalidate(va + e.delta, sizeof v);
+            return;
+        }
+        store_slow(va, sizeof(T), v);
+    }
+    // physical pc for the decode cache
+    uint32_t fetch(uint32_t va){
+        const Entry& e = slot(va);
+        if (e.tag[Exec] == tag_of(va, 4)) { ++st.hits[Exec]; return va + e.delta; }
+        return translate(va, Exec);
+    }
+    uint32_t translate(uint32_t va, Access a);
+
+    unsigned entries() const { return (unsigned)tlb.size(); }
+    const Stats& stats() const { return st; }
+    const Fault& last_fault() const { return fault; }
+
+private:
+    static constexpr uint32_t NO_TAG = PAGE - 1;   // never equal to a page address
+    struct Entry {
+        uint32_t tag[3];       // by Access: the page if that access may go direct, else NO_TAG
+        uint32_t vpage;        // NO_TAG: empty
+        uint32_t delta;        // pa - va
+        uint32_t perm;         // R/W/X the walk allowed (W only once D is set)
+        uintptr_t addend;      // host pointer = addend + va
+    };
+    static const Entry EMPTY;
+
+    // an aligned access of n bytes matches its page's tag; a misaligned one never does
+    static uint32_t tag_of(uint32_t va, uint32_t n){ return va & (~(PAGE - 1) | (n - 1)); }
+    Entry& slot(uint32_t va){ return tlb[(va >> PAGE_SHIFT) & mask]; }
+    uint32_t walk(uint32_t va, Access a, uint32_t& perm);   // pa of va's page
+    [[noreturn]] void page_fault(uint32_t va, Access a);
+    uint32_t load_slow(uint32_t va, unsigned n);
+    void store_slow(uint32_t va, unsigned n, uint32_t v);
+
+    Memory& mem;
+    std::vector<Entry> tlb;
+    uint32_t mask;
+    uint32_t cur{0};
+    Stats st;
+    Fault fault;
+};
@@ -0,0 +1,105 @@
+#include "profile.hpp"
+#include "symbols.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+
+Profiler::Profiler(const ProfileSpec& s) : cfg(s), left(s.period ? s.period : 1) {
+    if (!cfg.period) cfg.period = 1;
+    frames.reserve(cfg.max_depth);
+}
+
+void Profiler::sample(uint32_t pc){
+    key.assign(frames.begin(), frames.end());
+    key.push_back(pc);
+    ++stacks[key];
+    ++total;
+}
+
+// Link-register conventions as in BranchPredictor::jump. A return to just
+// after a live call site pops down to it (longjmp-style unwinds included);
+// one that matches nothing leaves the stack alone.
+void Profiler::apply(){
+    pending = false;
+    auto link = [](uint8_t r){ return r == 1 || r == 5; };
+    if (j_jalr && link(j_rs1) && !(link(j_rd) && j_rs1 == j_rd) && depth_) {
+        if (depth_ > frames.size()) {
+            --depth_;
+        } else {
+            for (std::size_t i = frames.size(); i-- > 0; ) {
+                if (frames[i] + 4 != j_target) continue;
+                depth_ -= (uint32_t)(frames.size() - i);
+                frames.resize(i);
+                break;
+            }
+        }
+    }
+    if (link(j_rd)) {
+        if (depth_ < cfg.max_depth) frames.push_back(j_pc);
+        ++depth_;
+    }
+}
+
+static std::string function_of(uint32_t pc, const SymbolTable* syms){
+    if (syms)
+        if (const auto* s = syms->lookup(pc)) return s->name;
+    char buf[16];
+    std::snprintf(buf, sizeof buf, "0x%08x", pc);
+    return buf;
+}
+
+void Profiler::write_folded(std::FILE* f, const SymbolTable* syms) const {
+    std::map<std::string, uint64_t> folded;     // sorted, and merges stacks that differ only in pcs
+    for (auto& [k, n] : stacks) {
+        std::string line;
+        for (std::size_t i = 0; i < k.size(); ++i) {
+            if (i) line += ';';
+            line += function_of(k[i], syms);
+        }
+        folded[line] += n;
+    }
+    for (auto& [line, n] : folded) std::fprintf(f, "%s %llu\n", line.c_str(), (unsigned long long)n);
+}
+
+void Profiler::write_top(std::FILE* f, std::size_t n, const SymbolTable* syms) const {
+    struct Count { uint64_t self{0}, incl{0}; };
+    std::unordered_map<std::string, Count> by_fn;
+    std::vector<std::string> names;
+    for (auto& [k, c] : stacks) {
+        names.clear();
+        for (uint32_t pc : k) names.push_back(function_of(pc, syms));
+        by_fn[names.back()].self += c;
+        std::sort(names.begin(), names.end());                  // recursion counts once
+        names.erase(std::unique(names.begin(), names.end()), names.end());
+        for (auto& s : names) by_fn[s].incl += c;
+    }
+    std::vector<std::pair<std::string, Count>> v(by_fn.begin(), by_fn.end());
+    std::sort(v.begin(), v.end(), [](const auto& a, const auto& b){
+        return a.second.self != b.second.self ? a.second.self > b.second.self : a.first < b.first;
+    });
+    if (v.size() > n) v.resize(n);
+    std::fprintf(f, "%7s %10s %7s %10s  %s\n", "self%", "self", "total%", "total", "function");
+    const double pct = total ? 100.0 / total : 0.0;
+    for (auto& [name, c] : v)
+        std::fprintf(f, "%6.2f%% %10llu %6.2f%% %10llu  %s\n", c.self * pct, (unsigned long long)c.self,
+                     c.incl * pct, (unsigned long long)c.incl, name.c_str());
+}
+
+ProfileSpec ProfileSpec::parse(const std::string& text){
+    ProfileSpec s;
+    std::string num = text;
+    auto colon = text.find(':');
+    if (colon != std::string::npos) {
+        std::string unit = text.substr(0, colon);
+        if (unit == "insns")       s.unit = Insns;
+        else if (unit == "cycles") s.unit = Cycles;
+        else throw std::invalid_argument("unknown profile unit '" + unit + "'");
+        num = text.substr(colon + 1);
+    }
+    char* end = nullptr;
+    unsigned long long n = std::strtoull(num.c_str(), &end, 0);
+    if (num.empty() || *end || n == 0) throw std::invalid_argument("bad profile period '" + num + "'");
+    s.period = n;
+    return s;
+}
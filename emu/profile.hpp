@@ -0,0 +1,71 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class SymbolTable;
+
+// Sampling profiler for one hart. Set CPU::profiler and every period
+// retired instructions (or cycles) the guest pc is recorded together with a
+// shadow call stack, kept from JAL/JALR by the same link-register
+// conventions as the return-address stack in bpred.hpp. Samples stay raw
+// pcs in a hash table; symbols are only looked up when writing reports.
+
+struct ProfileSpec {
+    enum Unit : uint8_t { Insns, Cycles };
+    Unit unit{Insns};
+    uint64_t period{10000};
+    uint32_t max_depth{64};      // deeper frames are counted but not recorded
+
+    // "N", "insns:N" or "cycles:N". Throws std::invalid_argument.
+    static ProfileSpec parse(const std::string& text);
+};
+
+class Profiler {
+public:
+    explicit Profiler(const ProfileSpec& s = ProfileSpec{});
+
+    // every retired instruction, with the cycles it took; the stack a
+    // sample sees is the one the instruction ran under
+    void retire(uint32_t pc, uint32_t cycles){
+        uint64_t step = cfg.unit == ProfileSpec::Cycles ? cycles : 1;
+        if (left > step) left -= step;
+        else { left = cfg.period; sample(pc); }
+        if (pending) apply();
+    }
+    // a JAL/JALR about to retire
+    void jump(uint32_t pc, uint8_t rd, uint8_t rs1, bool jalr, uint32_t target){
+        pending = true; j_pc = pc; j_target = target; j_rd = rd; j_rs1 = rs1; j_jalr = jalr;
+    }
+
+    const ProfileSpec& spec() const { return cfg; }
+    uint64_t samples() const { return total; }
+    uint32_t depth() const { return depth_; }
+    // "outer;inner;leaf count" per distinct stack, one function per frame
+    void write_folded(std::FILE* f, const SymbolTable* syms = nullptr) const;
+    // the n functions with the most samples of their own, with inclusive counts
+    void write_top(std::FILE* f, std::size_t n, const SymbolTable* syms = nullptr) const;
+
+private:
+    struct StackHash {
+        std::size_t operator()(const std::vector<uint32_t>& v) const {
+            uint64_t h = 0xcbf29ce484222325ull;
+            for (uint32_t x : v) h = (h ^ x) * 0x100000001b3ull;
+            return (std::size_t)h;
+        }
+    };
+    void sample(uint32_t pc);
+    void apply();                       // the pending jump's call and/or return
+
+    ProfileSpec cfg;
+    uint64_t left, total{0};
+    uint32_t depth_{0};
+    bool pending{false}, j_jalr{false};
+    uint8_t j_rd{0}, j_rs1{0};
+    uint32_t j_pc{0}, j_target{0};
+    std::vector<uint32_t> frames;       // pc of each live call site, outermost first
+    std::vector<uint32_t> key;          // scratch: frames + the sampled pc
+    std::unordered_map<std::vector<uint32_t>, uint64_t, StackHash> stacks;
+};
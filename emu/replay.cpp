@@ -0,0 +1,91 @@
+#include "replay.hpp"
+#include <algorithm>
+#include "mmu.hpp"
+
+Recorder::Recorder(CPU& c, Memory& m, uint64_t iv, std::size_t max_checkpoints)
+    : cpu(c), mem(m), interval(iv ? iv : 1), max_cks(std::max<std::size_t>(max_checkpoints, 1)),
+      front(c.instret) {
+    mem.attach_replay(this);
+    checkpoint();
+}
+
+Recorder::~Recorder(){
+    mem.attach_replay(nullptr);
+    if (mem.console().is_muted()) mem.console().set_muted(false);
+}
+
+uint64_t Recorder::room() const {
+    uint64_t r = cks.back().instret + interval - cpu.instret;
+    if (cpu.instret < front) r = std::min(r, front - cpu.instret);
+    return std::max<uint64_t>(r, 1);
+}
+
+void Recorder::sync(){
+    if (cpu.instret >= front) {
+        front = cpu.instret;
+        if (mem.console().is_muted()) mem.console().set_muted(false);
+    }
+    if (cpu.instret >= cks.back().instret + interval) checkpoint();
+}
+
+void Recorder::checkpoint(){
+    mem.reset_writes();
+    Checkpoint ck{cpu.instret, cpu, mem.text_end, mem.heap_brk, mem.heap_base, mem.time(), mem.timer_on,
+                  mem.heap, mem.locks, pos, {}};
+    cks.push_back(std::move(ck));
+    if (cks.size() > max_cks) cks.pop_front();
+}
+
+void Recorder::undo(Checkpoint& ck){
+    for (auto& [pg, bytes] : ck.undo) mem.write_page(pg, bytes);
+    ck.undo.clear();
+}
+
+void Recorder::rewind(uint64_t t){
+    while (cks.size() > 1 && cks.back().instret > t) { undo(cks.back()); cks.pop_back(); }
+    Checkpoint& ck = cks.back();
+    undo(ck);
+    mem.reset_writes();
+
+    mem.text_end = ck.text_end; mem.heap_brk = ck.heap_brk; mem.heap_base = ck.heap_base;
+    mem.pending_ticks = 0;
+    mem.timer.now.store(ck.timer_now, std::memory_order_relaxed);
+    mem.timer_on = ck.timer_on;
+    mem.heap = ck.heap; mem.locks = ck.locks;
+
+    // the registers and counters go back; what the CPU is attached to stays
+    CPU now = cpu;
+    cpu = ck.cpu;
+    cpu.breakpoints = now.breakpoints; cpu.debugger = now.debugger; cpu.jit = now.jit;
+    cpu.caches = now.caches; cpu.bpred = now.bpred; cpu.profiler = now.profiler; cpu.mmu = now.mmu;
+    if (cpu.mmu) cpu.mmu->flush();
+
+    pos = ck.input_pos;
+    if (cpu.instret < front && !mem.console().is_muted()) mem.console().set_muted(true);
+    ++rewinds;
+}
+
+uint64_t Recorder::checkpoint_before(uint64_t t) const {
+    for (auto it = cks.rbegin(); it != cks.rend(); ++it)
+        if (it->instret < t) return it->instret;
+    return start();
+}
+
+uint32_t Recorder::input(uint32_t v){
+    if (!live) return v;
+    if (pos < inputs.size()) return inputs[pos++];   // replaying
+    inputs.push_back(v);
+    ++pos;
+    return v;
+}
+
+void Recorder::first_write(uint32_t pg){
+    cks.back().undo.emplace_back(pg, std::vector<uint8_t>());
+    mem.read_page(pg, cks.back().undo.back().second);
+}
+
+Recorder::Stats Recorder::stats() const {
+    Stats s{cks.size(), 0, inputs.size(), rewinds};
+    for (const auto& ck : cks) s.pages += ck.undo.size();
+    return s;
+}
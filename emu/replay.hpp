@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "cpu.hpp"
+#include "mem.hpp"
+
+// Record/replay for one CPU + Memory: what the debugger's reverse-step and
+// reverse-continue run on (debug.hpp drives it).
+//
+// Every `interval` instructions sync() takes a checkpoint: the CPU, the
+// Memory bookkeeping (brk, heap, locks, timer) and an undo log, filled in
+// as execution goes, of the old contents of each page first written after
+// it. Device reads (the timer at 0x3000, the UART) and the time ECALL are
+// logged in order. Scheduling needs no log: yields and quanta are counted
+// in instructions, so replaying the instructions replays them.
+//
+// rewind(t) applies the undo logs back to the latest checkpoint at or
+// before t and restores it. Running forward from there replays the logged
+// inputs and keeps guest output muted until execution passes the furthest
+// point reached so far, so reaching any past instruction costs the pages
+// written since that checkpoint plus at most `interval` instructions,
+// whatever the length of the run.
+//
+// Timing models (caches, bpred, profiler) are not rewound; they see
+// replayed instructions again.
+class Recorder : public ReplayLog {
+public:
+    static constexpr uint64_t INTERVAL = 1u << 16;
+    static constexpr std::size_t MAX_CHECKPOINTS = 1024;   // the oldest go first
+
+    Recorder(CPU& cpu, Memory& mem, uint64_t interval = INTERVAL,
+             std::size_t max_checkpoints = MAX_CHECKPOINTS);
+    ~Recorder() override;
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // The owner runs the guest in pieces of at most room() instructions,
+    // with set_live(true) around each (other reads, e.g. a memory dump,
+    // are not the guest's inputs) and sync() after it.
+    uint64_t room() const;
+    void set_live(bool on){ live = on; }
+    void sync();
+
+    // back to the latest checkpoint at or before instret t (the earliest
+    // if t predates them all); later ones are dropped and taken again as
+    // execution passes them
+    void rewind(uint64_t t);
+
+    uint64_t start() const { return cks.front().instret; }
+    uint64_t frontier() const { return front; }                 // furthest instret reached
+    uint64_t checkpoint_before(uint64_t t) const;               // latest < t, else start()
+    bool replaying() const { return cpu.instret < front; }
+
+    struct Stats { std::size_t checkpoints, pages, inputs; uint64_t rewinds; };
+    Stats stats() const;
+
+    uint32_t input(uint32_t v) override;
+    void first_write(uint32_t pg) override;
+
+private:
+    struct Checkpoint {
+        uint64_t instret;
+        CPU cpu;
+        uint32_t text_end, heap_brk, heap_base, timer_now;
+        bool timer_on;
+        GuestHeap heap;
+        std::unordered_map<uint32_t, bool> locks;
+        std::size_t input_pos;
+        std::vector<std::pair<uint32_t, std::vector<uint8_t>>> undo;   // page, contents at the checkpoint
+    };
+    void checkpoint();
+    void undo(Checkpoint& ck);
+
+    CPU& cpu;
+    Memory& mem;
+    uint64_t interval;
+    std::size_t max_cks;
+    std::deque<Checkpoint> cks;
+    std::vector<uint32_t> inputs;
+    std::size_t pos{0};
+    uint64_t front;
+    uint64_t rewinds{0};
+    bool live{false};
+};
@@ -0,0 +1,135 @@
+#include "sched.hpp"
+#include <algorithm>
+
+Scheduler::Scheduler(Memory& mem, const SchedConfig& c)
+: mem(mem), cfg(c) {
+    cfg.levels = std::clamp(cfg.levels, 1u, 64u);
+    cfg.base_quantum = std::max(cfg.base_quantum, 1u);
+    head.assign(cfg.levels, -1);
+    tail.assign(cfg.levels, -1);
+    if (cfg.park) mem.attach_waits(&log);
+}
+
+Scheduler::~Scheduler(){ if (cfg.park) mem.attach_waits(nullptr); }
+
+int Scheduler::spawn(uint32_t pc, uint32_t prio){
+    int id = (int)tasks.size();
+    Task& t = tasks.emplace_back();
+    t.cpu.pc = pc;
+    t.cpu.tid = (uint32_t)id;
+    t.cpu.prio = prio;
+    t.level = std::min(prio, cfg.levels - 1);
+    t.since = st.insns;
+    push(id);
+    ++live;
+    return id;
+}
+
+void Scheduler::push(int id){
+    Task& t = tasks[id];
+    t.next = -1;
+    if (tail[t.level] < 0) head[t.level] = id; else tasks[tail[t.level]].next = id;
+    tail[t.level] = id;
+    nonempty |= 1ull << t.level;
+}
+
+int Scheduler::pop(unsigned level){
+    int id = head[level];
+    head[level] = tasks[id].next;
+    if (head[level] < 0) { tail[level] = -1; nonempty &= ~(1ull << level); }
+    return id;
+}
+
+int Scheduler::pick(){
+    if (!nonempty) return -1;
+    unsigned best = (unsigned)__builtin_ctzll(nonempty);
+    if (cfg.aging) {
+        for (uint64_t m = nonempty & ~((2ull << best) - 1); m; m &= m - 1) {
+            unsigned l = (unsigned)__builtin_ctzll(m);
+            Task& h = tasks[head[l]];
+            if (st.insns - h.since < cfg.aging) continue;
+            int id = pop(l);
+            h.wait_insns += st.insns - h.since;      // the next promotion needs another full wait
+            h.since = st.insns;
+            h.level = l - 1;
+            push(id);
+            ++st.promotions;
+        }
+    }
+    return pop((unsigned)__builtin_ctzll(nonempty));
+}
+
+void Scheduler::ready(int id){
+    Task& t = tasks[id];
+    t.blocked_insns += st.insns - t.since;
+    t.since = st.insns;
+    t.state = State::Ready;
+    t.level = std::min(t.cpu.prio, cfg.levels - 1);
+    push(id);
+    ++st.wakeups;
+}
+
+// hand the lock to the longest-waiting task: it owns the lock before any
+// other task runs, and resumes past its lock ECALL. Retaken later in the
+// same slice, the lock stays with its holder, whose unlock comes back here.
+void Scheduler::wake_lock(uint32_t addr){
+    auto it = waiters.find(addr);
+    if (it == waiters.end() || !mem.try_lock(addr)) return;
+    int id = it->second.front();
+    it->second.pop_front();
+    if (it->second.empty()) waiters.erase(it);
+    tasks[id].cpu.pc += 4;
+    ready(id);
+}
+
+// the n longest waiters; they resume past their wait ECALL
+void Scheduler::wake_futex(uint32_t addr, uint32_t n){
+    auto it = futexes.find(addr);
+    if (it == futexes.end()) return;
+    for (; n && !it->second.empty(); --n) {
+        ready(it->second.front());
+        it->second.pop_front();
+    }
+    if (it->second.empty()) futexes.erase(it);
+}
+
+Scheduler::Stats Scheduler::run(uint64_t max_insns){
+    const uint64_t start = st.insns;
+    st.deadlock = false;
+    while (live && st.insns - start < max_insns) {
+        int id = pick();
+        if (id < 0) { st.deadlock = true; break; }
+        Task& t = tasks[id];
+        t.wait_insns += st.insns - t.since;
+        t.state = State::Running;
+        ++t.switches; ++st.switches;
+
+        t.cpu.quantum = quantum(t.level);
+        t.cpu.slice_count = 0;
+        RunExit r = t.cpu.run(mem, UINT64_MAX);
+        t.cpu.quantum = 0;
+        t.run_insns += r.insns;
+        st.insns += r.insns;
+        t.since = st.insns;
+
+        for (uint32_t a : log.unlocked) wake_lock(a);
+        for (auto [a, n] : log.woken) wake_futex(a, n);
+        log.unlocked.clear(); log.woken.clear();
+
+        if (t.cpu.halted || r.reason == Exit::Trap) {
+            t.state = State::Done;
+            --live;
+        } else if (t.cpu.waiting != CPU::Wait::None) {
+            auto& q = t.cpu.waiting == CPU::Wait::Lock ? waiters : futexes;
+            q[t.cpu.wait_addr].push_back(id);
+            t.cpu.waiting = CPU::Wait::None;
+            t.state = State::Blocked;
+            ++st.blocks;
+        } else {
+            t.state = State::Ready;
+            t.level = std::min(t.cpu.prio, cfg.levels - 1);
+            push(id);
+        }
+    }
+    return st;
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include "cpu.hpp"
+#include "mem.hpp"
+
+// O(1) multi-level scheduler for guest tasks sharing one Memory on one
+// host thread. Each priority level (CPU::prio, 0 = highest, clamped to
+// levels-1) is a FIFO; a bitmap of non-empty levels makes picking the next
+// task a find-first-set. A task runs until its level's quantum expires, it
+// yields (ECALL 7), blocks, halts or traps. Blocking uses no CPU: a task
+// whose lock ECALL (9) finds the lock taken is parked until that address
+// is unlocked, then handed the lock ahead of any ready task, and a futex wait (ECALL 11: addr, expected) that finds the
+// word unchanged is parked until a futex wake (ECALL 12: addr, n) picks it;
+// each address has its own FIFO of parked tasks.
+//
+// Aging: the head of a lower level that has been ready for `aging`
+// instructions of scheduler time moves up one level; a task drops back to
+// its own priority once it has run. Only heads are checked (they are each
+// level's oldest), so a pick looks at no more than `levels` tasks.
+//
+// Time is counted in retired guest instructions across all tasks.
+struct SchedConfig {
+    unsigned levels{8};          // 1..64
+    uint32_t base_quantum{20};   // level p runs base_quantum * (levels - p) per slice
+    uint64_t aging{2000};        // 0 = never promote
+    bool park{true};             // false: the old spin-yield, contended tasks retry every slice
+};
+
+class Scheduler {
+public:
+    enum class State : uint8_t { Ready, Running, Blocked, Done };
+    struct Task {
+        CPU cpu;
+        State state{State::Ready};
+        unsigned level{0};               // current level (prio, or better while aged)
+        uint64_t run_insns{0};           // retired while running
+        uint64_t wait_insns{0};          // scheduler time spent ready
+        uint64_t blocked_insns{0};       // scheduler time spent parked on a lock
+        uint64_t switches{0};            // times dispatched
+        uint64_t since{0};               // when it last became ready / blocked
+        int next{-1};                    // run-queue link
+    };
+    struct Stats {
+        uint64_t switches{0}, insns{0}, promotions{0}, blocks{0}, wakeups{0};
+        bool deadlock{false};            // everything left is blocked
+    };
+
+    Scheduler(Memory& mem, const SchedConfig& c = SchedConfig{});
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    // a ready task starting at pc; its CPU can be adjusted through task()
+    // before run(). Returns its id.
+    int spawn(uint32_t pc, uint32_t prio);
+    // dispatch until every task is done, everything left is blocked, or
+    // about max_insns instructions have run (a slice is never cut short)
+    Stats run(uint64_t max_insns = UINT64_MAX);
+
+    Task& task(int id){ return tasks[id]; }
+    const Task& task(int id) const { return tasks[id]; }
+    int size() const { return (int)tasks.size(); }
+    const Stats& stats() const { return st; }
+    uint32_t quantum(unsigned level) const { return cfg.base_quantum * (cfg.levels - level); }
+
+private:
+    void push(int id);                   // to the tail of its level
+    int pop(unsigned level);             // from the head
+    int pick();                          // aging, then the best non-empty level
+    void ready(int id);                  // parked -> ready at its own level
+    void wake_lock(uint32_t addr);
+    void wake_futex(uint32_t addr, uint32_t n);
+
+    Memory& mem;
+    SchedConfig cfg;
+    std::deque<Task> tasks;              // stable addresses while spawning
+    std::vector<int> head, tail;         // per level
+    uint64_t nonempty{0};                // bit per level
+    std::unordered_map<uint32_t, std::deque<int>> waiters;   // lock address -> parked tasks
+    std::unordered_map<uint32_t, std::deque<int>> futexes;   // futex address -> parked tasks
+    Memory::WaitLog log;                 // unlocks and wakes of the last slice
+    unsigned live{0};                    // not Done
+    Stats st;
+};
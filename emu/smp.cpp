@@ -0,0 +1,31 @@
+#include "smp.hpp"
+#include "mem.hpp"
+#include <chrono>
+#include <thread>
+
+static RunExit run_hart(CPU& cpu, Memory& mem, uint64_t budget){
+    constexpr uint64_t SLICE = 1u << 16;   // check in this often
+    Memory::Hart bind(mem);
+    RunExit total{Exit::Budget, 0};
+    while (!budget || total.insns < budget) {
+        uint64_t n = budget ? std::min(SLICE, budget - total.insns) : SLICE;
+        RunExit ex = cpu.interpret(mem, n);
+        total.insns += ex.insns;
+        total.reason = ex.reason;
+        if (ex.reason == Exit::Halt || ex.reason == Exit::Trap) break;
+        if (ex.reason == Exit::Yield) std::this_thread::yield();
+    }
+    return total;
+}
+
+Smp::Result Smp::run(uint64_t budget){
+    Result r;
+    r.harts.resize(harts.size());
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> th;
+    for (std::size_t i = 0; i < harts.size(); ++i)
+        th.emplace_back([&, i]{ r.harts[i] = run_hart(*harts[i], mem, budget); });
+    for (auto& t : th) t.join();
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return r;
+}
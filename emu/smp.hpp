@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "cpu.hpp"
+
+class Memory;
+
+// Runs several harts over one Memory, each on its own host thread. Harts
+// share guest RAM, devices and the heap; each binds a Memory::Hart for the
+// run, so its decode cache and timer ticks are private (see mem.hpp).
+// Harts talk through RV32A (LR/SC, AMOs) and FENCE, which map straight onto
+// host atomics. The translator is not thread-safe, so harts always go
+// through CPU::interpret, and global_trace() must be off.
+class Smp {
+public:
+    struct Result {
+        std::vector<RunExit> harts;     // last exit and insns retired, per hart
+        double seconds = 0;             // wall time for the whole run
+    };
+
+    explicit Smp(Memory& mem) : mem(mem) {}
+    void add(CPU& cpu){ harts.push_back(&cpu); }
+
+    // Run every hart until it halts, traps or retires `budget` instructions
+    // (0 = no limit). Yield exits give the host core away and carry on.
+    Result run(uint64_t budget = 0);
+
+private:
+    Memory& mem;
+    std::vector<CPU*> harts;
+};
@@ -0,0 +1,78 @@
+#include "snapshot.hpp"
+#include "mmu.hpp"
+
+Snapshot::Snapshot(const CPU& cpu, const Memory& mem) : regs(cpu), image(mem.n) {
+    // attachments belong to the parent (its Mmu is bound to its Memory); a child brings its own
+    regs.jit = nullptr; regs.breakpoints = nullptr; regs.debugger = nullptr;
+    regs.caches = nullptr; regs.bpred = nullptr; regs.profiler = nullptr; regs.mmu = nullptr;
+    for (std::size_t a = 0; a < mem.n; a += fastmem::PAGE) {   // device pages keep their RAM aside
+        std::size_t len = std::min<std::size_t>(fastmem::PAGE, mem.n - a);
+        auto it = mem.shadow.find((uint32_t)(a >> Bus::PAGE_SHIFT));
+        std::memcpy(image.data() + a, it != mem.shadow.end() ? it->second.data() : mem.ram + a, len);
+    }
+    fastmem_backend = mem.backend() == MemBackend::Fastmem;
+    if (fastmem_backend) fd = fastmem::make_image(image.data(), image.size());
+
+    text_end = mem.text_end; heap_brk = mem.heap_brk; heap_base = mem.heap_base;
+    timer_now = mem.time(); timer_on = mem.timer_on;
+    heap = mem.heap; locks = mem.locks;
+}
+
+Snapshot::~Snapshot(){ fastmem::close_image(fd); }
+
+void Snapshot::restore_meta(Memory& m) const {
+    m.text_end = text_end; m.heap_brk = heap_brk; m.heap_base = heap_base;
+    m.pending_ticks = 0;
+    m.timer.now.store(timer_now, std::memory_order_relaxed);
+    m.timer_on = timer_on;
+    m.heap = heap; m.locks = locks;
+}
+
+Snapshot::Child Snapshot::fork() const {
+    Child c{regs, nullptr};
+    bool fm = fastmem_backend && fd >= 0;
+    c.mem = std::make_unique<Memory>(image.size(), fm ? MemBackend::Fastmem : MemBackend::Vector);
+    Memory& m = *c.mem;
+    if (m.fm && fastmem::map_image(m.fm, image.size(), fd)) {
+        // shared read-only from here; the constructor's device pages go
+        // back to PROT_NONE with their RAM from the image
+        for (auto& [pg, bytes] : m.shadow) {
+            std::size_t a = (std::size_t)pg << Bus::PAGE_SHIFT;
+            std::memcpy(bytes.data(), image.data() + a, bytes.size());
+            fastmem::protect(m.fm, (uint32_t)a, Bus::PAGE);
+        }
+    } else {
+        for (uint32_t a = 0; a < image.size(); a += fastmem::PAGE) {   // private copy, page by page
+            uint32_t len = (uint32_t)std::min<std::size_t>(fastmem::PAGE, image.size() - a);
+            auto it = m.shadow.find(a >> Bus::PAGE_SHIFT);
+            std::memcpy(it != m.shadow.end() ? it->second.data() : m.ram + a, image.data() + a, len);
+        }
+    }
+    m.cow = true;
+    m.dirty.assign((image.size() + fastmem::PAGE - 1) / fastmem::PAGE, 0);
+    restore_meta(m);
+    return c;
+}
+
+void Snapshot::reset(CPU& cpu, Memory& m) const {
+    for (uint32_t pg : m.dirty_list) {
+        uint32_t a = pg * fastmem::PAGE;
+        uint32_t len = (uint32_t)std::min<std::size_t>(fastmem::PAGE, image.size() - a);
+        auto it = m.shadow.find(a >> Bus::PAGE_SHIFT);
+        if (it != m.shadow.end()) std::memcpy(it->second.data(), image.data() + a, len);
+        else if (m.fm) {                                    // back to the shared page, read-only
+            fastmem::discard(m.fm, a, fastmem::PAGE, fd);
+        }
+        else std::memcpy(m.ram + a, image.data() + a, len);
+        m.dirty[pg] = 0;
+        m.dcache.invalidate_page(pg);
+    }
+    m.dirty_list.clear();
+    restore_meta(m);
+    // the registers and counters go back; what the child is attached to stays
+    CPU now = cpu;
+    cpu = regs;
+    cpu.breakpoints = now.breakpoints; cpu.debugger = now.debugger; cpu.jit = now.jit;
+    cpu.caches = now.caches; cpu.bpred = now.bpred; cpu.profiler = now.profiler; cpu.mmu = now.mmu;
+    if (cpu.mmu) cpu.mmu->flush();
+}
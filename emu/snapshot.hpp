@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "cpu.hpp"
+#include "mem.hpp"
+
+// A frozen CPU + Memory state that many guests can start from. Take one
+// after the common setup (ELF load, init code), then fork() children instead
+// of building and warming each guest from scratch.
+//
+// With the fastmem backend a child maps the snapshot's RAM image privately:
+// pages are shared until the child first writes one, and only then copied
+// (the first write to a clean page faults and marks it dirty). The vector
+// backend copies the image at fork. Either way a child tracks its dirty
+// pages, and reset() puts back only those.
+//
+// Captured: registers and counters, RAM (device pages' RAM included), heap
+// and lock state, and the timer. Devices attached after construction are
+// not, and a child is a single-hart guest (don't hand it to Smp). Nor are the
+// CPU's attachments (JIT, breakpoints, debugger, caches, predictor, profiler,
+// Mmu): a child starts bare and attaches its own, bound to its own Memory.
+class Snapshot {
+public:
+    Snapshot(const CPU& cpu, const Memory& mem);
+    ~Snapshot();
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    struct Child { CPU cpu; std::unique_ptr<Memory> mem; };
+    Child fork() const;
+
+    // Return a child to the snapshot state; cost grows with the pages it
+    // wrote, not with the size of RAM
+    void reset(CPU& cpu, Memory& mem) const;
+
+    const CPU& cpu() const { return regs; }
+    std::size_t size() const { return image.size(); }
+
+private:
+    void restore_meta(Memory& m) const;
+
+    CPU regs;
+    std::vector<uint8_t> image;            // RAM as the guest sees it
+    int fd = -1;                           // fastmem: the same bytes, for children to map
+    bool fastmem_backend = false;
+
+    // Memory bookkeeping outside RAM
+    uint32_t text_end = 0, heap_brk = 0, heap_base = 0;
+    uint32_t timer_now = 0;
+    bool timer_on = true;
+    GuestHeap heap;
+    std::unordered_map<uint32_t, bool> locks;
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+// Bounded single-producer/single-consumer ring. push() only from one thread,
+// pop() only from one other; neither ever blocks or takes a lock.
+template<typename T, std::size_t N>
+class SpscQueue {
+    static_assert(N && (N & (N - 1)) == 0, "capacity must be a power of two");
+public:
+    bool push(const T& v){
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) return false;   // full
+        buf[h & (N - 1)] = v;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(T& v){
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;       // empty
+        v = buf[t & (N - 1)];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    bool empty() const {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<std::size_t> head{0};   // written by the producer
+    alignas(64) std::atomic<std::size_t> tail{0};   // written by the consumer
+    T buf[N];
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Address -> symbol index (from an ELF .symtab, see elf.hpp) for the
+// debugger, the profiler and the disassembler.
+class SymbolTable {
+public:
+    struct Symbol {
+        uint32_t addr, size;     // size 0: runs up to the next symbol
+        std::string name;
+        bool func;
+    };
+
+    void add(Symbol s){ syms.push_back(std::move(s)); }
+    // sort after the last add(); functions win over data at the same address
+    void finish(){
+        std::sort(syms.begin(), syms.end(), [](const Symbol& a, const Symbol& b){
+            return a.addr != b.addr ? a.addr < b.addr : a.func > b.func;
+        });
+        syms.erase(std::unique(syms.begin(), syms.end(), [](const Symbol& a, const Symbol& b){
+            return a.addr == b.addr && a.name == b.name;
+        }), syms.end());
+    }
+
+    // the symbol covering addr, or nullptr
+    const Symbol* lookup(uint32_t addr) const {
+        auto it = std::upper_bound(syms.begin(), syms.end(), addr,
+                                   [](uint32_t a, const Symbol& s){ return a < s.addr; });
+        if (it == syms.begin()) return nullptr;
+        auto first = it - 1;
+        while (first != syms.begin() && (first - 1)->addr == first->addr) --first;   // preferred one
+        if (first->size && addr - first->addr >= first->size) return nullptr;
+        return &*first;
+    }
+    const Symbol* find(const std::string& name) const {
+        for (auto& s : syms) if (s.name == name) return &s;
+        return nullptr;
+    }
+
+    // "name" or "name+0x1c"; "" when nothing covers addr
+    std::string describe(uint32_t addr) const {
+        const Symbol* s = lookup(addr);
+        if (!s) return "";
+        if (addr == s->addr) return s->name;
+        std::ostringstream os; os << s->name << "+0x" << std::hex << (addr - s->addr);
+        return os.str();
+    }
+
+    std::size_t size() const { return syms.size(); }
+    bool empty() const { return syms.empty(); }
+    const std::vector<Symbol>& all() const { return syms; }
+
+private:
+    std::vector<Symbol> syms;    // by address
+};
@@ -6,3 +6,6 @@ struct Memory;  // forward-declare (defined in mem.hpp)
 // Handle an ECALL using simple IDs in a7 and args in a0/a1.
 // Returns true if handled.
 bool handle_ecall(CPU& cpu, Memory& mem);
+
+// print a [sys] line per call (default); off keeps them out of the hot path
+void set_syscall_log(bool on);
@@ -1,6 +1,153 @@
 #include "trace.hpp"
+#include "spsc.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
 
 TraceLog& global_trace(){
     static TraceLog g;
     return g;
 }
+
+namespace tracebin {
+
+// Owns the chunk pool. Chunks cycle producer -> `full` -> writer -> `free`
+// -> producer; with both queues as large as the pool neither push can fail.
+class Writer {
+public:
+    static constexpr std::size_t POOL = 8;         // 2 MiB in flight at most
+
+    explicit Writer(FILE* f) : f(f) {
+        for (auto& c : pool) { c = std::make_unique<Chunk>(); free.push(c.get()); }
+        th = std::thread([this]{ loop(); });
+    }
+    ~Writer(){
+        stop.store(true, std::memory_order_release);
+        th.join();
+        std::fclose(f);
+    }
+
+    Chunk* get(){                                  // producer: blocks only if the disk is behind
+        Chunk* c;
+        while (!free.pop(c)) std::this_thread::yield();
+        c->used = c->count = 0;
+        return c;
+    }
+    void put(Chunk* c){ full.push(c); }            // producer
+
+private:
+    void loop(){
+        for (;;) {
+            Chunk* c;
+            if (full.pop(c)) {
+                uint32_t hdr[2] = { c->used, c->count };
+                std::fwrite(hdr, sizeof hdr, 1, f);
+                std::fwrite(c->data, 1, c->used, f);
+                free.push(c);
+            } else if (stop.load(std::memory_order_acquire)) {
+                if (full.empty()) break;
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+        std::fflush(f);
+    }
+
+    FILE* f;
+    std::unique_ptr<Chunk> pool[POOL];
+    SpscQueue<Chunk*, POOL> full, free;
+    std::atomic<bool> stop{false};
+    std::thread th;
+};
+
+static bool get_varint(const uint8_t*& p, const uint8_t* end, uint64_t& v){
+    v = 0;
+    for (int sh = 0; p < end && sh < 64; sh += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << sh;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+bool Reader::open(const std::string& path){
+    f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    char magic[8];
+    if (std::fread(magic, 1, 8, f) != 8 || std::memcmp(magic, MAGIC, 8) != 0) { std::fclose(f); f = nullptr; return false; }
+    return true;
+}
+
+Reader::~Reader(){ if (f) std::fclose(f); }
+
+bool Reader::next(TraceRec& r){
+    if (!f) return false;
+    while (left == 0) {                            // next chunk
+        uint32_t hdr[2];
+        if (std::fread(hdr, sizeof hdr, 1, f) != 1 || hdr[0] > CHUNK_BYTES + MAX_REC) return false;
+        buf.resize(hdr[0]);
+        if (std::fread(buf.data(), 1, hdr[0], f) != hdr[0]) return false;
+        pos = 0; left = hdr[1]; s.reset();
+    }
+    const uint8_t* p = buf.data() + pos; const uint8_t* end = buf.data() + buf.size();
+    if (p >= end) return false;
+    uint8_t head = *p++;
+    uint64_t tid = s.tid, dinst = 1, dpc, dcyc;
+    if (head & 0x80) {
+        if (!get_varint(p, end, tid) || !get_varint(p, end, dinst)) return false;
+    }
+    if (!get_varint(p, end, dpc) || !get_varint(p, end, dcyc)) return false;
+    r.tid = (uint32_t)tid;
+    r.opcode = head & 0x7F;
+    r.pc = s.pc + 4 + (uint32_t)unzigzag((uint32_t)dpc);
+    r.cycles_after = s.cycles + (uint32_t)dcyc;
+    r.instret_after = s.instret + dinst;
+    s.tid = r.tid; s.pc = r.pc; s.cycles = r.cycles_after; s.instret = r.instret_after;
+    pos = (std::size_t)(p - buf.data()); --left;
+    return true;
+}
+
+} // namespace tracebin
+
+TraceLog::~TraceLog(){ close_stream(); }
+
+bool TraceLog::open_stream(const std::string& path){
+    close_stream();
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    std::fwrite(tracebin::MAGIC, 1, sizeof tracebin::MAGIC, f);
+    writer = std::make_unique<tracebin::Writer>(f);
+    chunk = writer->get();
+    out = chunk->data; out_end = chunk->data + tracebin::CHUNK_BYTES - tracebin::MAX_REC;
+    delta.reset(); streamed = 0;
+    return true;
+}
+
+void TraceLog::flush_chunk(){
+    chunk->used = (uint32_t)(out - chunk->data);
+    streamed += chunk->count;
+    writer->put(chunk);
+    chunk = writer->get();
+    out = chunk->data; out_end = chunk->data + tracebin::CHUNK_BYTES - tracebin::MAX_REC;
+    delta.reset();
+}
+
+uint64_t TraceLog::close_stream(){
+    if (!chunk) return 0;
+    if (chunk->count) flush_chunk();
+    chunk = nullptr; out = out_end = nullptr;
+    writer.reset();                                // drains the queue, joins, closes
+    return streamed;
+}
+
+long long trace_to_ndjson(const std::string& bin_path, const std::string& ndjson_path){
+    tracebin::Reader rd;
+    if (!rd.open(bin_path)) return -1;
+    FILE* f = std::fopen(ndjson_path.c_str(), "wb");
+    if (!f) return -1;
+    long long n = 0;
+    for (TraceRec r; rd.next(r); ++n) TraceLog::write_ndjson_rec(f, r);
+    std::fclose(f);
+    return n;
+}
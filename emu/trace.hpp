@@ -1,9 +1,9 @@
-
 #pragma once
 #include <cstdint>
 #include <vector>
 #include <string>
 #include <cstdio>
+#include <memory>
 
 struct TraceRec {
     uint32_t tid;
@@ -13,8 +13,63 @@ struct TraceRec {
     uint64_t instret_after;
 };
 
+// ---- binary trace format ----
+// File: "SEEDTRC1", then chunks of { u32 payload bytes, u32 records, payload }.
+// Deltas restart in every chunk, so each chunk decodes on its own. Record:
+//   u8      opcode | 0x80 when tid/instret don't continue the previous record
+//   varint  tid, varint instret delta           (only with 0x80)
+//   varint  zigzag(pc - previous pc - 4)
+//   varint  cycles - previous cycles            (mod 2^32)
+// A straight-line record is 3 bytes against 24 in memory.
+namespace tracebin {
+constexpr char     MAGIC[8]    = {'S','E','E','D','T','R','C','1'};
+constexpr uint32_t CHUNK_BYTES = 256u << 10;
+constexpr uint32_t MAX_REC     = 32;             // worst-case encoded record
+
+struct Chunk { uint32_t used, count; uint8_t data[CHUNK_BYTES]; };
+
+// encoder state for one chunk
+struct Delta {
+    uint32_t tid = 0, pc = 0, cycles = 0; uint64_t instret = 0;
+    void reset(){ *this = Delta{}; }
+};
+
+inline uint8_t* put_varint(uint8_t* p, uint64_t v){
+    while (v >= 0x80) { *p++ = (uint8_t)(v | 0x80); v >>= 7; }
+    *p++ = (uint8_t)v;
+    return p;
+}
+inline uint32_t zigzag(int32_t v){ return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+inline int32_t  unzigzag(uint32_t v){ return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+inline uint8_t* encode(uint8_t* p, Delta& s, const TraceRec& r){
+    bool jump = r.tid != s.tid || r.instret_after != s.instret + 1;
+    *p++ = (uint8_t)((r.opcode & 0x7F) | (jump ? 0x80 : 0));
+    if (jump) { p = put_varint(p, r.tid); p = put_varint(p, r.instret_after - s.instret); }
+    p = put_varint(p, zigzag((int32_t)(r.pc - s.pc - 4)));
+    p = put_varint(p, (uint32_t)(r.cycles_after - s.cycles));
+    s.tid = r.tid; s.pc = r.pc; s.cycles = r.cycles_after; s.instret = r.instret_after;
+    return p;
+}
+
+class Writer;   // background thread writing filled chunks (trace.cpp)
+
+// sequential reader for the converter and tests
+class Reader {
+public:
+    bool open(const std::string& path);
+    bool next(TraceRec& r);           // false at end of file (or on a damaged chunk)
+    ~Reader();
+private:
+    FILE* f = nullptr;
+    std::vector<uint8_t> buf; std::size_t pos = 0; uint32_t left = 0;
+    Delta s;
+};
+} // namespace tracebin
+
 class TraceLog {
 public:
+    ~TraceLog();
     void enable(bool on){ enabled = on; }
     bool is_enabled() const { return enabled; }
 
@@ -22,6 +77,12 @@ public:
               uint32_t cycles_after, uint64_t instret_after)
     {
         if(!enabled) return;
+        if (chunk) {                    // streaming: encode into the current chunk
+            out = tracebin::encode(out, delta, TraceRec{tid,pc,opcode,cycles_after,instret_after});
+            ++chunk->count;
+            if (out > out_end) flush_chunk();
+            return;
+        }
         if (records.size() < max_keep) {
             records.push_back(TraceRec{tid,pc,opcode,cycles_after,instret_after});
         } else {
@@ -30,14 +91,18 @@ public:
         }
     }
 
+    // Stream every record to `path` in the binary format instead of keeping
+    // the last max_keep in memory. Encoding stays on the calling thread;
+    // full chunks go to a writer thread over an SPSC queue, and a fixed
+    // pool of chunks bounds memory however long the run is.
+    bool open_stream(const std::string& path);
+    uint64_t close_stream();          // flush, join the writer; returns records written
+    bool is_streaming() const { return chunk != nullptr; }
+
     bool write_ndjson(const std::string& path) const {
         FILE* f = std::fopen(path.c_str(), "wb");
         if(!f) return false;
-        auto dump = [&](const TraceRec& r){
-            std::fprintf(f,
-              "{\"tid\":%u,\"pc\":%u,\"opcode\":%u,\"cycles\":%u,\"instret\":%llu}\n",
-              r.tid, r.pc, r.opcode, r.cycles_after, (unsigned long long)r.instret_after);
-        };
+        auto dump = [&](const TraceRec& r){ write_ndjson_rec(f, r); };
         if (idx==0) {
             for (auto& r: records) dump(r);
         } else {
@@ -50,6 +115,11 @@ public:
         std::fclose(f);
         return true;
     }
+    static void write_ndjson_rec(FILE* f, const TraceRec& r){
+        std::fprintf(f,
+          "{\"tid\":%u,\"pc\":%u,\"opcode\":%u,\"cycles\":%u,\"instret\":%llu}\n",
+          r.tid, r.pc, r.opcode, r.cycles_after, (unsigned long long)r.instret_after);
+    }
 
     void set_capacity(size_t n){
         max_keep = n;
@@ -59,11 +129,22 @@ public:
     }
 
 private:
+    void flush_chunk();               // hand the chunk over, start the next
+
     bool enabled = false;
     size_t max_keep = 200000;
     size_t idx = 0;
     std::vector<TraceRec> records;
+
+    tracebin::Chunk* chunk = nullptr; // non-null while streaming
+    uint8_t* out = nullptr; uint8_t* out_end = nullptr;
+    tracebin::Delta delta;
+    uint64_t streamed = 0;
+    std::unique_ptr<tracebin::Writer> writer;
 };
 
 // global accessor
 TraceLog& global_trace();
+
+// binary trace -> the NDJSON write_ndjson produces; returns records converted, -1 on error
+long long trace_to_ndjson(const std::string& bin_path, const std::string& ndjson_path);
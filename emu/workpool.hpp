@@ -0,0 +1,67 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool for a known batch of independent tasks. Tasks are dealt
+// round-robin onto one deque per worker; a worker takes from the back of its
+// own deque and, once that is empty, steals from the front of the others', so
+// a few long tasks don't leave the rest of the pool idle.
+class WorkPool {
+public:
+    explicit WorkPool(unsigned threads = 0)
+    : nthreads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    unsigned threads() const { return nthreads; }
+    uint64_t steals() const { return nsteals.load(std::memory_order_relaxed); }
+
+    // Call f(i) for every i in [0, n) and wait for all of them. f may run on
+    // any worker, so it must only touch state of its own task.
+    template<typename F> void for_each(std::size_t n, F&& f){
+        unsigned w = (unsigned)std::min<std::size_t>(nthreads, std::max<std::size_t>(n, 1));
+        std::vector<std::unique_ptr<Queue>> qs;
+        for (unsigned k = 0; k < w; ++k) qs.push_back(std::make_unique<Queue>());
+        for (std::size_t i = 0; i < n; ++i) qs[i % w]->q.push_back(i);
+
+        auto worker = [&](unsigned self){
+            std::size_t i;
+            for (;;) {
+                if (qs[self]->pop_back(i)) { f(i); continue; }
+                bool got = false;
+                for (unsigned k = 1; k < w && !got; ++k) got = qs[(self + k) % w]->pop_front(i);
+                if (!got) return;                  // nothing left anywhere: tasks never spawn tasks
+                nsteals.fetch_add(1, std::memory_order_relaxed);
+                f(i);
+            }
+        };
+        std::vector<std::thread> th;
+        for (unsigned k = 1; k < w; ++k) th.emplace_back(worker, k);
+        worker(0);
+        for (auto& t : th) t.join();
+    }
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<std::size_t> q;
+        bool pop_back(std::size_t& i){
+            std::lock_guard<std::mutex> lk(m);
+            if (q.empty()) return false;
+            i = q.back(); q.pop_back(); return true;
+        }
+        bool pop_front(std::size_t& i){
+            std::lock_guard<std::mutex> lk(m);
+            if (q.empty()) return false;
+            i = q.front(); q.pop_front(); return true;
+        }
+    };
+
+    unsigned nthreads;
+    std::atomic<uint64_t> nsteals{0};
+};
@@ -1,8 +1,27 @@
 // tests/test_cpu.cpp
 #include "test_util.hpp"
+#include "emu/console.hpp"
 #include "emu/cpu.hpp"
 #include "emu/mem.hpp"
 #include "emu/disasm.hpp"
+#include "emu/jit.hpp"
+#include "emu/trace.hpp"
+#include "emu/smp.hpp"
+#include "emu/batch.hpp"
+#include "emu/bpred.hpp"
+#include "emu/cache.hpp"
+#include "emu/csr.hpp"
+#include "emu/debug.hpp"
+#include "emu/mmu.hpp"
+#include "emu/profile.hpp"
+#include "emu/sched.hpp"
+#include "emu/elf.hpp"
+#include "emu/snapshot.hpp"
+#include "emu/symbols.hpp"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
 
 // helper: write a 32-bit word to memory at addr
 static inline void put32(Memory& m, uint32_t addr, uint32_t w){ m.store32(addr, w); }
@@ -22,6 +41,75 @@ static inline uint32_t enc_B(uint8_t op,uint8_t rs1,uint8_t rs2,uint8_t funct3,i
     return (b12<<31)|(b10_5<<25)|(rs2<<20)|(rs1<<15)|(funct3<<12)|(b4_1<<8)|(b11<<7)|op;
 }
 
+static inline uint32_t enc_LW(uint8_t rd,uint8_t rs1,int32_t imm12){
+    return (((uint32_t)imm12 & 0xFFF)<<20)|(rs1<<15)|(0b010<<12)|(rd<<7)|0x03;
+}
+static inline uint32_t enc_SW(uint8_t rs1,uint8_t rs2,int32_t imm12){
+    uint32_t u=(uint32_t)imm12 & 0xFFF;
+    return ((u>>5)<<25)|(rs2<<20)|(rs1<<15)|(0b010<<12)|((u&0x1F)<<7)|0x23;
+}
+static inline uint32_t enc_LD(uint8_t f3,uint8_t rd,uint8_t rs1,int32_t imm12){   // lb/lh/lw/lbu/lhu
+    return (((uint32_t)imm12 & 0xFFF)<<20)|(rs1<<15)|(f3<<12)|(rd<<7)|0x03;
+}
+static inline uint32_t enc_ST(uint8_t f3,uint8_t rs1,uint8_t rs2,int32_t imm12){    // sb/sh/sw
+    uint32_t u=(uint32_t)imm12 & 0xFFF;
+    return ((u>>5)<<25)|(rs2<<20)|(rs1<<15)|(f3<<12)|((u&0x1F)<<7)|0x23;
+}
+static inline uint32_t enc_JAL(uint8_t rd,int32_t off){
+    uint32_t u=(uint32_t)off;
+    return (((u>>20)&1)<<31)|(((u>>1)&0x3FF)<<21)|(((u>>11)&1)<<20)|(((u>>12)&0xFF)<<12)|(rd<<7)|0x6F;
+}
+static inline uint32_t enc_LUI(uint8_t rd,uint32_t imm20){ return ((imm20&0xFFFFF)<<12)|(rd<<7)|0x37; }
+static inline uint32_t enc_CSR(uint8_t f3,uint8_t rd,uint8_t rs1,uint32_t csr){   // csrr*[i]; rs1 = uimm for *i
+    return ((csr & 0xFFF)<<20)|(rs1<<15)|(f3<<12)|(rd<<7)|0x73;
+}
+static inline uint32_t enc_AMO(uint8_t f5,uint8_t rd,uint8_t rs1,uint8_t rs2){   // lr/sc/amo*.w
+    return ((uint32_t)f5<<27)|(rs2<<20)|(rs1<<15)|(0b010<<12)|(rd<<7)|0x2F;
+}
+
+// Every opcode the core knows: a counted loop calling a leaf function that
+// mixes ALU ops, loads/stores and all six branch kinds, then exit(x10).
+static void load_mix_program(Memory& ram){
+    uint32_t a=0;
+    auto emit=[&](uint32_t w){ put32(ram,a,w); a+=4; };
+    emit(enc_I(0x13, 5, 0, 200));               // 0x00 x5 = loop count
+    emit(enc_I(0x13, 8, 0, 0x400));             // 0x04 x8 = data base
+    emit(enc_LUI(9, 0x80000));                  // 0x08 x9 = 0x80000000
+    emit(enc_JAL(1, 0x30 - 0x0C));              // 0x0C loop: call f
+    emit(enc_I(0x13, 5, 5, -1));                // 0x10
+    emit(enc_B(0x63, 5, 0, 0b001, 0x0C - 0x14));// 0x14 bne x5,x0,loop
+    emit(enc_R(0x33,10, 6, 7, 0b000, 0));       // 0x18 x10 = x6 + x7
+    emit(enc_I(0x13,17, 0, 0));                 // 0x1C a7 = 0
+    emit(0x00000073u);                          // 0x20 ecall exit
+    a = 0x30;                                   // f:
+    emit(enc_R(0x33, 6, 6, 5, 0b000, 0));       // 0x30 x6 += x5
+    emit(enc_R(0x33,11, 6, 5, 0b001, 0));       // 0x34 sll
+    emit(enc_R(0x33,12, 9, 5, 0b101, 0));       // 0x38 srl
+    emit(enc_R(0x33,13, 9, 5, 0b101, 0x20));    // 0x3C sra
+    emit(enc_R(0x33,14, 9, 5, 0b010, 0));       // 0x40 slt
+    emit(enc_R(0x33,15, 9, 5, 0b011, 0));       // 0x44 sltu
+    emit(enc_R(0x33,16,11,12, 0b000, 0x20));    // 0x48 sub
+    emit(enc_SW(8, 16, 4));                     // 0x4C sw x16, 4(x8)
+    emit(enc_LW(7, 8, 4));                      // 0x50 lw x7, 4(x8)
+    emit(enc_B(0x63,14,15, 0b000, 8));          // 0x54 beq  (skips one)
+    emit(enc_I(0x13, 7, 7, 3));                 // 0x58
+    emit(enc_B(0x63, 9, 5, 0b100, 8));          // 0x5C blt  (signed)
+    emit(enc_I(0x13, 7, 7, 5));                 // 0x60
+    emit(enc_B(0x63, 9, 5, 0b101, 8));          // 0x64 bge
+    emit(enc_I(0x13, 7, 7, 7));                 // 0x68
+    emit(enc_B(0x63, 9, 5, 0b110, 8));          // 0x6C bltu
+    emit(enc_I(0x13, 7, 7, 9));                 // 0x70
+    emit(enc_B(0x63, 9, 5, 0b111, 8));          // 0x74 bgeu
+    emit(enc_I(0x13, 7, 7,11));                 // 0x78
+    emit(enc_I(0x67, 0, 1, 0));                 // 0x7C jalr x0, 0(x1)
+}
+
+static bool same_state(const CPU& a, const CPU& b, const Memory& ma, const Memory& mb){
+    for(int i=0;i<32;i++) if(a.x[i]!=b.x[i]) return false;
+    return a.pc==b.pc && a.cycles==b.cycles && a.instret==b.instret && a.halted==b.halted
+        && a.quantum==b.quantum && a.slice_count==b.slice_count && ma.time()==mb.time();
+}
+
 int main(){
     TestState T;
 
@@ -67,5 +155,1379 @@ int main(){
         EXPECT_EQ(T, ram.sbrk(0), old+64);
     }
 
+    // ---------- test 5: decode cache hits on a loop ----------
+    {
+        Memory ram(64*1024); CPU cpu; cpu.pc=0;
+        // addi x1,x0,10 ; addi x1,x1,-1 ; bne x1,x0,-4
+        put32(ram,0x00, enc_I(0x13, 1, 0, 10));
+        put32(ram,0x04, enc_I(0x13, 1, 1, -1));
+        put32(ram,0x08, enc_B(0x63, 1, 0, 0b001, -4));
+        for(int i=0;i<21;i++) cpu.step(ram);
+        EXPECT_EQ(T, cpu.x[1], (uint32_t)0);
+        EXPECT_EQ(T, cpu.pc, (uint32_t)0x0C);
+        // a fill also decodes the following word, so only 0x00 and 0x08 miss
+        EXPECT_EQ(T, ram.icache().stats().misses, (uint64_t)2);
+        EXPECT_EQ(T, ram.icache().stats().hits,   (uint64_t)19);
+    }
+
+    // ---------- test 6: stores invalidate decoded words (self-modifying code) ----------
+    {
+        Memory ram(64*1024); CPU cpu; cpu.pc=0;
+        put32(ram,0x00, enc_I(0x13, 7, 0, 1));   // addi x7,x0,1
+        cpu.step(ram);
+        EXPECT_EQ(T, cpu.x[7], (uint32_t)1);
+        put32(ram,0x00, enc_I(0x13, 7, 0, 2));   // patch: addi x7,x0,2
+        EXPECT_EQ(T, ram.icache().stats().invalidations, (uint64_t)1);
+        cpu.pc=0; cpu.step(ram);
+        EXPECT_EQ(T, cpu.x[7], (uint32_t)2);
+        ram.store8(0x00, 0x13);                  // byte store into the same word
+        EXPECT_EQ(T, ram.icache().stats().invalidations, (uint64_t)2);
+    }
+
+    // ---------- test 7: run() matches step() and reports why it stopped ----------
+    {
+        auto load = [](Memory& ram){
+            put32(ram,0x00, enc_I(0x13, 1, 0, 10));              // addi x1,x0,10
+            put32(ram,0x04, enc_I(0x13, 1, 1, -1));              // addi x1,x1,-1
+            put32(ram,0x08, enc_B(0x63, 1, 0, 0b001, -4));       // bne x1,x0,-4
+            put32(ram,0x0C, 0x00000073u);                        // ecall (a7=0: exit)
+        };
+        Memory r1(64*1024), r2(64*1024); load(r1); load(r2);
+        CPU a, b; a.quantum = b.quantum = 7;
+        while(a.step(r1)) {}
+        uint64_t n = 0; RunExit ex{Exit::Budget,0};
+        while(!b.halted){ ex = b.run(r2, 1000); n += ex.insns; }
+        EXPECT_EQ(T, ex.reason, Exit::Halt);
+        EXPECT_EQ(T, n, a.instret);
+        EXPECT_EQ(T, b.cycles, a.cycles);
+        EXPECT_EQ(T, b.slice_count, a.slice_count);
+        EXPECT_EQ(T, r2.time(), r1.time());
+
+        Memory r3(64*1024); load(r3); CPU c;
+        EXPECT_EQ(T, c.run(r3, 5).reason, Exit::Budget);
+        std::unordered_set<uint32_t> bps{0x0C};
+        c.breakpoints = &bps;
+        ex = c.run(r3, 1000);
+        EXPECT_EQ(T, ex.reason, Exit::Breakpoint);
+        EXPECT_EQ(T, c.pc, (uint32_t)0x0C);
+        c.breakpoints = nullptr;
+
+        Memory r4(64*1024); CPU q; q.quantum = 3;
+        put32(r4,0x00, enc_I(0x13, 1, 1, 1));
+        put32(r4,0x04, enc_I(0x13, 1, 1, 1));
+        put32(r4,0x08, enc_I(0x13, 1, 1, 1));
+        put32(r4,0x0C, 0xFFFFFFFFu);                             // illegal
+        ex = q.run(r4, 1000);                                    // yields when slice_count meets quantum
+        EXPECT_EQ(T, ex.reason, Exit::Yield);
+        ex = q.run(r4, 1000);
+        EXPECT_EQ(T, ex.reason, Exit::Quantum);
+        ex = q.run(r4, 1000);
+        EXPECT_EQ(T, ex.reason, Exit::Trap);
+        EXPECT_EQ(T, q.pc, (uint32_t)0x0C);
+        EXPECT_EQ(T, q.x[1], (uint32_t)3);
+    }
+
+    // ---------- test 8: fused pairs match unfused execution and are counted ----------
+    {
+        auto prog = [](Memory& ram){
+            uint32_t a=0; auto emit=[&](uint32_t w){ put32(ram,a,w); a+=4; };
+            put32(ram,0x904, 3);
+            emit(enc_LUI(8, 0x1));                       // 0x00 lui x8,0x1        } lui+addi
+            emit(enc_I(0x13, 8, 8, -0x700));             // 0x04 addi x8,x8,-1792  }  x8 = 0x900
+            emit(enc_I(0x13, 5, 0, 50));                 // 0x08 x5 = 50
+            emit(enc_R(0x33, 9, 8, 0, 0, 0));            // 0x0C loop: add x9,x8,x0 } add+lw
+            emit(enc_LW(7, 9, 4));                       // 0x10 lw x7,4(x9)        }
+            emit(enc_R(0x33, 6, 6, 7, 0, 0));            // 0x14 x6 += x7
+            emit((12u<<7)|0x17u);                        // 0x18 auipc x12,0       } auipc+jalr
+            emit(enc_I(0x67, 1, 12, 0x30 - 0x18));       // 0x1C jalr x1,24(x12)   }  -> 0x30
+            emit(enc_I(0x13, 5, 5, -1));                 // 0x20 addi x5,x5,-1     } addi+branch
+            emit(enc_B(0x63, 5, 0, 0b001, 0x0C - 0x24)); // 0x24 bne x5,x0,loop    }
+            emit(enc_I(0x13,17, 0, 0));                  // 0x28
+            emit(0x00000073u);                           // 0x2C exit
+            emit(enc_LUI(13, 0x3));                      // 0x30 lui x13,0x3       } lui+lw: timer
+            emit(enc_LW(14, 13, 0));                     // 0x34 lw x14,0(x13)     }
+            emit(enc_I(0x67, 0, 1, 0));                  // 0x38 ret
+        };
+        Memory rf(64*1024), ru(64*1024); prog(rf); prog(ru);
+        ru.icache().set_fusion(false);
+        CPU cf, cu; cf.quantum = cu.quantum = 5;
+        bool lockstep = true;
+        while(!cf.halted || !cu.halted){
+            if(cf.quantum==0) cf.quantum = 5;
+            if(cu.quantum==0) cu.quantum = 5;
+            RunExit ef = cf.run(rf, 1000), eu = cu.run(ru, 1000);
+            if(ef.reason!=eu.reason || ef.insns!=eu.insns || !same_state(cf,cu,rf,ru)){ lockstep=false; break; }
+        }
+        EXPECT_TRUE(T, lockstep);
+        EXPECT_EQ(T, cf.x[6], (uint32_t)150);
+        const auto& st = rf.icache().stats();
+        auto runs = [&](Op k){ return st.fused_runs[(unsigned)k - FIRST_FUSED]; };
+        EXPECT_EQ(T, runs(Op::FuseLuiAddi), (uint64_t)1);
+        EXPECT_TRUE(T, runs(Op::FuseAddLw) > 0 && runs(Op::FuseAuipcJalr) > 0);
+        EXPECT_TRUE(T, runs(Op::FuseAddiBranch) > 0 && runs(Op::FuseLuiLw) > 0);
+        EXPECT_EQ(T, ru.icache().stats().fused_runs[(unsigned)Op::FuseAddLw - FIRST_FUSED], (uint64_t)0);
+    }
+
+    // ---------- test 9: JIT matches the interpreter (state, counters, quantum) ----------
+    if (Jit::available()) {
+        Memory ri(64*1024), rj(64*1024); load_mix_program(ri); load_mix_program(rj);
+        Jit jit(rj);
+        CPU ci, cj; cj.jit = &jit;
+        bool lockstep = true;
+        while(!ci.halted || !cj.halted){
+            // preemptive-scheduler style: re-arm the timer whenever it expires
+            if(ci.quantum==0) ci.quantum = 37;
+            if(cj.quantum==0) cj.quantum = 37;
+            RunExit ei = ci.run(ri, 1000), ej = cj.run(rj, 1000);
+            if(ei.reason!=ej.reason || ei.insns!=ej.insns || !same_state(ci,cj,ri,rj)){ lockstep=false; break; }
+        }
+        EXPECT_TRUE(T, lockstep);
+        EXPECT_EQ(T, cj.exit_code, ci.exit_code);
+        EXPECT_TRUE(T, jit.stats().jit_insns > jit.stats().interp_insns);
+        EXPECT_TRUE(T, jit.stats().chains > 0);
+    }
+
+    // ---------- test 10: JIT sees guest code writes and faults like the interpreter ----------
+    if (Jit::available()) {
+        auto load = [](Memory& ram){
+            put32(ram,0x400, enc_I(0x13, 3, 3, 100));      // replacement word
+            put32(ram,0x00, enc_I(0x13, 4, 0, 2));          // x4 = 2 passes
+            put32(ram,0x04, enc_I(0x13, 3, 3, 1));          // 0x04: patched below
+            put32(ram,0x08, enc_LW(5, 0, 0x400));
+            put32(ram,0x0C, enc_SW(0, 5, 0x04));            // overwrite 0x04
+            put32(ram,0x10, enc_I(0x13, 4, 4, -1));
+            put32(ram,0x14, enc_B(0x63, 4, 0, 0b001, -0x10));
+            put32(ram,0x18, enc_LW(6, 9, 0));               // x9 = 0xFFFFF000: fault
+        };
+        Memory ri(64*1024), rj(64*1024); load(ri); load(rj);
+        Jit jit(rj);
+        CPU ci, cj; cj.jit = &jit; ci.x[9] = cj.x[9] = 0xFFFFF000u;
+        RunExit ei = ci.run(ri, 1000), ej = cj.run(rj, 1000);
+        EXPECT_EQ(T, ej.reason, Exit::Trap);
+        EXPECT_EQ(T, ej.insns, ei.insns);
+        EXPECT_EQ(T, cj.x[3], (uint32_t)101);
+        EXPECT_EQ(T, cj.pc, (uint32_t)0x18);
+        EXPECT_TRUE(T, same_state(ci, cj, ri, rj));
+        EXPECT_TRUE(T, jit.stats().flushes > 0);
+    }
+
+    // ---------- test 11: specialised loops only drop the work that is switched off ----------
+    {
+        Memory rf(64*1024), rm(64*1024); load_mix_program(rf); load_mix_program(rm);
+        CPU cf, cm;                                      // cf: preempt + timer + cost table
+        cm.cost_model = CostModel::Flat; rm.set_timer(false);
+        EXPECT_EQ(T, cm.features(rm) & ~FeatFastmem, 0u);
+        RunExit ef{Exit::Budget,0}, em{Exit::Budget,0};
+        while(!cf.halted){ if(cf.quantum==0) cf.quantum = 50; ef = cf.run(rf, 1000); }
+        while(!cm.halted){ em = cm.run(rm, 1000); }
+        EXPECT_EQ(T, ef.reason, Exit::Halt);
+        EXPECT_EQ(T, em.reason, Exit::Halt);
+        EXPECT_EQ(T, cm.instret, cf.instret);
+        EXPECT_EQ(T, cm.exit_code, cf.exit_code);
+        EXPECT_EQ(T, cm.cycles, 2*cm.instret);           // flat: 1 + retire
+        EXPECT_TRUE(T, cf.cycles > cm.cycles);
+        EXPECT_EQ(T, rm.time(), 0u);
+        EXPECT_EQ(T, (uint64_t)rf.time(), cf.cycles - cf.instret);
+    }
+
+    // ---------- test 12: fastmem matches the vector backend, timer page and faults included ----------
+    if (Memory(64*1024, MemBackend::Fastmem).backend() == MemBackend::Fastmem) {
+        auto load = [](Memory& ram){
+            load_mix_program(ram);
+            put32(ram,0x20, enc_JAL(0, 0x90 - 0x20));       // instead of exit
+            put32(ram,0x90, enc_LUI(20, 0x3));              // x20 = 0x3000
+            put32(ram,0x94, enc_LW(21, 20, 0));             // TIME
+            put32(ram,0x98, enc_SW(20, 21, 4));             // add ticks
+            put32(ram,0x9C, enc_SW(20, 7, 0x10));           // plain RAM inside the timer page
+            put32(ram,0xA0, enc_LW(22, 20, 0x10));
+            put32(ram,0xA4, enc_LUI(23, 0x10));             // x23 = 0x10000 = end of RAM
+            put32(ram,0xA8, enc_LW(24, 23, -2));            // straddles the end: fault
+        };
+        Memory rv(64*1024, MemBackend::Vector), rf(64*1024, MemBackend::Fastmem);
+        load(rv); load(rf);
+        CPU cv, cf;
+        RunExit ev = cv.run(rv, 100000), ef = cf.run(rf, 100000);
+        EXPECT_EQ(T, ef.reason, Exit::Trap);
+        EXPECT_EQ(T, ef.insns, ev.insns);
+        EXPECT_EQ(T, cf.pc, (uint32_t)0xA8);
+        EXPECT_TRUE(T, cf.x[21] != 0 && cf.x[22] == cf.x[7]);
+        EXPECT_TRUE(T, same_state(cv, cf, rv, rf));
+        EXPECT_EQ(T, rf.load32(0x3010), rv.load32(0x3010));
+    }
+
+    // ---------- test 13: device bus (byte/half/word handlers) and sub-word accesses ----------
+    {
+        struct Probe : Device {
+            uint32_t last = 0, sizes = 0;
+            bool read8 (uint32_t off, uint8_t&  v) override { v = (uint8_t)(0xA0 + off); sizes |= 1; return true; }
+            bool read16(uint32_t off, uint16_t& v) override { v = (uint16_t)(0xB000 + off); sizes |= 2; return true; }
+            bool write32(uint32_t off, uint32_t v) override { last = v + off; sizes |= 4; return true; }
+        };
+        auto load = [](Memory& ram){
+            put32(ram,0x00, enc_LUI(20, 0x50000));           // x20 = 0x50000000 (probe)
+            put32(ram,0x04, enc_LD(0b000, 1, 20, 3));        // lb  -> 0xA3
+            put32(ram,0x08, enc_LD(0b101, 2, 20, 2));        // lhu -> 0xB002
+            put32(ram,0x0C, enc_I(0x13, 3, 0, -2));          // x3 = 0xFFFFFFFE
+            put32(ram,0x10, enc_ST(0b010, 20, 3, 8));        // sw -> probe (+8)
+            put32(ram,0x14, enc_ST(0b001, 0, 3, 0x400));     // sh x3 -> RAM
+            put32(ram,0x18, enc_LD(0b001, 4, 0, 0x400));     // lh  -> -2
+            put32(ram,0x1C, enc_LD(0b100, 5, 0, 0x401));     // lbu -> 0xFF
+            put32(ram,0x20, enc_ST(0b000, 0, 3, 0x3010));    // sb into the timer page's RAM
+            put32(ram,0x24, enc_LD(0b000, 6, 0, 0x3010));    // lb  -> -2
+            put32(ram,0x28, enc_LUI(21, 0x50001));           // the page after the probe's
+            put32(ram,0x2C, enc_LD(0b000, 7, 21, 0));        // unmapped: fault
+        };
+        for (int k = 0; k < 3; ++k) {
+            if (k == 2 && !Jit::available()) break;
+            Memory ram(64*1024, k == 0 ? MemBackend::Vector : MemBackend::Fastmem); Probe probe; load(ram);
+            ram.attach(0x50000000, 0x1000, &probe);
+            Jit jit(ram);
+            CPU cpu; if (k == 2) cpu.jit = &jit;
+            RunExit r = cpu.run(ram, 100);
+            EXPECT_EQ(T, r.reason, Exit::Trap);
+            EXPECT_EQ(T, cpu.pc, (uint32_t)0x2C);
+            EXPECT_EQ(T, cpu.x[1], (uint32_t)0xFFFFFFA3);
+            EXPECT_EQ(T, cpu.x[2], (uint32_t)0xB002);
+            EXPECT_EQ(T, probe.last, (uint32_t)0xFFFFFFFE + 8);
+            EXPECT_EQ(T, probe.sizes, 7u);
+            EXPECT_EQ(T, cpu.x[4], (uint32_t)0xFFFFFFFE);
+            EXPECT_EQ(T, cpu.x[5], (uint32_t)0xFF);
+            EXPECT_EQ(T, cpu.x[6], (uint32_t)0xFFFFFFFE);
+            EXPECT_EQ(T, ram.load32(0x3000), ram.time());    // TIME still served by the timer
+        }
+    }
+
+    // ---------- test 14: binary trace stream converts back to the ring's NDJSON ----------
+    {
+        auto slurp = [](const char* p){ std::ifstream f(p); std::stringstream ss; ss << f.rdbuf(); return ss.str(); };
+        auto traced = [](bool stream){
+            Memory ram(64*1024); load_mix_program(ram);
+            CPU cpu; cpu.tid = 3;
+            TraceLog& tr = global_trace();
+            if (stream) tr.open_stream("test_trace.bin"); else tr.set_capacity(1u << 20);
+            tr.enable(true);
+            while(!cpu.halted){ if(cpu.quantum==0) cpu.quantum = 40; cpu.run(ram, 1000); }
+            tr.enable(false);
+            uint64_t n = stream ? tr.close_stream() : 0;
+            if (!stream) tr.write_ndjson("test_trace_ring.ndjson");
+            return n;
+        };
+        traced(false);
+        uint64_t n = traced(true);
+        EXPECT_TRUE(T, n > 4000);
+        EXPECT_EQ(T, trace_to_ndjson("test_trace.bin", "test_trace_bin.ndjson"), (long long)n);
+        std::string a = slurp("test_trace_ring.ndjson"), b = slurp("test_trace_bin.ndjson");
+        EXPECT_TRUE(T, !a.empty() && a == b);
+        std::ifstream bin("test_trace.bin", std::ios::binary | std::ios::ate);
+        EXPECT_TRUE(T, (uint64_t)bin.tellg() < n * 5);    // vs 24 bytes per record in memory
+        bin.close();
+        global_trace().set_capacity(200000);
+        for (const char* p : {"test_trace.bin", "test_trace_ring.ndjson", "test_trace_bin.ndjson"}) std::remove(p);
+    }
+
+    // ---------- test 15: RV32A on one hart (old value in rd, LR/SC, FENCE.I) ----------
+    {
+        for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+            Memory ram(64*1024, b);
+            uint32_t a = 0;
+            auto emit = [&](uint32_t w){ put32(ram, a, w); a += 4; };
+            emit(enc_I(0x13, 5, 0, 0x400));          // x5 = &word (holds 10)
+            emit(enc_I(0x13, 6, 0, -3));             // x6 = -3
+            emit(enc_AMO(0x00, 1, 5, 6));            // amoadd  -> x1=10, mem 7
+            emit(enc_AMO(0x10, 2, 5, 6));            // amomin  -> x2=7,  mem -3
+            emit(enc_AMO(0x18, 3, 5, 5));            // amominu -> x3=-3, mem 0x400
+            emit(enc_AMO(0x14, 4, 5, 6));            // amomax  -> x4=0x400, mem 0x400
+            emit(enc_AMO(0x02, 7, 5, 0));            // lr.w    -> x7=0x400
+            emit(enc_AMO(0x03, 8, 5, 6));            // sc.w    -> x8=0, mem -3
+            emit(enc_AMO(0x03, 9, 5, 0));            // sc.w again: no reservation, x9=1
+            emit(enc_AMO(0x01, 10, 5, 0));           // amoswap -> x10=-3, mem 0
+            emit(enc_I(0x0F, 0, 0, 0) | (1u<<12));   // fence.i
+            emit(enc_I(0x0F, 0, 0, 0x0FF));          // fence iorw,iorw
+            emit(enc_AMO(0x00, 11, 0, 0));           // amoadd at 0: the code word, x11 = it
+            emit(enc_AMO(0x00, 0, 12, 0));           // x12 = 2 below: misaligned -> trap
+            ram.store32(0x400, 10);
+            CPU cpu; cpu.x[12] = 2;
+            RunExit r = cpu.run(ram, 100);
+            EXPECT_EQ(T, r.reason, Exit::Trap);
+            EXPECT_EQ(T, cpu.pc, a - 4);
+            EXPECT_EQ(T, cpu.x[1], 10u);
+            EXPECT_EQ(T, cpu.x[2], 7u);
+            EXPECT_EQ(T, cpu.x[3], (uint32_t)-3);
+            EXPECT_EQ(T, cpu.x[4], 0x400u);
+            EXPECT_EQ(T, cpu.x[7], 0x400u);
+            EXPECT_EQ(T, cpu.x[8], 0u);
+            EXPECT_EQ(T, cpu.x[9], 1u);
+            EXPECT_EQ(T, cpu.x[10], (uint32_t)-3);
+            EXPECT_EQ(T, cpu.x[11], enc_I(0x13, 5, 0, 0x400));
+            EXPECT_EQ(T, ram.load32(0x400), 0u);
+            EXPECT_EQ(T, disasm(enc_AMO(0x03, 8, 5, 6)), std::string("sc.w x8, x6, (x5)"));
+        }
+    }
+
+    // ---------- test 16: harts on host threads: AMO counter and an LR/SC spinlock ----------
+    {
+        Memory ram(64*1024);
+        uint32_t a = 0x100;
+        auto emit = [&](uint32_t w){ put32(ram, a, w); a += 4; };
+        emit(enc_I(0x13, 5, 0, 0x400));              // 0x100 x5 = data, x6 = 1, x8 = &lock
+        emit(enc_I(0x13, 6, 0, 1));
+        emit(enc_I(0x13, 8, 5, 8));
+        emit(enc_AMO(0x00, 0, 5, 6));                // 0x10C loop: amoadd.w x0,x6,(x5)
+        emit(enc_AMO(0x02, 9, 8, 0));                // 0x110 acq: lr.w x9,(x8)
+        emit(enc_B(0x63, 9, 0, 0b001, -4));          //            bnez x9,acq
+        emit(enc_AMO(0x03, 9, 8, 6));                //            sc.w x9,x6,(x8)
+        emit(enc_B(0x63, 9, 0, 0b001, -12));         //            bnez x9,acq
+        emit(enc_LW(10, 5, 4));                      // plain read-modify-write under the lock
+        emit(enc_I(0x13, 10, 10, 1));
+        emit(enc_SW(5, 10, 4));
+        emit(enc_AMO(0x01, 0, 8, 0));                // release: amoswap.w x0,x0,(x8)
+        emit(enc_I(0x13, 7, 7, -1));
+        emit(enc_B(0x63, 7, 0, 0b001, 0x10C - 0x134));
+        emit(enc_I(0x13, 17, 0, 0));                 // exit
+        emit(0x00000073);
+        CPU cpus[4]; Smp smp(ram);
+        for (uint32_t i = 0; i < 4; ++i) { cpus[i].pc = 0x100; cpus[i].x[7] = 2000 + i; smp.add(cpus[i]); }
+        Smp::Result r = smp.run(10'000'000);
+        for (auto& h : r.harts) EXPECT_EQ(T, h.reason, Exit::Halt);
+        EXPECT_EQ(T, ram.load32(0x400), 8006u);
+        EXPECT_EQ(T, ram.load32(0x404), 8006u);
+        EXPECT_EQ(T, ram.load32(0x408), 0u);
+        EXPECT_TRUE(T, ram.time() > 0);              // per-hart ticks reached the timer
+    }
+
+    // ---------- test 17: batch runner shares one parsed ELF across pooled instances ----------
+    {
+        // ELF32 with one PT_LOAD at 0x100: exit(a0*2 + a1)
+        const uint32_t code[] = { enc_R(0x33,10,10,10,0,0), enc_R(0x33,10,10,11,0,0),
+                                  enc_I(0x13,17,0,0), 0x00000073 };
+        std::vector<uint8_t> f(0x100, 0);
+        auto w16 = [&](std::size_t o, uint16_t v){ f[o] = (uint8_t)v; f[o+1] = (uint8_t)(v >> 8); };
+        auto w32 = [&](std::size_t o, uint32_t v){ w16(o, (uint16_t)v); w16(o+2, (uint16_t)(v >> 16)); };
+        const uint8_t ident[] = { 0x7F,'E','L','F',1,1,1 };
+        std::copy(ident, ident + sizeof ident, f.begin());
+        w16(16, 2); w16(18, 243); w32(20, 1); w32(24, 0x100); w32(28, 52);
+        w16(40, 52); w16(42, 32); w16(44, 1);
+        w32(52, 1); w32(56, 0x100); w32(60, 0x100); w32(64, 0x100);   // PT_LOAD: offset, vaddr, paddr
+        w32(68, sizeof code); w32(72, sizeof code + 16); w32(76, 5);   // filesz, memsz (+bss), flags
+        for (uint32_t c : code) { f.resize(f.size() + 4); w32(f.size() - 4, c); }
+        { std::ofstream o("test_batch.elf", std::ios::binary); o.write((const char*)f.data(), f.size()); }
+        {
+            std::ofstream m("test_batch.txt");
+            m << "# elf a0 a1\n";
+            for (int i = 0; i < 12; ++i) m << "test_batch.elf " << i << " 0x10\n";
+            m << "missing.elf 1\n";
+            m << "test_batch.elf max=2 5\n";
+        }
+        std::vector<BatchJob> jobs = read_manifest("test_batch.txt");
+        EXPECT_EQ(T, jobs.size(), (std::size_t)14);
+        BatchReport rep = run_batch(jobs, 3);
+        EXPECT_EQ(T, rep.images, (std::size_t)2);
+        EXPECT_EQ(T, rep.threads, 3u);
+        for (int i = 0; i < 12; ++i) {
+            EXPECT_TRUE(T, rep.results[i].ok && rep.results[i].reason == Exit::Halt);
+            EXPECT_EQ(T, rep.results[i].exit_code, (uint32_t)(2*i + 16));
+            EXPECT_EQ(T, rep.results[i].instret, (uint64_t)4);
+        }
+        EXPECT_TRUE(T, !rep.results[12].ok && !rep.results[12].error.empty());
+        EXPECT_EQ(T, rep.results[13].reason, Exit::Budget);
+        EXPECT_EQ(T, rep.results[13].pc, 0x108u);
+        bool threw = false;
+        { std::ofstream m("test_batch_bad.txt"); m << "test_batch.elf mem=\n"; }
+        try { read_manifest("test_batch_bad.txt"); } catch (const std::runtime_error&) { threw = true; }
+        EXPECT_TRUE(T, threw);
+        for (const char* p : {"test_batch.elf", "test_batch.txt", "test_batch_bad.txt"}) std::remove(p);
+    }
+
+    // ---------- test 18: snapshot children share pages copy-on-write and reset by dirty page ----------
+    {
+        for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+            Memory ram(64*1024, b);
+            uint32_t a = 0;
+            auto emit = [&](uint32_t w){ put32(ram, a, w); a += 4; };
+            emit(enc_I(0x13, 5, 0, 0x400));          // init: [0x400] = [0x3010] = 7
+            emit(enc_I(0x13, 6, 0, 7));
+            emit(enc_SW(5, 6, 0));
+            emit(enc_LUI(9, 3));
+            emit(enc_SW(9, 6, 0x10));
+            emit(enc_I(0x13, 17, 0, 7));             // yield: snapshot here
+            emit(0x00000073);
+            emit(enc_LW(7, 5, 0));                   // child: x7 = [0x400] + [0x3010] + 1
+            emit(enc_LW(11, 9, 0x10));
+            emit(enc_R(0x33, 7, 7, 11, 0, 0));
+            emit(enc_I(0x13, 7, 7, 1));
+            emit(enc_SW(5, 7, 0));                   // write three pages: 0, 3 (timer's), 8
+            emit(enc_SW(9, 7, 0x10));
+            emit(enc_LUI(8, 8));
+            emit(enc_SW(8, 7, 0));
+            emit(enc_I(0x13, 10, 7, 0));
+            emit(enc_I(0x13, 17, 0, 0));
+            emit(0x00000073);
+            CPU cpu;
+            EXPECT_EQ(T, cpu.run(ram, 100).reason, Exit::Yield);
+            Snapshot snap(cpu, ram);
+
+            Snapshot::Child c1 = snap.fork(), c2 = snap.fork();
+            EXPECT_EQ(T, c1.mem->backend(), ram.backend());     // Fastmem may fall back to vector
+            EXPECT_EQ(T, c1.mem->dirty_pages(), (std::size_t)0);
+            c1.cpu.run(*c1.mem, 100);
+            EXPECT_TRUE(T, c1.cpu.halted && c1.cpu.exit_code == 15);
+            EXPECT_EQ(T, c1.mem->dirty_pages(), (std::size_t)3);
+            EXPECT_EQ(T, c1.mem->load32(0x8000), 15u);
+            EXPECT_EQ(T, ram.load32(0x400), 7u);             // parent and sibling untouched
+            EXPECT_EQ(T, c2.mem->load32(0x3010), 7u);
+            EXPECT_EQ(T, c2.mem->load32(0x8000), 0u);
+            c2.cpu.run(*c2.mem, 100);
+            EXPECT_EQ(T, c2.cpu.exit_code, 15u);
+
+            uint64_t instret = c1.cpu.instret;
+            snap.reset(c1.cpu, *c1.mem);
+            EXPECT_EQ(T, c1.mem->dirty_pages(), (std::size_t)0);
+            EXPECT_TRUE(T, !c1.cpu.halted && c1.cpu.pc == snap.cpu().pc);
+            EXPECT_EQ(T, c1.mem->load32(0x400), 7u);
+            EXPECT_EQ(T, c1.mem->load32(0x3010), 7u);
+            EXPECT_EQ(T, c1.mem->load32(0x8000), 0u);
+            c1.cpu.run(*c1.mem, 100);
+            EXPECT_EQ(T, c1.cpu.exit_code, 15u);
+            EXPECT_EQ(T, c1.cpu.instret, instret);
+        }
+
+        // a child of a translated guest brings its own Mmu; the parent's is bound to the parent's RAM
+        for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+            Memory ram(64*1024, b);
+            uint32_t a = 0;
+            auto emit = [&](uint32_t w){ put32(ram, a, w); a += 4; };
+            emit(enc_LW(7, 0, 0x100));               // parent: warm the TLB, then yield
+            emit(enc_I(0x13, 17, 0, 7));
+            emit(0x00000073);
+            emit(enc_I(0x13, 6, 0, 99));             // child: [0x100] = 99
+            emit(enc_SW(0, 6, 0x100));
+            emit(enc_I(0x13, 10, 6, 0));
+            emit(enc_I(0x13, 17, 0, 0));
+            emit(0x00000073);
+            const uint32_t root = 0x8000;            // one identity megapage
+            put32(ram, root, Mmu::V | Mmu::R | Mmu::W | Mmu::X | Mmu::A | Mmu::D);
+            Mmu mmu(ram);
+            CPU cpu; cpu.mmu = &mmu; cpu.satp = Mmu::SATP_SV32 | (root >> 12);
+            EXPECT_EQ(T, cpu.run(ram, 100).reason, Exit::Yield);
+            Snapshot snap(cpu, ram);
+
+            Snapshot::Child c = snap.fork();
+            EXPECT_TRUE(T, c.cpu.mmu == nullptr);
+            Mmu cm(*c.mem);
+            c.cpu.mmu = &cm;
+            c.cpu.run(*c.mem, 100);
+            EXPECT_TRUE(T, c.cpu.halted && c.cpu.exit_code == 99);
+            EXPECT_EQ(T, c.mem->load32(0x100), 99u);
+            EXPECT_EQ(T, ram.load32(0x100), 0u);
+            EXPECT_EQ(T, c.mem->dirty_pages(), (std::size_t)1);
+            EXPECT_EQ(T, cm.stats().walks, 1u);      // its own TLB: code and data share page 0
+
+            snap.reset(c.cpu, *c.mem);
+            EXPECT_TRUE(T, c.cpu.mmu == &cm);
+            EXPECT_EQ(T, c.mem->load32(0x100), 0u);
+            c.cpu.run(*c.mem, 100);
+            EXPECT_EQ(T, c.cpu.exit_code, 99u);
+            EXPECT_EQ(T, ram.load32(0x100), 0u);
+        }
+    }
+
+    // ---------- test 19: ELF segments by bulk copy / file mapping, BSS, device page, .symtab ----------
+    {
+        std::vector<uint8_t> f(0x2A00, 0);
+        auto w16 = [&](std::size_t o, uint16_t v){ f[o] = (uint8_t)v; f[o+1] = (uint8_t)(v >> 8); };
+        auto w32 = [&](std::size_t o, uint32_t v){ w16(o, (uint16_t)v); w16(o+2, (uint16_t)(v >> 16)); };
+        const uint8_t ident[] = { 0x7F,'E','L','F',1,1,1 };
+        std::copy(ident, ident + sizeof ident, f.begin());
+        w16(16, 2); w16(18, 243); w32(20, 1); w32(24, 0x1000); w32(28, 52); w32(32, 0x200);
+        w16(40, 52); w16(42, 32); w16(44, 2); w16(46, 40); w16(48, 3);
+        auto phdr = [&](int i, uint32_t off, uint32_t va, uint32_t fsz, uint32_t msz){
+            std::size_t o = 52 + 32*i; w32(o, 1); w32(o+4, off); w32(o+8, va); w32(o+12, va); w32(o+16, fsz); w32(o+20, msz);
+        };
+        phdr(0, 0x1000, 0x1000, 0x1010, 0x1100);     // a whole page + 16 bytes, then BSS
+        phdr(1, 0x2800, 0x2F00, 0x200, 0x200);       // runs across the timer page
+        w32(0x200 + 40 + 4, 2); w32(0x200 + 40 + 16, 0x300); w32(0x200 + 40 + 20, 6*16); w32(0x200 + 40 + 24, 2);
+        w32(0x200 + 80 + 4, 3); w32(0x200 + 80 + 16, 0x380); w32(0x200 + 80 + 20, 32);
+        const char strtab[] = "\0main\0helper\0table\0$x\0ext";      // 1, 6, 13, 19, 22
+        std::copy(strtab, strtab + sizeof strtab, f.begin() + 0x380);
+        auto sym = [&](int i, uint32_t name, uint32_t val, uint32_t size, uint8_t type, uint16_t shndx){
+            std::size_t o = 0x300 + 16*i; w32(o, name); w32(o+4, val); w32(o+8, size); f[o+12] = type; w16(o+14, shndx);
+        };
+        sym(1, 1, 0x1000, 8, 2, 1); sym(2, 6, 0x1010, 0, 2, 1); sym(3, 13, 0x2000, 4, 1, 1);
+        sym(4, 19, 0x1000, 0, 0, 1); sym(5, 22, 0x1234, 0, 2, 0);
+        w32(0x1000, enc_JAL(1, 0x10));               // main: jal helper
+        for (uint32_t i = 4; i < 0x1010; ++i) if (i >= 0x20) f[0x1000 + i] = (uint8_t)(i * 13);
+        for (uint32_t i = 0; i < 0x200; ++i) f[0x2800 + i] = (uint8_t)(i + 1);
+        { std::ofstream o("test_syms.elf", std::ios::binary); o.write((const char*)f.data(), f.size()); }
+
+        ElfImage img = ElfImage::parse("test_syms.elf");
+        EXPECT_EQ(T, img.segments.size(), (std::size_t)2);
+        EXPECT_EQ(T, img.symbols.size(), (std::size_t)3);
+        EXPECT_EQ(T, img.symbols.describe(0x1004), std::string("main+0x4"));
+        EXPECT_EQ(T, img.symbols.describe(0x1008), std::string(""));       // past main's size
+        EXPECT_EQ(T, img.symbols.describe(0x1800), std::string("helper+0x7f0"));
+        EXPECT_TRUE(T, img.symbols.find("table") && !img.symbols.find("table")->func);
+        EXPECT_EQ(T, disasm(enc_JAL(1, 0x10), 0x1000, img.symbols), std::string("jal x1, +16 <helper>"));
+        for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+            Memory ram(64*1024, b);
+            ram.fill(0x2000, 0xAA, 0x200);
+            EXPECT_EQ(T, img.load_into(ram), 0x1000u);
+            bool same = true;
+            for (uint32_t a = 0x1000; a < 0x2010; ++a) same = same && ram.load8(a) == f[a];
+            for (uint32_t a = 0x2010; a < 0x2100; ++a) same = same && ram.load8(a) == 0;
+            for (uint32_t a = 0x2100; a < 0x2200; ++a) same = same && ram.load8(a) == 0xAA;
+            for (uint32_t a = 0x2F00; a < 0x3100; ++a) same = same && ram.load8(a) == f[0x2800 + a - 0x2F00];
+            EXPECT_TRUE(T, same);
+            CPU cpu; cpu.pc = 0x1000; cpu.step(ram);
+            EXPECT_EQ(T, cpu.pc, 0x1010u);
+            ram.store32(0x1100, 0xDEADBEEF);              // private: the file and other loads don't see it
+        }
+        Memory again(64*1024);
+        img.load_into(again);
+        EXPECT_EQ(T, again.load8(0x1100), f[0x1100]);
+        std::remove("test_syms.elf");
+    }
+
+
+    // ---------- test 20: cache model counters, policies and cycles ----------
+    {
+        Cache dm({256, 1, 16, Replace::Lru, WritePolicy::WriteBack, 0});   // 16 sets
+        dm.access(0x000, true);                       // miss, dirty
+        EXPECT_TRUE(T, dm.access(0x004, false));
+        EXPECT_TRUE(T, !dm.access(0x100, false));     // same set: evicts the dirty line
+        uint32_t wb = 0;
+        EXPECT_TRUE(T, dm.take_writeback(wb) && wb == 0 && !dm.take_writeback(wb));
+        EXPECT_EQ(T, dm.stats().hits, 1u);
+        EXPECT_EQ(T, dm.stats().misses, 2u);
+        EXPECT_EQ(T, dm.stats().evictions, 1u);
+        EXPECT_EQ(T, dm.stats().writebacks, 1u);
+
+        // one 2-way set: A B A C, then A again: LRU kept A, FIFO threw it out
+        for (Replace r : {Replace::Lru, Replace::Fifo}) {
+            Cache c({128, 2, 64, r, WritePolicy::WriteBack, 0});
+            for (uint32_t a : {0x000u, 0x040u, 0x000u, 0x080u}) c.access(a, false);
+            EXPECT_EQ(T, c.access(0x000, false), r == Replace::Lru);
+        }
+        Cache wt({256, 1, 16, Replace::Lru, WritePolicy::WriteThrough, 0});
+        wt.access(0x20, true);                        // no write-allocate
+        EXPECT_TRUE(T, !wt.access(0x20, false));
+        EXPECT_EQ(T, wt.stats().misses, 2u);
+
+        bool threw = false;
+        try { CacheSpec::parse("l1d=24k:4:64"); } catch (const std::invalid_argument&) { threw = true; }
+        EXPECT_TRUE(T, threw);
+        CacheSpec sp = CacheSpec::parse("l1d=32k:8:32:fifo:wt:1,l2=off,mem=50");
+        EXPECT_TRUE(T, sp.l1d.size == 32768 && sp.l1d.ways == 8 && sp.l1d.line == 32 && sp.l1d.latency == 1);
+        EXPECT_TRUE(T, sp.l1d.repl == Replace::Fifo && sp.l1d.write == WritePolicy::WriteThrough);
+        EXPECT_TRUE(T, sp.l2.size == 0 && sp.mem_latency == 50);
+
+        // two loads of one line and a timer read (fastmem faults and redoes
+        // it): every miss goes L1 -> L2 -> memory, 10 + 100 cycles each
+        for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+            Memory m1(64*1024, b), m2(64*1024, b);
+            for (Memory* m : {&m1, &m2}) {
+                put32(*m, 0x00, enc_LW(5, 0, 0x400));
+                put32(*m, 0x04, enc_LW(6, 0, 0x404));
+                put32(*m, 0x08, enc_LUI(7, 3));
+                put32(*m, 0x0C, enc_LW(8, 7, 0));
+                put32(*m, 0x10, 0x00100073);             // ebreak
+            }
+            CacheHierarchy ch;
+            CPU plain, cached; cached.caches = &ch;
+            plain.run(m1, 100); cached.run(m2, 100);
+            EXPECT_TRUE(T, cached.halted && cached.instret == 5);
+            EXPECT_EQ(T, cached.cycles - plain.cycles, 3u * 110u);
+            EXPECT_EQ(T, ch.level(0).stats().hits, 4u);
+            EXPECT_EQ(T, ch.level(0).stats().misses, 1u);
+            EXPECT_EQ(T, ch.level(1).stats().hits, 1u);
+            EXPECT_EQ(T, ch.level(1).stats().misses, 2u);
+            EXPECT_EQ(T, ch.level(2).stats().misses, 3u);
+        }
+    }
+
+    // ---------- test 21: Sv32 translation, TLB, A/D bits, SFENCE.VMA and page faults ----------
+    {
+        for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+            Memory ram(256*1024, b);
+            const uint32_t root = 0x10000, l0 = 0x11000;
+            auto map = [&](uint32_t va, uint32_t pa, uint32_t flags){
+                put32(ram, root + 4*(va >> 22), ((l0 >> 12) << 10) | Mmu::V);
+                put32(ram, l0 + 4*((va >> 12) & 0x3FF), ((pa >> 12) << 10) | flags | Mmu::V);
+            };
+            map(0x0000, 0x20000, Mmu::R | Mmu::X);
+            map(0x5000, 0x21000, Mmu::R | Mmu::W);
+            map(0x6000, 0x22000, Mmu::R);
+            put32(ram, root + 4*1, Mmu::R | Mmu::W | Mmu::V);           // 4 MiB megapage -> pa 0
+            put32(ram, 0x1100, 0xCAFEF00D);
+            ram.store8(0x21FFE, 0x11); ram.store8(0x21FFF, 0x22);
+            ram.store8(0x22000, 0x33); ram.store8(0x22001, 0x44);
+            const uint32_t prog[] = {
+                enc_LUI(5, 5),                  // 0x00 x5 = 0x5000
+                enc_I(0x13, 6, 0, 42),          // 0x04
+                enc_SW(5, 6, 0),                // 0x08 -> pa 0x21000
+                enc_LW(7, 5, 0),                // 0x0C
+                enc_LUI(8, 0x401),              // 0x10
+                enc_LW(9, 8, 0x100),            // 0x14 megapage: pa 0x1100
+                enc_LUI(12, 6),                 // 0x18
+                enc_LW(10, 12, -2),             // 0x1C straddles 0x5000 / 0x6000
+                0x12000073,                     // 0x20 sfence.vma x0, x0
+                enc_SW(12, 6, 0),               // 0x24 read-only page: fault
+            };
+            for (uint32_t i = 0; i < sizeof prog / sizeof prog[0]; ++i) put32(ram, 0x20000 + 4*i, prog[i]);
+
+            Mmu mmu(ram, 64);
+            CPU cpu; cpu.mmu = &mmu;
+            EXPECT_EQ(T, cpu.features(ram) & FeatMmu, 0u);             // bare: untranslated loop
+            cpu.satp = Mmu::SATP_SV32 | (root >> 12);
+            EXPECT_EQ(T, cpu.features(ram) & FeatMmu, (unsigned)FeatMmu);
+            RunExit r = cpu.run(ram, 100);
+            EXPECT_TRUE(T, r.reason == Exit::Trap && cpu.pc == 0x24);
+            EXPECT_EQ(T, cpu.x[7], 42u);
+            EXPECT_EQ(T, ram.load32(0x21000), 42u);
+            EXPECT_EQ(T, cpu.x[9], 0xCAFEF00Du);
+            EXPECT_EQ(T, cpu.x[10], 0x44332211u);
+            EXPECT_TRUE(T, mmu.last_fault().vaddr == 0x6000 && mmu.last_fault().access == Mmu::Write);
+            EXPECT_EQ(T, ram.load32(l0 + 4*5) & (Mmu::A | Mmu::D), (uint32_t)(Mmu::A | Mmu::D));
+            EXPECT_EQ(T, ram.load32(l0 + 4*6) & (Mmu::A | Mmu::D), (uint32_t)Mmu::A);
+            // code, 0x5000 (store), megapage, 0x6000 (load), then after the
+            // SFENCE: code again and the faulting store
+            EXPECT_EQ(T, mmu.stats().walks, 6u);
+            EXPECT_EQ(T, mmu.stats().faults, 1u);
+            EXPECT_EQ(T, mmu.stats().hits[Mmu::Exec], 6u);              // 8 fetches: both lui+lw pairs fuse
+            EXPECT_EQ(T, mmu.stats().flushes, 2u);                      // bind() + sfence
+
+            // another address space: the same VA reaches another frame
+            put32(ram, 0x30000 + 4*(0x5000 >> 22), ((0x31000 >> 12) << 10) | Mmu::V);
+            put32(ram, 0x31000 + 4*5, ((0x23000 >> 12) << 10) | Mmu::R | Mmu::V);
+            put32(ram, 0x31000, ((0x20000 >> 12) << 10) | Mmu::R | Mmu::X | Mmu::V);
+            put32(ram, 0x23000, 77);
+            CPU other; other.mmu = &mmu; other.satp = Mmu::SATP_SV32 | (0x30000 >> 12);
+            other.pc = 0x0C; other.x[5] = 0x5000;
+            EXPECT_TRUE(T, other.step(ram));
+            EXPECT_EQ(T, other.x[7], 77u);
+            EXPECT_EQ(T, mmu.stats().flushes, 3u);
+        }
+    }
+
+    // ---------- test 22: branch predictors, RAS, penalties and per-site stats ----------
+    {
+        BranchPredictor btfn(BranchSpec::parse("btfn,penalty=5"));
+        EXPECT_EQ(T, btfn.branch(0x100, -8, true), 0u);
+        EXPECT_EQ(T, btfn.branch(0x104,  8, true), 5u);
+        EXPECT_EQ(T, btfn.branch(0x108,  8, false), 0u);
+
+        BranchPredictor bim(BranchSpec::parse("bimodal:6"));
+        uint32_t wrong = 0;
+        for (int i = 0; i < 10; ++i) wrong += bim.branch(0x200, 16, true) != 0;
+        EXPECT_EQ(T, wrong, 1u);                     // counters start weakly not taken
+
+        // alternating T/N: bimodal keeps guessing wrong, gshare learns it
+        BranchPredictor bi2(BranchSpec::parse("bimodal")), gs(BranchSpec::parse("gshare:10:8"));
+        uint32_t bi_late = 0, gs_late = 0;
+        for (int i = 0; i < 200; ++i) {
+            bool t = i & 1;
+            uint32_t pb = bi2.branch(0x300, -4, t), pg = gs.branch(0x300, -4, t);
+            if (i >= 100) { bi_late += pb != 0; gs_late += pg != 0; }
+        }
+        EXPECT_TRUE(T, bi_late >= 50);
+        EXPECT_EQ(T, gs_late, 0u);
+
+        // call/return through the RAS; ras=0 has nothing to predict with
+        for (uint32_t depth : {16u, 0u}) {
+            BranchSpec sp; sp.ras_depth = depth;
+            BranchPredictor bp(sp);
+            EXPECT_EQ(T, bp.jump(0x10, 0x100, 1, 0, false), 0u);               // jal ra
+            EXPECT_EQ(T, bp.jump(0x100, 0x200, 1, 0, false), 0u);              // nested
+            EXPECT_EQ(T, bp.jump(0x200, 0x104, 0, 1, true) == 0, depth != 0);  // ret
+            EXPECT_EQ(T, bp.jump(0x104, 0x14, 0, 1, true) == 0, depth != 0);
+            EXPECT_EQ(T, bp.stats().executed[BranchPredictor::Return], 2u);
+        }
+        BranchPredictor ind;
+        EXPECT_TRUE(T, ind.jump(0x40, 0x800, 0, 7, true) != 0);                 // cold
+        EXPECT_EQ(T, ind.jump(0x40, 0x800, 0, 7, true), 0u);                    // last target
+        EXPECT_EQ(T, ind.stats().executed[BranchPredictor::Indirect], 2u);
+
+        BranchSpec sp = BranchSpec::parse("gshare:10:8,ras=4,penalty=7");
+        EXPECT_TRUE(T, sp.kind == Predictor::Gshare && sp.table_bits == 10 && sp.history_bits == 8);
+        EXPECT_TRUE(T, sp.ras_depth == 4 && sp.penalty == 7);
+        bool threw = false;
+        try { BranchSpec::parse("tage"); } catch (const std::invalid_argument&) { threw = true; }
+        EXPECT_TRUE(T, threw);
+
+        // the mix program: every mispredict costs exactly the penalty
+        for (const char* spec : {"btfn,penalty=5", "bimodal,penalty=5", "gshare,penalty=5"}) {
+            Memory m1(64*1024), m2(64*1024); load_mix_program(m1); load_mix_program(m2);
+            BranchPredictor bp(BranchSpec::parse(spec));
+            CPU plain, pred; pred.bpred = &bp;
+            EXPECT_EQ(T, pred.features(m2) & FeatTiming, (unsigned)FeatTiming);
+            plain.run(m1, 100000); pred.run(m2, 100000);
+            EXPECT_TRUE(T, pred.halted && pred.instret == plain.instret && pred.x[10] == plain.x[10]);
+            const auto& st = bp.stats();
+            uint64_t miss = st.mispredicted[0] + st.mispredicted[1] + st.mispredicted[2];
+            EXPECT_EQ(T, pred.cycles - plain.cycles, 5 * miss);
+            EXPECT_EQ(T, st.executed[BranchPredictor::Cond], 200u * 6);
+            EXPECT_EQ(T, st.executed[BranchPredictor::Return], 200u);
+            EXPECT_EQ(T, st.mispredicted[BranchPredictor::Return], 0u);
+            const auto& loop = bp.sites().at(0x14);     // bne back to the loop head
+            EXPECT_TRUE(T, loop.kind == BranchPredictor::Cond && loop.executed == 200 && loop.taken == 199);
+            if (spec[0] == 'b' && spec[1] == 't') EXPECT_EQ(T, loop.mispredicted, 1u);
+        }
+
+        BranchPredictor bp;
+        bp.branch(0x20, 8, true); bp.branch(0x24, 8, false);
+        std::FILE* f = std::tmpfile();
+        bp.write_csv(f);
+        std::rewind(f);
+        char line[128] = {};
+        std::fgets(line, sizeof line, f);
+        EXPECT_EQ(T, std::string(line), std::string("pc,symbol,kind,executed,taken,mispredicted\n"));
+        std::fgets(line, sizeof line, f);
+        EXPECT_EQ(T, std::string(line), std::string("0x00000020,,cond,1,1,1\n"));
+        std::fclose(f);
+    }
+
+    // ---------- test 23: sampling profiler: shadow call stack, folded stacks, top-N ----------
+    {
+        auto read_all = [](std::FILE* f){
+            std::string out; char buf[256];
+            std::rewind(f);
+            while (std::fgets(buf, sizeof buf, f)) out += buf;
+            return out;
+        };
+        SymbolTable syms;
+        syms.add({0x00, 0x30, "main", true});
+        syms.add({0x30, 0x50, "f", true});
+        syms.finish();
+
+        // every instruction: f runs 18 of its 20 per call, jal/ret count where they sit
+        Memory ram(64*1024); load_mix_program(ram);
+        Profiler prof(ProfileSpec::parse("insns:1"));
+        CPU cpu; cpu.profiler = &prof;
+        EXPECT_EQ(T, cpu.features(ram) & FeatTiming, (unsigned)FeatTiming);
+        cpu.run(ram, 100000);
+        EXPECT_TRUE(T, cpu.halted && prof.samples() == cpu.instret && prof.depth() == 0);
+        std::FILE* f = std::tmpfile();
+        prof.write_folded(f, &syms);
+        EXPECT_EQ(T, read_all(f), "main " + std::to_string(cpu.instret - 3600) + "\nmain;f 3600\n");
+        std::fclose(f);
+        f = std::tmpfile();
+        prof.write_top(f, 1, &syms);
+        std::string top = read_all(f);
+        EXPECT_TRUE(T, top.find("function\n") != std::string::npos);
+        EXPECT_TRUE(T, top.find(" 3600 ") != std::string::npos && top.size() > 2 && top.substr(top.size() - 3) == " f\n");
+        std::fclose(f);
+
+        // by cycles: one sample per period, give or take an instruction's cost
+        Memory rc(64*1024); load_mix_program(rc);
+        Profiler byc(ProfileSpec::parse("cycles:100"));
+        CPU cc; cc.profiler = &byc;
+        cc.run(rc, 100000);
+        EXPECT_TRUE(T, byc.samples() <= cc.cycles / 100 && byc.samples() >= cc.cycles / 104);
+
+        // a return past two frames (longjmp) unwinds both
+        Profiler lj(ProfileSpec::parse("1000"));
+        lj.jump(0x10, 1, 0, false, 0x100);  lj.retire(0x10, 1);
+        lj.jump(0x100, 1, 0, false, 0x200); lj.retire(0x100, 1);
+        EXPECT_EQ(T, lj.depth(), 2u);
+        lj.jump(0x204, 0, 1, true, 0x14);   lj.retire(0x204, 1);
+        EXPECT_EQ(T, lj.depth(), 0u);
+        EXPECT_EQ(T, lj.spec().period, 1000u);
+
+        bool threw = false;
+        try { ProfileSpec::parse("walltime:5"); } catch (const std::invalid_argument&) { threw = true; }
+        EXPECT_TRUE(T, threw);
+    }
+
+    // ---------- test 24: Zicsr counters, machine CSRs, read-only traps, satp ----------
+    {
+        EXPECT_EQ(T, disasm(enc_CSR(0b010, 5, 0, csr::CYCLE)), std::string("csrrs x5, cycle, x0"));
+        EXPECT_EQ(T, disasm(enc_CSR(0b110, 0, 8, csr::MSCRATCH)), std::string("csrrsi x0, mscratch, 8"));
+
+        Memory ram(64*1024);
+        const uint32_t prog[] = {
+            enc_CSR(0b010, 5, 0, csr::CYCLE),       // 0x00 rdcycle
+            enc_CSR(0b010, 6, 0, csr::INSTRET),     // 0x04 rdinstret
+            enc_I(0x13, 1, 0, 7),                   // 0x08
+            enc_CSR(0b010, 7, 0, csr::CYCLE),       // 0x0C
+            enc_CSR(0b010, 8, 0, csr::INSTRET),     // 0x10
+            enc_CSR(0b001, 9, 1, csr::MSCRATCH),    // 0x14 csrrw: old 0, now 7
+            enc_CSR(0b110,10, 8, csr::MSCRATCH),    // 0x18 csrrsi 8: old 7, now 15
+            enc_CSR(0b011,11, 1, csr::MSCRATCH),    // 0x1C csrrc x1: old 15, now 8
+            enc_CSR(0b010,12, 0, csr::MSCRATCH),    // 0x20
+            enc_CSR(0b010,13, 0, csr::MISA),        // 0x24
+            enc_CSR(0b010,14, 0, csr::MHARTID),     // 0x28
+            enc_CSR(0b010,15, 0, csr::TIME),        // 0x2C
+            enc_CSR(0b101, 0, 1, csr::CYCLE),       // 0x30 csrrwi to a read-only CSR: illegal
+        };
+        for (uint32_t i = 0; i < sizeof prog / sizeof prog[0]; ++i) put32(ram, 4*i, prog[i]);
+        CPU cpu; cpu.tid = 3;
+        RunExit r = cpu.run(ram, 100);
+        EXPECT_TRUE(T, r.reason == Exit::Trap && cpu.pc == 0x30);
+        EXPECT_EQ(T, cpu.x[5], 0u);
+        EXPECT_EQ(T, cpu.x[7] - cpu.x[5], 6u);          // three instructions at 1 + 1 cycles
+        EXPECT_EQ(T, cpu.x[6], 1u);
+        EXPECT_EQ(T, cpu.x[8], 4u);
+        EXPECT_TRUE(T, cpu.x[9] == 0 && cpu.x[10] == 7 && cpu.x[11] == 15 && cpu.x[12] == 8);
+        EXPECT_EQ(T, cpu.x[13], csr::MISA_VALUE);
+        EXPECT_EQ(T, cpu.x[14], 3u);
+        EXPECT_EQ(T, cpu.x[15], ram.time() - 1);        // before its own tick
+        uint32_t v = 0;
+        EXPECT_TRUE(T, !cpu.read_csr(0x7C0, ram, v) && !cpu.write_csr(csr::INSTRET, 1));
+        EXPECT_TRUE(T, cpu.write_csr(csr::MINSTRETH, 2) && cpu.read_csr(csr::INSTRETH, ram, v) && v == 2);
+
+        // csrw satp turns Sv32 on mid-run: the rest runs translated, one run() call
+        for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+            Memory vm(64*1024, b);
+            put32(vm, 0x8000, Mmu::V | Mmu::R | Mmu::W | Mmu::X | Mmu::A | Mmu::D);   // identity megapage
+            put32(vm, 0x100, 1234);
+            put32(vm, 0x00, enc_LUI(1, 0x80000));
+            put32(vm, 0x04, enc_I(0x13, 1, 1, 8));               // x1 = SV32 | root 0x8000
+            put32(vm, 0x08, enc_CSR(0b001, 0, 1, csr::SATP));
+            put32(vm, 0x0C, enc_LW(2, 0, 0x100));
+            put32(vm, 0x10, 0x00100073);                         // ebreak
+            Mmu mmu(vm);
+            CPU c; c.mmu = &mmu;
+            RunExit e = c.run(vm, 100);
+            EXPECT_TRUE(T, e.reason == Exit::Halt && e.insns == 5 && c.x[2] == 1234);
+            EXPECT_EQ(T, c.satp, Mmu::SATP_SV32 | 8u);
+            EXPECT_EQ(T, mmu.stats().walks, 1u);                 // code and data share page 0
+        }
+    }
+
+    // ---------- test 25: O(1) scheduler: priorities, lock parking, aging, stats ----------
+    {
+        // each task appends its hartid to a log at 0x310; dispatch order = priority order
+        Memory ram(64*1024);
+        const uint32_t order[] = {
+            enc_CSR(0b010, 6, 0, csr::MHARTID),     // 0x00
+            enc_LW(5, 0, 0x300),                    // 0x04 n
+            enc_R(0x33, 7, 5, 5, 0b000, 0),         // 0x08 x7 = 4n
+            enc_R(0x33, 7, 7, 7, 0b000, 0),         // 0x0C
+            enc_SW(7, 6, 0x310),                    // 0x10 log[n] = hartid
+            enc_I(0x13, 5, 5, 1),                   // 0x14
+            enc_SW(0, 5, 0x300),                    // 0x18
+            enc_I(0x13, 17, 0, 0),                  // 0x1C exit
+            0x00000073,                             // 0x20
+        };
+        for (uint32_t i = 0; i < sizeof order / 4; ++i) put32(ram, 4*i, order[i]);
+        Scheduler s(ram);
+        for (uint32_t p : {2u, 0u, 1u, 0u}) s.spawn(0, p);
+        auto st = s.run();
+        EXPECT_TRUE(T, !st.deadlock && st.switches == 4 && ram.load32(0x300) == 4);
+        EXPECT_TRUE(T, ram.load32(0x310) == 1 && ram.load32(0x314) == 3 && ram.load32(0x318) == 2 && ram.load32(0x31C) == 0);
+        EXPECT_TRUE(T, s.task(0).state == Scheduler::State::Done && s.task(0).wait_insns == 27);   // three tasks ran first
+        EXPECT_EQ(T, s.quantum(0), 160u);
+
+        // lock contention: holders get preempted, waiters park instead of spinning
+        Memory lr(64*1024);
+        const uint32_t locked[] = {
+            enc_I(0x13, 6, 0, 10),                  // 0x00 rounds
+            enc_I(0x13, 10, 0, 0x400),              // 0x04 loop: lock(0x400)
+            enc_I(0x13, 17, 0, 9), 0x00000073,      // 0x08
+            enc_LW(7, 0, 0x404),                    // 0x10
+            enc_I(0x13, 7, 7, 1),                   // 0x14
+            enc_SW(0, 7, 0x404),                    // 0x18
+            enc_I(0x13, 17, 0, 10), 0x00000073,     // 0x1C unlock
+            enc_I(0x13, 6, 6, -1),                  // 0x24
+            enc_B(0x63, 6, 0, 0b001, 0x04 - 0x28),  // 0x28
+            enc_I(0x13, 17, 0, 0), 0x00000073,      // 0x2C exit
+        };
+        for (uint32_t i = 0; i < sizeof locked / 4; ++i) put32(lr, 4*i, locked[i]);
+        SchedConfig cfg; cfg.levels = 2; cfg.base_quantum = 2;
+        Scheduler ls(lr, cfg);
+        for (int i = 0; i < 8; ++i) ls.spawn(0, (uint32_t)(i & 1));
+        auto lst = ls.run();
+        EXPECT_TRUE(T, !lst.deadlock && lr.load32(0x404) == 80);
+        EXPECT_TRUE(T, lst.blocks > 0 && lst.wakeups == lst.blocks);
+        uint64_t run = 0, blocked = 0;
+        for (int i = 0; i < ls.size(); ++i) { run += ls.task(i).run_insns; blocked += ls.task(i).blocked_insns; }
+        EXPECT_TRUE(T, run == lst.insns && blocked > 0);
+
+        // an unlock hands the lock to the parked waiter: a ready task can't take it first
+        Memory hr(64*1024);
+        uint32_t at = 0;
+        auto emit = [&](uint32_t w){ put32(hr, at, w); at += 4; };
+        emit(enc_I(0x13, 8, 0, 1));                         // 0x00 A: holds the lock across a yield
+        emit(enc_JAL(0, 0x20 - 0x04));
+        emit(enc_JAL(0, 0x20 - 0x08));                      // 0x08 W: parks behind A
+        emit(enc_I(0x13, 17, 0, 7));                        // 0x0C C: yields, then wants the lock
+        emit(0x00000073);
+        emit(enc_JAL(0, 0x20 - 0x14));
+        at = 0x20;
+        emit(enc_I(0x13, 10, 0, 0x400));                    // 0x20 lock(0x400)
+        emit(enc_I(0x13, 17, 0, 9)); emit(0x00000073);
+        emit(enc_CSR(0b010, 6, 0, csr::MHARTID));           // log[n++] = hartid
+        emit(enc_LW(5, 0, 0x300));
+        emit(enc_R(0x33, 7, 5, 5, 0b000, 0));
+        emit(enc_R(0x33, 7, 7, 7, 0b000, 0));
+        emit(enc_SW(7, 6, 0x310));
+        emit(enc_I(0x13, 5, 5, 1));
+        emit(enc_SW(0, 5, 0x300));
+        emit(enc_B(0x63, 8, 0, 0b000, 12));                 // A yields holding it
+        emit(enc_I(0x13, 17, 0, 7)); emit(0x00000073);
+        emit(enc_I(0x13, 10, 0, 0x400));                    // unlock(0x400), exit
+        emit(enc_I(0x13, 17, 0, 10)); emit(0x00000073);
+        emit(enc_I(0x13, 17, 0, 0)); emit(0x00000073);
+        Scheduler hs(hr);
+        for (uint32_t pc : {0x00u, 0x08u, 0x0Cu}) hs.spawn(pc, 0);
+        auto hst = hs.run();
+        EXPECT_TRUE(T, !hst.deadlock && hr.load32(0x300) == 3);
+        EXPECT_TRUE(T, hr.load32(0x310) == 0 && hr.load32(0x314) == 1 && hr.load32(0x318) == 2);   // A, W, C
+        EXPECT_TRUE(T, hst.blocks == 2 && hst.wakeups == 2);
+
+        // aging: a prio-3 task behind two spinning prio-0 tasks runs only with aging on
+        for (uint64_t aging : {0ull, 500ull}) {
+            Memory ar(64*1024);
+            put32(ar, 0x00, enc_JAL(0, 0));                 // spin
+            put32(ar, 0x10, enc_I(0x13, 5, 5, 1));          // low: count
+            put32(ar, 0x14, enc_JAL(0, -4));
+            SchedConfig ac; ac.levels = 4; ac.aging = aging;
+            Scheduler as(ar, ac);
+            as.spawn(0, 0); as.spawn(0, 0);
+            int low = as.spawn(0x10, 3);
+            auto ast = as.run(20000);
+            EXPECT_EQ(T, as.task(low).run_insns > 0, aging != 0);
+            EXPECT_EQ(T, ast.promotions > 0, aging != 0);
+        }
+
+        // a lock that is never released: the waiter stays parked, run() reports it
+        Memory dr(64*1024);
+        put32(dr, 0x00, enc_I(0x13, 10, 0, 0x400));
+        put32(dr, 0x04, enc_I(0x13, 17, 0, 9));
+        put32(dr, 0x08, 0x00000073);                        // lock, then exit holding it
+        put32(dr, 0x0C, enc_I(0x13, 17, 0, 0));
+        put32(dr, 0x10, 0x00000073);
+        Scheduler ds(dr);
+        ds.spawn(0, 0); ds.spawn(0, 1);
+        auto dst = ds.run();
+        EXPECT_TRUE(T, dst.deadlock && ds.task(1).state == Scheduler::State::Blocked && ds.task(1).cpu.pc == 0x08);
+    }
+    // ---------- test 26: segregated-fit heap: reuse, coalescing, OOM, stats ----------
+    {
+        Memory h(64*1024);
+        uint32_t base = h.brk();
+        uint32_t a = h.malloc32(24), b = h.malloc32(24), c = h.malloc32(24);
+        EXPECT_EQ(T, a, base);
+        EXPECT_TRUE(T, b == a + 24 && c == b + 24 && a % 8 == 0);
+        EXPECT_EQ(T, h.malloc32(0), 0u);
+        EXPECT_EQ(T, h.brk(), base + GuestHeap::GROW);      // one 4K growth step
+
+        h.free32(a);
+        EXPECT_EQ(T, h.malloc32(20), a);                    // exact class reuse
+        h.free32(b); h.free32(a);                           // neighbours merge both ways
+        EXPECT_EQ(T, h.malloc32(48), a);
+        h.free32(a);
+        h.free32(a); h.free32(0x1234);                      // double / wild free: ignored
+        auto hs = h.heap_stats();
+        EXPECT_EQ(T, hs.bad_frees, 2u);
+        EXPECT_EQ(T, hs.live_blocks, 1u);                   // c
+        EXPECT_EQ(T, hs.live_bytes, 24u);
+        EXPECT_EQ(T, hs.free_chunks, 2u);                   // before and after c
+        EXPECT_EQ(T, hs.free_bytes, (uint64_t)GuestHeap::GROW - 24);
+        EXPECT_TRUE(T, hs.fragmentation() > 0 && hs.fragmentation() < 0.02);
+        EXPECT_EQ(T, hs.hist[HeapStats::bucket(24)], 4u);   // 24, 24, 24, 20; 48 is a bucket up
+
+        // growing past the top extends the free top chunk instead of leaving a hole
+        uint32_t big = h.malloc32(6000);
+        EXPECT_EQ(T, big, c + 24);
+        h.free32(c);
+        EXPECT_EQ(T, h.heap_stats().free_chunks, 2u);       // [a..big) and the tail
+        h.free32(big);
+        hs = h.heap_stats();
+        EXPECT_EQ(T, hs.free_chunks, 1u);
+        EXPECT_EQ(T, hs.largest_free, hs.free_bytes);
+        EXPECT_EQ(T, hs.fragmentation(), 0.0);
+        EXPECT_EQ(T, hs.peak_brk, h.brk());
+
+        // out of RAM: 0, the break is left alone
+        uint32_t brk = h.brk();
+        EXPECT_EQ(T, h.malloc32(1u << 20), 0u);
+        EXPECT_EQ(T, h.malloc32(0xFFFFFFFFu), 0u);
+        EXPECT_EQ(T, h.brk(), brk);
+        EXPECT_EQ(T, h.heap_stats().failed, 2u);
+
+        // many sizes, random frees: no overlaps, everything merges back
+        std::vector<std::pair<uint32_t,uint32_t>> live;
+        uint32_t seed = 7;
+        for (int i = 0; i < 2000; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            if (!live.empty() && (seed >> 16) % 3 == 0) {
+                std::size_t k = (seed >> 8) % live.size();
+                h.free32(live[k].first);
+                live[k] = live.back(); live.pop_back();
+            } else {
+                uint32_t n = 1 + (seed >> 12) % 700;
+                if (uint32_t p = h.malloc32(n)) live.push_back({p, n});
+            }
+        }
+        std::sort(live.begin(), live.end());
+        bool disjoint = true;
+        for (std::size_t i = 1; i < live.size(); ++i) disjoint &= live[i-1].first + live[i-1].second <= live[i].first;
+        EXPECT_TRUE(T, disjoint);
+        for (auto& l : live) h.free32(l.first);
+        hs = h.heap_stats();
+        EXPECT_TRUE(T, hs.live_blocks == 0 && hs.live_bytes == 0 && hs.free_chunks == 1);
+
+        // guest ECALL 5/6, and a snapshot carries the heap
+        Memory g(64*1024);
+        put32(g, 0x00, enc_I(0x13, 10, 0, 100));
+        put32(g, 0x04, enc_I(0x13, 17, 0, 5));
+        put32(g, 0x08, 0x00000073);                         // a0 = malloc(100)
+        put32(g, 0x0C, enc_I(0x13, 17, 0, 0));
+        put32(g, 0x10, 0x00000073);
+        CPU gc; gc.run(g, 100);
+        EXPECT_EQ(T, gc.x[10], g.hbase());
+        Snapshot snap(gc, g);
+        auto child = snap.fork();
+        EXPECT_EQ(T, child.mem->malloc32(8), g.hbase() + 104);
+        child.mem->free32(g.hbase());
+        EXPECT_EQ(T, child.mem->heap_stats().live_blocks, 1u);
+        EXPECT_EQ(T, g.heap_stats().live_blocks, 1u);
+    }
+    // ---------- test 27: futex wait/wake: parking, mismatch, spin-yield mode ----------
+    {
+        Memory fm(64*1024);
+        const uint32_t E = 0x00000073;
+        const uint32_t waiter[] = {
+            enc_I(0x13,10,0,0x500), enc_I(0x13,11,0,0), enc_I(0x13,17,0,11), E,   // wait(w, 0)
+            enc_I(0x13,5,10,0), enc_LW(6,0,0x500), enc_I(0x13,17,0,0), E,
+        };
+        const uint32_t waker[] = {
+            enc_I(0x13,10,0,0x500), enc_I(0x13,11,0,5), enc_I(0x13,17,0,11), E,   // wait(w, 5): mismatch
+            enc_I(0x13,5,10,0), enc_I(0x13,10,0,0x500),
+            enc_I(0x13,6,0,1), enc_SW(10,6,0),
+            enc_I(0x13,11,0,4), enc_I(0x13,17,0,12), E, enc_I(0x13,7,10,0),       // wake(w, 4) -> 1
+            enc_I(0x13,11,0,1), enc_I(0x13,17,0,12), E, enc_I(0x13,8,10,0),       // nobody left -> 0
+            enc_I(0x13,10,0,0), enc_I(0x13,17,0,0), E,
+        };
+        for (uint32_t i = 0; i < sizeof waiter / 4; ++i) put32(fm, 0x00 + 4*i, waiter[i]);
+        for (uint32_t i = 0; i < sizeof waker / 4; ++i) put32(fm, 0x40 + 4*i, waker[i]);
+        {
+            Scheduler fs(fm);
+            int w = fs.spawn(0x00, 0), k = fs.spawn(0x40, 1);
+            auto fst = fs.run();
+            EXPECT_TRUE(T, !fst.deadlock && fst.blocks == 1 && fst.wakeups == 1);
+            EXPECT_TRUE(T, fs.task(w).cpu.halted && fs.task(k).cpu.halted);
+            EXPECT_EQ(T, fs.task(w).cpu.x[5], 0u);           // woken, not a mismatch
+            EXPECT_EQ(T, fs.task(w).cpu.x[6], 1u);           // sees the waker's store
+            EXPECT_EQ(T, fs.task(k).cpu.x[5], 1u);
+            EXPECT_EQ(T, fs.task(k).cpu.x[7], 1u);
+            EXPECT_EQ(T, fs.task(k).cpu.x[8], 0u);
+            EXPECT_TRUE(T, fs.task(w).blocked_insns > 0);
+        }
+
+        // no scheduler attached: a matching wait is just a yield past the ECALL
+        fm.store32(0x500, 0);
+        CPU fc;
+        RunExit fr = fc.run(fm, 100);
+        EXPECT_TRUE(T, fr.reason == Exit::Yield && fc.pc == 0x10 && fc.waiting == CPU::Wait::None);
+
+        // park off: a contended lock is retried every slice instead of parking
+        Memory sp(64*1024);
+        put32(sp, 0x00, enc_I(0x13, 10, 0, 0x400));
+        put32(sp, 0x04, enc_I(0x13, 17, 0, 9));
+        put32(sp, 0x08, E);                                 // lock, then exit holding it
+        put32(sp, 0x0C, enc_I(0x13, 17, 0, 0));
+        put32(sp, 0x10, E);
+        SchedConfig sc; sc.park = false;
+        Scheduler ss(sp, sc);
+        ss.spawn(0, 0); int spinner = ss.spawn(0, 1);
+        auto sst = ss.run(5000);
+        EXPECT_TRUE(T, !sst.deadlock && sst.blocks == 0);
+        EXPECT_TRUE(T, ss.task(spinner).switches > 100 && ss.task(spinner).cpu.pc == 0x08);
+    }
+    // ---------- test 28: console: line/full flushing, direct spans, guest write ECALL ----------
+    {
+        auto slurp = [](std::FILE* f){
+            std::string out; char b[256]; std::size_t k;
+            std::fflush(f); std::rewind(f);
+            while ((k = std::fread(b, 1, sizeof b, f)) > 0) out.append(b, k);
+            return out;
+        };
+        std::FILE* lf = std::tmpfile();
+        {
+            Console lc(fileno(lf));
+            lc.put('a'); lc.put('b');
+            EXPECT_EQ(T, lc.stats().writes, 0u);
+            lc.put('\n');
+            EXPECT_EQ(T, lc.stats().writes, 1u);                // one write per line
+            lc.write("xy\nz", 4);
+            EXPECT_EQ(T, lc.stats().writes, 2u);                // the tail after \n goes along
+            lc.put('w');
+            lc.flush();
+            EXPECT_EQ(T, lc.stats().writes, 3u);
+            lc.flush();
+            EXPECT_EQ(T, lc.stats().writes, 3u);                // nothing pending
+            EXPECT_EQ(T, lc.stats().bytes, 8u);
+        }
+        EXPECT_TRUE(T, slurp(lf) == "ab\nxy\nzw");
+        std::fclose(lf);
+
+        std::FILE* ff = std::tmpfile();
+        {
+            Console fc(fileno(ff), 8);
+            fc.set_policy(Console::Policy::Full);
+            fc.write("12\n45", 5);
+            EXPECT_EQ(T, fc.stats().writes, 0u);                // newlines don't flush
+            fc.write("67890", 5);
+            EXPECT_EQ(T, fc.stats().writes, 1u);                // would overflow: drain first
+            fc.write("abcdefghijkl", 12);
+            EXPECT_EQ(T, fc.stats().writes, 3u);                // drain, then the span itself
+            fc.put('!');
+        }                                                        // destructor flushes
+        EXPECT_TRUE(T, slurp(ff) == "12\n4567890abcdefghijkl!");
+        std::fclose(ff);
+
+        // ECALL 4 hands the whole guest buffer over; UART bytes join it
+        std::FILE* gf = std::tmpfile();
+        Memory gm(64*1024);
+        gm.console().set_fd(fileno(gf));
+        gm.console().set_policy(Console::Policy::Full);
+        const char* msg = "hello, console\n";
+        for (uint32_t i = 0; msg[i]; ++i) gm.store8(0x700 + i, (uint8_t)msg[i]);
+        uint32_t at = 0;
+        for (uint32_t w : {enc_I(0x13,10,0,0x700), enc_I(0x13,11,0,15), enc_I(0x13,17,0,4), 0x00000073u,
+                           enc_LUI(6, 0x40000), enc_I(0x13,7,0,'!'), enc_ST(0,6,7,0),
+                           enc_I(0x13,10,0,0), enc_I(0x13,17,0,0), 0x00000073u})
+            { put32(gm, at, w); at += 4; }
+        CPU gc;
+        gc.run(gm, 100);
+        EXPECT_TRUE(T, gc.halted);
+        EXPECT_EQ(T, gm.console().stats().bytes, 16u);
+        EXPECT_EQ(T, gm.console().stats().writes, 1u);          // flushed once, at exit
+        EXPECT_TRUE(T, slurp(gf) == "hello, console\n!");
+        gm.console().set_fd(1);
+        std::fclose(gf);
+        EXPECT_TRUE(T, gm.ram_span(0x700, 16) != nullptr);
+        EXPECT_TRUE(T, gm.ram_span(TimerDevice::BASE - 8, 16) == nullptr);   // touches the timer page
+        EXPECT_TRUE(T, gm.ram_span(64*1024 - 8, 16) == nullptr);
+    }
+    // ---------- test 29: bulk-memory ECALLs: results, overlap, devices, faults, cost ----------
+    {
+        Memory bm(64*1024);
+        auto call = [&](uint32_t id, uint32_t a0, uint32_t a1, uint32_t a2, CPU& c){
+            put32(bm, 0x00, enc_I(0x13, 17, 0, (int32_t)id));
+            put32(bm, 0x04, 0x00000073);
+            put32(bm, 0x08, enc_I(0x13, 17, 0, 0));
+            put32(bm, 0x0C, 0x00000073);
+            c = CPU{}; c.x[10] = a0; c.x[11] = a1; c.x[12] = a2;
+            return c.run(bm, 2);
+        };
+        CPU c;
+        const char* text = "bulk memory ecalls";               // 18 bytes
+        bm.write_bytes(0x1000, (const uint8_t*)text, 19);
+
+        call(16, 0x1000, 0, 0, c);
+        EXPECT_EQ(T, c.x[10], 18u);                             // strlen
+        EXPECT_EQ(T, c.pc, 0x08u);
+        call(13, 0x1800, 0x1000, 19, c);
+        EXPECT_EQ(T, c.x[10], 0x1800u);                         // memcpy returns dst
+        call(15, 0x1800, 0x1000, 19, c);
+        EXPECT_EQ(T, c.x[10], 0u);
+        bm.store8(0x1805, 'X');
+        call(15, 0x1800, 0x1000, 19, c);
+        EXPECT_EQ(T, c.x[10], 0xFFFFFFFFu);                     // 'X' < 'm'
+        call(15, 0x1000, 0x1800, 19, c);
+        EXPECT_EQ(T, c.x[10], 1u);
+        call(14, 0x1800, 0x1234, 4, c);                         // memset: low byte only
+        EXPECT_EQ(T, bm.load32(0x1800), 0x34343434u);
+        EXPECT_EQ(T, bm.load8(0x1804), (uint32_t)' ');
+
+        // overlapping copy behaves like memmove, both directions
+        call(13, 0x1002, 0x1000, 8, c);
+        EXPECT_EQ(T, bm.load8(0x1002), (uint32_t)'b');
+        EXPECT_EQ(T, bm.load8(0x1009), (uint32_t)'m');
+        call(13, 0x1000, 0x1002, 8, c);
+        EXPECT_EQ(T, bm.load8(0x1000), (uint32_t)'b');
+        EXPECT_EQ(T, bm.load8(0x1007), (uint32_t)'m');
+
+        // a string running into the timer page falls back to byte loads
+        bm.fill(TimerDevice::BASE - 4, 'a', 4);                 // then RAM under the timer: 0
+        call(16, TimerDevice::BASE - 4, 0, 0, c);
+        EXPECT_EQ(T, c.x[10], 4u);
+
+        // out of RAM: a fault, pc stays on the ECALL, nothing written past the end
+        RunExit fr = call(14, 64*1024 - 8, 0, 16, c);
+        EXPECT_TRUE(T, fr.reason == Exit::Trap && c.pc == 0x04);
+
+        // cost: setup + bytes/bytes_per_cycle on top of the ECALL, only under Table
+        call(14, 0x1800, 0, 0, c);
+        uint64_t c0 = c.cycles;
+        call(14, 0x1800, 0, 64, c);
+        EXPECT_EQ(T, c.cycles - c0, 64u / c.bulk_cost.bytes_per_cycle);
+        EXPECT_EQ(T, c0, 4u + c.bulk_cost.setup);               // ADDI 1+1, ECALL 1+1
+        c = CPU{}; c.cost_model = CostModel::Flat; c.x[10] = 0x1800; c.x[12] = 4096;
+        c.run(bm, 2);
+        EXPECT_EQ(T, c.cycles, 4u);
+    }
+
+    // ---------- test 30: debugger: patched EBREAK breakpoints, write watchpoints ----------
+    for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+        Memory dm(64*1024, b);
+        put32(dm, 0x00, enc_I(0x13, 5, 0, 7));
+        put32(dm, 0x04, enc_I(0x13, 6, 0, 0x700));
+        put32(dm, 0x08, enc_SW(6, 5, 0));                      // watched
+        put32(dm, 0x0C, enc_I(0x13, 5, 5, 1));
+        put32(dm, 0x10, enc_SW(6, 5, 0x40));                   // same page, not watched
+        put32(dm, 0x14, enc_I(0x13, 7, 0, 3));                 // breakpoint
+        put32(dm, 0x18, enc_I(0x13, 17, 0, 0));
+        put32(dm, 0x1C, 0x00000073);
+        put32(dm, 0x700, 0xAAAAAAAAu);
+        const uint32_t orig = dm.load32(0x14);
+        CPU c;
+        {
+            Debugger dbg(c, dm);
+            EXPECT_TRUE(T, dbg.set_breakpoint(0x14) && !dbg.set_breakpoint(0x14) && !dbg.set_breakpoint(0x16));
+            EXPECT_EQ(T, dm.load32(0x14), Debugger::EBREAK);
+            EXPECT_EQ(T, dbg.read32(0x14), orig);
+            EXPECT_TRUE(T, dbg.watch(0x700, 4) && !dbg.watch(0x700, 4));
+
+            Debugger::Stop s = dbg.cont();
+            EXPECT_TRUE(T, s.reason == Exit::Watchpoint);
+            EXPECT_EQ(T, c.pc, 0x0Cu);                          // after the store
+            EXPECT_EQ(T, s.insns, 3u);
+            EXPECT_EQ(T, s.old_value, 0xAAAAAAAAu);
+            EXPECT_EQ(T, s.new_value, 7u);
+            EXPECT_TRUE(T, s.store.addr == 0x700 && s.store.len == 4 && s.range.addr == 0x700);
+
+            s = dbg.cont();
+            EXPECT_TRUE(T, s.reason == Exit::Breakpoint && c.pc == 0x14 && s.insns == 2);
+            EXPECT_EQ(T, dm.load32(0x740), 8u);
+            EXPECT_EQ(T, c.instret, 5u);                        // the EBREAK didn't retire
+
+            s = dbg.step();                                     // steps over the patch
+            EXPECT_TRUE(T, s.reason == Exit::Budget && c.pc == 0x18 && c.x[7] == 3u);
+            EXPECT_EQ(T, dm.load32(0x14), Debugger::EBREAK);    // and puts it back
+
+            EXPECT_TRUE(T, dbg.unwatch(0x700) && !dbg.unwatch(0x700));
+            s = dbg.cont();
+            EXPECT_TRUE(T, s.reason == Exit::Halt && c.halted);
+        }
+        EXPECT_EQ(T, dm.load32(0x14), orig);                    // restored on detach
+        EXPECT_TRUE(T, c.debugger == nullptr && dm.watchpoints().empty());
+
+        // a real EBREAK still halts; an unwatched page stays on the fast path
+        Memory em(64*1024, b);
+        put32(em, 0x00, enc_I(0x13, 6, 0, 0x700));
+        put32(em, 0x04, enc_SW(6, 6, 0));
+        put32(em, 0x08, 0x00100073);
+        put32(em, 0x0C, 0x00000073);
+        {
+            CPU e;
+            Debugger edbg(e, em);
+            edbg.watch(0x2000, 8);
+            Debugger::Stop es = edbg.cont();
+            EXPECT_TRUE(T, es.reason == Exit::Halt && e.halted && em.load32(0x700) == 0x700u);
+        }
+
+        // a bulk ECALL write that only overlaps the range stops as well
+        CPU f; f.pc = 0x0C; f.x[10] = 0x1FF0; f.x[11] = 0x55; f.x[12] = 0x20; f.x[17] = 14;   // memset
+        Debugger fdbg(f, em);
+        fdbg.watch(0x2000, 8);
+        Debugger::Stop fs = fdbg.cont(1);
+        EXPECT_TRUE(T, fs.reason == Exit::Watchpoint && f.pc == 0x10);
+        EXPECT_TRUE(T, fs.store.addr == 0x1FF0 && fs.store.len == 0x20 && fs.range.addr == 0x2000);
+        EXPECT_EQ(T, fs.old_value, 0u);
+        EXPECT_EQ(T, fs.new_value, 0x55555555u);
+    }
+
+    // a watch set straight on Memory stops translated code too, before the store
+    if (Jit::available()) {
+        Memory jm(64*1024);
+        put32(jm, 0x00, enc_I(0x13, 5, 0, 0x400));
+        put32(jm, 0x04, enc_I(0x13, 6, 0, 0));
+        put32(jm, 0x08, enc_SW(5, 6, 0));                      // loop: [0x400] = x6
+        put32(jm, 0x0C, enc_I(0x13, 6, 6, 1));
+        put32(jm, 0x10, enc_JAL(0, 0x08 - 0x10));
+        Jit jit(jm);
+        CPU j; j.jit = &jit;
+        EXPECT_EQ(T, j.run(jm, 1000).reason, Exit::Budget);
+        EXPECT_TRUE(T, jit.stats().jit_insns > 0);
+        jm.watch(0x400, 4);
+        RunExit r = j.run(jm, 1000);
+        EXPECT_EQ(T, r.reason, Exit::Watchpoint);
+        EXPECT_EQ(T, j.pc, 0x08u);
+        EXPECT_EQ(T, jm.load32(0x400), j.x[6] - 1);
+        EXPECT_TRUE(T, jm.watch_hit().addr == 0x400 && jm.watch_hit().len == 4);
+    }
+
+    // ---------- test 31: record/replay: reverse-step, reverse-continue, logged inputs ----------
+    for (MemBackend b : {MemBackend::Vector, MemBackend::Fastmem}) {
+        struct Sensor : Device {                        // a different value on every read
+            uint32_t n = 0;
+            bool read32(uint32_t off, uint32_t& v) override { if (off) return false; v = ++n * 7; return true; }
+        } sensor;
+        Memory rm(64*1024, b);
+        rm.attach(0x5000, Bus::PAGE, &sensor);
+        std::FILE* rf = std::tmpfile();
+        rm.console().set_fd(fileno(rf));
+        uint32_t at = 0;
+        for (uint32_t w : {enc_I(0x13,5,0,0), enc_I(0x13,6,0,0x600), enc_LUI(8, 5),
+                           enc_LW(9,8,0),                                      // 0x0C: sensor
+                           enc_SW(6,9,0),                                      // 0x10
+                           enc_I(0x13,5,5,1), enc_I(0x13,6,6,0x100), enc_I(0x13,7,0,40),
+                           enc_B(0x63,5,7,1,-20),                              // bne back to 0x0C
+                           enc_I(0x13,10,0,'x'), enc_I(0x13,17,0,2), 0x00000073u,
+                           enc_I(0x13,10,0,0), enc_I(0x13,17,0,0), 0x00000073u})
+            { put32(rm, at, w); at += 4; }
+        auto sum = [&]{ uint32_t h = 0; for (uint32_t a = 0; a < 0x3000; a += 4) h = h * 31 + rm.load32(a); return h; };
+
+        CPU c;
+        Debugger dbg(c, rm);
+        dbg.record(16);
+        struct Seen { uint32_t pc, x5, x9, mem; };
+        std::vector<Seen> seen;
+        bool flushed = true;                            // 'x' has no newline: the stop writes it out
+        while (!c.halted) {
+            seen.push_back({c.pc, c.x[5], c.x[9], sum()});
+            dbg.step();
+            flushed = flushed && rm.console().stats().writes == rm.console().stats().bytes;
+        }
+        EXPECT_TRUE(T, flushed);
+        const uint64_t end = c.instret;
+        EXPECT_EQ(T, end, 3u + 6*40 + 6);
+        EXPECT_EQ(T, rm.console().stats().bytes, 1u);
+        EXPECT_EQ(T, rm.load32(0x600 + 39*0x100), 40u * 7);
+        EXPECT_TRUE(T, dbg.recorder()->stats().checkpoints == end / 16 + 1 && dbg.recorder()->stats().inputs == 40);
+
+        bool same = true;
+        for (uint64_t t : {end - 1, end - 17, (uint64_t)100, (uint64_t)17, (uint64_t)16, (uint64_t)1, (uint64_t)0}) {
+            dbg.reverse_step(c.instret - t);
+            same = same && c.instret == t && c.pc == seen[t].pc && c.x[5] == seen[t].x5
+                        && c.x[9] == seen[t].x9 && sum() == seen[t].mem && !c.halted;
+        }
+        EXPECT_TRUE(T, same);
+        Debugger::Stop st = dbg.reverse_step(5);        // already at the start
+        EXPECT_TRUE(T, st.reason == Exit::Budget && c.instret == 0 && c.pc == 0);
+
+        // forward again: the logged sensor values, not new ones, and no output twice
+        uint32_t reads = sensor.n;
+        st = dbg.cont();
+        EXPECT_TRUE(T, st.reason == Exit::Halt && c.instret == end && sum() == seen.back().mem);
+        EXPECT_EQ(T, rm.load32(0x600 + 39*0x100), 40u * 7);
+        EXPECT_EQ(T, sensor.n, reads + 40);             // the device was read, the log was used
+        EXPECT_EQ(T, rm.console().stats().bytes, 1u);
+
+        // reverse-continue stops at each earlier breakpoint hit, then at the start
+        dbg.set_breakpoint(0x14);
+        st = dbg.reverse_cont();
+        EXPECT_TRUE(T, st.reason == Exit::Breakpoint && c.pc == 0x14 && c.x[5] == 39);
+        st = dbg.reverse_cont();
+        EXPECT_TRUE(T, st.reason == Exit::Breakpoint && c.pc == 0x14 && c.x[5] == 38);
+        st = dbg.cont();
+        EXPECT_TRUE(T, st.reason == Exit::Breakpoint && c.pc == 0x14 && c.x[5] == 39);
+        EXPECT_EQ(T, dbg.read32(0x14), enc_I(0x13,5,5,1));
+        dbg.clear_breakpoint(0x14);
+
+        // and at the last watchpoint hit, with the values of that store
+        dbg.watch(0x600 + 10*0x100);
+        st = dbg.reverse_cont();
+        EXPECT_TRUE(T, st.reason == Exit::Watchpoint && c.pc == 0x14 && c.x[5] == 10);
+        EXPECT_EQ(T, st.new_value, 11u * 7);
+        EXPECT_EQ(T, rm.load32(0x14), enc_I(0x13,5,5,1));   // the cleared patch stays cleared
+        st = dbg.reverse_cont();
+        EXPECT_TRUE(T, st.reason == Exit::Budget && c.instret == 0);
+        rm.console().set_fd(1);
+        std::fclose(rf);
+    }
     return T.summary();
 }